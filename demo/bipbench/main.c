@@ -0,0 +1,415 @@
+/*************************************************************************
+* Copyright (C) 2014 Steve Karg <skarg@users.sourceforge.net>
+*
+* Permission is hereby granted, free of charge, to any person obtaining
+* a copy of this software and associated documentation files (the
+* "Software"), to deal in the Software without restriction, including
+* without limitation the rights to use, copy, modify, merge, publish,
+* distribute, sublicense, and/or sell copies of the Software, and to
+* permit persons to whom the Software is furnished to do so, subject to
+* the following conditions:
+*
+* The above copyright notice and this permission notice shall be included
+* in all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+* IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+* CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+* TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+* SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*
+*********************************************************************/
+
+/* command line tool that loads a BACnet/IP device with ReadProperty
+   requests, and a burst of Who-Is messages before each one.  The
+   replies per second, the latency and the lost requests are printed
+   at the end, and on the local host the packets the kernel dropped
+   from the socket of the device. */
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include "config.h"
+#include "bacdef.h"
+#include "bacenum.h"
+#include "bacint.h"
+#include "npdu.h"
+#include "bip.h"
+#include "rp.h"
+#include "whois.h"
+#include "filename.h"
+
+/* invoke IDs of the requests in flight */
+#define INVOKE_ID_MODULO 256
+
+static unsigned Count = 10000;
+static unsigned Window = 32;
+static unsigned Burst = 4;
+static unsigned Timeout = 1000;
+static uint32_t Device_Instance = BACNET_MAX_INSTANCE;
+static uint16_t Local_Port = 47809;
+static struct sockaddr_in Target;
+
+/* nanoseconds on the monotonic clock */
+static uint64_t now_ns(
+    void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint64_t) ts.tv_sec * 1000000000ULL + (uint64_t) ts.tv_nsec;
+}
+
+static int compare_latency(
+    const void *a,
+    const void *b)
+{
+    uint32_t la = *(const uint32_t *) a;
+    uint32_t lb = *(const uint32_t *) b;
+
+    return (la > lb) - (la < lb);
+}
+
+/* the packets the kernel dropped from the UDP sockets on the port of
+   the target, if it is on this host, or -1 */
+static long socket_drops(
+    void)
+{
+    FILE *file;
+    char line[256];
+    unsigned port = 0;
+    unsigned long drops = 0;
+    long total = -1;
+
+    file = fopen("/proc/net/udp", "r");
+    if (!file) {
+        return -1;
+    }
+    while (fgets(line, sizeof(line), file)) {
+        /* sl local_address rem_address ... drops */
+        if ((sscanf(line, " %*u: %*x:%x %*x:%*x %*x %*x:%*x %*x:%*x %*x "
+                    "%*u %*u %*u %*u %*x %lu", &port, &drops) == 2) &&
+            (port == ntohs(Target.sin_port))) {
+            if (total < 0) {
+                total = 0;
+            }
+            total += (long) drops;
+        }
+    }
+    fclose(file);
+
+    return total;
+}
+
+/* BVLC, NPDU and APDU */
+static int encode_bvlc(
+    uint8_t * buffer,
+    bool expecting_reply,
+    uint8_t * apdu,
+    int apdu_len)
+{
+    BACNET_NPDU_DATA npdu_data;
+    int len = 4;
+
+    npdu_encode_npdu_data(&npdu_data, expecting_reply,
+        MESSAGE_PRIORITY_NORMAL);
+    len += npdu_encode_pdu(&buffer[len], NULL, NULL, &npdu_data);
+    memcpy(&buffer[len], apdu, apdu_len);
+    len += apdu_len;
+    buffer[0] = BVLL_TYPE_BACNET_IP;
+    buffer[1] = BVLC_ORIGINAL_UNICAST_NPDU;
+    encode_unsigned16(&buffer[2], (uint16_t) len);
+
+    return len;
+}
+
+static int encode_read_property(
+    uint8_t * buffer,
+    uint8_t invoke_id)
+{
+    BACNET_READ_PROPERTY_DATA rpdata;
+    uint8_t apdu[MAX_APDU];
+    int apdu_len;
+
+    rpdata.object_type = OBJECT_DEVICE;
+    rpdata.object_instance = Device_Instance;
+    rpdata.object_property = PROP_OBJECT_NAME;
+    rpdata.array_index = BACNET_ARRAY_ALL;
+    apdu_len = rp_encode_apdu(apdu, invoke_id, &rpdata);
+
+    return encode_bvlc(buffer, true, apdu, apdu_len);
+}
+
+static int encode_whois(
+    uint8_t * buffer)
+{
+    uint8_t apdu[MAX_APDU];
+    int apdu_len;
+
+    apdu_len = whois_encode_apdu(apdu, -1, -1);
+
+    return encode_bvlc(buffer, false, apdu, apdu_len);
+}
+
+/* returns the invoke ID of a reply to a ReadProperty, or -1.
+   error is set if it is not a ComplexACK. */
+static int decode_reply(
+    uint8_t * buffer,
+    int len,
+    bool * error)
+{
+    BACNET_ADDRESS dest;
+    BACNET_ADDRESS src;
+    BACNET_NPDU_DATA npdu_data;
+    int offset;
+
+    if ((len < 4) || (buffer[0] != BVLL_TYPE_BACNET_IP)) {
+        return -1;
+    }
+    if (buffer[1] == BVLC_ORIGINAL_UNICAST_NPDU) {
+        offset = 4;
+    } else if (buffer[1] == BVLC_FORWARDED_NPDU) {
+        offset = 10;
+    } else {
+        return -1;
+    }
+    if (len <= offset) {
+        return -1;
+    }
+    offset += npdu_decode(&buffer[offset], &dest, &src, &npdu_data);
+    if ((offset + 3 > len) || npdu_data.network_layer_message) {
+        return -1;
+    }
+    switch (buffer[offset] & 0xF0) {
+        case PDU_TYPE_COMPLEX_ACK:
+            if (buffer[offset + 2] != SERVICE_CONFIRMED_READ_PROPERTY) {
+                return -1;
+            }
+            *error = false;
+            break;
+        case PDU_TYPE_ERROR:
+        case PDU_TYPE_REJECT:
+        case PDU_TYPE_ABORT:
+            *error = true;
+            break;
+        default:
+            return -1;
+    }
+
+    return buffer[offset + 1];
+}
+
+static void print_usage(
+    char *filename)
+{
+    printf("Usage: %s [-c count] [-w window] [-b burst] [-d device]"
+        " [-p port] device-address [device-port]\n", filename);
+}
+
+static void print_help(
+    char *filename)
+{
+    print_usage(filename);
+    printf("Measure the ReadProperty rate and latency of a BACnet/IP\n"
+        "device that is flooded with Who-Is messages.\n"
+        "-c count: number of ReadProperty requests to send (10000)\n"
+        "-w window: requests in flight at a time, up to 255 (32)\n"
+        "-b burst: Who-Is messages sent before each request (4)\n"
+        "-d device: device instance to read the name of (4194303)\n"
+        "-p port: local UDP port (47809)\n"
+        "device-port: UDP port of the device (47808)\n"
+        "Example:\n" "%s -c 100000 -b 16 127.0.0.1\n", filename);
+}
+
+static bool parse_command_line(
+    int argc,
+    char *argv[])
+{
+    char *filename = filename_remove_path(argv[0]);
+    int argi;
+    int target = 0;
+
+    Target.sin_family = AF_INET;
+    Target.sin_port = htons(0xBAC0);
+    for (argi = 1; argi < argc; argi++) {
+        if (strcmp(argv[argi], "--help") == 0) {
+            print_help(filename);
+            exit(0);
+        } else if ((strcmp(argv[argi], "-c") == 0) && (argi + 1 < argc)) {
+            Count = strtoul(argv[++argi], NULL, 0);
+        } else if ((strcmp(argv[argi], "-w") == 0) && (argi + 1 < argc)) {
+            Window = strtoul(argv[++argi], NULL, 0);
+        } else if ((strcmp(argv[argi], "-b") == 0) && (argi + 1 < argc)) {
+            Burst = strtoul(argv[++argi], NULL, 0);
+        } else if ((strcmp(argv[argi], "-d") == 0) && (argi + 1 < argc)) {
+            Device_Instance = strtoul(argv[++argi], NULL, 0);
+        } else if ((strcmp(argv[argi], "-p") == 0) && (argi + 1 < argc)) {
+            Local_Port = (uint16_t) strtoul(argv[++argi], NULL, 0);
+        } else if (target == 0) {
+            if (inet_aton(argv[argi], &Target.sin_addr) == 0) {
+                fprintf(stderr, "invalid device address %s\n", argv[argi]);
+                return false;
+            }
+            target++;
+        } else if (target == 1) {
+            Target.sin_port =
+                htons((uint16_t) strtoul(argv[argi], NULL, 0));
+            target++;
+        } else {
+            print_usage(filename);
+            return false;
+        }
+    }
+    if ((target == 0) || (Count == 0) || (Window == 0) ||
+        (Window >= INVOKE_ID_MODULO) ||
+        (Device_Instance > BACNET_MAX_INSTANCE)) {
+        print_usage(filename);
+        return false;
+    }
+
+    return true;
+}
+
+int main(
+    int argc,
+    char *argv[])
+{
+    struct sockaddr_in sin = { 0 };
+    struct pollfd fds;
+    uint8_t buffer[MAX_MPDU];
+    uint8_t whois[MAX_MPDU];
+    uint64_t *sent_time;
+    uint32_t *latency;
+    bool *done;
+    unsigned next = 0;
+    unsigned oldest = 0;
+    unsigned in_flight = 0;
+    unsigned received = 0;
+    unsigned errors = 0;
+    unsigned lost = 0;
+    unsigned whois_sent = 0;
+    unsigned sequence;
+    unsigned i;
+    uint64_t start, now, elapsed;
+    long drops_start, drops_end;
+    bool error = false;
+    int invoke_id;
+    int fd, len, whois_len, rc;
+
+    if (!parse_command_line(argc, argv)) {
+        return 1;
+    }
+    fd = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    if (fd < 0) {
+        perror("socket");
+        return 1;
+    }
+    sin.sin_family = AF_INET;
+    sin.sin_addr.s_addr = htonl(INADDR_ANY);
+    sin.sin_port = htons(Local_Port);
+    if (bind(fd, (struct sockaddr *) &sin, sizeof(sin)) < 0) {
+        perror("bind");
+        return 1;
+    }
+    sent_time = calloc(Count, sizeof(uint64_t));
+    latency = calloc(Count, sizeof(uint32_t));
+    done = calloc(Count, sizeof(bool));
+    if (!sent_time || !latency || !done) {
+        fprintf(stderr, "out of memory\n");
+        return 1;
+    }
+    whois_len = encode_whois(whois);
+
+    drops_start = socket_drops();
+    start = now_ns();
+    while (oldest < Count) {
+        while ((next < Count) && (in_flight < Window)) {
+            for (i = 0; i < Burst; i++) {
+                if (sendto(fd, whois, whois_len, 0,
+                        (struct sockaddr *) &Target, sizeof(Target)) > 0) {
+                    whois_sent++;
+                }
+            }
+            len = encode_read_property(buffer, next % INVOKE_ID_MODULO);
+            sent_time[next] = now_ns();
+            if (sendto(fd, buffer, len, 0, (struct sockaddr *) &Target,
+                    sizeof(Target)) < 0) {
+                perror("sendto");
+                return 1;
+            }
+            next++;
+            in_flight++;
+        }
+        fds.fd = fd;
+        fds.events = POLLIN;
+        rc = poll(&fds, 1, 10);
+        if ((rc < 0) && (errno != EINTR)) {
+            perror("poll");
+            return 1;
+        }
+        while ((len = recv(fd, buffer, sizeof(buffer), MSG_DONTWAIT)) > 0) {
+            now = now_ns();
+            invoke_id = decode_reply(buffer, len, &error);
+            if (invoke_id < 0) {
+                continue;
+            }
+            /* the one in flight with this invoke ID */
+            sequence = oldest + ((invoke_id - oldest) % INVOKE_ID_MODULO);
+            if ((sequence >= next) || done[sequence]) {
+                continue;
+            }
+            done[sequence] = true;
+            if (error) {
+                errors++;
+            }
+            latency[received++] =
+                (uint32_t) ((now - sent_time[sequence]) / 1000);
+            in_flight--;
+        }
+        /* the ones that were not answered in time are lost */
+        now = now_ns();
+        while ((oldest < next) && (done[oldest] ||
+                ((now - sent_time[oldest]) / 1000000 >= Timeout))) {
+            if (!done[oldest]) {
+                done[oldest] = true;
+                lost++;
+                in_flight--;
+            }
+            oldest++;
+        }
+    }
+    elapsed = now_ns() - start;
+    drops_end = socket_drops();
+
+    printf("sent %u requests and %u Who-Is, received %u (%u errors),"
+        " lost %u in %.3f s\n", Count, whois_sent, received, errors, lost,
+        (double) elapsed / 1e9);
+    printf("%.0f replies/s, %.0f packets/s sent\n",
+        (double) received * 1e9 / (double) elapsed,
+        (double) (Count + whois_sent) * 1e9 / (double) elapsed);
+    if (received) {
+        qsort(latency, received, sizeof(uint32_t), compare_latency);
+        printf("latency us: min %u median %u p99 %u max %u\n", latency[0],
+            latency[received / 2], latency[(received * 99) / 100],
+            latency[received - 1]);
+    }
+    if ((drops_start >= 0) && (drops_end >= 0)) {
+        printf("dropped by the device socket: %ld\n",
+            drops_end - drops_start);
+    }
+    close(fd);
+
+    return 0;
+}
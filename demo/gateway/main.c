@@ -59,6 +59,9 @@
 #ifdef BACNET_TEST_VMAC
 #include "vmac.h"
 #endif
+#if defined(BAC_UCI)
+#include "ucix.h"
+#endif
 
 /** @file gateway/main.c  Example virtual gateway application using the BACnet Stack. */
 
@@ -243,6 +246,26 @@ static void Initialize_Device_Addresses(
     }
 }
 
+/* set by a signal, to return from main() and run the exit handlers */
+static volatile sig_atomic_t Stop;
+
+static void sig_int(
+    int signo)
+{
+    (void) signo;
+    /* the exit handlers flush the pending config changes, but they
+       are not safe to run in a signal handler */
+    Stop = 1;
+}
+
+static void signal_init(
+    void)
+{
+    signal(SIGINT, sig_int);
+    signal(SIGHUP, sig_int);
+    signal(SIGTERM, sig_int);
+}
+
 /** Main function of server demo.
  *
  * @see Device_Set_Object_Instance_Number, dlenv_init, Send_I_Am,
@@ -292,6 +315,10 @@ int main(
     Init_Service_Handlers(first_object_instance);
     dlenv_init();
     atexit(datalink_cleanup);
+#if defined(BAC_UCI)
+    atexit(ucix_wb_flush);
+#endif
+    signal_init();
     Devices_Init(first_object_instance);
     Initialize_Device_Addresses();
 
@@ -307,8 +334,8 @@ int main(
     printf("Remote Network DNET Number %d \n", DNET_list[0]);
     Send_I_Am_Router_To_Network(DNET_list);
 
-    /* loop forever */
-    for (;;) {
+    /* loop until stopped */
+    while (!Stop) {
         /* input */
         current_seconds = time(NULL);
 
@@ -335,11 +362,14 @@ int main(
             tsm_timer_milliseconds(elapsed_milliseconds);
         }
         handler_cov_task();
+#if defined(BAC_UCI)
+        ucix_wb_task();
+#endif
         /* output */
 
         /* blink LEDs, Turn on or off outputs, etc */
     }
-    /* Dummy return */
+
     return 0;
 }
 
@@ -0,0 +1,488 @@
+/**
+* @file
+*
+* @section LICENSE
+*
+* This program is free software; you can redistribute it and/or
+* modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation; either version 2
+* of the License, or (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program; if not, write to:
+* The Free Software Foundation, Inc.
+* 59 Temple Place - Suite 330
+* Boston, MA  02111-1307, USA.
+*
+* @section DESCRIPTION
+*
+* Asynchronous confirmed requests.  The requests use the invoke IDs
+* of their destination in the TSM, and wait in a table found by
+* invoke ID and address for their reply, which is given to the
+* callback of the request.  A TSM timeout is given to it too.
+*/
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include "config.h"
+#include "bacdef.h"
+#include "bacaddr.h"
+#include "npdu.h"
+#include "apdu.h"
+#include "tsm.h"
+#include "dcc.h"
+#include "datalink.h"
+#include "handlers.h"
+#include "txbuf.h"
+#include "async.h"
+
+#if (MAX_TSM_TRANSACTIONS)
+typedef struct async_request {
+    /* 0 if unused */
+    uint8_t invoke_id;
+    BACNET_CONFIRMED_SERVICE service_choice;
+    BACNET_ADDRESS dest;
+    async_callback callback;
+    void *context;
+    /* next request with the same invoke ID: index + 1, or 0 */
+    uint16_t next;
+} ASYNC_REQUEST;
+
+static ASYNC_REQUEST Async_Requests[MAX_ASYNC_REQUESTS];
+/* first request of each invoke ID: index + 1, or 0 */
+static uint16_t Async_Invoke_Head[256];
+static uint16_t Async_Free_Stack[MAX_ASYNC_REQUESTS];
+static unsigned Async_Free_Count;
+static unsigned Async_Used;
+
+static uint8_t Async_Rx_Buf[MAX_MPDU];
+static uint32_t Async_Last_Milliseconds;
+static bool Async_Timer_Started;
+
+static uint32_t async_milliseconds(
+    void)
+{
+#if defined(CLOCK_MONOTONIC)
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (uint32_t) now.tv_sec * 1000 + (uint32_t) (now.tv_nsec / 1000000);
+#else
+    return (uint32_t) time(NULL) * 1000;
+#endif
+}
+
+/* returns MAX_ASYNC_REQUESTS if not found */
+static unsigned async_find(
+    BACNET_ADDRESS * address,
+    uint8_t invoke_id)
+{
+    uint16_t next = Async_Invoke_Head[invoke_id];
+
+    while (next) {
+        if (bacnet_address_same(&Async_Requests[next - 1].dest, address)) {
+            return next - 1;
+        }
+        next = Async_Requests[next - 1].next;
+    }
+
+    return MAX_ASYNC_REQUESTS;
+}
+
+static void async_free(
+    unsigned index)
+{
+    ASYNC_REQUEST *request = &Async_Requests[index];
+    uint16_t *link = &Async_Invoke_Head[request->invoke_id];
+
+    while (*link) {
+        if (*link == index + 1) {
+            *link = request->next;
+            break;
+        }
+        link = &Async_Requests[*link - 1].next;
+    }
+    request->invoke_id = 0;
+    request->next = 0;
+    Async_Free_Stack[Async_Free_Count] = (uint16_t) index;
+    Async_Free_Count++;
+}
+
+/* ends the request with its reply, and gives it to the callback */
+static void async_complete(
+    BACNET_ADDRESS * src,
+    uint8_t invoke_id,
+    BACNET_ASYNC_RESULT * result)
+{
+    BACNET_ADDRESS address;
+    async_callback callback;
+    void *context;
+    unsigned index;
+
+    index = async_find(src, invoke_id);
+    if (index >= MAX_ASYNC_REQUESTS) {
+        return;
+    }
+    bacnet_address_copy(&address, &Async_Requests[index].dest);
+    callback = Async_Requests[index].callback;
+    context = Async_Requests[index].context;
+    result->service_choice = Async_Requests[index].service_choice;
+    result->address = &address;
+    result->invoke_id = invoke_id;
+    /* free it first, so the callback may send the next request */
+    async_free(index);
+    /* apdu_handler() frees the invoke ID of a reply after this returns,
+       so a request sent by the callback cannot be given the same one.
+       A timeout leaves it to us. */
+    if (result->status == ASYNC_TIMEOUT) {
+        tsm_free_invoke_id_peer(&address, invoke_id);
+    }
+    if (callback) {
+        callback(result, context);
+    }
+}
+
+static void async_ack_handler(
+    uint8_t * service_request,
+    uint16_t service_len,
+    BACNET_ADDRESS * src,
+    BACNET_CONFIRMED_SERVICE_ACK_DATA * service_data)
+{
+    BACNET_ASYNC_RESULT result = { 0 };
+
+    result.status = ASYNC_COMPLEX_ACK;
+    result.service_data = service_request;
+    result.service_data_len = service_len;
+    result.ack_data = service_data;
+    async_complete(src, service_data->invoke_id, &result);
+}
+
+static void async_simple_ack_handler(
+    BACNET_ADDRESS * src,
+    uint8_t invoke_id)
+{
+    BACNET_ASYNC_RESULT result = { 0 };
+
+    result.status = ASYNC_SIMPLE_ACK;
+    async_complete(src, invoke_id, &result);
+}
+
+static void async_error_handler(
+    BACNET_ADDRESS * src,
+    uint8_t invoke_id,
+    BACNET_ERROR_CLASS error_class,
+    BACNET_ERROR_CODE error_code)
+{
+    BACNET_ASYNC_RESULT result = { 0 };
+
+    result.status = ASYNC_ERROR;
+    result.error_class = error_class;
+    result.error_code = error_code;
+    async_complete(src, invoke_id, &result);
+}
+
+static void async_abort_handler(
+    BACNET_ADDRESS * src,
+    uint8_t invoke_id,
+    uint8_t abort_reason,
+    bool server)
+{
+    BACNET_ASYNC_RESULT result = { 0 };
+
+    /* a client aborts one of our responses, not our request */
+    if (!server) {
+        return;
+    }
+    result.status = ASYNC_ABORT;
+    result.reason = abort_reason;
+    async_complete(src, invoke_id, &result);
+}
+
+static void async_reject_handler(
+    BACNET_ADDRESS * src,
+    uint8_t invoke_id,
+    uint8_t reject_reason)
+{
+    BACNET_ASYNC_RESULT result = { 0 };
+
+    result.status = ASYNC_REJECT;
+    result.reason = reject_reason;
+    async_complete(src, invoke_id, &result);
+}
+
+static void async_timeout_handler(
+    BACNET_ADDRESS * dest,
+    uint8_t invoke_id)
+{
+    BACNET_ASYNC_RESULT result = { 0 };
+
+    result.status = ASYNC_TIMEOUT;
+    async_complete(dest, invoke_id, &result);
+}
+
+/** Set the ACK, Error, Abort and Reject handlers of all the services,
+ * and the TSM timeout handler, to the ones of the requests.
+ * A reply to a request that is not one of ours is dropped.
+ */
+void async_init(
+    void)
+{
+    unsigned i = 0;
+
+    for (i = 0; i < MAX_BACNET_CONFIRMED_SERVICE; i++) {
+        /* these only take the services with that kind of ACK */
+        apdu_set_confirmed_ack_handler((BACNET_CONFIRMED_SERVICE) i,
+            async_ack_handler);
+        apdu_set_confirmed_simple_ack_handler((BACNET_CONFIRMED_SERVICE) i,
+            async_simple_ack_handler);
+        apdu_set_error_handler((BACNET_CONFIRMED_SERVICE) i,
+            async_error_handler);
+    }
+    apdu_set_abort_handler(async_abort_handler);
+    apdu_set_reject_handler(async_reject_handler);
+    tsm_set_peer_timeout_handler(async_timeout_handler);
+}
+
+static int async_encode_apdu(
+    uint8_t * apdu,
+    unsigned max_apdu,
+    uint8_t invoke_id,
+    BACNET_CONFIRMED_SERVICE service_choice,
+    void *data)
+{
+    int len = 0;
+
+    switch (service_choice) {
+        case SERVICE_CONFIRMED_READ_PROPERTY:
+            len =
+                rp_encode_apdu(apdu, invoke_id,
+                (BACNET_READ_PROPERTY_DATA *) data);
+            break;
+        case SERVICE_CONFIRMED_READ_PROP_MULTIPLE:
+            len =
+                rpm_encode_apdu(apdu, max_apdu, invoke_id,
+                (BACNET_READ_ACCESS_DATA *) data);
+            break;
+        case SERVICE_CONFIRMED_WRITE_PROPERTY:
+            len =
+                wp_encode_apdu(apdu, invoke_id,
+                (BACNET_WRITE_PROPERTY_DATA *) data);
+            break;
+        default:
+            break;
+    }
+
+    return len;
+}
+
+static uint8_t async_send(
+    BACNET_ADDRESS * dest,
+    uint16_t max_apdu,
+    BACNET_CONFIRMED_SERVICE service_choice,
+    void *data,
+    async_callback callback,
+    void *context)
+{
+    BACNET_ADDRESS my_address;
+    BACNET_NPDU_DATA npdu_data;
+    ASYNC_REQUEST *request;
+    unsigned index = 0;
+    uint8_t invoke_id = 0;
+    int len = 0;
+    int pdu_len = 0;
+    int bytes_sent = 0;
+
+    if (!dcc_communication_enabled() || !dest) {
+        return 0;
+    }
+    if (!Async_Free_Count && (Async_Used >= MAX_ASYNC_REQUESTS)) {
+        return 0;
+    }
+    invoke_id = tsm_next_free_invokeID_peer(dest);
+    if (!invoke_id) {
+        return 0;
+    }
+    datalink_get_my_address(&my_address);
+    npdu_encode_npdu_data(&npdu_data, true, MESSAGE_PRIORITY_NORMAL);
+    pdu_len =
+        npdu_encode_pdu(&Handler_Transmit_Buffer[0], dest, &my_address,
+        &npdu_data);
+    len =
+        async_encode_apdu(&Handler_Transmit_Buffer[pdu_len],
+        sizeof(Handler_Transmit_Buffer) - pdu_len, invoke_id, service_choice,
+        data);
+    pdu_len += len;
+    /* will it fit in the sender? */
+    if ((len <= 0) || ((unsigned) pdu_len >= max_apdu)) {
+        tsm_free_invoke_id_peer(dest, invoke_id);
+#if PRINT_ENABLED
+        fprintf(stderr, "Failed to Send Request "
+            "(exceeds destination maximum APDU)!\n");
+#endif
+        return 0;
+    }
+    if (Async_Free_Count) {
+        Async_Free_Count--;
+        index = Async_Free_Stack[Async_Free_Count];
+    } else {
+        index = Async_Used;
+        Async_Used++;
+    }
+    request = &Async_Requests[index];
+    request->invoke_id = invoke_id;
+    request->service_choice = service_choice;
+    bacnet_address_copy(&request->dest, dest);
+    request->callback = callback;
+    request->context = context;
+    request->next = Async_Invoke_Head[invoke_id];
+    Async_Invoke_Head[invoke_id] = (uint16_t) (index + 1);
+    tsm_set_confirmed_unsegmented_transaction(invoke_id, dest, &npdu_data,
+        &Handler_Transmit_Buffer[0], (uint16_t) pdu_len);
+    bytes_sent =
+        datalink_send_pdu(dest, &npdu_data, &Handler_Transmit_Buffer[0],
+        pdu_len);
+    if (bytes_sent <= 0) {
+        /* the TSM sends it again, or times out */
+#if PRINT_ENABLED
+        fprintf(stderr, "Failed to Send Request (%s)!\n", strerror(errno));
+#endif
+    }
+
+    return invoke_id;
+}
+
+/** Send a ReadProperty request.
+ * @param dest [in] the address of the device
+ * @param max_apdu [in] the max APDU accepted by the device
+ * @param rpdata [in] the property to read
+ * @param callback [in] called with the reply, or the timeout
+ * @param context [in] given to the callback
+ * @return the invoke ID, or 0 if no request could be sent
+ */
+uint8_t async_read_property(
+    BACNET_ADDRESS * dest,
+    uint16_t max_apdu,
+    BACNET_READ_PROPERTY_DATA * rpdata,
+    async_callback callback,
+    void *context)
+{
+    return async_send(dest, max_apdu, SERVICE_CONFIRMED_READ_PROPERTY,
+        rpdata, callback, context);
+}
+
+/** Send a ReadPropertyMultiple request.
+ * @param dest [in] the address of the device
+ * @param max_apdu [in] the max APDU accepted by the device
+ * @param read_access_data [in] the list of objects and properties to read
+ * @param callback [in] called with the reply, or the timeout
+ * @param context [in] given to the callback
+ * @return the invoke ID, or 0 if no request could be sent
+ */
+uint8_t async_read_property_multiple(
+    BACNET_ADDRESS * dest,
+    uint16_t max_apdu,
+    BACNET_READ_ACCESS_DATA * read_access_data,
+    async_callback callback,
+    void *context)
+{
+    return async_send(dest, max_apdu, SERVICE_CONFIRMED_READ_PROP_MULTIPLE,
+        read_access_data, callback, context);
+}
+
+/** Send a WriteProperty request.
+ * @param dest [in] the address of the device
+ * @param max_apdu [in] the max APDU accepted by the device
+ * @param wpdata [in] the property and value to write
+ * @param callback [in] called with the reply, or the timeout
+ * @param context [in] given to the callback
+ * @return the invoke ID, or 0 if no request could be sent
+ */
+uint8_t async_write_property(
+    BACNET_ADDRESS * dest,
+    uint16_t max_apdu,
+    BACNET_WRITE_PROPERTY_DATA * wpdata,
+    async_callback callback,
+    void *context)
+{
+    return async_send(dest, max_apdu, SERVICE_CONFIRMED_WRITE_PROPERTY,
+        wpdata, callback, context);
+}
+
+/* number of requests waiting for their reply */
+unsigned async_pending(
+    void)
+{
+    return Async_Used - Async_Free_Count;
+}
+
+bool async_request_pending(
+    BACNET_ADDRESS * dest,
+    uint8_t invoke_id)
+{
+    return (async_find(dest, invoke_id) < MAX_ASYNC_REQUESTS);
+}
+
+/* forget the request, without calling its callback */
+void async_cancel(
+    BACNET_ADDRESS * dest,
+    uint8_t invoke_id)
+{
+    unsigned index;
+
+    index = async_find(dest, invoke_id);
+    if (index < MAX_ASYNC_REQUESTS) {
+        async_free(index);
+        tsm_free_invoke_id_peer(dest, invoke_id);
+    }
+}
+
+/** Receive and handle a PDU, waiting for it up to the timeout,
+ * and run the TSM timers, which retry the requests or time them out.
+ * @param timeout_ms [in] milliseconds to wait for a PDU
+ */
+void async_task(
+    unsigned timeout_ms)
+{
+    BACNET_ADDRESS src = { 0 };
+    uint16_t pdu_len = 0;
+    uint32_t now = 0;
+    uint32_t elapsed = 0;
+
+    if (!Async_Timer_Started) {
+        Async_Last_Milliseconds = async_milliseconds();
+        Async_Timer_Started = true;
+    }
+    pdu_len = datalink_receive(&src, &Async_Rx_Buf[0], MAX_MPDU, timeout_ms);
+    if (pdu_len) {
+        npdu_handler(&src, &Async_Rx_Buf[0], pdu_len);
+    }
+    now = async_milliseconds();
+    elapsed = now - Async_Last_Milliseconds;
+    if (elapsed) {
+        if (elapsed > UINT16_MAX) {
+            elapsed = UINT16_MAX;
+        }
+        Async_Last_Milliseconds = now;
+        tsm_timer_milliseconds((uint16_t) elapsed);
+    }
+}
+
+/* handle PDUs until all the requests have their reply, or timed out */
+void async_run(
+    void)
+{
+    while (async_pending()) {
+        async_task(100);
+    }
+}
+#endif
@@ -0,0 +1,671 @@
+/**
+* @file
+*
+* @section LICENSE
+*
+* This program is free software; you can redistribute it and/or
+* modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation; either version 2
+* of the License, or (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program; if not, write to:
+* The Free Software Foundation, Inc.
+* 59 Temple Place - Suite 330
+* Boston, MA  02111-1307, USA.
+*
+* @section DESCRIPTION
+*
+* Scheduled binding.  The requests wait in a list sorted by device ID.
+* When the timer runs, the due requests of each network are merged
+* into ranges of nearby device IDs, and a Who-Is is sent for each
+* range while the network has credit for it.  The credit of each
+* network grows with the time, up to one second of Who-Is messages.
+*/
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include "config.h"
+#include "bacdef.h"
+#include "bacenum.h"
+#include "address.h"
+#include "apdu.h"
+#include "iam.h"
+#include "datalink.h"
+#include "client.h"
+#include "binding.h"
+
+typedef struct binding_entry {
+    uint32_t device_id;
+    uint16_t net;
+    /* Who-Is messages sent so far */
+    uint8_t tries;
+    /* when the next one is due, on the binding clock */
+    uint32_t due_time;
+    binding_callback callback;
+    void *context;
+} BINDING_ENTRY;
+
+typedef struct binding_network {
+    uint16_t net;
+    /* thousandths of a Who-Is */
+    uint32_t credit;
+} BINDING_NETWORK;
+
+static BINDING_ENTRY *Binding_List;
+static unsigned Binding_Count;
+static unsigned Binding_Size;
+static BINDING_NETWORK *Binding_Networks;
+static unsigned Binding_Network_Count;
+static unsigned Binding_Rate = BINDING_WHOIS_RATE;
+static uint32_t Binding_Time;
+
+static bool binding_time_reached(
+    uint32_t time)
+{
+    return ((int32_t) (Binding_Time - time) >= 0);
+}
+
+/* the index of the first entry for the device ID or above */
+static unsigned binding_lower_bound(
+    uint32_t device_id)
+{
+    unsigned low = 0;
+    unsigned high = Binding_Count;
+    unsigned middle = 0;
+
+    while (low < high) {
+        middle = (low + high) / 2;
+        if (Binding_List[middle].device_id < device_id) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+
+    return low;
+}
+
+static void binding_remove(
+    unsigned index)
+{
+    Binding_Count--;
+    memmove(&Binding_List[index], &Binding_List[index + 1],
+        (Binding_Count - index) * sizeof(BINDING_ENTRY));
+}
+
+/* takes the entry out of the list first, so the callback may request
+   again */
+static void binding_finish(
+    unsigned index,
+    bool bound)
+{
+    BINDING_ENTRY entry = Binding_List[index];
+
+    binding_remove(index);
+    if (entry.callback) {
+        entry.callback(entry.device_id, bound, entry.context);
+    }
+}
+
+static void binding_complete(
+    uint32_t device_id)
+{
+    unsigned index = 0;
+
+    for (;;) {
+        index = binding_lower_bound(device_id);
+        if ((index >= Binding_Count) ||
+            (Binding_List[index].device_id != device_id)) {
+            break;
+        }
+        binding_finish(index, true);
+    }
+}
+
+static BINDING_NETWORK *binding_network(
+    uint16_t net)
+{
+    BINDING_NETWORK *networks = NULL;
+    unsigned i = 0;
+
+    for (i = 0; i < Binding_Network_Count; i++) {
+        if (Binding_Networks[i].net == net) {
+            return &Binding_Networks[i];
+        }
+    }
+    networks =
+        realloc(Binding_Networks,
+        (Binding_Network_Count + 1) * sizeof(BINDING_NETWORK));
+    if (!networks) {
+        return NULL;
+    }
+    Binding_Networks = networks;
+    Binding_Networks[Binding_Network_Count].net = net;
+    Binding_Networks[Binding_Network_Count].credit = Binding_Rate * 1000;
+
+    return &Binding_Networks[Binding_Network_Count++];
+}
+
+static void binding_whois_send(
+    uint16_t net,
+    uint32_t low_limit,
+    uint32_t high_limit)
+{
+    BACNET_ADDRESS dest;
+
+    if (net == BACNET_BROADCAST_NETWORK) {
+        Send_WhoIs_Global((int32_t) low_limit, (int32_t) high_limit);
+    } else {
+        datalink_get_broadcast_address(&dest);
+        dest.net = net;
+        Send_WhoIs_Remote(&dest, (int32_t) low_limit, (int32_t) high_limit);
+    }
+}
+
+/* the next retry is due after a delay that doubles with each try */
+static void binding_retry_schedule(
+    BINDING_ENTRY * entry)
+{
+    uint32_t delay = BINDING_RETRY_FIRST;
+    uint8_t i = 0;
+
+    for (i = 1; (i < entry->tries) && (delay < BINDING_RETRY_MAX); i++) {
+        delay *= 2;
+    }
+    if (delay > BINDING_RETRY_MAX) {
+        delay = BINDING_RETRY_MAX;
+    }
+    entry->due_time = Binding_Time + delay;
+}
+
+/* sends the due requests of the network in ranged Who-Is messages,
+   while it has credit */
+static void binding_network_send(
+    BINDING_NETWORK * network)
+{
+    BINDING_ENTRY *entry = NULL;
+    uint32_t low_limit = 0;
+    uint32_t high_limit = 0;
+    unsigned first = 0;
+    unsigned index = 0;
+
+    while (network->credit >= 1000) {
+        while ((first < Binding_Count) &&
+            ((Binding_List[first].net != network->net) ||
+                !binding_time_reached(Binding_List[first].due_time))) {
+            first++;
+        }
+        if (first >= Binding_Count) {
+            break;
+        }
+        low_limit = high_limit = Binding_List[first].device_id;
+        for (index = first + 1; index < Binding_Count; index++) {
+            entry = &Binding_List[index];
+            if ((entry->device_id - high_limit) > BINDING_WHOIS_GAP) {
+                break;
+            }
+            if ((entry->net == network->net) &&
+                binding_time_reached(entry->due_time)) {
+                high_limit = entry->device_id;
+            }
+        }
+        binding_whois_send(network->net, low_limit, high_limit);
+        network->credit -= 1000;
+        for (; (first < Binding_Count) &&
+            (Binding_List[first].device_id <= high_limit); first++) {
+            entry = &Binding_List[first];
+            if ((entry->net == network->net) &&
+                binding_time_reached(entry->due_time)) {
+                entry->tries++;
+                binding_retry_schedule(entry);
+            }
+        }
+    }
+}
+
+static void binding_i_am_handler(
+    uint8_t * service_request,
+    uint16_t service_len,
+    BACNET_ADDRESS * src)
+{
+    int len = 0;
+    uint32_t device_id = 0;
+    unsigned max_apdu = 0;
+    int segmentation = 0;
+    uint16_t vendor_id = 0;
+    unsigned index = 0;
+
+    (void) service_len;
+    len =
+        iam_decode_service_request(service_request, &device_id, &max_apdu,
+        &segmentation, &vendor_id);
+    if (len > 0) {
+        index = binding_lower_bound(device_id);
+        if ((index < Binding_Count) &&
+            (Binding_List[index].device_id == device_id)) {
+            /* even if its bind request was dropped from a full cache */
+            address_add(device_id, max_apdu, src);
+        } else {
+            address_add_binding(device_id, max_apdu, src);
+        }
+        address_set_device_segmentation(device_id, (uint8_t) segmentation);
+        binding_complete(device_id);
+    }
+}
+
+void binding_init(
+    void)
+{
+    apdu_set_unconfirmed_handler(SERVICE_UNCONFIRMED_I_AM,
+        binding_i_am_handler);
+}
+
+bool binding_request(
+    uint32_t device_id,
+    uint16_t net,
+    binding_callback callback,
+    void *context)
+{
+    BINDING_ENTRY *list = NULL;
+    BINDING_ENTRY *entry = NULL;
+    unsigned max_apdu = 0;
+    unsigned index = 0;
+
+    if (address_bind_request(device_id, &max_apdu, NULL)) {
+        return true;
+    }
+    if (!binding_network(net)) {
+        return false;
+    }
+    if (Binding_Count >= Binding_Size) {
+        list =
+            realloc(Binding_List,
+            (Binding_Size ? Binding_Size * 2 : 16) * sizeof(BINDING_ENTRY));
+        if (!list) {
+            return false;
+        }
+        Binding_List = list;
+        Binding_Size = Binding_Size ? Binding_Size * 2 : 16;
+    }
+    /* after the other requests for the same device */
+    index = binding_lower_bound(device_id + 1);
+    memmove(&Binding_List[index + 1], &Binding_List[index],
+        (Binding_Count - index) * sizeof(BINDING_ENTRY));
+    Binding_Count++;
+    entry = &Binding_List[index];
+    entry->device_id = device_id;
+    entry->net = net;
+    entry->tries = 0;
+    entry->due_time = Binding_Time;
+    entry->callback = callback;
+    entry->context = context;
+
+    return false;
+}
+
+unsigned binding_pending(
+    void)
+{
+    return Binding_Count;
+}
+
+void binding_rate_set(
+    unsigned whois_per_second)
+{
+    Binding_Rate = whois_per_second;
+}
+
+void binding_timer_milliseconds(
+    uint16_t milliseconds)
+{
+    unsigned index = 0;
+    unsigned i = 0;
+
+    Binding_Time += milliseconds;
+    for (i = 0; i < Binding_Network_Count; i++) {
+        Binding_Networks[i].credit += (uint32_t) milliseconds * Binding_Rate;
+        if (Binding_Networks[i].credit > (Binding_Rate * 1000)) {
+            Binding_Networks[i].credit = Binding_Rate * 1000;
+        }
+    }
+    /* the due requests may have been bound another way, or given up.
+       The next entry takes the place of a finished one.  A callback
+       may only add requests, so those before it move the rest further
+       on, and none is missed. */
+    while (index < Binding_Count) {
+        if (binding_time_reached(Binding_List[index].due_time)) {
+            if (address_bound(Binding_List[index].device_id)) {
+                binding_finish(index, true);
+                continue;
+            }
+            if (Binding_List[index].tries >= BINDING_TRIES) {
+                binding_finish(index, false);
+                continue;
+            }
+        }
+        index++;
+    }
+    for (i = 0; i < Binding_Network_Count; i++) {
+        binding_network_send(&Binding_Networks[i]);
+    }
+}
+
+#ifdef TEST
+#include <assert.h>
+#include "ctest.h"
+
+/* the Who-Is messages sent */
+#define TEST_WHOIS_MAX 64
+static struct test_whois {
+    uint16_t net;
+    int32_t low_limit;
+    int32_t high_limit;
+    uint32_t time;
+} Test_WhoIs[TEST_WHOIS_MAX];
+static unsigned Test_WhoIs_Count;
+
+/* the callbacks */
+#define TEST_CALLBACK_MAX 16
+static struct test_callback {
+    uint32_t device_id;
+    bool bound;
+} Test_Callback[TEST_CALLBACK_MAX];
+static unsigned Test_Callback_Count;
+
+/* dummy function stubs */
+void Send_WhoIs_Global(
+    int32_t low_limit,
+    int32_t high_limit)
+{
+    if (Test_WhoIs_Count < TEST_WHOIS_MAX) {
+        Test_WhoIs[Test_WhoIs_Count].net = BACNET_BROADCAST_NETWORK;
+        Test_WhoIs[Test_WhoIs_Count].low_limit = low_limit;
+        Test_WhoIs[Test_WhoIs_Count].high_limit = high_limit;
+        Test_WhoIs[Test_WhoIs_Count].time = Binding_Time;
+    }
+    Test_WhoIs_Count++;
+}
+
+/* dummy function stubs */
+void Send_WhoIs_Remote(
+    BACNET_ADDRESS * target_address,
+    int32_t low_limit,
+    int32_t high_limit)
+{
+    if (Test_WhoIs_Count < TEST_WHOIS_MAX) {
+        Test_WhoIs[Test_WhoIs_Count].net = target_address->net;
+        Test_WhoIs[Test_WhoIs_Count].low_limit = low_limit;
+        Test_WhoIs[Test_WhoIs_Count].high_limit = high_limit;
+        Test_WhoIs[Test_WhoIs_Count].time = Binding_Time;
+    }
+    Test_WhoIs_Count++;
+}
+
+/* dummy function stubs */
+void datalink_get_broadcast_address(
+    BACNET_ADDRESS * dest)
+{
+    memset(dest, 0, sizeof(BACNET_ADDRESS));
+    dest->mac_len = 1;
+    dest->mac[0] = 0xFF;
+}
+
+/* dummy function stubs */
+void apdu_set_unconfirmed_handler(
+    BACNET_UNCONFIRMED_SERVICE service_choice,
+    unconfirmed_function pFunction)
+{
+    (void) service_choice;
+    (void) pFunction;
+}
+
+static void testBindingCallback(
+    uint32_t device_id,
+    bool bound,
+    void *context)
+{
+    (void) context;
+    if (Test_Callback_Count < TEST_CALLBACK_MAX) {
+        Test_Callback[Test_Callback_Count].device_id = device_id;
+        Test_Callback[Test_Callback_Count].bound = bound;
+    }
+    Test_Callback_Count++;
+}
+
+static void testBindingReset(
+    void)
+{
+    address_init();
+    Binding_Count = 0;
+    Binding_Network_Count = 0;
+    binding_rate_set(BINDING_WHOIS_RATE);
+    Test_WhoIs_Count = 0;
+    Test_Callback_Count = 0;
+}
+
+static void testBindingAddress(
+    uint32_t device_id,
+    BACNET_ADDRESS * src)
+{
+    memset(src, 0, sizeof(BACNET_ADDRESS));
+    src->mac_len = 6;
+    src->mac[3] = (uint8_t) (device_id >> 8);
+    src->mac[4] = (uint8_t) device_id;
+    src->mac[5] = 0xC0;
+}
+
+/* an I-Am from the device */
+static void testBindingIAm(
+    uint32_t device_id)
+{
+    BACNET_ADDRESS src;
+    uint8_t apdu[MAX_APDU] = { 0 };
+    int len = 0;
+
+    testBindingAddress(device_id, &src);
+    len = iam_encode_apdu(&apdu[0], device_id, MAX_APDU, SEGMENTATION_NONE,
+        260);
+    binding_i_am_handler(&apdu[2], (uint16_t) (len - 2), &src);
+}
+
+/* the requests of nearby device IDs share a Who-Is */
+static void testBindingMerge(
+    Test * pTest)
+{
+    BACNET_ADDRESS src;
+
+    testBindingReset();
+    testBindingAddress(99, &src);
+    address_add(99, MAX_APDU, &src);
+    ct_test(pTest, binding_request(99, BACNET_BROADCAST_NETWORK,
+            testBindingCallback, NULL));
+    ct_test(pTest, !binding_request(15, BACNET_BROADCAST_NETWORK,
+            testBindingCallback, NULL));
+    ct_test(pTest, !binding_request(10, BACNET_BROADCAST_NETWORK,
+            testBindingCallback, NULL));
+    ct_test(pTest, !binding_request(12, BACNET_BROADCAST_NETWORK,
+            testBindingCallback, NULL));
+    ct_test(pTest, !binding_request(12, BACNET_BROADCAST_NETWORK,
+            testBindingCallback, NULL));
+    ct_test(pTest, !binding_request(15 + BINDING_WHOIS_GAP + 1,
+            BACNET_BROADCAST_NETWORK, testBindingCallback, NULL));
+    ct_test(pTest, !binding_request(13, 5, testBindingCallback, NULL));
+    ct_test(pTest, binding_pending() == 6);
+    binding_timer_milliseconds(1);
+    ct_test(pTest, Test_WhoIs_Count == 3);
+    ct_test(pTest, Test_WhoIs[0].net == BACNET_BROADCAST_NETWORK);
+    ct_test(pTest, Test_WhoIs[0].low_limit == 10);
+    ct_test(pTest, Test_WhoIs[0].high_limit == 15);
+    ct_test(pTest, Test_WhoIs[1].net == BACNET_BROADCAST_NETWORK);
+    ct_test(pTest, Test_WhoIs[1].low_limit == (15 + BINDING_WHOIS_GAP + 1));
+    ct_test(pTest, Test_WhoIs[1].high_limit == (15 + BINDING_WHOIS_GAP + 1));
+    /* the other network has its own */
+    ct_test(pTest, Test_WhoIs[2].net == 5);
+    ct_test(pTest, Test_WhoIs[2].low_limit == 13);
+    ct_test(pTest, Test_WhoIs[2].high_limit == 13);
+    /* the I-Am completes both requests of the device */
+    testBindingIAm(12);
+    ct_test(pTest, Test_Callback_Count == 2);
+    ct_test(pTest, Test_Callback[0].device_id == 12);
+    ct_test(pTest, Test_Callback[0].bound);
+    ct_test(pTest, Test_Callback[1].device_id == 12);
+    ct_test(pTest, binding_pending() == 4);
+    ct_test(pTest, binding_request(12, BACNET_BROADCAST_NETWORK,
+            testBindingCallback, NULL));
+}
+
+/* no more Who-Is messages to a network than its rate */
+static void testBindingRate(
+    Test * pTest)
+{
+    uint32_t device_id = 0;
+    unsigned i = 0;
+
+    testBindingReset();
+    binding_rate_set(2);
+    for (i = 0; i < 10; i++) {
+        device_id = 1000 + (i * (BINDING_WHOIS_GAP + 1));
+        ct_test(pTest, !binding_request(device_id, 7, testBindingCallback,
+                NULL));
+    }
+    /* one second of credit to start with */
+    binding_timer_milliseconds(1);
+    ct_test(pTest, Test_WhoIs_Count == 2);
+    binding_timer_milliseconds(499);
+    ct_test(pTest, Test_WhoIs_Count == 2);
+    binding_timer_milliseconds(1);
+    ct_test(pTest, Test_WhoIs_Count == 3);
+    /* the lowest device IDs first */
+    for (i = 0; i < Test_WhoIs_Count; i++) {
+        ct_test(pTest, Test_WhoIs[i].net == 7);
+        ct_test(pTest, Test_WhoIs[i].low_limit == Test_WhoIs[i].high_limit);
+        ct_test(pTest, Test_WhoIs[i].low_limit ==
+            (int32_t) (1000 + (i * (BINDING_WHOIS_GAP + 1))));
+    }
+    /* the credit does not save up past one second */
+    binding_timer_milliseconds(5000);
+    ct_test(pTest, Test_WhoIs_Count == 5);
+}
+
+/* the retries of a device that does not answer back off, then it is
+   given up */
+static void testBindingBackoff(
+    Test * pTest)
+{
+    uint32_t delay = BINDING_RETRY_FIRST;
+    unsigned i = 0;
+
+    testBindingReset();
+    ct_test(pTest, !binding_request(42, BACNET_BROADCAST_NETWORK,
+            testBindingCallback, NULL));
+    while ((Test_Callback_Count == 0) && (Binding_Time < 3600000UL)) {
+        binding_timer_milliseconds(100);
+    }
+    ct_test(pTest, Test_WhoIs_Count == BINDING_TRIES);
+    for (i = 1; i < Test_WhoIs_Count; i++) {
+        ct_test(pTest, (Test_WhoIs[i].time - Test_WhoIs[i - 1].time) ==
+            delay);
+        delay *= 2;
+        if (delay > BINDING_RETRY_MAX) {
+            delay = BINDING_RETRY_MAX;
+        }
+    }
+    ct_test(pTest, Test_Callback_Count == 1);
+    ct_test(pTest, Test_Callback[0].device_id == 42);
+    ct_test(pTest, !Test_Callback[0].bound);
+    ct_test(pTest, binding_pending() == 0);
+}
+
+/* binds another device that is waiting, and asks for one more */
+static void testBindingCallbackBind(
+    uint32_t device_id,
+    bool bound,
+    void *context)
+{
+    BACNET_ADDRESS src;
+    uint32_t *other_id = (uint32_t *) context;
+
+    testBindingCallback(device_id, bound, NULL);
+    testBindingAddress(other_id[0], &src);
+    address_add(other_id[0], MAX_APDU, &src);
+    (void) binding_request(other_id[1], BACNET_BROADCAST_NETWORK,
+        testBindingCallback, NULL);
+}
+
+/* a callback that changes the list does not make the timer miss
+   the requests that are due */
+static void testBindingCallbackChange(
+    Test * pTest)
+{
+    /* the one it binds, after it, and the one it asks for, before it */
+    uint32_t other_id[2] = { 30, 5 };
+    uint32_t hits = 0, misses = 0;
+    uint32_t test_hits = 0, test_misses = 0;
+    unsigned index = 0;
+
+    testBindingReset();
+    ct_test(pTest, !binding_request(20, BACNET_BROADCAST_NETWORK,
+            testBindingCallbackBind, &other_id[0]));
+    index = binding_lower_bound(20);
+    address_cache_stats(&hits, &misses, NULL);
+    while (Binding_List[index].tries < BINDING_TRIES) {
+        binding_timer_milliseconds(100);
+    }
+    /* checking on the waiting requests is not a cache lookup */
+    address_cache_stats(&test_hits, &test_misses, NULL);
+    ct_test(pTest, test_hits == hits);
+    ct_test(pTest, test_misses == misses);
+    /* device 30 is due at the same time as 20 is given up */
+    binding_timer_milliseconds((uint16_t) (Binding_List[index].due_time -
+            Binding_Time - 1));
+    ct_test(pTest, !binding_request(other_id[0], BACNET_BROADCAST_NETWORK,
+            testBindingCallback, NULL));
+    Test_WhoIs_Count = 0;
+    binding_timer_milliseconds(1);
+    ct_test(pTest, Test_Callback_Count == 2);
+    ct_test(pTest, Test_Callback[0].device_id == 20);
+    ct_test(pTest, !Test_Callback[0].bound);
+    ct_test(pTest, Test_Callback[1].device_id == other_id[0]);
+    ct_test(pTest, Test_Callback[1].bound);
+    /* only the new request is left, and has its Who-Is */
+    ct_test(pTest, binding_pending() == 1);
+    ct_test(pTest, Binding_List[0].device_id == other_id[1]);
+    ct_test(pTest, Test_WhoIs_Count == 1);
+    ct_test(pTest, Test_WhoIs[0].low_limit == (int32_t) other_id[1]);
+}
+
+#ifdef TEST_BINDING
+int main(
+    void)
+{
+    Test *pTest;
+    bool rc;
+
+    pTest = ct_create("BACnet Binding", NULL);
+    /* individual tests */
+    rc = ct_addTestFunction(pTest, testBindingMerge);
+    assert(rc);
+    rc = ct_addTestFunction(pTest, testBindingRate);
+    assert(rc);
+    rc = ct_addTestFunction(pTest, testBindingBackoff);
+    assert(rc);
+    rc = ct_addTestFunction(pTest, testBindingCallbackChange);
+    assert(rc);
+
+    ct_setStream(pTest, stdout);
+    ct_run(pTest);
+    (void) ct_report(pTest);
+    ct_destroy(pTest);
+
+    return 0;
+}
+#endif /* TEST_BINDING */
+#endif /* TEST */
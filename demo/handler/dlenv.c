@@ -205,6 +205,10 @@ void dlenv_maintenance_timer(
  *     waits for a response from a BACnet device.
  *   - BACNET_APDU_RETRIES - indicate the maximum number of times that
  *     an APDU shall be retransmitted.
+ *   - BACNET_MAX_SEGMENTS - the most segments we send in one segmented
+ *     response, 2..MAX_SEGMENTS_SENT.
+ *   - BACNET_SEGMENT_WINDOW - the window size we propose when sending
+ *     a segmented response, and accept when receiving one, 1..127.
  *   - BACNET_IFACE - set this value to dotted IP address (Windows) of
  *     the interface (see ipconfig command on Windows) for which you
  *     want to bind.  On Linux, set this to the /dev interface
@@ -221,6 +225,8 @@ void dlenv_maintenance_timer(
  *       Registration (0..65535). Defaults to 60000 seconds.
  *   - BACNET_BBMD_ADDRESS - dotted IPv4 address of the BBMD or Foreign
  *       Device Registrar.
+ *   - BACNET_IP_WORKERS - number of threads that receive from the socket
+ *       (Linux).  Default is 0, to receive in the calling thread.
  * - BACDL_MSTP: (BACnet MS/TP)
  *   - BACNET_MAX_INFO_FRAMES
  *   - BACNET_MAX_MASTER
@@ -325,11 +331,32 @@ void dlenv_init(
     if (!datalink_init(getenv("BACNET_IFACE"))) {
         exit(1);
     }
+#if defined(BACDL_BIP) && defined(BIP_WORKERS_MAX)
+    pEnv = getenv("BACNET_IP_WORKERS");
+    if (pEnv && (strtol(pEnv, NULL, 0) > 0)) {
+        if (!bip_workers_start((unsigned) strtol(pEnv, NULL, 0))) {
+            fprintf(stderr,
+                "Failed to start the BACnet/IP receive threads\n");
+        }
+    }
+#endif
 #if (MAX_TSM_TRANSACTIONS)
     pEnv = getenv("BACNET_INVOKE_ID");
     if (pEnv) {
         tsm_invokeID_set((uint8_t) strtol(pEnv, NULL, 0));
     }
+#endif
+#if (MAX_SEGMENTED_RESPONSES)
+    pEnv = getenv("BACNET_MAX_SEGMENTS");
+    if (pEnv) {
+        tsm_segmented_max_segments_set((unsigned) strtol(pEnv, NULL, 0));
+    }
+#endif
+#if (MAX_SEGMENTED_RESPONSES) || (MAX_SEGMENTED_CONFIRMATIONS)
+    pEnv = getenv("BACNET_SEGMENT_WINDOW");
+    if (pEnv) {
+        tsm_segmented_window_size_set((uint8_t) strtol(pEnv, NULL, 0));
+    }
 #endif
     dlenv_register_as_foreign_device();
 }
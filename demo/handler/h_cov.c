@@ -25,6 +25,7 @@
 #include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <errno.h>
 #include "config.h"
@@ -40,6 +41,7 @@
 #include "cov.h"
 #include "tsm.h"
 #include "dcc.h"
+#include "keylist.h"
 #if PRINT_ENABLED
 #include "bactext.h"
 #endif
@@ -51,6 +53,8 @@
 
 typedef struct BACnet_COV_Address {
     bool valid:1;
+    unsigned ref_count; /* subscriptions sent to this address */
+    int next_hash;      /* next in the same hash bucket or free list, or -1 */
     BACNET_ADDRESS dest;
 } BACNET_COV_ADDRESS;
 
@@ -60,40 +64,275 @@ typedef struct BACnet_COV_Subscription_Flags {
     bool valid:1;
     bool issueConfirmedNotifications:1; /* optional */
     bool send_requested:1;
+    bool send_queued:1; /* linked on the send queue */
+    bool timer_queued:1;        /* linked on the timer wheel */
 } BACNET_COV_SUBSCRIPTION_FLAGS;
 
 typedef struct BACnet_COV_Subscription {
     BACNET_COV_SUBSCRIPTION_FLAGS flag;
-    uint8_t dest_index;
+    int dest_index;
     uint8_t invokeID;   /* for confirmed COV */
     uint32_t subscriberProcessIdentifier;
-    uint32_t lifetime;  /* optional */
+    uint32_t lifetime;  /* optional - zero is an indefinite lifetime */
+    uint32_t expiration;        /* COV_Seconds when the lifetime is over */
     BACNET_OBJECT_ID monitoredObjectIdentifier;
+    int next_object;    /* next subscription for the same object, or -1 */
+    int next_send;      /* next subscription on the send queue, or -1 */
+    int next_hash;      /* next in the same hash bucket or free list, or -1 */
+    int next_timer;     /* neighbours in the same timer wheel slot, or -1 */
+    int prev_timer;
 } BACNET_COV_SUBSCRIPTION;
 
+/* a monitored object and the chain of its subscriptions */
+typedef struct BACnet_COV_Object {
+    BACNET_OBJECT_ID object_id;
+    int first_subscription;     /* -1 once the last one is gone */
+    bool dirty_queued;  /* linked on the dirty queue */
+    struct BACnet_COV_Object *next_dirty;
+} BACNET_COV_OBJECT;
+
+/* The subscription and address lists start at these sizes,
+   and double whenever they are full, up to the limits. */
 #ifndef MAX_COV_SUBCRIPTIONS
 #define MAX_COV_SUBCRIPTIONS 128
 #endif
-static BACNET_COV_SUBSCRIPTION COV_Subscriptions[MAX_COV_SUBCRIPTIONS];
+#ifndef MAX_COV_SUBCRIPTIONS_LIMIT
+#define MAX_COV_SUBCRIPTIONS_LIMIT 16384
+#endif
+static BACNET_COV_SUBSCRIPTION *COV_Subscriptions;
+static int COV_Subscriptions_Size;
+static int COV_Subscriptions_Free = -1;
+/* hash buckets of valid subscriptions, by address, process and object */
+static int *COV_Subscription_Hash;
+static unsigned COV_Subscription_Hash_Size;     /* always a power of two */
 #ifndef MAX_COV_ADDRESSES
 #define MAX_COV_ADDRESSES 16
 #endif
-static BACNET_COV_ADDRESS COV_Addresses[MAX_COV_ADDRESSES];
+#ifndef MAX_COV_ADDRESSES_LIMIT
+#define MAX_COV_ADDRESSES_LIMIT 1024
+#endif
+static BACNET_COV_ADDRESS *COV_Addresses;
+static int COV_Addresses_Size;
+static int COV_Addresses_Free = -1;
+#define COV_ADDRESS_HASH_SIZE 64
+static int COV_Address_Hash[COV_ADDRESS_HASH_SIZE];
+/* lifetimes expire from a timer wheel of one second slots */
+#define COV_TIMER_WHEEL_SIZE 256
+static int COV_Timer_Wheel[COV_TIMER_WHEEL_SIZE];
+static uint32_t COV_Seconds;
+/* monitored objects, keyed by object type and instance */
+static OS_Keylist COV_Object_List;
+/* FIFO of monitored objects that reported a change */
+static BACNET_COV_OBJECT *COV_Dirty_Head;
+static BACNET_COV_OBJECT *COV_Dirty_Tail;
+/* FIFO of subscriptions with a notification to send */
+static int COV_Send_Head = -1;
+static int COV_Send_Tail = -1;
+/* object types that report their changes - the others are polled */
+static bool COV_Object_Type_Reports[MAX_BACNET_OBJECT_TYPE];
+/* optional COV-Notification-Multiple batching of the send queue */
+#ifndef MAX_COV_NOTIFICATIONS_MULTIPLE
+#define MAX_COV_NOTIFICATIONS_MULTIPLE 32
+#endif
+static bool COV_Multiple_Enabled;
+static uint16_t COV_Multiple_Window;    /* milliseconds */
+static uint16_t COV_Multiple_Window_Remaining;
+static uint32_t COV_Multiple_Frames_Saved;
+/* subscriptions waiting on each invoke ID; the ones notified together
+   share one */
+static uint16_t COV_Invoke_ID_Users[256];
+
+static BACNET_COV_OBJECT *cov_object_find(
+    BACNET_OBJECT_TYPE object_type,
+    uint32_t object_instance)
+{
+    if (!COV_Object_List) {
+        return NULL;
+    }
+
+    return (BACNET_COV_OBJECT *) Keylist_Data(COV_Object_List,
+        KEY_ENCODE(object_type, object_instance));
+}
+
+/**
+ * Links a subscription into the chain of its monitored object,
+ * adding the object to the monitored object list when needed.
+ *
+ * @param  index - offset into the COV subscription list
+ */
+static void cov_object_link(
+    int index)
+{
+    BACNET_COV_SUBSCRIPTION *cov_subscription = &COV_Subscriptions[index];
+    BACNET_OBJECT_ID *object_id =
+        &cov_subscription->monitoredObjectIdentifier;
+    BACNET_COV_OBJECT *cov_object = NULL;
+
+    if (!COV_Object_List) {
+        COV_Object_List = Keylist_Create();
+        if (!COV_Object_List) {
+            return;
+        }
+    }
+    cov_object = cov_object_find((BACNET_OBJECT_TYPE) object_id->type,
+        object_id->instance);
+    if (!cov_object) {
+        cov_object = calloc(1, sizeof(BACNET_COV_OBJECT));
+        if (!cov_object) {
+            return;
+        }
+        cov_object->object_id = *object_id;
+        cov_object->first_subscription = -1;
+        if (Keylist_Data_Add(COV_Object_List, KEY_ENCODE(object_id->type,
+                    object_id->instance), cov_object) < 0) {
+            free(cov_object);
+            return;
+        }
+    }
+    cov_subscription->next_object = cov_object->first_subscription;
+    cov_object->first_subscription = index;
+}
+
+/**
+ * Unlinks a subscription from the chain of its monitored object.
+ * The object is dropped with its last subscription, unless it is
+ * still on the dirty queue, which will drop it instead.
+ *
+ * @param  index - offset into the COV subscription list
+ */
+static void cov_object_unlink(
+    int index)
+{
+    BACNET_OBJECT_ID *object_id =
+        &COV_Subscriptions[index].monitoredObjectIdentifier;
+    BACNET_COV_OBJECT *cov_object = NULL;
+    int *link = NULL;
+
+    cov_object = cov_object_find((BACNET_OBJECT_TYPE) object_id->type,
+        object_id->instance);
+    if (!cov_object) {
+        return;
+    }
+    link = &cov_object->first_subscription;
+    while (*link >= 0) {
+        if (*link == index) {
+            *link = COV_Subscriptions[index].next_object;
+            break;
+        }
+        link = &COV_Subscriptions[*link].next_object;
+    }
+    COV_Subscriptions[index].next_object = -1;
+    if ((cov_object->first_subscription < 0) && !cov_object->dirty_queued) {
+        Keylist_Data_Delete(COV_Object_List, KEY_ENCODE(object_id->type,
+                object_id->instance));
+        free(cov_object);
+    }
+}
+
+static void cov_object_dirty(
+    BACNET_OBJECT_TYPE object_type,
+    uint32_t object_instance)
+{
+    BACNET_COV_OBJECT *cov_object = NULL;
+
+    cov_object = cov_object_find(object_type, object_instance);
+    if (cov_object && !cov_object->dirty_queued) {
+        cov_object->dirty_queued = true;
+        cov_object->next_dirty = NULL;
+        if (COV_Dirty_Tail) {
+            COV_Dirty_Tail->next_dirty = cov_object;
+        } else {
+            COV_Dirty_Head = cov_object;
+        }
+        COV_Dirty_Tail = cov_object;
+    }
+}
+
+static void cov_send_queue_add(
+    int index)
+{
+    if (!COV_Subscriptions[index].flag.send_queued) {
+        COV_Subscriptions[index].flag.send_queued = true;
+        COV_Subscriptions[index].next_send = -1;
+        if (COV_Send_Tail >= 0) {
+            COV_Subscriptions[COV_Send_Tail].next_send = index;
+        } else {
+            COV_Send_Head = index;
+            /* give later changes a chance to join this one */
+            COV_Multiple_Window_Remaining = COV_Multiple_Window;
+        }
+        COV_Send_Tail = index;
+    }
+}
+
+/* take a subscription out of the send queue, given the one before it */
+static void cov_send_queue_unlink(
+    int prev,
+    int index)
+{
+    int next = COV_Subscriptions[index].next_send;
+
+    if (prev >= 0) {
+        COV_Subscriptions[prev].next_send = next;
+    } else {
+        COV_Send_Head = next;
+    }
+    if (COV_Send_Tail == index) {
+        COV_Send_Tail = prev;
+    }
+    COV_Subscriptions[index].next_send = -1;
+    COV_Subscriptions[index].flag.send_queued = false;
+}
+
+static int cov_send_queue_remove(
+    void)
+{
+    int index = COV_Send_Head;
+
+    if (index >= 0) {
+        COV_Send_Head = COV_Subscriptions[index].next_send;
+        if (COV_Send_Head < 0) {
+            COV_Send_Tail = -1;
+        }
+        COV_Subscriptions[index].next_send = -1;
+        COV_Subscriptions[index].flag.send_queued = false;
+    }
+
+    return index;
+}
+
+/** Handler to learn that the COV properties of an object have changed.
+ * @ingroup DSCOV
+ * Object modules call this whenever they flag a change of value, so that
+ * only the subscriptions to changed objects are notified.  Object types
+ * that never call it are polled with Device_COV() instead.
+ *
+ * @param object_type [in] The BACNET_OBJECT_TYPE of the changed Object.
+ * @param object_instance [in] The object instance number of the changed Object.
+ */
+void handler_cov_object_changed(
+    BACNET_OBJECT_TYPE object_type,
+    uint32_t object_instance)
+{
+    if (object_type < MAX_BACNET_OBJECT_TYPE) {
+        COV_Object_Type_Reports[object_type] = true;
+    }
+    cov_object_dirty(object_type, object_instance);
+}
 
 /**
 * Gets the address from the list of COV addresses
 *
 * @param  index - offset into COV address list where address is stored
-* @param  dest - address to be filled when found
 *
-* @return true if valid address, false if not valid or not found
+* @return the valid address, or NULL if not valid or not found
 */
 static BACNET_ADDRESS *cov_address_get(
     int index)
 {
     BACNET_ADDRESS *cov_dest = NULL;
 
-    if (index < MAX_COV_ADDRESSES) {
+    if ((index >= 0) && (index < COV_Addresses_Size)) {
         if (COV_Addresses[index].valid) {
             cov_dest = &COV_Addresses[index].dest;
         }
@@ -102,36 +341,91 @@ static BACNET_ADDRESS *cov_address_get(
     return cov_dest;
 }
 
+/* hash of the address octets that bacnet_address_same() compares:
+   the network and the remote address, and the MAC only when local */
+static unsigned cov_address_hash(
+    BACNET_ADDRESS * dest)
+{
+    uint32_t hash = 2166136261UL;
+    unsigned i = 0;
+
+    hash = (hash ^ (dest->net & 0xFF)) * 16777619UL;
+    hash = (hash ^ (dest->net >> 8)) * 16777619UL;
+    for (i = 0; (i < dest->len) && (i < MAX_MAC_LEN); i++) {
+        hash = (hash ^ dest->adr[i]) * 16777619UL;
+    }
+    if (dest->net == 0) {
+        for (i = 0; (i < dest->mac_len) && (i < MAX_MAC_LEN); i++) {
+            hash = (hash ^ dest->mac[i]) * 16777619UL;
+        }
+    }
+
+    return hash % COV_ADDRESS_HASH_SIZE;
+}
+
 /**
- * Removes the address from the list of COV addresses, if it is not
- * used by other COV subscriptions
- */
-static void cov_address_remove_unused(
-    void)
+* Finds the address in the list of COV addresses
+*
+* @param  dest - address to be found
+*
+* @return index number 0..N, or -1 if not found
+*/
+static int cov_address_find(
+    BACNET_ADDRESS * dest)
 {
-    unsigned index = 0;
-    unsigned cov_index = 0;
-    bool found = false;
-
-    for (cov_index = 0; cov_index < MAX_COV_ADDRESSES; cov_index++) {
-        if (COV_Addresses[cov_index].valid) {
-            found = false;
-            for (index = 0; index < MAX_COV_SUBCRIPTIONS; index++) {
-                if ((COV_Subscriptions[index].flag.valid) &&
-                    (COV_Subscriptions[index].dest_index == cov_index)) {
-                    found = true;
-                    break;
-                }
-            }
-            if (!found) {
-                COV_Addresses[cov_index].valid = false;
+    int index = -1;
+
+    if (dest && COV_Addresses) {
+        index = COV_Address_Hash[cov_address_hash(dest)];
+        while (index >= 0) {
+            if (bacnet_address_same(dest, &COV_Addresses[index].dest)) {
+                break;
             }
+            index = COV_Addresses[index].next_hash;
+        }
+    }
+
+    return index;
+}
+
+/* double the address list, linking the new entries as free */
+static bool cov_address_list_grow(
+    void)
+{
+    BACNET_COV_ADDRESS *addresses = NULL;
+    int size = 0;
+    int index = 0;
+
+    if (COV_Addresses_Size >= MAX_COV_ADDRESSES_LIMIT) {
+        return false;
+    }
+    size = COV_Addresses_Size ? (COV_Addresses_Size * 2) : MAX_COV_ADDRESSES;
+    if (size > MAX_COV_ADDRESSES_LIMIT) {
+        size = MAX_COV_ADDRESSES_LIMIT;
+    }
+    addresses = realloc(COV_Addresses, size * sizeof(BACNET_COV_ADDRESS));
+    if (!addresses) {
+        return false;
+    }
+    if (!COV_Addresses) {
+        for (index = 0; index < COV_ADDRESS_HASH_SIZE; index++) {
+            COV_Address_Hash[index] = -1;
         }
     }
+    COV_Addresses = addresses;
+    /* link from the top down so the lowest index is used first */
+    for (index = size - 1; index >= COV_Addresses_Size; index--) {
+        memset(&COV_Addresses[index], 0, sizeof(BACNET_COV_ADDRESS));
+        COV_Addresses[index].next_hash = COV_Addresses_Free;
+        COV_Addresses_Free = index;
+    }
+    COV_Addresses_Size = size;
+
+    return true;
 }
 
 /**
-* Adds the address to the list of COV addresses
+* Adds a reference to the address in the list of COV addresses
 *
 * @param  dest - address to be added if there is room in the list
 *
@@ -141,41 +435,317 @@ static int cov_address_add(
     BACNET_ADDRESS * dest)
 {
     int index = -1;
-    unsigned i = 0;
-    bool found = false;
-    bool valid = false;
-    BACNET_ADDRESS *cov_dest = NULL;
+    unsigned bucket = 0;
 
     if (dest) {
-        for (i = 0; i < MAX_COV_ADDRESSES; i++) {
-            valid = COV_Addresses[i].valid;
-            if (valid) {
-                cov_dest = &COV_Addresses[i].dest;
-                found = bacnet_address_same(dest, cov_dest);
-                if (found) {
-                    index = i;
-                    break;
-                }
+        index = cov_address_find(dest);
+        if (index < 0) {
+            if ((COV_Addresses_Free < 0) && !cov_address_list_grow()) {
+                return -1;
             }
+            index = COV_Addresses_Free;
+            COV_Addresses_Free = COV_Addresses[index].next_hash;
+            bacnet_address_copy(&COV_Addresses[index].dest, dest);
+            COV_Addresses[index].valid = true;
+            COV_Addresses[index].ref_count = 0;
+            bucket = cov_address_hash(dest);
+            COV_Addresses[index].next_hash = COV_Address_Hash[bucket];
+            COV_Address_Hash[bucket] = index;
         }
-        if (!found) {
-            /* find a free place to add a new address */
-            for (i = 0; i < MAX_COV_ADDRESSES; i++) {
-                valid = COV_Addresses[i].valid;
-                if (!valid) {
-                    index = i;
-                    cov_dest = &COV_Addresses[i].dest;
-                    bacnet_address_copy(cov_dest, dest);
-                    COV_Addresses[i].valid = true;
-                    break;
-                }
-            }
+        COV_Addresses[index].ref_count++;
+    }
+
+    return index;
+}
+
+/**
+ * Drops a reference to the address in the list of COV addresses,
+ * and removes the address once no COV subscription uses it.
+ *
+ * @param  index - offset into COV address list
+ */
+static void cov_address_release(
+    int index)
+{
+    int *link = NULL;
+
+    if (!cov_address_get(index)) {
+        return;
+    }
+    if (COV_Addresses[index].ref_count > 1) {
+        COV_Addresses[index].ref_count--;
+        return;
+    }
+    link = &COV_Address_Hash[cov_address_hash(&COV_Addresses[index].dest)];
+    while (*link >= 0) {
+        if (*link == index) {
+            *link = COV_Addresses[index].next_hash;
+            break;
+        }
+        link = &COV_Addresses[*link].next_hash;
+    }
+    COV_Addresses[index].valid = false;
+    COV_Addresses[index].ref_count = 0;
+    COV_Addresses[index].next_hash = COV_Addresses_Free;
+    COV_Addresses_Free = index;
+}
+
+static unsigned cov_subscription_hash(
+    int dest_index,
+    uint32_t process_id,
+    BACNET_OBJECT_ID * object_id)
+{
+    uint32_t hash;
+
+    hash = KEY_ENCODE(object_id->type, object_id->instance);
+    hash = (hash ^ process_id) * 2654435761UL;
+    hash = (hash ^ (uint32_t) dest_index) * 2654435761UL;
+
+    return (unsigned) (hash >> 8) & (COV_Subscription_Hash_Size - 1);
+}
+
+static void cov_subscription_hash_add(
+    int index)
+{
+    BACNET_COV_SUBSCRIPTION *cov_subscription = &COV_Subscriptions[index];
+    unsigned bucket = 0;
+
+    bucket =
+        cov_subscription_hash(cov_subscription->dest_index,
+        cov_subscription->subscriberProcessIdentifier,
+        &cov_subscription->monitoredObjectIdentifier);
+    cov_subscription->next_hash = COV_Subscription_Hash[bucket];
+    COV_Subscription_Hash[bucket] = index;
+}
+
+static void cov_subscription_hash_remove(
+    int index)
+{
+    BACNET_COV_SUBSCRIPTION *cov_subscription = &COV_Subscriptions[index];
+    int *link = NULL;
+
+    link =
+        &COV_Subscription_Hash[cov_subscription_hash(cov_subscription->
+            dest_index, cov_subscription->subscriberProcessIdentifier,
+            &cov_subscription->monitoredObjectIdentifier)];
+    while (*link >= 0) {
+        if (*link == index) {
+            *link = cov_subscription->next_hash;
+            break;
+        }
+        link = &COV_Subscriptions[*link].next_hash;
+    }
+    cov_subscription->next_hash = -1;
+}
+
+/**
+ * Finds the subscription of the subscriber address and process
+ * to the monitored object.
+ *
+ * @param  src - address of the subscriber
+ * @param  cov_data - the subscriber process and the monitored object
+ *
+ * @return offset into the COV subscription list, or -1 if not found
+ */
+static int cov_subscription_find(
+    BACNET_ADDRESS * src,
+    BACNET_SUBSCRIBE_COV_DATA * cov_data)
+{
+    BACNET_OBJECT_ID *object_id = &cov_data->monitoredObjectIdentifier;
+    int dest_index = -1;
+    int index = -1;
+
+    if (!COV_Subscription_Hash) {
+        return -1;
+    }
+    dest_index = cov_address_find(src);
+    if (dest_index < 0) {
+        return -1;
+    }
+    index =
+        COV_Subscription_Hash[cov_subscription_hash(dest_index,
+            cov_data->subscriberProcessIdentifier, object_id)];
+    while (index >= 0) {
+        if ((COV_Subscriptions[index].dest_index == dest_index) &&
+            (COV_Subscriptions[index].subscriberProcessIdentifier ==
+                cov_data->subscriberProcessIdentifier) &&
+            (COV_Subscriptions[index].monitoredObjectIdentifier.type ==
+                object_id->type) &&
+            (COV_Subscriptions[index].monitoredObjectIdentifier.instance ==
+                object_id->instance)) {
+            break;
         }
+        index = COV_Subscriptions[index].next_hash;
     }
 
     return index;
 }
 
+/* double the subscription list, linking the new entries as free,
+   and resize the hash table to match */
+static bool cov_subscription_list_grow(
+    void)
+{
+    BACNET_COV_SUBSCRIPTION *subscriptions = NULL;
+    int *hash = NULL;
+    unsigned hash_size = 16;
+    int size = 0;
+    int index = 0;
+
+    if (COV_Subscriptions_Size >= MAX_COV_SUBCRIPTIONS_LIMIT) {
+        return false;
+    }
+    size =
+        COV_Subscriptions_Size ? (COV_Subscriptions_Size *
+        2) : MAX_COV_SUBCRIPTIONS;
+    if (size > MAX_COV_SUBCRIPTIONS_LIMIT) {
+        size = MAX_COV_SUBCRIPTIONS_LIMIT;
+    }
+    /* keep the load factor at or below one half */
+    while (hash_size < (unsigned) (size * 2)) {
+        hash_size *= 2;
+    }
+    hash = malloc(hash_size * sizeof(int));
+    if (!hash) {
+        return false;
+    }
+    subscriptions =
+        realloc(COV_Subscriptions, size * sizeof(BACNET_COV_SUBSCRIPTION));
+    if (!subscriptions) {
+        free(hash);
+        return false;
+    }
+    if (!COV_Subscriptions) {
+        for (index = 0; index < COV_TIMER_WHEEL_SIZE; index++) {
+            COV_Timer_Wheel[index] = -1;
+        }
+    }
+    COV_Subscriptions = subscriptions;
+    /* link from the top down so the lowest index is used first */
+    for (index = size - 1; index >= COV_Subscriptions_Size; index--) {
+        memset(&COV_Subscriptions[index], 0,
+            sizeof(BACNET_COV_SUBSCRIPTION));
+        COV_Subscriptions[index].dest_index = -1;
+        COV_Subscriptions[index].next_object = -1;
+        COV_Subscriptions[index].next_send = -1;
+        COV_Subscriptions[index].next_timer = -1;
+        COV_Subscriptions[index].prev_timer = -1;
+        COV_Subscriptions[index].next_hash = COV_Subscriptions_Free;
+        COV_Subscriptions_Free = index;
+    }
+    COV_Subscriptions_Size = size;
+    /* rehash the valid subscriptions */
+    free(COV_Subscription_Hash);
+    COV_Subscription_Hash = hash;
+    COV_Subscription_Hash_Size = hash_size;
+    memset(COV_Subscription_Hash, 0xFF, hash_size * sizeof(int));
+    for (index = 0; index < COV_Subscriptions_Size; index++) {
+        if (COV_Subscriptions[index].flag.valid) {
+            cov_subscription_hash_add(index);
+        }
+    }
+
+    return true;
+}
+
+/* start the lifetime of a subscription on the timer wheel */
+static void cov_timer_add(
+    int index)
+{
+    BACNET_COV_SUBSCRIPTION *cov_subscription = &COV_Subscriptions[index];
+    unsigned slot = 0;
+
+    if (cov_subscription->lifetime == 0) {
+        /* indefinite lifetime */
+        return;
+    }
+    cov_subscription->expiration = COV_Seconds + cov_subscription->lifetime;
+    slot = cov_subscription->expiration % COV_TIMER_WHEEL_SIZE;
+    cov_subscription->prev_timer = -1;
+    cov_subscription->next_timer = COV_Timer_Wheel[slot];
+    if (COV_Timer_Wheel[slot] >= 0) {
+        COV_Subscriptions[COV_Timer_Wheel[slot]].prev_timer = index;
+    }
+    COV_Timer_Wheel[slot] = index;
+    cov_subscription->flag.timer_queued = true;
+}
+
+static void cov_timer_remove(
+    int index)
+{
+    BACNET_COV_SUBSCRIPTION *cov_subscription = &COV_Subscriptions[index];
+    unsigned slot = 0;
+
+    if (!cov_subscription->flag.timer_queued) {
+        return;
+    }
+    if (cov_subscription->prev_timer >= 0) {
+        COV_Subscriptions[cov_subscription->prev_timer].next_timer =
+            cov_subscription->next_timer;
+    } else {
+        slot = cov_subscription->expiration % COV_TIMER_WHEEL_SIZE;
+        COV_Timer_Wheel[slot] = cov_subscription->next_timer;
+    }
+    if (cov_subscription->next_timer >= 0) {
+        COV_Subscriptions[cov_subscription->next_timer].prev_timer =
+            cov_subscription->prev_timer;
+    }
+    cov_subscription->next_timer = -1;
+    cov_subscription->prev_timer = -1;
+    cov_subscription->flag.timer_queued = false;
+}
+
+/* seconds left of the subscription lifetime, zero if indefinite */
+static uint32_t cov_time_remaining(
+    BACNET_COV_SUBSCRIPTION * cov_subscription)
+{
+    uint32_t remaining = 0;
+
+    if (cov_subscription->flag.timer_queued) {
+        remaining = cov_subscription->expiration - COV_Seconds;
+    }
+
+    return remaining;
+}
+
+/* The subscription stops waiting on its invoke ID.  A transaction that
+   is still running is only cancelled when asked, and once no other
+   subscription of its notification multiple waits on it. */
+static void cov_invoke_id_release(
+    BACNET_COV_SUBSCRIPTION * cov_subscription,
+    bool free_transaction)
+{
+    uint8_t invoke_id = cov_subscription->invokeID;
+
+    if (!invoke_id) {
+        return;
+    }
+    cov_subscription->invokeID = 0;
+    if (COV_Invoke_ID_Users[invoke_id]) {
+        COV_Invoke_ID_Users[invoke_id]--;
+    }
+    if (free_transaction && (COV_Invoke_ID_Users[invoke_id] == 0)) {
+        tsm_free_invoke_id(invoke_id);
+    }
+}
+
+/* remove a subscription from every index and return it to the free list */
+static void cov_subscription_free(
+    int index)
+{
+    BACNET_COV_SUBSCRIPTION *cov_subscription = &COV_Subscriptions[index];
+
+    cov_subscription_hash_remove(index);
+    cov_object_unlink(index);
+    cov_timer_remove(index);
+    cov_address_release(cov_subscription->dest_index);
+    cov_subscription->flag.valid = false;
+    cov_subscription->dest_index = -1;
+    cov_invoke_id_release(cov_subscription, true);
+    cov_subscription->next_hash = COV_Subscriptions_Free;
+    COV_Subscriptions_Free = index;
+}
+
 /*
 BACnetCOVSubscription ::= SEQUENCE {
 Recipient [0] BACnetRecipientProcess,
@@ -283,7 +853,7 @@ static int cov_encode_subscription(
     /* TimeRemaining [3] Unsigned, */
     len =
         encode_context_unsigned(&apdu[apdu_len], 3,
-        cov_subscription->lifetime);
+        cov_time_remaining(cov_subscription));
     apdu_len += len;
 
     return apdu_len;
@@ -306,10 +876,10 @@ int handler_cov_encode_subscriptions(
 {
     int len = 0;
     int apdu_len = 0;
-    unsigned index = 0;
+    int index = 0;
 
     if (apdu) {
-        for (index = 0; index < MAX_COV_SUBCRIPTIONS; index++) {
+        for (index = 0; index < COV_Subscriptions_Size; index++) {
             if (COV_Subscriptions[index].flag.valid) {
                 len =
                     cov_encode_subscription(&apdu[apdu_len],
@@ -332,23 +902,28 @@ int handler_cov_encode_subscriptions(
 void handler_cov_init(
     void)
 {
-    unsigned index = 0;
-
-    for (index = 0; index < MAX_COV_SUBCRIPTIONS; index++) {
-        COV_Subscriptions[index].flag.valid = false;
-        COV_Subscriptions[index].dest_index = -1;
-        COV_Subscriptions[index].subscriberProcessIdentifier = 0;
-        COV_Subscriptions[index].monitoredObjectIdentifier.type =
-            OBJECT_ANALOG_INPUT;
-        COV_Subscriptions[index].monitoredObjectIdentifier.instance = 0;
-        COV_Subscriptions[index].flag.issueConfirmedNotifications = false;
-        COV_Subscriptions[index].invokeID = 0;
-        COV_Subscriptions[index].lifetime = 0;
-        COV_Subscriptions[index].flag.send_requested = false;
-    }
-    for (index = 0; index < MAX_COV_ADDRESSES; index++) {
-        COV_Addresses[index].valid = false;
+    free(COV_Subscriptions);
+    COV_Subscriptions = NULL;
+    COV_Subscriptions_Size = 0;
+    COV_Subscriptions_Free = -1;
+    free(COV_Subscription_Hash);
+    COV_Subscription_Hash = NULL;
+    COV_Subscription_Hash_Size = 0;
+    free(COV_Addresses);
+    COV_Addresses = NULL;
+    COV_Addresses_Size = 0;
+    COV_Addresses_Free = -1;
+    COV_Seconds = 0;
+    if (COV_Object_List) {
+        while (Keylist_Count(COV_Object_List) > 0) {
+            free(Keylist_Data_Pop(COV_Object_List));
+        }
     }
+    COV_Dirty_Head = NULL;
+    COV_Dirty_Tail = NULL;
+    COV_Send_Head = -1;
+    COV_Send_Tail = -1;
+    COV_Multiple_Window_Remaining = 0;
 }
 
 static bool cov_list_subscribe(
@@ -357,90 +932,69 @@ static bool cov_list_subscribe(
     BACNET_ERROR_CLASS * error_class,
     BACNET_ERROR_CODE * error_code)
 {
-    bool existing_entry = false;
-    int index;
-    int first_invalid_index = -1;
-    bool found = true;
-    bool address_match = false;
-    BACNET_ADDRESS *dest = NULL;
-
-    /* unable to subscribe - resources? */
-    /* unable to cancel subscription - other? */
+    int index = -1;
+    BACNET_COV_SUBSCRIPTION *cov_subscription = NULL;
 
     /* existing? - match Object ID and Process ID and address */
-    for (index = 0; index < MAX_COV_SUBCRIPTIONS; index++) {
-        if (COV_Subscriptions[index].flag.valid) {
-            dest = cov_address_get(COV_Subscriptions[index].dest_index);
-            if (dest) {
-                address_match = bacnet_address_same(src, dest);
-            } else {
-                /* skip address matching - we don't have an address */
-                address_match = true;
-            }
-            if ((COV_Subscriptions[index].monitoredObjectIdentifier.type ==
-                    cov_data->monitoredObjectIdentifier.type) &&
-                (COV_Subscriptions[index].monitoredObjectIdentifier.instance ==
-                    cov_data->monitoredObjectIdentifier.instance) &&
-                (COV_Subscriptions[index].subscriberProcessIdentifier ==
-                    cov_data->subscriberProcessIdentifier) && address_match) {
-                existing_entry = true;
-                if (cov_data->cancellationRequest) {
-                    COV_Subscriptions[index].flag.valid = false;
-                    COV_Subscriptions[index].dest_index = -1;
-                    cov_address_remove_unused();
-                } else {
-                    COV_Subscriptions[index].dest_index = cov_address_add(src);
-                    COV_Subscriptions[index].flag.issueConfirmedNotifications =
-                        cov_data->issueConfirmedNotifications;
-                    COV_Subscriptions[index].lifetime = cov_data->lifetime;
-                    COV_Subscriptions[index].flag.send_requested = true;
-                }
-                if (COV_Subscriptions[index].invokeID) {
-                    tsm_free_invoke_id(COV_Subscriptions[index].invokeID);
-                    COV_Subscriptions[index].invokeID = 0;
-                }
-                break;
-            }
+    index = cov_subscription_find(src, cov_data);
+    if (index >= 0) {
+        cov_subscription = &COV_Subscriptions[index];
+        if (cov_data->cancellationRequest) {
+            cov_subscription_free(index);
         } else {
-            if (first_invalid_index < 0) {
-                first_invalid_index = index;
-            }
+            cov_subscription->flag.issueConfirmedNotifications =
+                cov_data->issueConfirmedNotifications;
+            cov_timer_remove(index);
+            cov_subscription->lifetime = cov_data->lifetime;
+            cov_timer_add(index);
+            cov_invoke_id_release(cov_subscription, true);
+            cov_subscription->flag.send_requested = true;
+            cov_send_queue_add(index);
         }
+        return true;
     }
-    if (!existing_entry && (first_invalid_index >= 0) &&
-        (!cov_data->cancellationRequest)) {
-        index = first_invalid_index;
-        found = true;
-        COV_Subscriptions[index].flag.valid = true;
-        COV_Subscriptions[index].dest_index = cov_address_add(src);
-        COV_Subscriptions[index].monitoredObjectIdentifier.type =
-            cov_data->monitoredObjectIdentifier.type;
-        COV_Subscriptions[index].monitoredObjectIdentifier.instance =
-            cov_data->monitoredObjectIdentifier.instance;
-        COV_Subscriptions[index].subscriberProcessIdentifier =
-            cov_data->subscriberProcessIdentifier;
-        COV_Subscriptions[index].flag.issueConfirmedNotifications =
-            cov_data->issueConfirmedNotifications;
-        COV_Subscriptions[index].invokeID = 0;
-        COV_Subscriptions[index].lifetime = cov_data->lifetime;
-        COV_Subscriptions[index].flag.send_requested = true;
-    } else if (!existing_entry) {
-        if (first_invalid_index < 0) {
-            /* Out of resources */
-            *error_class = ERROR_CLASS_RESOURCES;
-            *error_code = ERROR_CODE_NO_SPACE_TO_ADD_LIST_ELEMENT;
-            found = false;
-        } else {
-            /* cancellationRequest - valid object not subscribed */
-            /* From BACnet Standard 135-2010-13.14.2
-               ...Cancellations that are issued for which no matching COV
-               context can be found shall succeed as if a context had
-               existed, returning 'Result(+)'. */
-            found = true;
-        }
+    if (cov_data->cancellationRequest) {
+        /* cancellationRequest - valid object not subscribed */
+        /* From BACnet Standard 135-2010-13.14.2
+           ...Cancellations that are issued for which no matching COV
+           context can be found shall succeed as if a context had
+           existed, returning 'Result(+)'. */
+        return true;
     }
+    if ((COV_Subscriptions_Free < 0) && !cov_subscription_list_grow()) {
+        /* Out of resources */
+        *error_class = ERROR_CLASS_RESOURCES;
+        *error_code = ERROR_CODE_NO_SPACE_TO_ADD_LIST_ELEMENT;
+        return false;
+    }
+    index = COV_Subscriptions_Free;
+    cov_subscription = &COV_Subscriptions[index];
+    cov_subscription->dest_index = cov_address_add(src);
+    if (cov_subscription->dest_index < 0) {
+        /* Out of resources */
+        *error_class = ERROR_CLASS_RESOURCES;
+        *error_code = ERROR_CODE_NO_SPACE_TO_ADD_LIST_ELEMENT;
+        return false;
+    }
+    COV_Subscriptions_Free = cov_subscription->next_hash;
+    cov_subscription->flag.valid = true;
+    cov_subscription->monitoredObjectIdentifier.type =
+        cov_data->monitoredObjectIdentifier.type;
+    cov_subscription->monitoredObjectIdentifier.instance =
+        cov_data->monitoredObjectIdentifier.instance;
+    cov_subscription->subscriberProcessIdentifier =
+        cov_data->subscriberProcessIdentifier;
+    cov_subscription->flag.issueConfirmedNotifications =
+        cov_data->issueConfirmedNotifications;
+    cov_subscription->invokeID = 0;
+    cov_subscription->lifetime = cov_data->lifetime;
+    cov_subscription->flag.send_requested = true;
+    cov_subscription_hash_add(index);
+    cov_object_link(index);
+    cov_timer_add(index);
+    cov_send_queue_add(index);
 
-    return found;
+    return true;
 }
 
 static bool cov_send_request(
@@ -486,13 +1040,14 @@ static bool cov_send_request(
         cov_subscription->monitoredObjectIdentifier.type;
     cov_data.monitoredObjectIdentifier.instance =
         cov_subscription->monitoredObjectIdentifier.instance;
-    cov_data.timeRemaining = cov_subscription->lifetime;
+    cov_data.timeRemaining = cov_time_remaining(cov_subscription);
     cov_data.listOfValues = value_list;
     if (cov_subscription->flag.issueConfirmedNotifications) {
         npdu_data.data_expecting_reply = true;
         invoke_id = tsm_next_free_invokeID();
         if (invoke_id) {
             cov_subscription->invokeID = invoke_id;
+            COV_Invoke_ID_Users[invoke_id]++;
             len =
                 ccov_notify_encode_apdu(&Handler_Transmit_Buffer[pdu_len],
                 sizeof(Handler_Transmit_Buffer) - pdu_len, invoke_id, &cov_data);
@@ -525,223 +1080,409 @@ static bool cov_send_request(
 }
 
 static void cov_lifetime_expiration_handler(
-    unsigned index,
-    uint32_t elapsed_seconds,
-    uint32_t lifetime_seconds)
-{
-    if (index < MAX_COV_SUBCRIPTIONS) {
-        /* handle lifetime expiration */
-        if (lifetime_seconds >= elapsed_seconds) {
-            COV_Subscriptions[index].lifetime -= elapsed_seconds;
-#if 0
-            fprintf(stderr, "COVtimer: subscription[%d].lifetime=%lu\n", index,
-                (unsigned long) COV_Subscriptions[index].lifetime);
-#endif
-        } else {
-            COV_Subscriptions[index].lifetime = 0;
-        }
-        if (COV_Subscriptions[index].lifetime == 0) {
-            /* expire the subscription */
+    int index)
+{
+    /* expire the subscription */
 #if PRINT_ENABLED
-            fprintf(stderr, "COVtimer: PID=%u ",
-                COV_Subscriptions[index].subscriberProcessIdentifier);
-            fprintf(stderr, "%s %u ",
-                bactext_object_type_name(COV_Subscriptions[index].
-                    monitoredObjectIdentifier.type),
-                COV_Subscriptions[index].monitoredObjectIdentifier.instance);
-            fprintf(stderr, "time remaining=%u seconds ",
-                COV_Subscriptions[index].lifetime);
-            fprintf(stderr, "\n");
+    fprintf(stderr, "COVtimer: PID=%u ",
+        COV_Subscriptions[index].subscriberProcessIdentifier);
+    fprintf(stderr, "%s %u ",
+        bactext_object_type_name(COV_Subscriptions[index].
+            monitoredObjectIdentifier.type),
+        COV_Subscriptions[index].monitoredObjectIdentifier.instance);
+    fprintf(stderr, "time remaining=%u seconds ", 0);
+    fprintf(stderr, "\n");
 #endif
-            COV_Subscriptions[index].flag.valid = false;
-            COV_Subscriptions[index].dest_index = -1;
-            cov_address_remove_unused();
-            if (COV_Subscriptions[index].flag.issueConfirmedNotifications) {
-                if (COV_Subscriptions[index].invokeID) {
-                    tsm_free_invoke_id(COV_Subscriptions[index].invokeID);
-                    COV_Subscriptions[index].invokeID = 0;
-                }
-            }
-        }
-    }
+    cov_subscription_free(index);
 }
 
-/** Handler to check the list of subscribed objects for any that have changed
- *  and so need to have notifications sent.
+/** Handler to expire the COV subscriptions whose lifetime is over.
  * @ingroup DSCOV
  * This handler will be invoked by the main program every second or so.
- * This example only handles Binary Inputs, but can be easily extended to
- * support other types.
- * For each subscribed object,
- *  - See if the subscription has timed out
- *    - Remove it if it has timed out.
- *  - See if the subscribed object instance has changed
- *    (eg, check with Binary_Input_Change_Of_Value() )
- *  - If changed,
- *    - Clear the COV (eg, Binary_Input_Change_Of_Value_Clear() )
- *    - Send the notice with cov_send_request()
- *      - Will be confirmed or unconfirmed, as per the subscription.
- *
- * @note worst case tasking: MS/TP with the ability to send only
- *        one notification per task cycle.
+ * Subscriptions wait on a timer wheel slot by their expiration second,
+ * so only the slots of the elapsed seconds are visited.
  *
  * @param elapsed_seconds [in] How many seconds have elapsed since last called.
  */
 void handler_cov_timer_seconds(
     uint32_t elapsed_seconds)
 {
-    unsigned index = 0;
-    uint32_t lifetime_seconds = 0;
+    uint32_t now = 0;
+    uint32_t slots = 0;
+    uint32_t i = 0;
+    int index = 0;
+    int next = 0;
 
-    if (elapsed_seconds) {
-        /* handle the subscription timeouts */
-        for (index = 0; index < MAX_COV_SUBCRIPTIONS; index++) {
-            if (COV_Subscriptions[index].flag.valid) {
-                lifetime_seconds = COV_Subscriptions[index].lifetime;
-                if (lifetime_seconds) {
-                    /* only expire COV with definite lifetimes */
-                    cov_lifetime_expiration_handler(index, elapsed_seconds,
-                        lifetime_seconds);
+    if (elapsed_seconds && COV_Subscriptions) {
+        now = COV_Seconds + elapsed_seconds;
+        slots = elapsed_seconds;
+        if (slots > COV_TIMER_WHEEL_SIZE) {
+            slots = COV_TIMER_WHEEL_SIZE;
+        }
+        for (i = 1; i <= slots; i++) {
+            index = COV_Timer_Wheel[(COV_Seconds + i) % COV_TIMER_WHEEL_SIZE];
+            while (index >= 0) {
+                next = COV_Subscriptions[index].next_timer;
+                /* the slot also holds later turns of the wheel */
+                if ((int32_t) (COV_Subscriptions[index].expiration - now) <=
+                    0) {
+                    cov_lifetime_expiration_handler(index);
                 }
+                index = next;
             }
         }
+        COV_Seconds = now;
     }
 }
 
-bool handler_cov_fsm(
+/* confirmed notification house keeping */
+static void cov_invoke_id_check(
+    BACNET_COV_SUBSCRIPTION * cov_subscription)
+{
+    if ((cov_subscription->flag.valid) &&
+        (cov_subscription->flag.issueConfirmedNotifications) &&
+        (cov_subscription->invokeID)) {
+        if (tsm_invoke_id_free(cov_subscription->invokeID)) {
+            cov_invoke_id_release(cov_subscription, false);
+        } else if (tsm_invoke_id_failed(cov_subscription->invokeID)) {
+            /* the others of its notification multiple find it free */
+            tsm_free_invoke_id(cov_subscription->invokeID);
+            cov_invoke_id_release(cov_subscription, false);
+        }
+    }
+}
+
+/* request a notification on every subscription to the changed objects */
+static void cov_dirty_objects_mark(
+    void)
+{
+    BACNET_COV_OBJECT *cov_object = NULL;
+    BACNET_OBJECT_ID object_id;
+    int index = 0;
+
+    while (COV_Dirty_Head) {
+        cov_object = COV_Dirty_Head;
+        COV_Dirty_Head = cov_object->next_dirty;
+        if (!COV_Dirty_Head) {
+            COV_Dirty_Tail = NULL;
+        }
+        cov_object->next_dirty = NULL;
+        cov_object->dirty_queued = false;
+        object_id = cov_object->object_id;
+        if (cov_object->first_subscription < 0) {
+            /* the last subscription went away while queued */
+            Keylist_Data_Delete(COV_Object_List, KEY_ENCODE(object_id.type,
+                    object_id.instance));
+            free(cov_object);
+            continue;
+        }
+        for (index = cov_object->first_subscription; index >= 0;
+            index = COV_Subscriptions[index].next_object) {
+            if (COV_Subscriptions[index].flag.valid) {
+                COV_Subscriptions[index].flag.send_requested = true;
+                cov_send_queue_add(index);
+            }
+        }
+#if PRINT_ENABLED
+        fprintf(stderr, "COVtask: Marking...\n");
+#endif
+        /* clear the COV flag after marking all its subscriptions */
+        Device_COV_Clear((BACNET_OBJECT_TYPE) object_id.type,
+            object_id.instance);
+    }
+}
+
+/* visit one subscription: poll objects that do not report changes,
+   and release the invoke ID of a finished confirmed notification */
+static void cov_subscription_sweep(
     void)
 {
     static int index = 0;
     BACNET_OBJECT_TYPE object_type = MAX_BACNET_OBJECT_TYPE;
     uint32_t object_instance = 0;
-    bool status = false;
-    bool send = false;
+
+    if (index >= COV_Subscriptions_Size) {
+        index = 0;
+        if (COV_Subscriptions_Size == 0) {
+            return;
+        }
+    }
+    if (COV_Subscriptions[index].flag.valid) {
+        object_type = (BACNET_OBJECT_TYPE)
+            COV_Subscriptions[index].monitoredObjectIdentifier.type;
+        object_instance =
+            COV_Subscriptions[index].monitoredObjectIdentifier.instance;
+        if ((object_type < MAX_BACNET_OBJECT_TYPE) &&
+            (!COV_Object_Type_Reports[object_type]) &&
+            Device_COV(object_type, object_instance)) {
+            cov_object_dirty(object_type, object_instance);
+        }
+        cov_invoke_id_check(&COV_Subscriptions[index]);
+    }
+    index++;
+}
+
+/* can this queued subscription join a notification multiple
+   that is being built for the given one? */
+static bool cov_send_multiple_match(
+    BACNET_COV_SUBSCRIPTION * cov_subscription,
+    BACNET_COV_SUBSCRIPTION * candidate)
+{
+    if ((!candidate->flag.valid) || (!candidate->flag.send_requested)) {
+        return false;
+    }
+    if ((candidate->dest_index != cov_subscription->dest_index) ||
+        (candidate->subscriberProcessIdentifier !=
+            cov_subscription->subscriberProcessIdentifier) ||
+        (candidate->flag.issueConfirmedNotifications !=
+            cov_subscription->flag.issueConfirmedNotifications)) {
+        return false;
+    }
+    if (candidate->flag.issueConfirmedNotifications) {
+        cov_invoke_id_check(candidate);
+        if (candidate->invokeID != 0) {
+            /* still waiting for its previous notification */
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/* encode the current values of the object of a subscription */
+static int cov_send_multiple_encode_object(
+    uint8_t * apdu,
+    BACNET_COV_SUBSCRIPTION * cov_subscription)
+{
     BACNET_PROPERTY_VALUE value_list[2];
-    /* states for transmitting */
-    static enum {
-        COV_STATE_IDLE = 0,
-        COV_STATE_MARK,
-        COV_STATE_CLEAR,
-        COV_STATE_FREE,
-        COV_STATE_SEND
-    } cov_task_state = COV_STATE_IDLE;
-
-    switch (cov_task_state) {
-        case COV_STATE_IDLE:
-            index = 0;
-            cov_task_state = COV_STATE_MARK;
-            break;
-        case COV_STATE_MARK:
-            /* mark any subscriptions where the value has changed */
-            if (COV_Subscriptions[index].flag.valid) {
-                object_type = (BACNET_OBJECT_TYPE)
-                    COV_Subscriptions[index].monitoredObjectIdentifier.type;
-                object_instance =
-                    COV_Subscriptions[index].
-                    monitoredObjectIdentifier.instance;
-                status = Device_COV(object_type, object_instance);
-                if (status) {
-                    COV_Subscriptions[index].flag.send_requested = true;
+    bool status = false;
+
+    /* configure the linked list for the two properties */
+    value_list[0].next = &value_list[1];
+    value_list[1].next = NULL;
+    status = Device_Encode_Value_List((BACNET_OBJECT_TYPE)
+        cov_subscription->monitoredObjectIdentifier.type,
+        cov_subscription->monitoredObjectIdentifier.instance,
+        &value_list[0]);
+    if (!status) {
+        return 0;
+    }
+
+    return cov_notify_multiple_encode_apdu_object(apdu,
+        &cov_subscription->monitoredObjectIdentifier, &value_list[0]);
+}
+
+/* Send the notification of one subscription, together with the queued
+   notifications of the other subscriptions of the same subscriber process,
+   in as few COV-Notification-Multiple requests as fit in one APDU.
+   The notifications that were not sent are queued again. */
+static void cov_send_multiple(
+    int index)
+{
+    static uint8_t Objects_Buffer[MAX_APDU];
+    uint8_t buffer[MAX_APDU];
+    int group[MAX_COV_NOTIFICATIONS_MULTIPLE];
+    unsigned group_count = 0;
+    unsigned i = 0;
+    int len = 0;
+    int objects_len = 0;
+    int header_len = 0;
+    int pdu_len = 0;
+    int prev = -1;
+    int next = -1;
+    int candidate = -1;
+    int bytes_sent = 0;
+    uint8_t invoke_id = 0;
+    uint32_t time_remaining = 0;
+    uint32_t remaining = 0;
+    bool confirmed = false;
+    BACNET_NPDU_DATA npdu_data;
+    BACNET_ADDRESS my_address;
+    BACNET_ADDRESS *dest = NULL;
+    BACNET_COV_SUBSCRIPTION *cov_subscription = &COV_Subscriptions[index];
+    BACNET_COV_MULTIPLE_DATA cov_data;
+
+    dest = cov_address_get(cov_subscription->dest_index);
+    if ((!dcc_communication_enabled()) || (!dest)) {
+        cov_send_queue_add(index);
+        return;
+    }
+    confirmed = cov_subscription->flag.issueConfirmedNotifications;
+    cov_data.subscriberProcessIdentifier =
+        cov_subscription->subscriberProcessIdentifier;
+    cov_data.initiatingDeviceIdentifier = Device_Object_Instance_Number();
+    cov_data.listOfCOVNotifications = NULL;
+    /* the largest header, since the timeRemaining is not known yet */
+    cov_data.timeRemaining = UINT32_MAX;
+    header_len = ccov_notify_multiple_encode_apdu_init(&buffer[0], 0,
+        &cov_data);
+    /* the first notification, then any others that fit */
+    len = cov_send_multiple_encode_object(&Objects_Buffer[0],
+        cov_subscription);
+    if ((len <= 0) || ((header_len + len + 1) > MAX_APDU)) {
+        cov_send_queue_add(index);
+        return;
+    }
+    objects_len = len;
+    group[group_count++] = index;
+    for (candidate = COV_Send_Head;
+        (candidate >= 0) && (group_count < MAX_COV_NOTIFICATIONS_MULTIPLE);
+        candidate = next) {
+        next = COV_Subscriptions[candidate].next_send;
+        if (cov_send_multiple_match(cov_subscription,
+                &COV_Subscriptions[candidate])) {
+            len = cov_send_multiple_encode_object(&buffer[0],
+                &COV_Subscriptions[candidate]);
+            /* leave room for the closing tag */
+            if ((len > 0) &&
+                ((header_len + objects_len + len + 1) <= MAX_APDU)) {
+                memcpy(&Objects_Buffer[objects_len], &buffer[0], len);
+                objects_len += len;
+                cov_send_queue_unlink(prev, candidate);
+                group[group_count++] = candidate;
+                continue;
+            }
+        }
+        prev = candidate;
+    }
+    /* report the soonest end of the grouped subscriptions */
+    for (i = 0; i < group_count; i++) {
+        remaining = cov_time_remaining(&COV_Subscriptions[group[i]]);
+        if (COV_Subscriptions[group[i]].lifetime &&
+            ((time_remaining == 0) || (remaining < time_remaining))) {
+            time_remaining = remaining;
+        }
+    }
+    cov_data.timeRemaining = time_remaining;
+    if (confirmed) {
+        invoke_id = tsm_next_free_invokeID();
+        if (!invoke_id) {
+            goto COV_FAILED;
+        }
+    }
+    datalink_get_my_address(&my_address);
+    npdu_encode_npdu_data(&npdu_data, confirmed, MESSAGE_PRIORITY_NORMAL);
+    pdu_len =
+        npdu_encode_pdu(&Handler_Transmit_Buffer[0], dest, &my_address,
+        &npdu_data);
+    if (confirmed) {
+        pdu_len +=
+            ccov_notify_multiple_encode_apdu_init(&Handler_Transmit_Buffer
+            [pdu_len], invoke_id, &cov_data);
+    } else {
+        pdu_len +=
+            ucov_notify_multiple_encode_apdu_init(&Handler_Transmit_Buffer
+            [pdu_len], &cov_data);
+    }
+    memcpy(&Handler_Transmit_Buffer[pdu_len], &Objects_Buffer[0],
+        objects_len);
+    pdu_len += objects_len;
+    pdu_len +=
+        cov_notify_multiple_encode_apdu_end(&Handler_Transmit_Buffer[pdu_len]);
+    if (confirmed) {
+        tsm_set_confirmed_unsegmented_transaction(invoke_id, dest, &npdu_data,
+            &Handler_Transmit_Buffer[0], (uint16_t) pdu_len);
+    }
+    bytes_sent =
+        datalink_send_pdu(dest, &npdu_data, &Handler_Transmit_Buffer[0],
+        pdu_len);
+    if (bytes_sent > 0) {
 #if PRINT_ENABLED
-                    fprintf(stderr, "COVtask: Marking...\n");
+        fprintf(stderr, "COVnotification: Sent %u in one request!\n",
+            group_count);
 #endif
-                }
-            }
-            index++;
-            if (index >= MAX_COV_SUBCRIPTIONS) {
-                index = 0;
-                cov_task_state = COV_STATE_CLEAR;
-            }
-            break;
-        case COV_STATE_CLEAR:
-            /* clear the COV flag after checking all subscriptions */
-            if ((COV_Subscriptions[index].flag.valid) &&
-                (COV_Subscriptions[index].flag.send_requested)) {
-                object_type = (BACNET_OBJECT_TYPE)
-                    COV_Subscriptions[index].monitoredObjectIdentifier.type;
-                object_instance =
-                    COV_Subscriptions[index].
-                    monitoredObjectIdentifier.instance;
-                Device_COV_Clear(object_type, object_instance);
-            }
-            index++;
-            if (index >= MAX_COV_SUBCRIPTIONS) {
-                index = 0;
-                cov_task_state = COV_STATE_FREE;
-            }
-            break;
-        case COV_STATE_FREE:
-            /* confirmed notification house keeping */
-            if ((COV_Subscriptions[index].flag.valid) &&
-                (COV_Subscriptions[index].flag.issueConfirmedNotifications) &&
-                (COV_Subscriptions[index].invokeID)) {
-                if (tsm_invoke_id_free(COV_Subscriptions[index].invokeID)) {
-                    COV_Subscriptions[index].invokeID = 0;
-                } else
-                    if (tsm_invoke_id_failed(COV_Subscriptions
-                        [index].invokeID)) {
-                    tsm_free_invoke_id(COV_Subscriptions[index].invokeID);
-                    COV_Subscriptions[index].invokeID = 0;
-                }
-            }
-            index++;
-            if (index >= MAX_COV_SUBCRIPTIONS) {
-                index = 0;
-                cov_task_state = COV_STATE_SEND;
-            }
-            break;
-        case COV_STATE_SEND:
-            /* send any COVs that are requested */
-            if ((COV_Subscriptions[index].flag.valid) &&
-                (COV_Subscriptions[index].flag.send_requested)) {
-                send = true;
-                if (COV_Subscriptions[index].flag.issueConfirmedNotifications) {
-                    if (COV_Subscriptions[index].invokeID != 0) {
-                        /* already sending */
-                        send = false;
-                    }
-                    if (!tsm_transaction_available()) {
-                        /* no transactions available - can't send now */
-                        send = false;
-                    }
-                }
-                if (send) {
-                    object_type = (BACNET_OBJECT_TYPE)
-                        COV_Subscriptions[index].
-                        monitoredObjectIdentifier.type;
-                    object_instance =
-                        COV_Subscriptions[index].
-                        monitoredObjectIdentifier.instance;
+        for (i = 0; i < group_count; i++) {
+            COV_Subscriptions[group[i]].flag.send_requested = false;
+            COV_Subscriptions[group[i]].invokeID = invoke_id;
+        }
+        if (confirmed) {
+            COV_Invoke_ID_Users[invoke_id] += group_count;
+        }
+        COV_Multiple_Frames_Saved += group_count - 1;
+        return;
+    }
+
+  COV_FAILED:
+    for (i = 0; i < group_count; i++) {
+        cov_send_queue_add(group[i]);
+    }
+}
+
+/* send the next requested notification, if it can be sent now */
+static void cov_send_next(
+    void)
+{
+    int index = 0;
+    bool status = false;
+    BACNET_OBJECT_TYPE object_type = MAX_BACNET_OBJECT_TYPE;
+    uint32_t object_instance = 0;
+    BACNET_COV_SUBSCRIPTION *cov_subscription = NULL;
+    BACNET_PROPERTY_VALUE value_list[2];
+
+    if (COV_Multiple_Enabled && COV_Multiple_Window_Remaining) {
+        /* still collecting changes for the notifications multiple */
+        return;
+    }
+    /* skip the entries of cancelled or already notified subscriptions */
+    do {
+        index = cov_send_queue_remove();
+        if (index < 0) {
+            return;
+        }
+        cov_subscription = &COV_Subscriptions[index];
+    } while ((!cov_subscription->flag.valid) ||
+        (!cov_subscription->flag.send_requested));
+    if (cov_subscription->flag.issueConfirmedNotifications) {
+        cov_invoke_id_check(cov_subscription);
+        if ((cov_subscription->invokeID != 0) ||
+            (!tsm_transaction_available())) {
+            /* already sending, or no transactions available -
+               try again later */
+            cov_send_queue_add(index);
+            return;
+        }
+    }
+    if (COV_Multiple_Enabled) {
+        cov_send_multiple(index);
+        return;
+    }
+    object_type = (BACNET_OBJECT_TYPE)
+        cov_subscription->monitoredObjectIdentifier.type;
+    object_instance = cov_subscription->monitoredObjectIdentifier.instance;
 #if PRINT_ENABLED
-                    fprintf(stderr, "COVtask: Sending...\n");
+    fprintf(stderr, "COVtask: Sending...\n");
 #endif
-                    /* configure the linked list for the two properties */
-                    value_list[0].next = &value_list[1];
-                    value_list[1].next = NULL;
-                    status = Device_Encode_Value_List(object_type,
-                        object_instance, &value_list[0]);
-                    if (status) {
-                        status =
-                            cov_send_request(&COV_Subscriptions[index],
-                            &value_list[0]);
-                    }
-                    if (status) {
-                        COV_Subscriptions[index].flag.send_requested = false;
-                    }
-                }
-            }
-            index++;
-            if (index >= MAX_COV_SUBCRIPTIONS) {
-                index = 0;
-                cov_task_state = COV_STATE_IDLE;
-            }
-            break;
-        default:
-            index = 0;
-            cov_task_state = COV_STATE_IDLE;
-            break;
+    /* configure the linked list for the two properties */
+    value_list[0].next = &value_list[1];
+    value_list[1].next = NULL;
+    status = Device_Encode_Value_List(object_type, object_instance,
+        &value_list[0]);
+    if (status) {
+        status = cov_send_request(cov_subscription, &value_list[0]);
+    }
+    if (status) {
+        cov_subscription->flag.send_requested = false;
+    } else {
+        cov_send_queue_add(index);
     }
-    return (cov_task_state == COV_STATE_IDLE);
+}
+
+/** Handler to run the COV notifications.
+ * @ingroup DSCOV
+ * Each call marks the subscriptions of all the objects that reported a
+ * change, visits one subscription for polling and house keeping, and
+ * sends at most one notification.
+ *
+ * @return true if no notifications are waiting to be sent.
+ */
+bool handler_cov_fsm(
+    void)
+{
+    cov_dirty_objects_mark();
+    cov_subscription_sweep();
+    cov_send_next();
+
+    return (COV_Send_Head < 0);
 }
 
 void handler_cov_task(
@@ -750,6 +1491,55 @@ void handler_cov_task(
     handler_cov_fsm();
 }
 
+/** Handler to configure the batching of COV notifications.
+ * @ingroup DSCOV
+ * When enabled, the queued notifications for the same subscriber process
+ * are sent together in COV-Notification-Multiple requests, as many as fit
+ * in one APDU.  Only enable it when the subscribers accept that service.
+ * Notifications are held back for the coalescing window after the first
+ * one is queued, which is counted down by handler_cov_timer_milliseconds().
+ *
+ * @param enable [in] true to send COV-Notification-Multiple requests.
+ * @param window_milliseconds [in] Coalescing window, or zero to only
+ *  combine the notifications that are already queued.
+ */
+void handler_cov_notify_multiple_set(
+    bool enable,
+    uint16_t window_milliseconds)
+{
+    COV_Multiple_Enabled = enable;
+    COV_Multiple_Window = window_milliseconds;
+    COV_Multiple_Window_Remaining = 0;
+}
+
+/** Get the number of notification frames saved by batching.
+ * @ingroup DSCOV
+ *
+ * @return The number of notifications that were sent in a
+ *  COV-Notification-Multiple request together with another one.
+ */
+uint32_t handler_cov_notify_multiple_frames_saved(
+    void)
+{
+    return COV_Multiple_Frames_Saved;
+}
+
+/** Handler to count down the COV notification coalescing window.
+ * @ingroup DSCOV
+ *
+ * @param elapsed_milliseconds [in] How many milliseconds have elapsed
+ *  since last called.
+ */
+void handler_cov_timer_milliseconds(
+    uint16_t elapsed_milliseconds)
+{
+    if (COV_Multiple_Window_Remaining > elapsed_milliseconds) {
+        COV_Multiple_Window_Remaining -= elapsed_milliseconds;
+    } else {
+        COV_Multiple_Window_Remaining = 0;
+    }
+}
+
 static bool cov_subscribe(
     BACNET_ADDRESS * src,
     BACNET_SUBSCRIBE_COV_DATA * cov_data,
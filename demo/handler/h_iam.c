@@ -67,6 +67,7 @@ void handler_i_am_add(
             src->mac[3], src->mac[4], src->mac[5]);
 #endif
         address_add(device_id, max_apdu, src);
+        address_set_device_segmentation(device_id, (uint8_t) segmentation);
     } else {
 #if PRINT_ENABLED
         fprintf(stderr, ", but unable to decode it.\n");
@@ -102,6 +103,7 @@ void handler_i_am_bind(
     if (len > 0) {
         /* only add address if requested to bind */
         address_add_binding(device_id, max_apdu, src);
+        address_set_device_segmentation(device_id, (uint8_t) segmentation);
     }
 
     return;
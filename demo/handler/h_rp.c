@@ -38,6 +38,7 @@
 #include "abort.h"
 #include "reject.h"
 #include "rp.h"
+#include "tsm.h"
 /* device object has custom handler for all objects */
 #include "device.h"
 #include "handlers.h"
@@ -53,8 +54,9 @@
  * - an Abort if
  *   - the message is segmented
  *   - if decoding fails
- *   - if the response would be too large
- * - the result from Device_Read_Property(), if it succeeds
+ *   - if the response would be too large, or need too many segments
+ * - the result from Device_Read_Property(), if it succeeds, sent
+ *   segmented if it is too large and the client accepts segmentation
  * - an Error if Device_Read_Property() fails
  *   or there isn't enough room in the APDU to fit the data.
  *
@@ -71,6 +73,8 @@ void handler_read_property(
     BACNET_CONFIRMED_SERVICE_DATA * service_data)
 {
     BACNET_READ_PROPERTY_DATA rpdata;
+    uint8_t *apdu = NULL;
+    unsigned apdu_max = 0;
     int len = 0;
     int pdu_len = 0;
     int apdu_len = -1;
@@ -116,21 +120,39 @@ void handler_read_property(
         rpdata.object_instance = Device_Object_Instance_Number();
     }
 
+    /* a large response, like the Object_List, may be sent segmented */
+    if (service_data->segmented_response_accepted) {
+        apdu = tsm_segmented_response_buffer(&apdu_max);
+    }
+    if (!apdu) {
+        apdu = &Handler_Transmit_Buffer[npdu_len];
+        apdu_max = sizeof(Handler_Transmit_Buffer) - npdu_len;
+    }
     apdu_len =
-        rp_ack_encode_apdu_init(&Handler_Transmit_Buffer[npdu_len],
-        service_data->invoke_id, &rpdata);
+        rp_ack_encode_apdu_init(apdu, service_data->invoke_id, &rpdata);
     /* configure our storage */
-    rpdata.application_data = &Handler_Transmit_Buffer[npdu_len + apdu_len];
-    rpdata.application_data_len =
-        sizeof(Handler_Transmit_Buffer) - (npdu_len + apdu_len);
+    rpdata.application_data = &apdu[apdu_len];
+    rpdata.application_data_len = apdu_max - apdu_len;
     len = Device_Read_Property(&rpdata);
     if (len >= 0) {
         apdu_len += len;
-        len =
-            rp_ack_encode_apdu_object_property_end(&Handler_Transmit_Buffer
-            [npdu_len + apdu_len]);
+        len = rp_ack_encode_apdu_object_property_end(&apdu[apdu_len]);
         apdu_len += len;
-        if (apdu_len > service_data->max_resp) {
+        if ((apdu != &Handler_Transmit_Buffer[npdu_len]) &&
+            ((apdu_len > service_data->max_resp) || (apdu_len > MAX_APDU))) {
+            if (tsm_set_segmented_response(src, &npdu_data, service_data,
+                    apdu, apdu_len)) {
+#if PRINT_ENABLED
+                fprintf(stderr, "RP: Sending Segmented Ack!\n");
+#endif
+                return;
+            }
+            rpdata.error_code = ERROR_CODE_ABORT_BUFFER_OVERFLOW;
+            len = BACNET_STATUS_ABORT;
+#if PRINT_ENABLED
+            fprintf(stderr, "RP: Message needs too many segments.\n");
+#endif
+        } else if (apdu_len > service_data->max_resp) {
             /* too big for the sender - send an abort
              * Setting of error code needed here as read property processing may
              * have overriden the default set at start */
@@ -143,6 +165,9 @@ void handler_read_property(
 #if PRINT_ENABLED
             fprintf(stderr, "RP: Sending Ack!\n");
 #endif
+            if (apdu != &Handler_Transmit_Buffer[npdu_len]) {
+                memmove(&Handler_Transmit_Buffer[npdu_len], apdu, apdu_len);
+            }
             error = false;
         }
     } else {
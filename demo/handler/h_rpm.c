@@ -40,6 +40,7 @@
 #include "reject.h"
 #include "bacerror.h"
 #include "rpm.h"
+#include "tsm.h"
 #include "handlers.h"
 /* device object has custom handler for all objects */
 #include "device.h"
@@ -105,8 +106,8 @@ static unsigned RPM_Object_Property_Count(
    or 0 if there is no room to fit the encoding.  */
 static int RPM_Encode_Property(
     uint8_t * apdu,
-    uint16_t offset,
-    uint16_t max_apdu,
+    unsigned offset,
+    unsigned max_apdu,
     BACNET_RPM_DATA * rpmdata)
 {
     int len = 0;
@@ -130,8 +131,14 @@ static int RPM_Encode_Property(
     rpdata.object_instance = rpmdata->object_instance;
     rpdata.object_property = rpmdata->object_property;
     rpdata.array_index = rpmdata->array_index;
-    rpdata.application_data = &Temp_Buf[0];
-    rpdata.application_data_len = sizeof(Temp_Buf);
+    /* read the value in place, after the opening tag, so that
+       large values like the Object_List are not limited to Temp_Buf */
+    if ((offset + apdu_len + 2) >= max_apdu) {
+        rpmdata->error_code = ERROR_CODE_ABORT_SEGMENTATION_NOT_SUPPORTED;
+        return BACNET_STATUS_ABORT;
+    }
+    rpdata.application_data = &apdu[offset + apdu_len + 1];
+    rpdata.application_data_len = max_apdu - (offset + apdu_len + 2);
     len = Device_Read_Property(&rpdata);
     if (len < 0) {
         if ((len == BACNET_STATUS_ABORT) || (len == BACNET_STATUS_REJECT)) {
@@ -154,7 +161,7 @@ static int RPM_Encode_Property(
         /* enough room to fit the property value and tags */
         len =
             rpm_ack_encode_apdu_object_property_value(&apdu[offset + apdu_len],
-            &Temp_Buf[0], len);
+            rpdata.application_data, len);
     } else {
         /* not enough room - abort! */
         rpmdata->error_code = ERROR_CODE_ABORT_SEGMENTATION_NOT_SUPPORTED;
@@ -173,8 +180,9 @@ static int RPM_Encode_Property(
  * - an Abort if
  *   - the message is segmented
  *   - if decoding fails
- *   - if the response would be too large
- * - the result from each included read request, if it succeeds
+ *   - if the response would be too large, or need too many segments
+ * - the result from each included read request, if it succeeds, sent
+ *   segmented if it is too large and the client accepts segmentation
  * - an Error if processing fails for all, or individual errors if only some fail,
  *   or there isn't enough room in the APDU to fit the data.
  *
@@ -198,6 +206,8 @@ void handler_read_property_multiple(
     int bytes_sent;
     BACNET_ADDRESS my_address;
     BACNET_RPM_DATA rpmdata;
+    uint8_t *apdu = NULL;
+    unsigned apdu_max = 0;
     int apdu_len = 0;
     int npdu_len = 0;
     int error = 0;
@@ -218,11 +228,17 @@ void handler_read_property_multiple(
 #endif
         goto RPM_FAILURE;
     }
+    /* a large response may be sent segmented */
+    if (service_data->segmented_response_accepted) {
+        apdu = tsm_segmented_response_buffer(&apdu_max);
+    }
+    if (!apdu) {
+        apdu = &Handler_Transmit_Buffer[npdu_len];
+        apdu_max = MAX_APDU;
+    }
     /* decode apdu request & encode apdu reply
        encode complex ack, invoke id, service choice */
-    apdu_len =
-        rpm_ack_encode_apdu_init(&Handler_Transmit_Buffer[npdu_len],
-        service_data->invoke_id);
+    apdu_len = rpm_ack_encode_apdu_init(apdu, service_data->invoke_id);
     for (;;) {
         /* Start by looking for an object ID */
         len =
@@ -249,8 +265,7 @@ void handler_read_property_multiple(
         /* Stick this object id into the reply - if it will fit */
         len = rpm_ack_encode_apdu_object_begin(&Temp_Buf[0], &rpmdata);
         copy_len =
-            memcopy(&Handler_Transmit_Buffer[npdu_len], &Temp_Buf[0], apdu_len,
-            len, MAX_APDU);
+            memcopy(apdu, &Temp_Buf[0], apdu_len, len, apdu_max);
         if (copy_len == 0) {
 #if PRINT_ENABLED
             fprintf(stderr, "RPM: Response too big!\r\n");
@@ -292,8 +307,8 @@ void handler_read_property_multiple(
                         rpm_ack_encode_apdu_object_property(&Temp_Buf[0],
                         rpmdata.object_property, rpmdata.array_index);
                     copy_len =
-                        memcopy(&Handler_Transmit_Buffer[npdu_len],
-                        &Temp_Buf[0], apdu_len, len, MAX_APDU);
+                        memcopy(apdu, &Temp_Buf[0], apdu_len, len,
+                        apdu_max);
                     if (copy_len == 0) {
 #if PRINT_ENABLED
                         fprintf(stderr,
@@ -310,8 +325,8 @@ void handler_read_property_multiple(
                         ERROR_CLASS_PROPERTY,
                         ERROR_CODE_PROPERTY_IS_NOT_AN_ARRAY);
                     copy_len =
-                        memcopy(&Handler_Transmit_Buffer[npdu_len],
-                        &Temp_Buf[0], apdu_len, len, MAX_APDU);
+                        memcopy(apdu, &Temp_Buf[0], apdu_len, len,
+                        apdu_max);
                     if (copy_len == 0) {
 #if PRINT_ENABLED
                         fprintf(stderr, "RPM: Too full to encode error!\r\n");
@@ -342,9 +357,8 @@ void handler_read_property_multiple(
                                 RPM_Object_Property(&property_list,
                                 special_object_property, index);
                             len =
-                                RPM_Encode_Property(&Handler_Transmit_Buffer
-                                [npdu_len], (uint16_t) apdu_len, MAX_APDU,
-                                &rpmdata);
+                                RPM_Encode_Property(apdu, (unsigned) apdu_len,
+                                apdu_max, &rpmdata);
                             if (len > 0) {
                                 apdu_len += len;
                             } else {
@@ -361,8 +375,8 @@ void handler_read_property_multiple(
             } else {
                 /* handle an individual property */
                 len =
-                    RPM_Encode_Property(&Handler_Transmit_Buffer[npdu_len],
-                    (uint16_t) apdu_len, MAX_APDU, &rpmdata);
+                    RPM_Encode_Property(apdu, (unsigned) apdu_len, apdu_max,
+                    &rpmdata);
                 if (len > 0) {
                     apdu_len += len;
                 } else {
@@ -379,8 +393,7 @@ void handler_read_property_multiple(
                 decode_len++;
                 len = rpm_ack_encode_apdu_object_end(&Temp_Buf[0]);
                 copy_len =
-                    memcopy(&Handler_Transmit_Buffer[npdu_len], &Temp_Buf[0],
-                    apdu_len, len, MAX_APDU);
+                    memcopy(apdu, &Temp_Buf[0], apdu_len, len, apdu_max);
                 if (copy_len == 0) {
 #if PRINT_ENABLED
                     fprintf(stderr, "RPM: Too full to encode object end!\r\n");
@@ -401,6 +414,22 @@ void handler_read_property_multiple(
         }
     }
 
+    if ((apdu != &Handler_Transmit_Buffer[npdu_len]) &&
+        ((apdu_len > service_data->max_resp) || (apdu_len > MAX_APDU))) {
+        if (tsm_set_segmented_response(src, &npdu_data, service_data, apdu,
+                apdu_len)) {
+#if PRINT_ENABLED
+            fprintf(stderr, "RPM: Sending Segmented Ack!\n");
+#endif
+            return;
+        }
+        rpmdata.error_code = ERROR_CODE_ABORT_BUFFER_OVERFLOW;
+        error = BACNET_STATUS_ABORT;
+#if PRINT_ENABLED
+        fprintf(stderr, "RPM: Message needs too many segments.\n");
+#endif
+        goto RPM_FAILURE;
+    }
     if (apdu_len > service_data->max_resp) {
         /* too big for the sender - send an abort */
         rpmdata.error_code = ERROR_CODE_ABORT_SEGMENTATION_NOT_SUPPORTED;
@@ -410,6 +439,9 @@ void handler_read_property_multiple(
 #endif
         goto RPM_FAILURE;
     }
+    if (apdu != &Handler_Transmit_Buffer[npdu_len]) {
+        memmove(&Handler_Transmit_Buffer[npdu_len], apdu, apdu_len);
+    }
 
   RPM_FAILURE:
     if (error) {
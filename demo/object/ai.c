@@ -45,6 +45,7 @@
 #include "timestamp.h"
 #include "ai.h"
 #include "ucix.h"
+#include "keylist.h"
 
 #ifndef MAX_ANALOG_INPUTS
 #define MAX_ANALOG_INPUTS 1024
@@ -61,6 +62,8 @@ unsigned max_analog_inputs_int = 0;
 #define ANALOG_LEVEL_NULL 255
 
 ANALOG_INPUT_DESCR AI_Descr[MAX_ANALOG_INPUTS];
+/* sorted instance number index into AI_Descr[] */
+static OS_Keylist AI_Instance_List;
 
 /* These three arrays are used by the ReadPropertyMultiple handler */
 static const int Analog_Input_Properties_Required[] = {
@@ -423,6 +426,7 @@ void Analog_Input_Init(
                 max_analog_inputs_int = i;
             }
         }
+        Analog_Input_Instance_Index_Build();
 #if PRINT_ENABLED
         fprintf(stderr, "max_analog_inputs %i\n", max_analog_inputs_int);
 #endif
@@ -432,23 +436,36 @@ void Analog_Input_Init(
     return;
 }
 
-/* we simply have 0-n object instances.  Yours might be */
-/* more complex, and then you need to return the index */
-/* that correlates to the correct instance number */
+/* (re)builds the sorted instance number index of AI_Descr[] */
+/* call whenever the table was loaded or changed */
+void Analog_Input_Instance_Index_Build(
+    void)
+{
+    unsigned i;
+
+    if (!AI_Instance_List) {
+        AI_Instance_List = Keylist_Create();
+    }
+    while (Keylist_Count(AI_Instance_List) > 0) {
+        (void) Keylist_Data_Pop(AI_Instance_List);
+    }
+    for (i = 0; i < max_analog_inputs_int; i++) {
+        (void) Keylist_Data_Add(AI_Instance_List, AI_Descr[i].Instance,
+            &AI_Descr[i]);
+    }
+}
+
+/* binary search of the instance index for the AI_Descr[] offset */
 unsigned Analog_Input_Instance_To_Index(
     uint32_t object_instance)
 {
     ANALOG_INPUT_DESCR *CurrentAI;
-    int index,i;
-    //int instance;
-    index = max_analog_inputs_int;
-    for (i = 0; i < index; i++) {
-    	CurrentAI = &AI_Descr[i];
-    	//instance = CurrentAI->Instance;
-    	if (CurrentAI->Instance == object_instance) {
-    		return i;
-    	}
+
+    CurrentAI = Keylist_Data(AI_Instance_List, object_instance);
+    if (CurrentAI) {
+        return (unsigned) (CurrentAI - AI_Descr);
     }
+
     return MAX_ANALOG_INPUTS;
 }
 
@@ -516,6 +533,7 @@ static void Analog_Input_COV_Detect(uint32_t object_instance,
         }
         if (cov_delta >= cov_increment) {
             CurrentAI->Changed = true;
+            handler_cov_object_changed(OBJECT_ANALOG_INPUT, object_instance);
             CurrentAI->Prior_Value = value;
         }
     }
@@ -852,16 +870,9 @@ static bool Analog_Input_Description_Write(
                 } else {
                     sprintf(idx_cc,"%d",CurrentAI->Instance);
                     idx_c = idx_cc;
-                    if(ctx) {
-                        ucix_add_option(ctx, "bacnet_ai", idx_c,
-                            "description", char_string->value);
-                        ucix_commit(ctx, "bacnet_ai");
-#if PRINT_ENABLED
-                    } else {
-                        fprintf(stderr,
-                            "Failed to open config file bacnet_ai\n");
-#endif
-                    }
+                    ucix_wb_add_option("bacnet_ai", idx_c,
+                        "description", char_string->value);
+                    ucix_wb_commit("bacnet_ai");
                 }
             } else {
                 *error_class = ERROR_CLASS_PROPERTY;
@@ -922,18 +933,13 @@ static bool Analog_Input_Object_Name_Write(
                     *error_class = ERROR_CLASS_PROPERTY;
                     *error_code = ERROR_CODE_VALUE_OUT_OF_RANGE;
                 } else {
+                    Device_Object_Name_Changed(OBJECT_ANALOG_INPUT,
+                        object_instance);
                     sprintf(idx_cc,"%d",CurrentAI->Instance);
                     idx_c = idx_cc;
-                    if(ctx) {
-                        ucix_add_option(ctx, "bacnet_ai", idx_c,
-                            "name", char_string->value);
-                        ucix_commit(ctx, "bacnet_ai");
-#if PRINT_ENABLED
-                    } else {
-                        fprintf(stderr,
-                            "Failed to open config file bacnet_ai\n");
-#endif
-                    }
+                    ucix_wb_add_option("bacnet_ai", idx_c,
+                        "name", char_string->value);
+                    ucix_wb_commit("bacnet_ai");
                 }
             } else {
                 *error_class = ERROR_CLASS_PROPERTY;
@@ -1271,7 +1277,6 @@ bool Analog_Input_Write_Property(
     uint8_t level = ANALOG_LEVEL_NULL;
     int len = 0;
     BACNET_APPLICATION_DATA_VALUE value;
-    ctx = ucix_init("bacnet_ai");
     const char *idx_c;
     char cur_value[16];
     float pvalue;
@@ -1355,14 +1360,14 @@ bool Analog_Input_Write_Property(
                         value.type.Real, wp_data->priority)) {
                     status = true;
                     sprintf(cur_value,"%f",value.type.Real);
-                    ucix_add_option(ctx, "bacnet_ai", idx_c, "value",
+                    ucix_wb_add_option("bacnet_ai", idx_c, "value",
                         cur_value);
                     cur_value_time = time(NULL);
-                    ucix_add_option_int(ctx, "bacnet_ai", idx_c, "value_time",
+                    ucix_wb_add_option_int("bacnet_ai", idx_c, "value_time",
                         cur_value_time);
-                    ucix_add_option_int(ctx, "bacnet_ai", idx_c, "write",
+                    ucix_wb_add_option_int("bacnet_ai", idx_c, "write",
                         1);
-                    ucix_save_state(ctx, "bacnet_ai");
+                    ucix_wb_save_state("bacnet_ai");
                 } else if (wp_data->priority == 6) {
                     /* Command priority 6 is reserved for use by Minimum On/Off
                        algorithm and may not be used for other purposes in any
@@ -1397,14 +1402,14 @@ bool Analog_Input_Write_Property(
                             }
                         }
                         sprintf(cur_value,"%f",pvalue);
-                        ucix_add_option(ctx, "bacnet_ai", idx_c, "value",
+                        ucix_wb_add_option("bacnet_ai", idx_c, "value",
                             cur_value);
                         cur_value_time = time(NULL);
-                        ucix_add_option_int(ctx, "bacnet_ai", idx_c, "value_time",
+                        ucix_wb_add_option_int("bacnet_ai", idx_c, "value_time",
                             cur_value_time);
-                        ucix_add_option_int(ctx, "bacnet_ai", idx_c, "write",
+                        ucix_wb_add_option_int("bacnet_ai", idx_c, "write",
                             1);
-                        ucix_save_state(ctx, "bacnet_ai");
+                        ucix_wb_save_state("bacnet_ai");
                     } else {
                         status = false;
                         wp_data->error_class = ERROR_CLASS_PROPERTY;
@@ -1474,9 +1479,9 @@ bool Analog_Input_Write_Property(
 
             if (status) {
                 CurrentAI->Max_Pres_Value = value.type.Real;
-                ucix_add_option_int(ctx, "bacnet_ai", idx_c, "max_value",
+                ucix_wb_add_option_int("bacnet_ai", idx_c, "max_value",
                         value.type.Real);
-                ucix_commit(ctx, "bacnet_ai");
+                ucix_wb_commit("bacnet_ai");
             }
             break;
 
@@ -1487,9 +1492,9 @@ bool Analog_Input_Write_Property(
 
             if (status) {
                 CurrentAI->Min_Pres_Value = value.type.Real;
-                ucix_add_option_int(ctx, "bacnet_ai", idx_c, "min_value",
+                ucix_wb_add_option_int("bacnet_ai", idx_c, "min_value",
                         value.type.Real);
-                ucix_commit(ctx, "bacnet_ai");
+                ucix_wb_commit("bacnet_ai");
             }
             break;
 
@@ -1502,9 +1507,9 @@ bool Analog_Input_Write_Property(
             if (status) {
                 CurrentAI->Time_Delay = value.type.Unsigned_Int;
                 CurrentAI->Remaining_Time_Delay = CurrentAI->Time_Delay;
-                ucix_add_option_int(ctx, "bacnet_ai", idx_c, "time_delay",
+                ucix_wb_add_option_int("bacnet_ai", idx_c, "time_delay",
                     value.type.Unsigned_Int);
-                ucix_commit(ctx, "bacnet_ai");
+                ucix_wb_commit("bacnet_ai");
             }
             break;
 
@@ -1515,9 +1520,9 @@ bool Analog_Input_Write_Property(
 
             if (status) {
                 CurrentAI->Notification_Class = value.type.Unsigned_Int;
-                ucix_add_option_int(ctx, "bacnet_ai", idx_c, "nc",
+                ucix_wb_add_option_int("bacnet_ai", idx_c, "nc",
                     value.type.Unsigned_Int);
-                ucix_commit(ctx, "bacnet_ai");
+                ucix_wb_commit("bacnet_ai");
             }
             break;
 
@@ -1528,9 +1533,9 @@ bool Analog_Input_Write_Property(
 
             if (status) {
                 CurrentAI->High_Limit = value.type.Real;
-                ucix_add_option_int(ctx, "bacnet_ai", idx_c, "high_limit",
+                ucix_wb_add_option_int("bacnet_ai", idx_c, "high_limit",
                         value.type.Real);
-                ucix_commit(ctx, "bacnet_ai");
+                ucix_wb_commit("bacnet_ai");
             }
             break;
 
@@ -1541,9 +1546,9 @@ bool Analog_Input_Write_Property(
 
             if (status) {
                 CurrentAI->Low_Limit = value.type.Real;
-                ucix_add_option_int(ctx, "bacnet_ai", idx_c, "low_limit",
+                ucix_wb_add_option_int("bacnet_ai", idx_c, "low_limit",
                         value.type.Real);
-                ucix_commit(ctx, "bacnet_ai");
+                ucix_wb_commit("bacnet_ai");
             }
             break;
 
@@ -1554,9 +1559,9 @@ bool Analog_Input_Write_Property(
 
             if (status) {
                 CurrentAI->Deadband = value.type.Real;
-                ucix_add_option_int(ctx, "bacnet_ai", idx_c, "dead_limit",
+                ucix_wb_add_option_int("bacnet_ai", idx_c, "dead_limit",
                         value.type.Real);
-                ucix_commit(ctx, "bacnet_ai");
+                ucix_wb_commit("bacnet_ai");
             }
             break;
 
@@ -1568,9 +1573,9 @@ bool Analog_Input_Write_Property(
             if (status) {
                 if (value.type.Bit_String.bits_used == 2) {
                     CurrentAI->Limit_Enable = value.type.Bit_String.value[0];
-                    ucix_add_option_int(ctx, "bacnet_ai", idx_c, "limit",
+                    ucix_wb_add_option_int("bacnet_ai", idx_c, "limit",
                         value.type.Bit_String.value[0]);
-                    ucix_commit(ctx, "bacnet_ai");
+                    ucix_wb_commit("bacnet_ai");
                 } else {
                     wp_data->error_class = ERROR_CLASS_PROPERTY;
                     wp_data->error_code = ERROR_CODE_VALUE_OUT_OF_RANGE;
@@ -1587,9 +1592,9 @@ bool Analog_Input_Write_Property(
             if (status) {
                 if (value.type.Bit_String.bits_used == 3) {
                     CurrentAI->Event_Enable = value.type.Bit_String.value[0];
-                    ucix_add_option_int(ctx, "bacnet_ai", idx_c, "event",
+                    ucix_wb_add_option_int("bacnet_ai", idx_c, "event",
                         value.type.Bit_String.value[0]);
-                    ucix_commit(ctx, "bacnet_ai");
+                    ucix_wb_commit("bacnet_ai");
                 } else {
                     wp_data->error_class = ERROR_CLASS_PROPERTY;
                     wp_data->error_code = ERROR_CODE_VALUE_OUT_OF_RANGE;
@@ -1640,7 +1645,6 @@ bool Analog_Input_Write_Property(
             wp_data->error_code = ERROR_CODE_UNKNOWN_PROPERTY;
             break;
     }
-    ucix_cleanup(ctx);
     return status;
 }
 
@@ -2238,4 +2242,73 @@ int main(
     return 0;
 }
 #endif /* TEST_ANALOG_INPUT */
+
+#ifdef BENCH_ANALOG_INPUT
+#include <time.h>
+
+/* the benchmark is linked without the device object */
+bool Device_Valid_Object_Name(
+    BACNET_CHARACTER_STRING * object_name,
+    int *object_type,
+    uint32_t * object_instance)
+{
+    (void) object_name;
+    (void) object_type;
+    (void) object_instance;
+
+    return false;
+}
+
+void Device_Object_Name_Changed(
+    int object_type,
+    uint32_t object_instance)
+{
+    (void) object_type;
+    (void) object_instance;
+}
+
+/* ReadProperty latency of Present_Value against the number of objects */
+int main(
+    void)
+{
+    uint8_t apdu[MAX_APDU] = { 0 };
+    BACNET_READ_PROPERTY_DATA rpdata;
+    struct timespec start, stop;
+    const unsigned loops = 1000000;
+    unsigned count, i, j;
+    double ns;
+
+    rpdata.application_data = &apdu[0];
+    rpdata.application_data_len = sizeof(apdu);
+    rpdata.object_type = OBJECT_ANALOG_INPUT;
+    rpdata.object_property = PROP_PRESENT_VALUE;
+    rpdata.array_index = BACNET_ARRAY_ALL;
+    printf("objects  ns/ReadProperty\n");
+    for (count = 16; count <= MAX_ANALOG_INPUTS; count *= 2) {
+        /* fill the table directly, no uci config is needed */
+        memset(AI_Descr, 0, sizeof(AI_Descr));
+        for (i = 0; i < count; i++) {
+            /* the uci section list is loaded in reverse order */
+            AI_Descr[i].Instance = count - i;
+            for (j = 0; j < BACNET_MAX_PRIORITY; j++) {
+                AI_Descr[i].Priority_Array[j] = ANALOG_LEVEL_NULL;
+            }
+            AI_Descr[i].Priority_Array[15] = (float) i;
+        }
+        max_analog_inputs_int = count;
+        Analog_Input_Instance_Index_Build();
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for (i = 0; i < loops; i++) {
+            rpdata.object_instance = AI_Descr[i % count].Instance;
+            (void) Analog_Input_Read_Property(&rpdata);
+        }
+        clock_gettime(CLOCK_MONOTONIC, &stop);
+        ns = (double) (stop.tv_sec - start.tv_sec) * 1.0e9 +
+            (double) (stop.tv_nsec - start.tv_nsec);
+        printf("%7u  %15.1f\n", count, ns / loops);
+    }
+
+    return 0;
+}
+#endif /* BENCH_ANALOG_INPUT */
 #endif /* TEST */
@@ -119,6 +119,9 @@ struct ai_inst_itr_ctx {
     unsigned Analog_Input_Instance_To_Index(
         uint32_t object_instance);
 
+    void Analog_Input_Instance_Index_Build(
+        void);
+
     int Analog_Input_Read_Property(
         BACNET_READ_PROPERTY_DATA * rpdata);
 
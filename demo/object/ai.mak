@@ -17,6 +17,7 @@ SRCS = ai.c \
 	$(SRC_DIR)/bactext.c \
 	$(SRC_DIR)/indtext.c \
 	$(SRC_DIR)/datetime.c \
+	$(SRC_DIR)/keylist.c \
 	$(TEST_DIR)/ctest.c
 
 TARGET = analog_input
@@ -0,0 +1,52 @@
+#Makefile to build the Analog Input ReadProperty benchmark
+# Usage: make -f ai_bench.mak [MAX_ANALOG_INPUTS=8192]
+CC      = gcc
+SRC_DIR = ../../src
+TEST_DIR = ../../test
+HANDLER_DIR = ../handler
+UCI_LIB_DIR ?= /usr/local/lib
+UCI_INCLUDE_DIR ?= /usr/local/include
+MAX_ANALOG_INPUTS ?= 1024
+INCLUDES = -I../../include -I$(TEST_DIR) -I. -I$(HANDLER_DIR) \
+	-I$(UCI_INCLUDE_DIR)
+DEFINES = -DBIG_ENDIAN=0 -DBACDL_ALL -DTEST -DBENCH_ANALOG_INPUT \
+	-DMAX_ANALOG_INPUTS=$(MAX_ANALOG_INPUTS)
+
+CFLAGS  = -Wall $(INCLUDES) $(DEFINES) -O2
+LFLAGS  = -L$(UCI_LIB_DIR) -luci -lubox
+
+SRCS = ai.c \
+	$(SRC_DIR)/bacdcode.c \
+	$(SRC_DIR)/bacint.c \
+	$(SRC_DIR)/bacstr.c \
+	$(SRC_DIR)/bacreal.c \
+	$(SRC_DIR)/bacapp.c \
+	$(SRC_DIR)/bacdevobjpropref.c \
+	$(SRC_DIR)/bactext.c \
+	$(SRC_DIR)/indtext.c \
+	$(SRC_DIR)/datetime.c \
+	$(SRC_DIR)/keylist.c \
+	$(SRC_DIR)/lighting.c \
+	$(SRC_DIR)/ucix.c \
+	$(TEST_DIR)/ctest.c
+
+TARGET = analog_input_bench
+
+all: ${TARGET}
+
+OBJS = ${SRCS:.c=.o}
+
+${TARGET}: ${OBJS}
+	${CC} -o $@ ${OBJS} ${LFLAGS}
+
+.c.o:
+	${CC} -c ${CFLAGS} $*.c -o $@
+
+depend:
+	rm -f .depend
+	${CC} -MM ${CFLAGS} *.c >> .depend
+
+clean:
+	rm -rf core ${TARGET} $(OBJS)
+
+include: .depend
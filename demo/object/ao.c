@@ -45,6 +45,7 @@
 #include "timestamp.h"
 #include "ao.h"
 #include "ucix.h"
+#include "keylist.h"
 
 /* number of demo objects */
 #ifndef MAX_ANALOG_OUTPUTS
@@ -62,6 +63,8 @@ unsigned max_analog_outputs_int = 0;
 #define ANALOG_LEVEL_NULL 255
 
 ANALOG_OUTPUT_DESCR AO_Descr[MAX_ANALOG_OUTPUTS];
+/* sorted instance number index into AO_Descr[] */
+static OS_Keylist AO_Instance_List;
 
 /* These three arrays are used by the ReadPropertyMultiple handler */
 static const int Analog_Output_Properties_Required[] = {
@@ -425,6 +428,7 @@ void Analog_Output_Init(
                 max_analog_outputs_int = i;
             }
         }
+        Analog_Output_Instance_Index_Build();
 #if PRINT_ENABLED
         fprintf(stderr, "max_analog_outputs %i\n", max_analog_outputs_int);
 #endif
@@ -434,23 +438,36 @@ void Analog_Output_Init(
     return;
 }
 
-/* we simply have 0-n object instances.  Yours might be */
-/* more complex, and then you need to return the index */
-/* that correlates to the correct instance number */
+/* (re)builds the sorted instance number index of AO_Descr[] */
+/* call whenever the table was loaded or changed */
+void Analog_Output_Instance_Index_Build(
+    void)
+{
+    unsigned i;
+
+    if (!AO_Instance_List) {
+        AO_Instance_List = Keylist_Create();
+    }
+    while (Keylist_Count(AO_Instance_List) > 0) {
+        (void) Keylist_Data_Pop(AO_Instance_List);
+    }
+    for (i = 0; i < max_analog_outputs_int; i++) {
+        (void) Keylist_Data_Add(AO_Instance_List, AO_Descr[i].Instance,
+            &AO_Descr[i]);
+    }
+}
+
+/* binary search of the instance index for the AO_Descr[] offset */
 unsigned Analog_Output_Instance_To_Index(
     uint32_t object_instance)
 {
     ANALOG_OUTPUT_DESCR *CurrentAO;
-    int index,i;
-    //int instance;
-    index = max_analog_outputs_int;
-    for (i = 0; i < index; i++) {
-    	CurrentAO = &AO_Descr[i];
-    	//instance = CurrentAO->Instance;
-    	if (CurrentAO->Instance == object_instance) {
-    		return i;
-    	}
+
+    CurrentAO = Keylist_Data(AO_Instance_List, object_instance);
+    if (CurrentAO) {
+        return (unsigned) (CurrentAO - AO_Descr);
     }
+
     return MAX_ANALOG_OUTPUTS;
 }
 
@@ -518,6 +535,7 @@ static void Analog_Output_COV_Detect(uint32_t object_instance,
         }
         if (cov_delta >= cov_increment) {
             CurrentAO->Changed = true;
+            handler_cov_object_changed(OBJECT_ANALOG_OUTPUT, object_instance);
             CurrentAO->Prior_Value = value;
         }
     }
@@ -882,16 +900,9 @@ static bool Analog_Output_Description_Write(
                 } else {
                     sprintf(idx_cc,"%d",CurrentAO->Instance);
                     idx_c = idx_cc;
-                    if(ctx) {
-                        ucix_add_option(ctx, "bacnet_ao", idx_c,
-                            "description", char_string->value);
-                        ucix_commit(ctx, "bacnet_ao");
-#if PRINT_ENABLED
-                    } else {
-                        fprintf(stderr,
-                            "Failed to open config file bacnet_ao\n");
-#endif
-                    }
+                    ucix_wb_add_option("bacnet_ao", idx_c,
+                        "description", char_string->value);
+                    ucix_wb_commit("bacnet_ao");
                 }
             } else {
                 *error_class = ERROR_CLASS_PROPERTY;
@@ -952,18 +963,13 @@ static bool Analog_Output_Object_Name_Write(
                     *error_class = ERROR_CLASS_PROPERTY;
                     *error_code = ERROR_CODE_VALUE_OUT_OF_RANGE;
                 } else {
+                    Device_Object_Name_Changed(OBJECT_ANALOG_OUTPUT,
+                        object_instance);
                     sprintf(idx_cc,"%d",CurrentAO->Instance);
                     idx_c = idx_cc;
-                    if(ctx) {
-                        ucix_add_option(ctx, "bacnet_ao", idx_c,
-                            "name", char_string->value);
-                        ucix_commit(ctx, "bacnet_ao");
-#if PRINT_ENABLED
-                    } else {
-                        fprintf(stderr,
-                            "Failed to open config file bacnet_ao\n");
-#endif
-                    }
+                    ucix_wb_add_option("bacnet_ao", idx_c,
+                        "name", char_string->value);
+                    ucix_wb_commit("bacnet_ao");
                 }
             } else {
                 *error_class = ERROR_CLASS_PROPERTY;
@@ -1300,7 +1306,6 @@ bool Analog_Output_Write_Property(
     uint8_t level = ANALOG_LEVEL_NULL;
     int len = 0;
     BACNET_APPLICATION_DATA_VALUE value;
-    ctx = ucix_init("bacnet_ao");
     const char *idx_c;
     char cur_value[16];
     float pvalue;
@@ -1384,14 +1389,14 @@ bool Analog_Output_Write_Property(
                         value.type.Real, wp_data->priority)) {
                     status = true;
                     sprintf(cur_value,"%f",value.type.Real);
-                    ucix_add_option(ctx, "bacnet_ao", idx_c, "value",
+                    ucix_wb_add_option("bacnet_ao", idx_c, "value",
                         cur_value);
                     cur_value_time = time(NULL);
-                    ucix_add_option_int(ctx, "bacnet_ao", idx_c, "value_time",
+                    ucix_wb_add_option_int("bacnet_ao", idx_c, "value_time",
                         cur_value_time);
-                    ucix_add_option_int(ctx, "bacnet_ao", idx_c, "write",
+                    ucix_wb_add_option_int("bacnet_ao", idx_c, "write",
                         1);
-                    ucix_save_state(ctx, "bacnet_ao");
+                    ucix_wb_save_state("bacnet_ao");
                 } else if (wp_data->priority == 6) {
                     /* Command priority 6 is reserved for use by Minimum On/Off
                        algorithm and may not be used for other purposes in any
@@ -1426,14 +1431,14 @@ bool Analog_Output_Write_Property(
                             }
                         }
                         sprintf(cur_value,"%f",pvalue);
-                        ucix_add_option(ctx, "bacnet_ao", idx_c, "value",
+                        ucix_wb_add_option("bacnet_ao", idx_c, "value",
                             cur_value);
                         cur_value_time = time(NULL);
-                        ucix_add_option_int(ctx, "bacnet_ao", idx_c, "value_time",
+                        ucix_wb_add_option_int("bacnet_ao", idx_c, "value_time",
                             cur_value_time);
-                        ucix_add_option_int(ctx, "bacnet_ao", idx_c, "write",
+                        ucix_wb_add_option_int("bacnet_ao", idx_c, "write",
                             1);
-                        ucix_save_state(ctx, "bacnet_ao");
+                        ucix_wb_save_state("bacnet_ao");
                     } else {
                         status = false;
                         wp_data->error_class = ERROR_CLASS_PROPERTY;
@@ -1503,9 +1508,9 @@ bool Analog_Output_Write_Property(
 
             if (status) {
                 CurrentAO->Max_Pres_Value = value.type.Real;
-                ucix_add_option_int(ctx, "bacnet_ao", idx_c, "max_value",
+                ucix_wb_add_option_int("bacnet_ao", idx_c, "max_value",
                         value.type.Real);
-                ucix_commit(ctx, "bacnet_ao");
+                ucix_wb_commit("bacnet_ao");
             }
             break;
 
@@ -1516,9 +1521,9 @@ bool Analog_Output_Write_Property(
 
             if (status) {
                 CurrentAO->Min_Pres_Value = value.type.Real;
-                ucix_add_option_int(ctx, "bacnet_ao", idx_c, "min_value",
+                ucix_wb_add_option_int("bacnet_ao", idx_c, "min_value",
                         value.type.Real);
-                ucix_commit(ctx, "bacnet_ao");
+                ucix_wb_commit("bacnet_ao");
             }
             break;
 
@@ -1531,9 +1536,9 @@ bool Analog_Output_Write_Property(
             if (status) {
                 CurrentAO->Time_Delay = value.type.Unsigned_Int;
                 CurrentAO->Remaining_Time_Delay = CurrentAO->Time_Delay;
-                ucix_add_option_int(ctx, "bacnet_ao", idx_c, "time_delay",
+                ucix_wb_add_option_int("bacnet_ao", idx_c, "time_delay",
                     value.type.Unsigned_Int);
-                ucix_commit(ctx, "bacnet_ao");
+                ucix_wb_commit("bacnet_ao");
             }
             break;
 
@@ -1544,9 +1549,9 @@ bool Analog_Output_Write_Property(
 
             if (status) {
                 CurrentAO->Notification_Class = value.type.Unsigned_Int;
-                ucix_add_option_int(ctx, "bacnet_ao", idx_c, "nc",
+                ucix_wb_add_option_int("bacnet_ao", idx_c, "nc",
                     value.type.Unsigned_Int);
-                ucix_commit(ctx, "bacnet_ao");
+                ucix_wb_commit("bacnet_ao");
             }
             break;
 
@@ -1557,9 +1562,9 @@ bool Analog_Output_Write_Property(
 
             if (status) {
                 CurrentAO->High_Limit = value.type.Real;
-                ucix_add_option_int(ctx, "bacnet_ao", idx_c, "high_limit",
+                ucix_wb_add_option_int("bacnet_ao", idx_c, "high_limit",
                         value.type.Real);
-                ucix_commit(ctx, "bacnet_ao");
+                ucix_wb_commit("bacnet_ao");
             }
             break;
 
@@ -1570,9 +1575,9 @@ bool Analog_Output_Write_Property(
 
             if (status) {
                 CurrentAO->Low_Limit = value.type.Real;
-                ucix_add_option_int(ctx, "bacnet_ao", idx_c, "low_limit",
+                ucix_wb_add_option_int("bacnet_ao", idx_c, "low_limit",
                         value.type.Real);
-                ucix_commit(ctx, "bacnet_ao");
+                ucix_wb_commit("bacnet_ao");
             }
             break;
 
@@ -1583,9 +1588,9 @@ bool Analog_Output_Write_Property(
 
             if (status) {
                 CurrentAO->Deadband = value.type.Real;
-                ucix_add_option_int(ctx, "bacnet_ao", idx_c, "dead_limit",
+                ucix_wb_add_option_int("bacnet_ao", idx_c, "dead_limit",
                         value.type.Real);
-                ucix_commit(ctx, "bacnet_ao");
+                ucix_wb_commit("bacnet_ao");
             }
             break;
 
@@ -1597,9 +1602,9 @@ bool Analog_Output_Write_Property(
             if (status) {
                 if (value.type.Bit_String.bits_used == 2) {
                     CurrentAO->Limit_Enable = value.type.Bit_String.value[0];
-                    ucix_add_option_int(ctx, "bacnet_ao", idx_c, "limit",
+                    ucix_wb_add_option_int("bacnet_ao", idx_c, "limit",
                         value.type.Bit_String.value[0]);
-                    ucix_commit(ctx, "bacnet_ao");
+                    ucix_wb_commit("bacnet_ao");
                 } else {
                     wp_data->error_class = ERROR_CLASS_PROPERTY;
                     wp_data->error_code = ERROR_CODE_VALUE_OUT_OF_RANGE;
@@ -1616,9 +1621,9 @@ bool Analog_Output_Write_Property(
             if (status) {
                 if (value.type.Bit_String.bits_used == 3) {
                     CurrentAO->Event_Enable = value.type.Bit_String.value[0];
-                    ucix_add_option_int(ctx, "bacnet_ao", idx_c, "event",
+                    ucix_wb_add_option_int("bacnet_ao", idx_c, "event",
                         value.type.Bit_String.value[0]);
-                    ucix_commit(ctx, "bacnet_ao");
+                    ucix_wb_commit("bacnet_ao");
                 } else {
                     wp_data->error_class = ERROR_CLASS_PROPERTY;
                     wp_data->error_code = ERROR_CODE_VALUE_OUT_OF_RANGE;
@@ -1669,7 +1674,6 @@ bool Analog_Output_Write_Property(
             wp_data->error_code = ERROR_CODE_UNKNOWN_PROPERTY;
             break;
     }
-    ucix_cleanup(ctx);
     return status;
 }
 
@@ -120,6 +120,9 @@ struct ao_inst_itr_ctx {
     unsigned Analog_Output_Instance_To_Index(
         uint32_t object_instance);
 
+    void Analog_Output_Instance_Index_Build(
+        void);
+
     int Analog_Output_Read_Property(
         BACNET_READ_PROPERTY_DATA * rpdata);
 
@@ -45,6 +45,7 @@
 #include "timestamp.h"
 #include "av.h"
 #include "ucix.h"
+#include "keylist.h"
 
 /* number of demo objects */
 #ifndef MAX_ANALOG_VALUES
@@ -62,6 +63,8 @@ unsigned max_analog_values_int = 0;
 #define ANALOG_LEVEL_NULL 255
 
 ANALOG_VALUE_DESCR AV_Descr[MAX_ANALOG_VALUES];
+/* sorted instance number index into AV_Descr[] */
+static OS_Keylist AV_Instance_List;
 
 /* These three arrays are used by the ReadPropertyMultiple handler */
 static const int Analog_Value_Properties_Required[] = {
@@ -388,6 +391,7 @@ void Analog_Value_Init(
                 max_analog_values_int = i;
             }
         }
+        Analog_Value_Instance_Index_Build();
 #if PRINT_ENABLED
         fprintf(stderr, "max_analog_values %i\n", max_analog_values_int);
 #endif
@@ -397,23 +401,36 @@ void Analog_Value_Init(
     return;
 }
 
-/* we simply have 0-n object instances.  Yours might be */
-/* more complex, and then you need to return the index */
-/* that correlates to the correct instance number */
+/* (re)builds the sorted instance number index of AV_Descr[] */
+/* call whenever the table was loaded or changed */
+void Analog_Value_Instance_Index_Build(
+    void)
+{
+    unsigned i;
+
+    if (!AV_Instance_List) {
+        AV_Instance_List = Keylist_Create();
+    }
+    while (Keylist_Count(AV_Instance_List) > 0) {
+        (void) Keylist_Data_Pop(AV_Instance_List);
+    }
+    for (i = 0; i < max_analog_values_int; i++) {
+        (void) Keylist_Data_Add(AV_Instance_List, AV_Descr[i].Instance,
+            &AV_Descr[i]);
+    }
+}
+
+/* binary search of the instance index for the AV_Descr[] offset */
 unsigned Analog_Value_Instance_To_Index(
     uint32_t object_instance)
 {
     ANALOG_VALUE_DESCR *CurrentAV;
-    int index,i;
-    //int instance;
-    index = max_analog_values_int;
-    for (i = 0; i < index; i++) {
-    	CurrentAV = &AV_Descr[i];
-    	//instance = CurrentAV->Instance;
-    	if (CurrentAV->Instance == object_instance) {
-    		return i;
-    	}
+
+    CurrentAV = Keylist_Data(AV_Instance_List, object_instance);
+    if (CurrentAV) {
+        return (unsigned) (CurrentAV - AV_Descr);
     }
+
     return MAX_ANALOG_VALUES;
 }
 
@@ -481,6 +498,7 @@ static void Analog_Value_COV_Detect(uint32_t object_instance,
         }
         if (cov_delta >= cov_increment) {
             CurrentAV->Changed = true;
+            handler_cov_object_changed(OBJECT_ANALOG_VALUE, object_instance);
             CurrentAV->Prior_Value = value;
         }
     }
@@ -843,16 +861,9 @@ static bool Analog_Value_Description_Write(
                 } else {
                     sprintf(idx_cc,"%d",CurrentAV->Instance);
                     idx_c = idx_cc;
-                    if(ctx) {
-                        ucix_add_option(ctx, "bacnet_av", idx_c,
-                            "description", char_string->value);
-                        ucix_commit(ctx, "bacnet_av");
-#if PRINT_ENABLED
-                    } else {
-                        fprintf(stderr,
-                            "Failed to open config file bacnet_av\n");
-#endif
-                    }
+                    ucix_wb_add_option("bacnet_av", idx_c,
+                        "description", char_string->value);
+                    ucix_wb_commit("bacnet_av");
                 }
             } else {
                 *error_class = ERROR_CLASS_PROPERTY;
@@ -913,18 +924,13 @@ static bool Analog_Value_Object_Name_Write(
                     *error_class = ERROR_CLASS_PROPERTY;
                     *error_code = ERROR_CODE_VALUE_OUT_OF_RANGE;
                 } else {
+                    Device_Object_Name_Changed(OBJECT_ANALOG_VALUE,
+                        object_instance);
                     sprintf(idx_cc,"%d",CurrentAV->Instance);
                     idx_c = idx_cc;
-                    if(ctx) {
-                        ucix_add_option(ctx, "bacnet_av", idx_c,
-                            "name", char_string->value);
-                        ucix_commit(ctx, "bacnet_av");
-#if PRINT_ENABLED
-                    } else {
-                        fprintf(stderr,
-                            "Failed to open config file bacnet_av\n");
-#endif
-                    }
+                    ucix_wb_add_option("bacnet_av", idx_c,
+                        "name", char_string->value);
+                    ucix_wb_commit("bacnet_av");
                 }
             } else {
                 *error_class = ERROR_CLASS_PROPERTY;
@@ -1251,7 +1257,6 @@ bool Analog_Value_Write_Property(
     uint8_t level = ANALOG_LEVEL_NULL;
     int len = 0;
     BACNET_APPLICATION_DATA_VALUE value;
-    ctx = ucix_init("bacnet_av");
     const char *idx_c;
     char cur_value[16];
     float pvalue;
@@ -1335,14 +1340,14 @@ bool Analog_Value_Write_Property(
                         value.type.Real, wp_data->priority)) {
                     status = true;
                     sprintf(cur_value,"%f",value.type.Real);
-                    ucix_add_option(ctx, "bacnet_av", idx_c, "value",
+                    ucix_wb_add_option("bacnet_av", idx_c, "value",
                         cur_value);
                     cur_value_time = time(NULL);
-                    ucix_add_option_int(ctx, "bacnet_av", idx_c, "value_time",
+                    ucix_wb_add_option_int("bacnet_av", idx_c, "value_time",
                         cur_value_time);
-                    ucix_add_option_int(ctx, "bacnet_av", idx_c, "write",
+                    ucix_wb_add_option_int("bacnet_av", idx_c, "write",
                         1);
-                    ucix_save_state(ctx, "bacnet_av");
+                    ucix_wb_save_state("bacnet_av");
                 } else if (wp_data->priority == 6) {
                     /* Command priority 6 is reserved for use by Minimum On/Off
                        algorithm and may not be used for other purposes in any
@@ -1377,14 +1382,14 @@ bool Analog_Value_Write_Property(
                             }
                         }
                         sprintf(cur_value,"%f",pvalue);
-                        ucix_add_option(ctx, "bacnet_av", idx_c, "value",
+                        ucix_wb_add_option("bacnet_av", idx_c, "value",
                             cur_value);
                         cur_value_time = time(NULL);
-                        ucix_add_option_int(ctx, "bacnet_av", idx_c, "value_time",
+                        ucix_wb_add_option_int("bacnet_av", idx_c, "value_time",
                             cur_value_time);
-                        ucix_add_option_int(ctx, "bacnet_av", idx_c, "write",
+                        ucix_wb_add_option_int("bacnet_av", idx_c, "write",
                             1);
-                        ucix_save_state(ctx, "bacnet_av");
+                        ucix_wb_save_state("bacnet_av");
                     } else {
                         status = false;
                         wp_data->error_class = ERROR_CLASS_PROPERTY;
@@ -1456,9 +1461,9 @@ bool Analog_Value_Write_Property(
             if (status) {
                 CurrentAV->Time_Delay = value.type.Unsigned_Int;
                 CurrentAV->Remaining_Time_Delay = CurrentAV->Time_Delay;
-                ucix_add_option_int(ctx, "bacnet_av", idx_c, "time_delay",
+                ucix_wb_add_option_int("bacnet_av", idx_c, "time_delay",
                     value.type.Unsigned_Int);
-                ucix_commit(ctx, "bacnet_av");
+                ucix_wb_commit("bacnet_av");
             }
             break;
 
@@ -1469,9 +1474,9 @@ bool Analog_Value_Write_Property(
 
             if (status) {
                 CurrentAV->Notification_Class = value.type.Unsigned_Int;
-                ucix_add_option_int(ctx, "bacnet_av", idx_c, "nc",
+                ucix_wb_add_option_int("bacnet_av", idx_c, "nc",
                     value.type.Unsigned_Int);
-                ucix_commit(ctx, "bacnet_av");
+                ucix_wb_commit("bacnet_av");
             }
             break;
 
@@ -1482,9 +1487,9 @@ bool Analog_Value_Write_Property(
 
             if (status) {
                 CurrentAV->High_Limit = value.type.Real;
-                ucix_add_option_int(ctx, "bacnet_av", idx_c, "high_limit",
+                ucix_wb_add_option_int("bacnet_av", idx_c, "high_limit",
                         value.type.Real);
-                ucix_commit(ctx, "bacnet_av");
+                ucix_wb_commit("bacnet_av");
             }
             break;
 
@@ -1495,9 +1500,9 @@ bool Analog_Value_Write_Property(
 
             if (status) {
                 CurrentAV->Low_Limit = value.type.Real;
-                ucix_add_option_int(ctx, "bacnet_av", idx_c, "low_limit",
+                ucix_wb_add_option_int("bacnet_av", idx_c, "low_limit",
                         value.type.Real);
-                ucix_commit(ctx, "bacnet_av");
+                ucix_wb_commit("bacnet_av");
             }
             break;
 
@@ -1508,9 +1513,9 @@ bool Analog_Value_Write_Property(
 
             if (status) {
                 CurrentAV->Deadband = value.type.Real;
-                ucix_add_option_int(ctx, "bacnet_av", idx_c, "dead_limit",
+                ucix_wb_add_option_int("bacnet_av", idx_c, "dead_limit",
                         value.type.Real);
-                ucix_commit(ctx, "bacnet_av");
+                ucix_wb_commit("bacnet_av");
             }
             break;
 
@@ -1522,9 +1527,9 @@ bool Analog_Value_Write_Property(
             if (status) {
                 if (value.type.Bit_String.bits_used == 2) {
                     CurrentAV->Limit_Enable = value.type.Bit_String.value[0];
-                    ucix_add_option_int(ctx, "bacnet_av", idx_c, "limit",
+                    ucix_wb_add_option_int("bacnet_av", idx_c, "limit",
                         value.type.Bit_String.value[0]);
-                    ucix_commit(ctx, "bacnet_av");
+                    ucix_wb_commit("bacnet_av");
                 } else {
                     wp_data->error_class = ERROR_CLASS_PROPERTY;
                     wp_data->error_code = ERROR_CODE_VALUE_OUT_OF_RANGE;
@@ -1541,9 +1546,9 @@ bool Analog_Value_Write_Property(
             if (status) {
                 if (value.type.Bit_String.bits_used == 3) {
                     CurrentAV->Event_Enable = value.type.Bit_String.value[0];
-                    ucix_add_option_int(ctx, "bacnet_av", idx_c, "event",
+                    ucix_wb_add_option_int("bacnet_av", idx_c, "event",
                         value.type.Bit_String.value[0]);
-                    ucix_commit(ctx, "bacnet_av");
+                    ucix_wb_commit("bacnet_av");
                 } else {
                     wp_data->error_class = ERROR_CLASS_PROPERTY;
                     wp_data->error_code = ERROR_CODE_VALUE_OUT_OF_RANGE;
@@ -1594,7 +1599,6 @@ bool Analog_Value_Write_Property(
             wp_data->error_code = ERROR_CODE_UNKNOWN_PROPERTY;
             break;
     }
-    ucix_cleanup(ctx);
     return status;
 }
 
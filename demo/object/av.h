@@ -117,6 +117,9 @@ struct av_inst_itr_ctx {
     unsigned Analog_Value_Instance_To_Index(
         uint32_t object_instance);
 
+    void Analog_Value_Instance_Index_Build(
+        void);
+
     int Analog_Value_Read_Property(
         BACNET_READ_PROPERTY_DATA * rpdata);
 
@@ -45,6 +45,7 @@
 #include "timestamp.h"
 #include "bi.h"
 #include "ucix.h"
+#include "keylist.h"
 
 #ifndef MAX_BINARY_INPUTS
 #define MAX_BINARY_INPUTS 1024
@@ -61,6 +62,8 @@ unsigned max_binary_inputs_int = 0;
 #define BINARY_LEVEL_NULL 255
 
 BINARY_INPUT_DESCR BI_Descr[MAX_BINARY_INPUTS];
+/* sorted instance number index into BI_Descr[] */
+static OS_Keylist BI_Instance_List;
 
 /* These three arrays are used by the ReadPropertyMultiple handler */
 static const int Binary_Input_Properties_Required[] = {
@@ -318,6 +321,7 @@ void Binary_Input_Init(
                 max_binary_inputs_int = i;
             }
         }
+        Binary_Input_Instance_Index_Build();
 #if PRINT_ENABLED
         fprintf(stderr, "max_binary_inputs %i\n", max_binary_inputs_int);
 #endif
@@ -327,21 +331,36 @@ void Binary_Input_Init(
     return;
 }
 
-/* we simply have 0-n object instances.  Yours might be */
-/* more complex, and then you need to return the index */
-/* that correlates to the correct instance number */
+/* (re)builds the sorted instance number index of BI_Descr[] */
+/* call whenever the table was loaded or changed */
+void Binary_Input_Instance_Index_Build(
+    void)
+{
+    unsigned i;
+
+    if (!BI_Instance_List) {
+        BI_Instance_List = Keylist_Create();
+    }
+    while (Keylist_Count(BI_Instance_List) > 0) {
+        (void) Keylist_Data_Pop(BI_Instance_List);
+    }
+    for (i = 0; i < max_binary_inputs_int; i++) {
+        (void) Keylist_Data_Add(BI_Instance_List, BI_Descr[i].Instance,
+            &BI_Descr[i]);
+    }
+}
+
+/* binary search of the instance index for the BI_Descr[] offset */
 unsigned Binary_Input_Instance_To_Index(
     uint32_t object_instance)
 {
     BINARY_INPUT_DESCR *CurrentBI;
-    int index,i;
-    index = max_binary_inputs_int;
-    for (i = 0; i < index; i++) {
-    	CurrentBI = &BI_Descr[i];
-    	if (CurrentBI->Instance == object_instance) {
-    		return i;
-    	}
+
+    CurrentBI = Keylist_Data(BI_Instance_List, object_instance);
+    if (CurrentBI) {
+        return (unsigned) (CurrentBI - BI_Descr);
     }
+
     return MAX_BINARY_INPUTS;
 }
 
@@ -466,6 +485,7 @@ void Binary_Input_Out_Of_Service_Set(
         CurrentBI = &BI_Descr[index];
         if (CurrentBI->Out_Of_Service != value) {
             CurrentBI->Changed = true;
+            handler_cov_object_changed(OBJECT_BINARY_INPUT, object_instance);
         }
         CurrentBI->Out_Of_Service = value;
     }
@@ -580,16 +600,9 @@ static bool Binary_Input_Description_Write(
                 } else {
                     sprintf(idx_cc,"%d",index);
                     idx_c = idx_cc;
-                    if(ctx) {
-                        ucix_add_option(ctx, "bacnet_bi", idx_c,
-                            "description", char_string->value);
-                        ucix_commit(ctx, "bacnet_bi");
-#if PRINT_ENABLED
-                    } else {
-                        fprintf(stderr,
-                            "Failed to open config file bacnet_bi\n");
-#endif
-                    }
+                    ucix_wb_add_option("bacnet_bi", idx_c,
+                        "description", char_string->value);
+                    ucix_wb_commit("bacnet_bi");
                 }
             } else {
                 *error_class = ERROR_CLASS_PROPERTY;
@@ -683,18 +696,13 @@ static bool Binary_Input_Object_Name_Write(
                     *error_class = ERROR_CLASS_PROPERTY;
                     *error_code = ERROR_CODE_VALUE_OUT_OF_RANGE;
                 } else {
+                    Device_Object_Name_Changed(OBJECT_BINARY_INPUT,
+                        object_instance);
                     sprintf(idx_cc,"%d",index);
                     idx_c = idx_cc;
-                    if(ctx) {
-                        ucix_add_option(ctx, "bacnet_bi", idx_c,
-                            "name", char_string->value);
-                        ucix_commit(ctx, "bacnet_bi");
-#if PRINT_ENABLED
-                    } else {
-                        fprintf(stderr,
-                            "Failed to open config file bacnet_bi\n");
-#endif
-                    }
+                    ucix_wb_add_option("bacnet_bi", idx_c,
+                        "name", char_string->value);
+                    ucix_wb_commit("bacnet_bi");
                 }
             } else {
                 *error_class = ERROR_CLASS_PROPERTY;
@@ -808,6 +816,7 @@ bool Binary_Input_Present_Value_Set(
         CurrentBI->Present_Value = (uint8_t) value;
         CurrentBI->Priority_Array[priority - 1] = (uint8_t) value;
         CurrentBI->Changed = true;
+        handler_cov_object_changed(OBJECT_BINARY_INPUT, object_instance);
         status = true;
     }
     return status;
@@ -845,18 +854,12 @@ bool Binary_Input_Polarity_Set(
         CurrentBI = &BI_Descr[index];
         CurrentBI->Polarity=polarity;
         CurrentBI->Changed = true;
+        handler_cov_object_changed(OBJECT_BINARY_INPUT, object_instance);
         sprintf(idx_cc,"%d",index);
         idx_c = idx_cc;
-        if(ctx) {
-            ucix_add_option_int(ctx, "bacnet_bi", idx_c,
-                "polarity", polarity);
-            ucix_commit(ctx, "bacnet_bi");
-#if PRINT_ENABLED
-        } else {
-            fprintf(stderr,
-                "Failed to open config file bacnet_bi\n");
-#endif
-        }
+        ucix_wb_add_option_int("bacnet_bi", idx_c,
+            "polarity", polarity);
+        ucix_wb_commit("bacnet_bi");
     }
 
     return status;
@@ -891,16 +894,9 @@ static bool Binary_Input_Active_Text_Write(
                 } else {
                     sprintf(idx_cc,"%d",index);
                     idx_c = idx_cc;
-                    if(ctx) {
-                        ucix_add_option(ctx, "bacnet_bi", idx_c,
-                            "active", char_string->value);
-                        ucix_commit(ctx, "bacnet_bi");
-#if PRINT_ENABLED
-                    } else {
-                        fprintf(stderr,
-                            "Failed to open config file bacnet_bi\n");
-#endif
-                    }
+                    ucix_wb_add_option("bacnet_bi", idx_c,
+                        "active", char_string->value);
+                    ucix_wb_commit("bacnet_bi");
                 }
             } else {
                 *error_class = ERROR_CLASS_PROPERTY;
@@ -944,16 +940,9 @@ static bool Binary_Input_Inactive_Text_Write(
                 } else {
                     sprintf(idx_cc,"%d",index);
                     idx_c = idx_cc;
-                    if(ctx) {
-                        ucix_add_option(ctx, "bacnet_bi", idx_c,
-                            "inactive", char_string->value);
-                        ucix_commit(ctx, "bacnet_bi");
-#if PRINT_ENABLED
-                    } else {
-                        fprintf(stderr,
-                            "Failed to open config file bacnet_bi\n");
-#endif
-                    }
+                    ucix_wb_add_option("bacnet_bi", idx_c,
+                        "inactive", char_string->value);
+                    ucix_wb_commit("bacnet_bi");
                 }
             } else {
                 *error_class = ERROR_CLASS_PROPERTY;
@@ -1270,7 +1259,6 @@ bool Binary_Input_Write_Property(
     uint8_t level = BINARY_LEVEL_NULL;
     int len = 0;
     BACNET_APPLICATION_DATA_VALUE value;
-    ctx = ucix_init("bacnet_bi");
 #if defined(INTRINSIC_REPORTING)
     const char index_c[32] = "";
 #endif
@@ -1358,14 +1346,14 @@ bool Binary_Input_Write_Property(
                 if (Binary_Input_Present_Value_Set(wp_data->object_instance,
                         value.type.Unsigned_Int, wp_data->priority)) {
                     status = true;
-                    ucix_add_option_int(ctx, "bacnet_bi", idx_c, "value",
+                    ucix_wb_add_option_int("bacnet_bi", idx_c, "value",
                         value.type.Unsigned_Int);
                     cur_value_time = time(NULL);
-                    ucix_add_option_int(ctx, "bacnet_bi", idx_c, "value_time",
+                    ucix_wb_add_option_int("bacnet_bi", idx_c, "value_time",
                         cur_value_time);
-                    ucix_add_option_int(ctx, "bacnet_bi", idx_c, "write",
+                    ucix_wb_add_option_int("bacnet_bi", idx_c, "write",
                         1);
-                    ucix_save_state(ctx, "bacnet_bi");
+                    ucix_wb_save_state("bacnet_bi");
                 } else if (wp_data->priority == 6) {
                     /* Command priority 6 is reserved for use by Minimum On/Off
                        algorithm and may not be used for other purposes in any
@@ -1399,14 +1387,14 @@ bool Binary_Input_Write_Property(
                                 break;
                             }
                         }
-                        ucix_add_option_int(ctx, "bacnet_bi", idx_c, "value",
+                        ucix_wb_add_option_int("bacnet_bi", idx_c, "value",
                             pvalue);
                         cur_value_time = time(NULL);
-                        ucix_add_option_int(ctx, "bacnet_bi", idx_c, "value_time",
+                        ucix_wb_add_option_int("bacnet_bi", idx_c, "value_time",
                             cur_value_time);
-                        ucix_add_option_int(ctx, "bacnet_bi", idx_c, "write",
+                        ucix_wb_add_option_int("bacnet_bi", idx_c, "write",
                             1);
-                        ucix_save_state(ctx, "bacnet_bi");
+                        ucix_wb_save_state("bacnet_bi");
                     } else {
                         status = false;
                         wp_data->error_class = ERROR_CLASS_PROPERTY;
@@ -1473,9 +1461,9 @@ bool Binary_Input_Write_Property(
                     int array_index = 0;
                     alarm_value = wp_data->application_data[array_index];
                     CurrentBI->Alarm_Value = alarm_value;
-                    ucix_add_option_int(ctx, "bacnet_bi", idx_c, "alarmstate",
+                    ucix_wb_add_option_int("bacnet_bi", idx_c, "alarmstate",
                         alarm_value);
-                    ucix_commit(ctx, "bacnet_bi");
+                    ucix_wb_commit("bacnet_bi");
                 }
             }
         case PROP_TIME_DELAY:
@@ -1486,8 +1474,8 @@ bool Binary_Input_Write_Property(
             if (status) {
                 CurrentBI->Time_Delay = value.type.Unsigned_Int;
                 CurrentBI->Remaining_Time_Delay = CurrentBI->Time_Delay;
-                ucix_add_option_int(ctx, "bacnet_bi", index_c, "time_delay", value.type.Unsigned_Int);
-                ucix_commit(ctx, "bacnet_bi");
+                ucix_wb_add_option_int("bacnet_bi", index_c, "time_delay", value.type.Unsigned_Int);
+                ucix_wb_commit("bacnet_bi");
             }
             break;
 
@@ -1498,8 +1486,8 @@ bool Binary_Input_Write_Property(
 
             if (status) {
                 CurrentBI->Notification_Class = value.type.Unsigned_Int;
-                ucix_add_option_int(ctx, "bacnet_bi", index_c, "nc", value.type.Unsigned_Int);
-                ucix_commit(ctx, "bacnet_bi");
+                ucix_wb_add_option_int("bacnet_bi", index_c, "nc", value.type.Unsigned_Int);
+                ucix_wb_commit("bacnet_bi");
             }
             break;
 
@@ -1511,8 +1499,8 @@ bool Binary_Input_Write_Property(
             if (status) {
                 if (value.type.Bit_String.bits_used == 3) {
                     CurrentBI->Event_Enable = value.type.Bit_String.value[0];
-                    ucix_add_option_int(ctx, "bacnet_bi", index_c, "event", value.type.Bit_String.value[0]);
-                    ucix_commit(ctx, "bacnet_bi");
+                    ucix_wb_add_option_int("bacnet_bi", index_c, "event", value.type.Bit_String.value[0]);
+                    ucix_wb_commit("bacnet_bi");
                 } else {
                     wp_data->error_class = ERROR_CLASS_PROPERTY;
                     wp_data->error_code = ERROR_CODE_VALUE_OUT_OF_RANGE;
@@ -1589,7 +1577,6 @@ bool Binary_Input_Write_Property(
             wp_data->error_code = ERROR_CODE_UNKNOWN_PROPERTY;
             break;
     }
-    ucix_cleanup(ctx);
     return status;
 }
 
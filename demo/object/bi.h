@@ -113,6 +113,9 @@ struct bi_inst_itr_ctx {
     unsigned Binary_Input_Instance_To_Index(
         uint32_t instance);
 
+    void Binary_Input_Instance_Index_Build(
+        void);
+
     bool Binary_Input_Object_Instance_Add(
         uint32_t instance);
 
@@ -43,6 +43,7 @@
 #include "handlers.h"
 #include "bo.h"
 #include "ucix.h"
+#include "keylist.h"
 
 /* number of demo objects */
 #ifndef MAX_BINARY_OUTPUTS
@@ -60,6 +61,8 @@ unsigned max_binary_outputs_int = 0;
 #define BINARY_LEVEL_NULL 255
 
 BINARY_OUTPUT_DESCR BO_Descr[MAX_BINARY_OUTPUTS];
+/* sorted instance number index into BO_Descr[] */
+static OS_Keylist BO_Instance_List;
 
 /* These three arrays are used by the ReadPropertyMultiple handler */
 static const int Binary_Output_Properties_Required[] = {
@@ -322,6 +325,7 @@ void Binary_Output_Init(
                 max_binary_outputs_int = i;
             }
         }
+        Binary_Output_Instance_Index_Build();
 #if PRINT_ENABLED
         fprintf(stderr, "max_binary_outputs %i\n", max_binary_outputs_int);
 #endif
@@ -331,21 +335,36 @@ void Binary_Output_Init(
     return;
 }
 
-/* we simply have 0-n object instances.  Yours might be */
-/* more complex, and then you need to return the index */
-/* that correlates to the correct instance number */
+/* (re)builds the sorted instance number index of BO_Descr[] */
+/* call whenever the table was loaded or changed */
+void Binary_Output_Instance_Index_Build(
+    void)
+{
+    unsigned i;
+
+    if (!BO_Instance_List) {
+        BO_Instance_List = Keylist_Create();
+    }
+    while (Keylist_Count(BO_Instance_List) > 0) {
+        (void) Keylist_Data_Pop(BO_Instance_List);
+    }
+    for (i = 0; i < max_binary_outputs_int; i++) {
+        (void) Keylist_Data_Add(BO_Instance_List, BO_Descr[i].Instance,
+            &BO_Descr[i]);
+    }
+}
+
+/* binary search of the instance index for the BO_Descr[] offset */
 unsigned Binary_Output_Instance_To_Index(
     uint32_t object_instance)
 {
     BINARY_OUTPUT_DESCR *CurrentBO;
-    int index,i;
-    index = max_binary_outputs_int;
-    for (i = 0; i < index; i++) {
-    	CurrentBO = &BO_Descr[i];
-    	if (CurrentBO->Instance == object_instance) {
-    		return i;
-    	}
+
+    CurrentBO = Keylist_Data(BO_Instance_List, object_instance);
+    if (CurrentBO) {
+        return (unsigned) (CurrentBO - BO_Descr);
     }
+
     return MAX_BINARY_OUTPUTS;
 }
 
@@ -470,6 +489,7 @@ void Binary_Output_Out_Of_Service_Set(
         CurrentBO = &BO_Descr[index];
         if (CurrentBO->Out_Of_Service != value) {
             CurrentBO->Changed = true;
+            handler_cov_object_changed(OBJECT_BINARY_OUTPUT, object_instance);
         }
         CurrentBO->Out_Of_Service = value;
     }
@@ -584,16 +604,9 @@ static bool Binary_Output_Description_Write(
                 } else {
                     sprintf(idx_cc,"%d",index);
                     idx_c = idx_cc;
-                    if(ctx) {
-                        ucix_add_option(ctx, "bacnet_bo", idx_c,
-                            "description", char_string->value);
-                        ucix_commit(ctx, "bacnet_bo");
-#if PRINT_ENABLED
-                    } else {
-                        fprintf(stderr,
-                            "Failed to open config file bacnet_bo\n");
-#endif
-                    }
+                    ucix_wb_add_option("bacnet_bo", idx_c,
+                        "description", char_string->value);
+                    ucix_wb_commit("bacnet_bo");
                 }
             } else {
                 *error_class = ERROR_CLASS_PROPERTY;
@@ -687,18 +700,13 @@ static bool Binary_Output_Object_Name_Write(
                     *error_class = ERROR_CLASS_PROPERTY;
                     *error_code = ERROR_CODE_VALUE_OUT_OF_RANGE;
                 } else {
+                    Device_Object_Name_Changed(OBJECT_BINARY_OUTPUT,
+                        object_instance);
                     sprintf(idx_cc,"%d",index);
                     idx_c = idx_cc;
-                    if(ctx) {
-                        ucix_add_option(ctx, "bacnet_bo", idx_c,
-                            "name", char_string->value);
-                        ucix_commit(ctx, "bacnet_bo");
-#if PRINT_ENABLED
-                    } else {
-                        fprintf(stderr,
-                            "Failed to open config file bacnet_bo\n");
-#endif
-                    }
+                    ucix_wb_add_option("bacnet_bo", idx_c,
+                        "name", char_string->value);
+                    ucix_wb_commit("bacnet_bo");
                 }
             } else {
                 *error_class = ERROR_CLASS_PROPERTY;
@@ -819,6 +827,7 @@ bool Binary_Output_Present_Value_Set(
                 CurrentBO->Priority_Array[15] = (uint8_t) value;
             }
             CurrentBO->Changed = true;
+            handler_cov_object_changed(OBJECT_BINARY_OUTPUT, object_instance);
             status = true;
         }
     }
@@ -857,18 +866,12 @@ bool Binary_Output_Polarity_Set(
         CurrentBO = &BO_Descr[index];
         CurrentBO->Polarity=polarity;
         CurrentBO->Changed = true;
+        handler_cov_object_changed(OBJECT_BINARY_OUTPUT, object_instance);
         sprintf(idx_cc,"%d",index);
         idx_c = idx_cc;
-        if(ctx) {
-            ucix_add_option_int(ctx, "bacnet_bo", idx_c,
-                "polarity", polarity);
-            ucix_commit(ctx, "bacnet_bo");
-#if PRINT_ENABLED
-        } else {
-            fprintf(stderr,
-                "Failed to open config file bacnet_bo\n");
-#endif
-        }
+        ucix_wb_add_option_int("bacnet_bo", idx_c,
+            "polarity", polarity);
+        ucix_wb_commit("bacnet_bo");
     }
 
     return status;
@@ -903,16 +906,9 @@ static bool Binary_Output_Active_Text_Write(
                 } else {
                     sprintf(idx_cc,"%d",index);
                     idx_c = idx_cc;
-                    if(ctx) {
-                        ucix_add_option(ctx, "bacnet_bo", idx_c,
-                            "active", char_string->value);
-                        ucix_commit(ctx, "bacnet_bo");
-#if PRINT_ENABLED
-                    } else {
-                        fprintf(stderr,
-                            "Failed to open config file bacnet_bo\n");
-#endif
-                    }
+                    ucix_wb_add_option("bacnet_bo", idx_c,
+                        "active", char_string->value);
+                    ucix_wb_commit("bacnet_bo");
                 }
             } else {
                 *error_class = ERROR_CLASS_PROPERTY;
@@ -956,16 +952,9 @@ static bool Binary_Output_Inactive_Text_Write(
                 } else {
                     sprintf(idx_cc,"%d",index);
                     idx_c = idx_cc;
-                    if(ctx) {
-                        ucix_add_option(ctx, "bacnet_bo", idx_c,
-                            "inactive", char_string->value);
-                        ucix_commit(ctx, "bacnet_bo");
-#if PRINT_ENABLED
-                    } else {
-                        fprintf(stderr,
-                            "Failed to open config file bacnet_bo\n");
-#endif
-                    }
+                    ucix_wb_add_option("bacnet_bo", idx_c,
+                        "inactive", char_string->value);
+                    ucix_wb_commit("bacnet_bo");
                 }
             } else {
                 *error_class = ERROR_CLASS_PROPERTY;
@@ -1289,7 +1278,6 @@ bool Binary_Output_Write_Property(
     uint8_t level = BINARY_LEVEL_NULL;
     int len = 0;
     BACNET_APPLICATION_DATA_VALUE value;
-    ctx = ucix_init("bacnet_bo");
 #if defined(INTRINSIC_REPORTING)
     const char index_c[32] = "";
 #endif
@@ -1377,14 +1365,14 @@ bool Binary_Output_Write_Property(
                 if (Binary_Output_Present_Value_Set(wp_data->object_instance,
                         value.type.Unsigned_Int, wp_data->priority)) {
                     status = true;
-                    ucix_add_option_int(ctx, "bacnet_bo", idx_c, "value",
+                    ucix_wb_add_option_int("bacnet_bo", idx_c, "value",
                         value.type.Unsigned_Int);
                     cur_value_time = time(NULL);
-                    ucix_add_option_int(ctx, "bacnet_bo", idx_c, "value_time",
+                    ucix_wb_add_option_int("bacnet_bo", idx_c, "value_time",
                         cur_value_time);
-                    ucix_add_option_int(ctx, "bacnet_bo", idx_c, "write",
+                    ucix_wb_add_option_int("bacnet_bo", idx_c, "write",
                         1);
-                    ucix_save_state(ctx, "bacnet_bo");
+                    ucix_wb_save_state("bacnet_bo");
                 } else if (wp_data->priority == 6) {
                     /* Command priority 6 is reserved for use by Minimum On/Off
                        algorithm and may not be used for other purposes in any
@@ -1418,14 +1406,14 @@ bool Binary_Output_Write_Property(
                                 break;
                             }
                         }
-                        ucix_add_option_int(ctx, "bacnet_bo", idx_c, "value",
+                        ucix_wb_add_option_int("bacnet_bo", idx_c, "value",
                             pvalue);
                         cur_value_time = time(NULL);
-                        ucix_add_option_int(ctx, "bacnet_bo", idx_c, "value_time",
+                        ucix_wb_add_option_int("bacnet_bo", idx_c, "value_time",
                             cur_value_time);
-                        ucix_add_option_int(ctx, "bacnet_bo", idx_c, "write",
+                        ucix_wb_add_option_int("bacnet_bo", idx_c, "write",
                             1);
-                        ucix_save_state(ctx, "bacnet_bo");
+                        ucix_wb_save_state("bacnet_bo");
                     } else {
                         status = false;
                         wp_data->error_class = ERROR_CLASS_PROPERTY;
@@ -1492,9 +1480,9 @@ bool Binary_Output_Write_Property(
                     int array_index = 0;
                     fb_value = wp_data->application_data[array_index];
                     CurrentBO->Feedback_Value = fb_value;
-                    ucix_add_option_int(ctx, "bacnet_bo", idx_c, "fb_value",
+                    ucix_wb_add_option_int("bacnet_bo", idx_c, "fb_value",
                         fb_value);
-                    ucix_commit(ctx, "bacnet_bo");
+                    ucix_wb_commit("bacnet_bo");
                 }
             }
         case PROP_TIME_DELAY:
@@ -1505,8 +1493,8 @@ bool Binary_Output_Write_Property(
             if (status) {
                 CurrentBO->Time_Delay = value.type.Unsigned_Int;
                 CurrentBO->Remaining_Time_Delay = CurrentBO->Time_Delay;
-                ucix_add_option_int(ctx, "bacnet_bo", index_c, "time_delay", value.type.Unsigned_Int);
-                ucix_commit(ctx, "bacnet_bo");
+                ucix_wb_add_option_int("bacnet_bo", index_c, "time_delay", value.type.Unsigned_Int);
+                ucix_wb_commit("bacnet_bo");
             }
             break;
 
@@ -1517,8 +1505,8 @@ bool Binary_Output_Write_Property(
 
             if (status) {
                 CurrentBO->Notification_Class = value.type.Unsigned_Int;
-                ucix_add_option_int(ctx, "bacnet_bo", index_c, "nc", value.type.Unsigned_Int);
-                ucix_commit(ctx, "bacnet_bo");
+                ucix_wb_add_option_int("bacnet_bo", index_c, "nc", value.type.Unsigned_Int);
+                ucix_wb_commit("bacnet_bo");
             }
             break;
 
@@ -1530,8 +1518,8 @@ bool Binary_Output_Write_Property(
             if (status) {
                 if (value.type.Bit_String.bits_used == 3) {
                     CurrentBO->Event_Enable = value.type.Bit_String.value[0];
-                    ucix_add_option_int(ctx, "bacnet_bo", index_c, "event", value.type.Bit_String.value[0]);
-                    ucix_commit(ctx, "bacnet_bo");
+                    ucix_wb_add_option_int("bacnet_bo", index_c, "event", value.type.Bit_String.value[0]);
+                    ucix_wb_commit("bacnet_bo");
                 } else {
                     wp_data->error_class = ERROR_CLASS_PROPERTY;
                     wp_data->error_code = ERROR_CODE_VALUE_OUT_OF_RANGE;
@@ -1608,7 +1596,6 @@ bool Binary_Output_Write_Property(
             wp_data->error_code = ERROR_CODE_UNKNOWN_PROPERTY;
             break;
     }
-    ucix_cleanup(ctx);
     return status;
 }
 
@@ -116,6 +116,9 @@ struct bo_inst_itr_ctx {
     unsigned Binary_Output_Instance_To_Index(
         uint32_t instance);
 
+    void Binary_Output_Instance_Index_Build(
+        void);
+
     bool Binary_Output_Object_Instance_Add(
         uint32_t instance);
 
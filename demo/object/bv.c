@@ -43,6 +43,7 @@
 #include "handlers.h"
 #include "bv.h"
 #include "ucix.h"
+#include "keylist.h"
 
 /* number of demo objects */
 #ifndef MAX_BINARY_VALUES
@@ -60,6 +61,8 @@ unsigned max_binary_values_int = 0;
 #define BINARY_LEVEL_NULL 255
 
 BINARY_VALUE_DESCR BV_Descr[MAX_BINARY_VALUES];
+/* sorted instance number index into BV_Descr[] */
+static OS_Keylist BV_Instance_List;
 
 /* These three arrays are used by the ReadPropertyMultiple handler */
 static const int Binary_Value_Properties_Required[] = {
@@ -317,6 +320,7 @@ void Binary_Value_Init(
                 max_binary_values_int = i;
             }
         }
+        Binary_Value_Instance_Index_Build();
 #if PRINT_ENABLED
         fprintf(stderr, "max_binary_values %i\n", max_binary_values_int);
 #endif
@@ -326,21 +330,36 @@ void Binary_Value_Init(
     return;
 }
 
-/* we simply have 0-n object instances.  Yours might be */
-/* more complex, and then you need to return the index */
-/* that correlates to the correct instance number */
+/* (re)builds the sorted instance number index of BV_Descr[] */
+/* call whenever the table was loaded or changed */
+void Binary_Value_Instance_Index_Build(
+    void)
+{
+    unsigned i;
+
+    if (!BV_Instance_List) {
+        BV_Instance_List = Keylist_Create();
+    }
+    while (Keylist_Count(BV_Instance_List) > 0) {
+        (void) Keylist_Data_Pop(BV_Instance_List);
+    }
+    for (i = 0; i < max_binary_values_int; i++) {
+        (void) Keylist_Data_Add(BV_Instance_List, BV_Descr[i].Instance,
+            &BV_Descr[i]);
+    }
+}
+
+/* binary search of the instance index for the BV_Descr[] offset */
 unsigned Binary_Value_Instance_To_Index(
     uint32_t object_instance)
 {
     BINARY_VALUE_DESCR *CurrentBV;
-    int index,i;
-    index = max_binary_values_int;
-    for (i = 0; i < index; i++) {
-    	CurrentBV = &BV_Descr[i];
-    	if (CurrentBV->Instance == object_instance) {
-    		return i;
-    	}
+
+    CurrentBV = Keylist_Data(BV_Instance_List, object_instance);
+    if (CurrentBV) {
+        return (unsigned) (CurrentBV - BV_Descr);
     }
+
     return MAX_BINARY_VALUES;
 }
 
@@ -465,6 +484,7 @@ void Binary_Value_Out_Of_Service_Set(
         CurrentBV = &BV_Descr[index];
         if (CurrentBV->Out_Of_Service != value) {
             CurrentBV->Changed = true;
+            handler_cov_object_changed(OBJECT_BINARY_VALUE, object_instance);
         }
         CurrentBV->Out_Of_Service = value;
     }
@@ -579,16 +599,9 @@ static bool Binary_Value_Description_Write(
                 } else {
                     sprintf(idx_cc,"%d",index);
                     idx_c = idx_cc;
-                    if(ctx) {
-                        ucix_add_option(ctx, "bacnet_bv", idx_c,
-                            "description", char_string->value);
-                        ucix_commit(ctx, "bacnet_bv");
-#if PRINT_ENABLED
-                    } else {
-                        fprintf(stderr,
-                            "Failed to open config file bacnet_bv\n");
-#endif
-                    }
+                    ucix_wb_add_option("bacnet_bv", idx_c,
+                        "description", char_string->value);
+                    ucix_wb_commit("bacnet_bv");
                 }
             } else {
                 *error_class = ERROR_CLASS_PROPERTY;
@@ -682,18 +695,13 @@ static bool Binary_Value_Object_Name_Write(
                     *error_class = ERROR_CLASS_PROPERTY;
                     *error_code = ERROR_CODE_VALUE_OUT_OF_RANGE;
                 } else {
+                    Device_Object_Name_Changed(OBJECT_BINARY_VALUE,
+                        object_instance);
                     sprintf(idx_cc,"%d",index);
                     idx_c = idx_cc;
-                    if(ctx) {
-                        ucix_add_option(ctx, "bacnet_bv", idx_c,
-                            "name", char_string->value);
-                        ucix_commit(ctx, "bacnet_bv");
-#if PRINT_ENABLED
-                    } else {
-                        fprintf(stderr,
-                            "Failed to open config file bacnet_bv\n");
-#endif
-                    }
+                    ucix_wb_add_option("bacnet_bv", idx_c,
+                        "name", char_string->value);
+                    ucix_wb_commit("bacnet_bv");
                 }
             } else {
                 *error_class = ERROR_CLASS_PROPERTY;
@@ -807,6 +815,7 @@ bool Binary_Value_Present_Value_Set(
         CurrentBV->Present_Value = (uint8_t) value;
         CurrentBV->Priority_Array[priority - 1] = (uint8_t) value;
         CurrentBV->Changed = true;
+        handler_cov_object_changed(OBJECT_BINARY_VALUE, object_instance);
         status = true;
     }
     return status;
@@ -844,18 +853,12 @@ bool Binary_Value_Polarity_Set(
         CurrentBV = &BV_Descr[index];
         CurrentBV->Polarity=polarity;
         CurrentBV->Changed = true;
+        handler_cov_object_changed(OBJECT_BINARY_VALUE, object_instance);
         sprintf(idx_cc,"%d",index);
         idx_c = idx_cc;
-        if(ctx) {
-            ucix_add_option_int(ctx, "bacnet_bv", idx_c,
-                "polarity", polarity);
-            ucix_commit(ctx, "bacnet_bv");
-#if PRINT_ENABLED
-        } else {
-            fprintf(stderr,
-                "Failed to open config file bacnet_bv\n");
-#endif
-        }
+        ucix_wb_add_option_int("bacnet_bv", idx_c,
+            "polarity", polarity);
+        ucix_wb_commit("bacnet_bv");
     }
 
     return status;
@@ -890,16 +893,9 @@ static bool Binary_Value_Active_Text_Write(
                 } else {
                     sprintf(idx_cc,"%d",index);
                     idx_c = idx_cc;
-                    if(ctx) {
-                        ucix_add_option(ctx, "bacnet_bv", idx_c,
-                            "active", char_string->value);
-                        ucix_commit(ctx, "bacnet_bv");
-#if PRINT_ENABLED
-                    } else {
-                        fprintf(stderr,
-                            "Failed to open config file bacnet_bv\n");
-#endif
-                    }
+                    ucix_wb_add_option("bacnet_bv", idx_c,
+                        "active", char_string->value);
+                    ucix_wb_commit("bacnet_bv");
                 }
             } else {
                 *error_class = ERROR_CLASS_PROPERTY;
@@ -943,16 +939,9 @@ static bool Binary_Value_Inactive_Text_Write(
                 } else {
                     sprintf(idx_cc,"%d",index);
                     idx_c = idx_cc;
-                    if(ctx) {
-                        ucix_add_option(ctx, "bacnet_bv", idx_c,
-                            "inactive", char_string->value);
-                        ucix_commit(ctx, "bacnet_bv");
-#if PRINT_ENABLED
-                    } else {
-                        fprintf(stderr,
-                            "Failed to open config file bacnet_bv\n");
-#endif
-                    }
+                    ucix_wb_add_option("bacnet_bv", idx_c,
+                        "inactive", char_string->value);
+                    ucix_wb_commit("bacnet_bv");
                 }
             } else {
                 *error_class = ERROR_CLASS_PROPERTY;
@@ -1269,7 +1258,6 @@ bool Binary_Value_Write_Property(
     uint8_t level = BINARY_LEVEL_NULL;
     int len = 0;
     BACNET_APPLICATION_DATA_VALUE value;
-    ctx = ucix_init("bacnet_bv");
 #if defined(INTRINSIC_REPORTING)
     const char index_c[32] = "";
 #endif
@@ -1357,14 +1345,14 @@ bool Binary_Value_Write_Property(
                 if (Binary_Value_Present_Value_Set(wp_data->object_instance,
                         value.type.Unsigned_Int, wp_data->priority)) {
                     status = true;
-                    ucix_add_option_int(ctx, "bacnet_bv", idx_c, "value",
+                    ucix_wb_add_option_int("bacnet_bv", idx_c, "value",
                         value.type.Unsigned_Int);
                     cur_value_time = time(NULL);
-                    ucix_add_option_int(ctx, "bacnet_bv", idx_c, "value_time",
+                    ucix_wb_add_option_int("bacnet_bv", idx_c, "value_time",
                         cur_value_time);
-                    ucix_add_option_int(ctx, "bacnet_bv", idx_c, "write",
+                    ucix_wb_add_option_int("bacnet_bv", idx_c, "write",
                         1);
-                    ucix_save_state(ctx, "bacnet_bv");
+                    ucix_wb_save_state("bacnet_bv");
                 } else if (wp_data->priority == 6) {
                     /* Command priority 6 is reserved for use by Minimum On/Off
                        algorithm and may not be used for other purposes in any
@@ -1398,14 +1386,14 @@ bool Binary_Value_Write_Property(
                                 break;
                             }
                         }
-                        ucix_add_option_int(ctx, "bacnet_bv", idx_c, "value",
+                        ucix_wb_add_option_int("bacnet_bv", idx_c, "value",
                             pvalue);
                         cur_value_time = time(NULL);
-                        ucix_add_option_int(ctx, "bacnet_bv", idx_c, "value_time",
+                        ucix_wb_add_option_int("bacnet_bv", idx_c, "value_time",
                             cur_value_time);
-                        ucix_add_option_int(ctx, "bacnet_bv", idx_c, "write",
+                        ucix_wb_add_option_int("bacnet_bv", idx_c, "write",
                             1);
-                        ucix_save_state(ctx, "bacnet_bv");
+                        ucix_wb_save_state("bacnet_bv");
                     } else {
                         status = false;
                         wp_data->error_class = ERROR_CLASS_PROPERTY;
@@ -1472,9 +1460,9 @@ bool Binary_Value_Write_Property(
                     int array_index = 0;
                     alarm_value = wp_data->application_data[array_index];
                     CurrentBV->Alarm_Value = alarm_value;
-                    ucix_add_option_int(ctx, "bacnet_bv", idx_c, "alarmstate",
+                    ucix_wb_add_option_int("bacnet_bv", idx_c, "alarmstate",
                         alarm_value);
-                    ucix_commit(ctx, "bacnet_bv");
+                    ucix_wb_commit("bacnet_bv");
                 }
             }
         case PROP_TIME_DELAY:
@@ -1485,8 +1473,8 @@ bool Binary_Value_Write_Property(
             if (status) {
                 CurrentBV->Time_Delay = value.type.Unsigned_Int;
                 CurrentBV->Remaining_Time_Delay = CurrentBV->Time_Delay;
-                ucix_add_option_int(ctx, "bacnet_bv", index_c, "time_delay", value.type.Unsigned_Int);
-                ucix_commit(ctx, "bacnet_bv");
+                ucix_wb_add_option_int("bacnet_bv", index_c, "time_delay", value.type.Unsigned_Int);
+                ucix_wb_commit("bacnet_bv");
             }
             break;
 
@@ -1497,8 +1485,8 @@ bool Binary_Value_Write_Property(
 
             if (status) {
                 CurrentBV->Notification_Class = value.type.Unsigned_Int;
-                ucix_add_option_int(ctx, "bacnet_bv", index_c, "nc", value.type.Unsigned_Int);
-                ucix_commit(ctx, "bacnet_bv");
+                ucix_wb_add_option_int("bacnet_bv", index_c, "nc", value.type.Unsigned_Int);
+                ucix_wb_commit("bacnet_bv");
             }
             break;
 
@@ -1510,8 +1498,8 @@ bool Binary_Value_Write_Property(
             if (status) {
                 if (value.type.Bit_String.bits_used == 3) {
                     CurrentBV->Event_Enable = value.type.Bit_String.value[0];
-                    ucix_add_option_int(ctx, "bacnet_bv", index_c, "event", value.type.Bit_String.value[0]);
-                    ucix_commit(ctx, "bacnet_bv");
+                    ucix_wb_add_option_int("bacnet_bv", index_c, "event", value.type.Bit_String.value[0]);
+                    ucix_wb_commit("bacnet_bv");
                 } else {
                     wp_data->error_class = ERROR_CLASS_PROPERTY;
                     wp_data->error_code = ERROR_CODE_VALUE_OUT_OF_RANGE;
@@ -1588,7 +1576,6 @@ bool Binary_Value_Write_Property(
             wp_data->error_code = ERROR_CODE_UNKNOWN_PROPERTY;
             break;
     }
-    ucix_cleanup(ctx);
     return status;
 }
 
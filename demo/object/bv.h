@@ -113,6 +113,9 @@ struct bv_inst_itr_ctx {
     unsigned Binary_Value_Instance_To_Index(
         uint32_t instance);
 
+    void Binary_Value_Instance_Index_Build(
+        void);
+
     bool Binary_Value_Object_Instance_Add(
         uint32_t instance);
 
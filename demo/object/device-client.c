@@ -979,6 +979,10 @@ int Device_Read_Property_Local(
         case PROP_DEVICE_ADDRESS_BINDING:
             /* FIXME: the real max apdu remaining should be passed into function */
             apdu_len = address_list_encode(&apdu[0], MAX_APDU);
+            if (apdu_len < 0) {
+                rpdata->error_code =
+                    ERROR_CODE_ABORT_SEGMENTATION_NOT_SUPPORTED;
+            }
             break;
         case PROP_DATABASE_REVISION:
             apdu_len =
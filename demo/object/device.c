@@ -137,6 +137,29 @@ extern bool Routed_Device_Write_Property_Local(
 /* may be overridden by outside table */
 static object_functions_t *Object_Table;
 
+/** One entry of the materialized Object_List, in array index order. */
+typedef struct object_list_entry {
+    BACNET_OBJECT_TYPE Object_Type;
+    uint32_t Object_Instance;
+    struct object_functions *pObject;
+    /* object name index - the Device object itself is not indexed */
+    bool Name_Indexed;
+    uint32_t Name_Hash;
+    struct object_list_entry *Name_Next;
+    /* object identifier index */
+    struct object_list_entry *Id_Next;
+} OBJECT_LIST_ENTRY;
+
+/* cache of the virtual, concatenated object list of all object types */
+static OBJECT_LIST_ENTRY *Object_List_Cache;
+static unsigned Object_List_Cache_Size;
+static unsigned Object_List_Cache_Count;
+static bool Object_List_Cache_Valid;
+/* hash tables of chained Object_List_Cache entries, by name and by id */
+static OBJECT_LIST_ENTRY **Object_Name_Table;
+static OBJECT_LIST_ENTRY **Object_Id_Table;
+static unsigned Object_Hash_Table_Size;        /* always a power of two */
+
 #if defined(BAC_UCI)
 struct uci_context *ctx;
 #endif /* defined(BAC_UCI) */
@@ -752,6 +775,10 @@ static const int Device_Properties_Optional[] = {
 #if defined(BACDL_MSTP)
     PROP_MAX_MASTER,
     PROP_MAX_INFO_FRAMES,
+#endif
+#if (MAX_SEGMENTED_RESPONSES)
+    /* required when segmentation is supported */
+    PROP_MAX_SEGMENTS_ACCEPTED,
 #endif
     PROP_DESCRIPTION,
     PROP_LOCAL_TIME,
@@ -925,16 +952,8 @@ bool Device_Set_Object_Name(
 #endif
         }
 
-        ctx = ucix_init("bacnet_dev");
-        if(ctx) {
-            ucix_add_option(ctx, "bacnet_dev", pEnv, "name", object_name->value);
-            ucix_commit(ctx, "bacnet_dev");
-            ucix_cleanup(ctx);
-#if PRINT_ENABLED
-        } else {
-            fprintf(stderr,  "Failed to open config file bacnet_dev\n");
-#endif
-        }
+        ucix_wb_add_option("bacnet_dev", pEnv, "name", object_name->value);
+        ucix_wb_commit("bacnet_dev");
 #endif /* defined(BAC_UCI) */
     }
 
@@ -1113,16 +1132,8 @@ bool Device_Set_Description(
 #endif
         }
 
-        ctx = ucix_init("bacnet_dev");
-        if(ctx) {
-            ucix_add_option(ctx, "bacnet_dev", pEnv, "description", name);
-            ucix_commit(ctx, "bacnet_dev");
-            ucix_cleanup(ctx);
-#if PRINT_ENABLED
-        } else {
-            fprintf(stderr,  "Failed to open config file bacnet_dev\n");
-#endif
-        }
+        ucix_wb_add_option("bacnet_dev", pEnv, "description", name);
+        ucix_wb_commit("bacnet_dev");
 #endif /* defined(BAC_UCI) */
         status = true;
     }
@@ -1156,16 +1167,8 @@ bool Device_Set_Location(
 #endif
         }
 
-        ctx = ucix_init("bacnet_dev");
-        if(ctx) {
-            ucix_add_option(ctx, "bacnet_dev", pEnv, "location", name);
-            ucix_commit(ctx, "bacnet_dev");
-            ucix_cleanup(ctx);
-#if PRINT_ENABLED
-        } else {
-            fprintf(stderr,  "Failed to open config file bacnet_dev\n");
-#endif
-        }
+        ucix_wb_add_option("bacnet_dev", pEnv, "location", name);
+        ucix_wb_commit("bacnet_dev");
 #endif /* defined(BAC_UCI) */
         status = true;
     }
@@ -1188,7 +1191,12 @@ uint8_t Device_Protocol_Revision(
 BACNET_SEGMENTATION Device_Segmentation_Supported(
     void)
 {
+#if (MAX_SEGMENTED_RESPONSES)
+    /* large ComplexACKs are sent segmented by the TSM */
+    return SEGMENTATION_TRANSMIT;
+#else
     return SEGMENTATION_NONE;
+#endif
 }
 
 uint32_t Device_Database_Revision(
@@ -1212,20 +1220,142 @@ void Device_Inc_Database_Revision(
     void)
 {
     Database_Revision++;
+    /* object ids or the set of objects changed */
+    Device_Object_List_Invalidate();
 }
 
-/** Get the total count of objects supported by this Device Object.
- * @note Since many network clients depend on the object list
- *       for discovery, it must be consistent!
- * @return The count of objects, for all supported Object types.
+/** Drop the cached Object_List.
+ * Call whenever objects are created or deleted, or an object table
+ * is reloaded from configuration; the cache is rebuilt on next use.
  */
-unsigned Device_Object_List_Count(
+void Device_Object_List_Invalidate(
+    void)
+{
+    Object_List_Cache_Valid = false;
+}
+
+/* FNV-1a over the encoding and the octets of an object name */
+static uint32_t Device_Object_Name_Hash(
+    BACNET_CHARACTER_STRING * object_name)
+{
+    uint32_t hash = 2166136261UL;
+    const char *value = characterstring_value(object_name);
+    size_t length = characterstring_length(object_name);
+    size_t i = 0;
+
+    hash = (hash ^ characterstring_encoding(object_name)) * 16777619UL;
+    for (i = 0; i < length; i++) {
+        hash = (hash ^ (uint8_t) value[i]) * 16777619UL;
+    }
+
+    return hash;
+}
+
+static unsigned Device_Object_Id_Bucket(
+    int object_type,
+    uint32_t object_instance)
+{
+    uint32_t hash;
+
+    hash = ((uint32_t) object_type << 22) ^ object_instance;
+    hash *= 2654435761UL;
+
+    return (unsigned) (hash >> 8) & (Object_Hash_Table_Size - 1);
+}
+
+/* (re)insert an entry into the name index using its current name */
+static void Device_Object_Name_Index_Add(
+    OBJECT_LIST_ENTRY * entry)
+{
+    BACNET_CHARACTER_STRING object_name;
+    unsigned bucket = 0;
+
+    entry->Name_Indexed = false;
+    entry->Name_Next = NULL;
+    if ((entry->Object_Type == OBJECT_DEVICE) ||
+        (entry->pObject->Object_Name == NULL) ||
+        !entry->pObject->Object_Name(entry->Object_Instance, &object_name)) {
+        return;
+    }
+    entry->Name_Hash = Device_Object_Name_Hash(&object_name);
+    bucket = entry->Name_Hash & (Object_Hash_Table_Size - 1);
+    entry->Name_Next = Object_Name_Table[bucket];
+    Object_Name_Table[bucket] = entry;
+    entry->Name_Indexed = true;
+}
+
+static void Device_Object_Name_Index_Remove(
+    OBJECT_LIST_ENTRY * entry)
+{
+    OBJECT_LIST_ENTRY **link = NULL;
+
+    if (!entry->Name_Indexed) {
+        return;
+    }
+    link = &Object_Name_Table[entry->Name_Hash & (Object_Hash_Table_Size - 1)];
+    while (*link) {
+        if (*link == entry) {
+            *link = entry->Name_Next;
+            break;
+        }
+        link = &(*link)->Name_Next;
+    }
+    entry->Name_Indexed = false;
+    entry->Name_Next = NULL;
+}
+
+/* size the hash tables for count entries and empty them */
+static bool Device_Object_Hash_Tables_Init(
+    unsigned count)
+{
+    unsigned size = 16;
+    OBJECT_LIST_ENTRY **table = NULL;
+
+    /* keep the load factor at or below one half */
+    while (size < (count * 2)) {
+        size *= 2;
+    }
+    if (size > Object_Hash_Table_Size) {
+        table = realloc(Object_Name_Table, size * sizeof(*table));
+        if (!table) {
+            return false;
+        }
+        Object_Name_Table = table;
+        table = realloc(Object_Id_Table, size * sizeof(*table));
+        if (!table) {
+            return false;
+        }
+        Object_Id_Table = table;
+        Object_Hash_Table_Size = size;
+    }
+    memset(Object_Name_Table, 0, Object_Hash_Table_Size * sizeof(*table));
+    memset(Object_Id_Table, 0, Object_Hash_Table_Size * sizeof(*table));
+
+    return true;
+}
+
+/** Walk all object types once and materialize the Object_List,
+ * along with its object name and object identifier indexes.
+ * @return True if the cache is valid.
+ */
+static bool Device_Object_List_Cache_Build(
     void)
 {
-    unsigned count = 0; /* number of objects */
+    unsigned count = 0;
+    unsigned index = 0;
+    unsigned object_index = 0;
+    unsigned type_count = 0;
+    unsigned bucket = 0;
+    unsigned i = 0;
+    OBJECT_LIST_ENTRY *entries = NULL;
     struct object_functions *pObject = NULL;
 
-    /* initialize the default return values */
+    if (Object_List_Cache_Valid) {
+        return true;
+    }
+    if (!Object_Table) {
+        return false;
+    }
     pObject = Object_Table;
     while (pObject->Object_Type < MAX_BACNET_OBJECT_TYPE) {
         if (pObject->Object_Count) {
@@ -1233,14 +1363,76 @@ unsigned Device_Object_List_Count(
         }
         pObject++;
     }
+    if (count > Object_List_Cache_Size) {
+        entries = realloc(Object_List_Cache, count * sizeof(*entries));
+        if (!entries) {
+            return false;
+        }
+        Object_List_Cache = entries;
+        Object_List_Cache_Size = count;
+    }
+    pObject = Object_Table;
+    while (pObject->Object_Type < MAX_BACNET_OBJECT_TYPE) {
+        if (pObject->Object_Count && pObject->Object_Index_To_Instance) {
+            type_count = pObject->Object_Count();
+            /* Use the iterator function if available otherwise
+             * the index is the same as the position in the type */
+            if (pObject->Object_Iterator) {
+                object_index = pObject->Object_Iterator(~(unsigned) 0);
+            } else {
+                object_index = 0;
+            }
+            for (i = 0; (i < type_count) && (index < count); i++) {
+                Object_List_Cache[index].Object_Type = pObject->Object_Type;
+                Object_List_Cache[index].Object_Instance =
+                    pObject->Object_Index_To_Instance(object_index);
+                Object_List_Cache[index].pObject = pObject;
+                index++;
+                if (pObject->Object_Iterator) {
+                    object_index = pObject->Object_Iterator(object_index);
+                } else {
+                    object_index++;
+                }
+            }
+        }
+        pObject++;
+    }
+    Object_List_Cache_Count = index;
+    if (!Device_Object_Hash_Tables_Init(Object_List_Cache_Count)) {
+        return false;
+    }
+    for (i = 0; i < Object_List_Cache_Count; i++) {
+        entries = &Object_List_Cache[i];
+        bucket =
+            Device_Object_Id_Bucket(entries->Object_Type,
+            entries->Object_Instance);
+        entries->Id_Next = Object_Id_Table[bucket];
+        Object_Id_Table[bucket] = entries;
+        Device_Object_Name_Index_Add(entries);
+    }
+    Object_List_Cache_Valid = true;
 
-    return count;
+    return true;
+}
+
+/** Get the total count of objects supported by this Device Object.
+ * @note Since many network clients depend on the object list
+ *       for discovery, it must be consistent!
+ * @return The count of objects, for all supported Object types.
+ */
+unsigned Device_Object_List_Count(
+    void)
+{
+    if (!Device_Object_List_Cache_Build()) {
+        return 0;
+    }
+
+    return Object_List_Cache_Count;
 }
 
 /** Lookup the Object at the given array index in the Device's Object List.
- * Even though we don't keep a single linear array of objects in the Device,
- * this method acts as though we do and works through a virtual, concatenated
- * array of all of our object type arrays.
+ * The virtual, concatenated array of all of our object type arrays is
+ * materialized once, see Device_Object_List_Cache_Build().
  *
  * @param array_index [in] The desired array index (1 to N)
  * @param object_type [out] The object's type, if found.
@@ -1252,50 +1444,63 @@ bool Device_Object_List_Identifier(
     int *object_type,
     uint32_t * instance)
 {
-    bool status = false;
-    uint32_t count = 0;
-    uint32_t object_index = 0;
-    uint32_t temp_index = 0;
-    struct object_functions *pObject = NULL;
+    OBJECT_LIST_ENTRY *entry = NULL;
 
     /* array index zero is length - so invalid */
     if (array_index == 0) {
-        return status;
+        return false;
     }
-    object_index = array_index - 1;
-    /* initialize the default return values */
-    pObject = Object_Table;
-    while (pObject->Object_Type < MAX_BACNET_OBJECT_TYPE) {
-        if (pObject->Object_Count) {
-            object_index -= count;
-            count = pObject->Object_Count();
-            if (object_index < count) {
-                /* Use the iterator function if available otherwise
-                 * look for the index to instance to get the ID */
-                if (pObject->Object_Iterator) {
-                    /* First find the first object */
-                    temp_index = pObject->Object_Iterator(~(unsigned) 0);
-                    /* Then step through the objects to find the nth */
-                    while (object_index != 0) {
-                        temp_index = pObject->Object_Iterator(temp_index);
-                        object_index--;
-                    }
-                    /* set the object_index up before falling through to next bit */
-                    object_index = temp_index;
-                }
-                if (pObject->Object_Index_To_Instance) {
-                    *object_type = pObject->Object_Type;
-                    *instance =
-                        pObject->Object_Index_To_Instance(object_index);
-                    status = true;
-                    break;
-                }
-            }
-        }
-        pObject++;
+    if (!Device_Object_List_Cache_Build() ||
+        (array_index > Object_List_Cache_Count)) {
+        return false;
+    }
+    entry = &Object_List_Cache[array_index - 1];
+    *object_type = entry->Object_Type;
+#if defined(BAC_ROUTING)
+    /* the routed Device instance follows the currently addressed device */
+    if (entry->Object_Type == OBJECT_DEVICE) {
+        *instance = entry->pObject->Object_Index_To_Instance(0);
+    } else {
+        *instance = entry->Object_Instance;
     }
+#else
+    *instance = entry->Object_Instance;
+#endif
 
-    return status;
+    return true;
+}
+
+/** Keep the object name index current after an object was renamed.
+ * Object modules call this once the new name is stored.
+ * @param object_type [in] The BACNET_OBJECT_TYPE of the renamed Object.
+ * @param object_instance [in] The object instance number of the renamed Object.
+ */
+void Device_Object_Name_Changed(
+    int object_type,
+    uint32_t object_instance)
+{
+    OBJECT_LIST_ENTRY *entry = NULL;
+
+    if (!Object_List_Cache_Valid) {
+        /* the index is rebuilt with the cache */
+        return;
+    }
+    entry =
+        Object_Id_Table[Device_Object_Id_Bucket(object_type,
+            object_instance)];
+    while (entry) {
+        if ((entry->Object_Type == object_type) &&
+            (entry->Object_Instance == object_instance)) {
+            break;
+        }
+        entry = entry->Id_Next;
+    }
+    if (entry) {
+        Device_Object_Name_Index_Remove(entry);
+        Device_Object_Name_Index_Add(entry);
+    } else {
+        Device_Object_List_Invalidate();
+    }
 }
 
 /** Determine if we have an object with the given object_name.
@@ -1314,28 +1519,48 @@ bool Device_Valid_Object_Name(
     bool found = false;
     int type = 0;
     uint32_t instance;
-    uint32_t max_objects = 0, i = 0;
-    bool check_id = false;
+    uint32_t hash = 0;
     BACNET_CHARACTER_STRING object_name2;
     struct object_functions *pObject = NULL;
+    OBJECT_LIST_ENTRY *entry = NULL;
 
-    max_objects = Device_Object_List_Count();
-    for (i = 1; i <= max_objects; i++) {
-        check_id = Device_Object_List_Identifier(i, &type, &instance);
-        if (check_id) {
-            pObject = Device_Objects_Find_Functions(type);
-            if ((pObject != NULL) && (pObject->Object_Name != NULL) &&
-                (pObject->Object_Name(instance, &object_name2) &&
-                    characterstring_same(object_name1, &object_name2))) {
+    if (!Device_Object_List_Cache_Build()) {
+        return false;
+    }
+    /* the Device object name is not indexed, since it follows the
+       currently addressed device when routing */
+    pObject = Device_Objects_Find_Functions(OBJECT_DEVICE);
+    if (pObject && pObject->Object_Index_To_Instance &&
+        pObject->Object_Name) {
+        instance = pObject->Object_Index_To_Instance(0);
+        if (pObject->Object_Name(instance, &object_name2) &&
+            characterstring_same(object_name1, &object_name2)) {
+            type = OBJECT_DEVICE;
+            found = true;
+        }
+    }
+    if (!found) {
+        hash = Device_Object_Name_Hash(object_name1);
+        entry = Object_Name_Table[hash & (Object_Hash_Table_Size - 1)];
+        while (entry) {
+            if ((entry->Name_Hash == hash) &&
+                entry->pObject->Object_Name(entry->Object_Instance,
+                    &object_name2) &&
+                characterstring_same(object_name1, &object_name2)) {
+                type = entry->Object_Type;
+                instance = entry->Object_Instance;
                 found = true;
-                if (object_type) {
-                    *object_type = type;
-                }
-                if (object_instance) {
-                    *object_instance = instance;
-                }
                 break;
             }
+            entry = entry->Name_Next;
+        }
+    }
+    if (found) {
+        if (object_type) {
+            *object_type = type;
+        }
+        if (object_instance) {
+            *object_instance = instance;
         }
     }
 
@@ -1730,6 +1955,14 @@ int Device_Read_Property_Local(
                 encode_application_enumerated(&apdu[0],
                 Device_Segmentation_Supported());
             break;
+#if (MAX_SEGMENTED_RESPONSES)
+        case PROP_MAX_SEGMENTS_ACCEPTED:
+            /* the segmented ComplexACKs to our requests, if any */
+            apdu_len =
+                encode_application_unsigned(&apdu[0],
+                MAX_SEGMENTED_CONFIRMATIONS ? MAX_SEGMENTS_ACCEPTED : 1);
+            break;
+#endif
         case PROP_APDU_TIMEOUT:
             apdu_len = encode_application_unsigned(&apdu[0], apdu_timeout());
             break;
@@ -1738,6 +1971,10 @@ int Device_Read_Property_Local(
             break;
         case PROP_DEVICE_ADDRESS_BINDING:
             apdu_len = address_list_encode(&apdu[0], apdu_max);
+            if (apdu_len < 0) {
+                rpdata->error_code =
+                    ERROR_CODE_ABORT_SEGMENTATION_NOT_SUPPORTED;
+            }
             break;
         case PROP_DATABASE_REVISION:
             apdu_len =
@@ -2110,6 +2347,9 @@ bool Device_Write_Property_Local(
         case PROP_OBJECT_LIST:
         case PROP_MAX_APDU_LENGTH_ACCEPTED:
         case PROP_SEGMENTATION_SUPPORTED:
+#if (MAX_SEGMENTED_RESPONSES)
+        case PROP_MAX_SEGMENTS_ACCEPTED:
+#endif
         case PROP_DEVICE_ADDRESS_BINDING:
         case PROP_DATABASE_REVISION:
         case PROP_ACTIVE_COV_SUBSCRIPTIONS:
@@ -2268,16 +2508,15 @@ void Device_local_reporting(
 
     /* loop for all objects */
     for (idx = 1; idx <= objects_count; idx++) {
-        Device_Object_List_Identifier(idx, &object_type, &object_instance);
-
-        pObject = Device_Objects_Find_Functions(object_type);
-        if (pObject != NULL) {
-            if (pObject->Object_Valid_Instance &&
-                pObject->Object_Valid_Instance(object_instance)) {
-                if (pObject->Object_Intrinsic_Reporting) {
-                    pObject->Object_Intrinsic_Reporting(object_instance);
-                }
-            }
+        if (!Device_Object_List_Identifier(idx, &object_type,
+                &object_instance)) {
+            continue;
+        }
+        pObject = Object_List_Cache[idx - 1].pObject;
+        if (pObject->Object_Intrinsic_Reporting &&
+            pObject->Object_Valid_Instance &&
+            pObject->Object_Valid_Instance(object_instance)) {
+            pObject->Object_Intrinsic_Reporting(object_instance);
         }
     }
 }
@@ -2379,6 +2618,7 @@ void Device_Init(
         }
         pObject++;
     }
+    Device_Object_List_Invalidate();
 }
 
 bool DeviceGetRRInfo(
@@ -2453,6 +2693,7 @@ void Routing_Device_Init(
     pDevObject->Object_Name = Routed_Device_Name;
     pDevObject->Object_Read_Property = Routed_Device_Read_Property_Local;
     pDevObject->Object_Write_Property = Routed_Device_Write_Property_Local;
+    Device_Object_List_Invalidate();
 }
 
 #endif /* BAC_ROUTING */
@@ -2508,6 +2749,9 @@ void testDevice(
 {
     bool status = false;
     const char *name = "Patricia";
+    BACNET_CHARACTER_STRING object_name;
+    int object_type = 0;
+    uint32_t object_instance = 0;
 
     status = Device_Set_Object_Instance_Number(0);
     ct_test(pTest, Device_Object_Instance_Number() == 0);
@@ -2533,6 +2777,20 @@ void testDevice(
     Device_Set_Model_Name(name, strlen(name));
     ct_test(pTest, strcmp(Device_Model_Name(), name) == 0);
 
+    Device_Init(NULL);
+    characterstring_init_ansi(&object_name, name);
+    status = Device_Set_Object_Name(&object_name);
+    ct_test(pTest, status == true);
+    status =
+        Device_Valid_Object_Name(&object_name, &object_type,
+        &object_instance);
+    ct_test(pTest, status == true);
+    ct_test(pTest, object_type == OBJECT_DEVICE);
+    ct_test(pTest, object_instance == Device_Object_Instance_Number());
+    characterstring_init_ansi(&object_name, "Nobody");
+    status = Device_Valid_Object_Name(&object_name, NULL, NULL);
+    ct_test(pTest, status == false);
+
     return;
 }
 
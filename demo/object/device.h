@@ -277,6 +277,8 @@ extern "C" {
         uint32_t object_id);
     unsigned Device_Object_List_Count(
         void);
+    void Device_Object_List_Invalidate(
+        void);
     bool Device_Object_List_Identifier(
         uint32_t array_index,
         int *object_type,
@@ -359,6 +361,9 @@ extern "C" {
         BACNET_CHARACTER_STRING * object_name,
         int *object_type,
         uint32_t * object_instance);
+    void Device_Object_Name_Changed(
+        int object_type,
+        uint32_t object_instance);
     bool Device_Valid_Object_Id(
         int object_type,
         uint32_t object_instance);
@@ -43,6 +43,7 @@
 #include "handlers.h"
 #include "msi.h"
 #include "ucix.h"
+#include "keylist.h"
 
 /* number of demo objects */
 #ifndef MAX_MULTI_STATE_INPUTS
@@ -60,6 +61,8 @@ unsigned max_multi_state_inputs_int = 0;
 #define MULTI_STATE_LEVEL_NULL 255
 
 MULTI_STATE_INPUT_DESCR MSI_Descr[MAX_MULTI_STATE_INPUTS];
+/* sorted instance number index into MSI_Descr[] */
+static OS_Keylist MSI_Instance_List;
 
 /* These three arrays are used by the ReadPropertyMultiple handler */
 static const int Multistate_Input_Properties_Required[] = {
@@ -333,6 +336,7 @@ void Multistate_Input_Init(
                 max_multi_state_inputs_int = i;
             }
         }
+        Multistate_Input_Instance_Index_Build();
 #if PRINT_ENABLED
         fprintf(stderr, "max_multi_state_inputs: %i\n", max_multi_state_inputs_int);
 #endif
@@ -342,21 +346,36 @@ void Multistate_Input_Init(
     return;
 }
 
-/* we simply have 0-n object instances.  Yours might be */
-/* more complex, and then you need to return the index */
-/* that correlates to the correct instance number */
+/* (re)builds the sorted instance number index of MSI_Descr[] */
+/* call whenever the table was loaded or changed */
+void Multistate_Input_Instance_Index_Build(
+    void)
+{
+    unsigned i;
+
+    if (!MSI_Instance_List) {
+        MSI_Instance_List = Keylist_Create();
+    }
+    while (Keylist_Count(MSI_Instance_List) > 0) {
+        (void) Keylist_Data_Pop(MSI_Instance_List);
+    }
+    for (i = 0; i < max_multi_state_inputs_int; i++) {
+        (void) Keylist_Data_Add(MSI_Instance_List, MSI_Descr[i].Instance,
+            &MSI_Descr[i]);
+    }
+}
+
+/* binary search of the instance index for the MSI_Descr[] offset */
 unsigned Multistate_Input_Instance_To_Index(
     uint32_t object_instance)
 {
     MULTI_STATE_INPUT_DESCR *CurrentMSI;
-    int index,i;
-    index = max_multi_state_inputs_int;
-    for (i = 0; i < index; i++) {
-    	CurrentMSI = &MSI_Descr[i];
-    	if (CurrentMSI->Instance == object_instance) {
-    		return i;
-    	}
+
+    CurrentMSI = Keylist_Data(MSI_Instance_List, object_instance);
+    if (CurrentMSI) {
+        return (unsigned) (CurrentMSI - MSI_Descr);
     }
+
     return MAX_MULTI_STATE_INPUTS;
 }
 
@@ -539,6 +558,8 @@ bool Multistate_Input_Present_Value_Set(
                 CurrentMSI->Priority_Array[15] = (uint8_t) value;
             }
             CurrentMSI->Changed = true;
+            handler_cov_object_changed(OBJECT_MULTI_STATE_INPUT,
+                object_instance);
             status = true;
         }
     }
@@ -573,6 +594,7 @@ void Multistate_Input_Out_Of_Service_Set(
         CurrentMSI = &MSI_Descr[index];
         CurrentMSI->Out_Of_Service = value;
         CurrentMSI->Changed = true;
+        handler_cov_object_changed(OBJECT_MULTI_STATE_INPUT, object_instance);
     }
 }
 
@@ -683,16 +705,9 @@ static bool Multistate_Input_Description_Write(
                 } else {
                     sprintf(idx_cc,"%d",CurrentMSI->Instance);
                     idx_c = idx_cc;
-                    if(ctx) {
-                        ucix_add_option(ctx, "bacnet_mi", idx_c,
-                            "description", char_string->value);
-                        ucix_commit(ctx, "bacnet_mi");
-#if PRINT_ENABLED
-                    } else {
-                        fprintf(stderr,
-                            "Failed to open config file bacnet_mi\n");
-#endif
-                    }
+                    ucix_wb_add_option("bacnet_mi", idx_c,
+                        "description", char_string->value);
+                    ucix_wb_commit("bacnet_mi");
                 }
             } else {
                 *error_class = ERROR_CLASS_PROPERTY;
@@ -786,18 +801,13 @@ static bool Multistate_Input_Object_Name_Write(
                     *error_class = ERROR_CLASS_PROPERTY;
                     *error_code = ERROR_CODE_VALUE_OUT_OF_RANGE;
                 } else {
+                    Device_Object_Name_Changed(OBJECT_MULTI_STATE_INPUT,
+                        object_instance);
                     sprintf(idx_cc,"%d",CurrentMSI->Instance);
                     idx_c = idx_cc;
-                    if(ctx) {
-                        ucix_add_option(ctx, "bacnet_mi", idx_c,
-                            "name", char_string->value);
-                        ucix_commit(ctx, "bacnet_mi");
-#if PRINT_ENABLED
-                    } else {
-                        fprintf(stderr,
-                            "Failed to open config file bacnet_mi\n");
-#endif
-                    }
+                    ucix_wb_add_option("bacnet_mi", idx_c,
+                        "name", char_string->value);
+                    ucix_wb_commit("bacnet_mi");
                 }
             } else {
                 *error_class = ERROR_CLASS_PROPERTY;
@@ -900,7 +910,7 @@ static bool Multistate_Input_State_Text_Write(
                     status =
                         characterstring_ansi_copy(CurrentMSI->State_Text[state_index],
                     sizeof(CurrentMSI->State_Text[state_index]), char_string);
-                    ucix_set_list(ctx, "bacnet_mi", idx_c, "state",
+                    ucix_wb_set_list("bacnet_mi", idx_c, "state",
                         CurrentMSI->State_Text, CurrentMSI->number_of_states);
 #if defined(INTRINSIC_REPORTING)
                     ucialarmstate_n = CurrentMSI->number_of_alarmstates;
@@ -910,7 +920,7 @@ static bool Multistate_Input_State_Text_Write(
                         sprintf(ucialarmstate[j], "%s",
                             CurrentMSI->State_Text[alarm_value-1]);
                     }
-                    ucix_set_list(ctx, "bacnet_mi", idx_c, "alarmstate",
+                    ucix_wb_set_list("bacnet_mi", idx_c, "alarmstate",
                         ucialarmstate, ucialarmstate_n);
 #endif
                     if (!status) {
@@ -1285,7 +1295,6 @@ bool Multistate_Input_Write_Property(
     BACNET_APPLICATION_DATA_VALUE value;
     uint32_t max_states = 0;
     uint32_t array_index = 0;
-    ctx = ucix_init("bacnet_mi");
 #if defined(INTRINSIC_REPORTING)
     const char index_c[32] = "";
 #endif
@@ -1363,14 +1372,14 @@ bool Multistate_Input_Write_Property(
                         value.type.Unsigned_Int, wp_data->priority)) {
                     status = true;
                     sprintf(cur_value,"%d",value.type.Unsigned_Int);
-                    ucix_add_option(ctx, "bacnet_mi", idx_c, "value",
+                    ucix_wb_add_option("bacnet_mi", idx_c, "value",
                         cur_value);
                     cur_value_time = time(NULL);
-                    ucix_add_option_int(ctx, "bacnet_mi", idx_c, "value_time",
+                    ucix_wb_add_option_int("bacnet_mi", idx_c, "value_time",
                         cur_value_time);
-                    ucix_add_option_int(ctx, "bacnet_mi", idx_c, "write",
+                    ucix_wb_add_option_int("bacnet_mi", idx_c, "write",
                         1);
-                    ucix_save_state(ctx, "bacnet_mi");
+                    ucix_wb_save_state("bacnet_mi");
                 } else if (wp_data->priority == 6) {
                     /* Command priority 6 is reserved for use by Minimum On/Off
                        algorithm and may not be used for other purposes in any
@@ -1515,9 +1524,9 @@ bool Multistate_Input_Write_Property(
                         array_index++;        
                     }
                     CurrentMSI->number_of_alarmstates = ucialarmstate_n;
-                    ucix_set_list(ctx, "bacnet_mi", idx_c, "alarmstate",
+                    ucix_wb_set_list("bacnet_mi", idx_c, "alarmstate",
                         ucialarmstate, ucialarmstate_n);
-                    ucix_commit(ctx, "bacnet_mi");
+                    ucix_wb_commit("bacnet_mi");
                 }
             }
         case PROP_TIME_DELAY:
@@ -1528,8 +1537,8 @@ bool Multistate_Input_Write_Property(
             if (status) {
                 CurrentMSI->Time_Delay = value.type.Unsigned_Int;
                 CurrentMSI->Remaining_Time_Delay = CurrentMSI->Time_Delay;
-                ucix_add_option_int(ctx, "bacnet_mi", index_c, "time_delay", value.type.Unsigned_Int);
-                ucix_commit(ctx, "bacnet_mi");
+                ucix_wb_add_option_int("bacnet_mi", index_c, "time_delay", value.type.Unsigned_Int);
+                ucix_wb_commit("bacnet_mi");
             }
             break;
 
@@ -1540,8 +1549,8 @@ bool Multistate_Input_Write_Property(
 
             if (status) {
                 CurrentMSI->Notification_Class = value.type.Unsigned_Int;
-                ucix_add_option_int(ctx, "bacnet_mi", index_c, "nc", value.type.Unsigned_Int);
-                ucix_commit(ctx, "bacnet_mi");
+                ucix_wb_add_option_int("bacnet_mi", index_c, "nc", value.type.Unsigned_Int);
+                ucix_wb_commit("bacnet_mi");
             }
             break;
 
@@ -1553,8 +1562,8 @@ bool Multistate_Input_Write_Property(
             if (status) {
                 if (value.type.Bit_String.bits_used == 3) {
                     CurrentMSI->Event_Enable = value.type.Bit_String.value[0];
-                    ucix_add_option_int(ctx, "bacnet_mi", index_c, "event", value.type.Bit_String.value[0]);
-                    ucix_commit(ctx, "bacnet_mi");
+                    ucix_wb_add_option_int("bacnet_mi", index_c, "event", value.type.Bit_String.value[0]);
+                    ucix_wb_commit("bacnet_mi");
                 } else {
                     wp_data->error_class = ERROR_CLASS_PROPERTY;
                     wp_data->error_code = ERROR_CODE_VALUE_OUT_OF_RANGE;
@@ -1606,7 +1615,6 @@ bool Multistate_Input_Write_Property(
             wp_data->error_code = ERROR_CODE_UNKNOWN_PROPERTY;
             break;
     }
-    ucix_cleanup(ctx);
     return status;
 }
 
@@ -119,6 +119,9 @@ struct mi_inst_itr_ctx {
     unsigned Multistate_Input_Instance_To_Index(
         uint32_t object_instance);
 
+    void Multistate_Input_Instance_Index_Build(
+        void);
+
     int Multistate_Input_Read_Property(
         BACNET_READ_PROPERTY_DATA * rpdata);
 
@@ -43,6 +43,7 @@
 #include "handlers.h"
 #include "mso.h"
 #include "ucix.h"
+#include "keylist.h"
 
 /* number of demo objects */
 #ifndef MAX_MULTI_STATE_OUTPUTS
@@ -60,6 +61,8 @@ unsigned max_multi_state_outputs_int = 0;
 #define MULTI_STATE_LEVEL_NULL 255
 
 MULTI_STATE_OUTPUT_DESCR MSO_Descr[MAX_MULTI_STATE_OUTPUTS];
+/* sorted instance number index into MSO_Descr[] */
+static OS_Keylist MSO_Instance_List;
 
 /* These three arrays are used by the ReadPropertyMultiple handler */
 static const int Multistate_Output_Properties_Required[] = {
@@ -342,6 +345,7 @@ void Multistate_Output_Init(
                 max_multi_state_outputs_int = i;
             }
         }
+        Multistate_Output_Instance_Index_Build();
 #if PRINT_ENABLED
         fprintf(stderr, "max_multi_state_outputs: %i\n", max_multi_state_outputs_int);
 #endif
@@ -351,21 +355,36 @@ void Multistate_Output_Init(
     return;
 }
 
-/* we simply have 0-n object instances.  Yours might be */
-/* more complex, and then you need to return the index */
-/* that correlates to the correct instance number */
+/* (re)builds the sorted instance number index of MSO_Descr[] */
+/* call whenever the table was loaded or changed */
+void Multistate_Output_Instance_Index_Build(
+    void)
+{
+    unsigned i;
+
+    if (!MSO_Instance_List) {
+        MSO_Instance_List = Keylist_Create();
+    }
+    while (Keylist_Count(MSO_Instance_List) > 0) {
+        (void) Keylist_Data_Pop(MSO_Instance_List);
+    }
+    for (i = 0; i < max_multi_state_outputs_int; i++) {
+        (void) Keylist_Data_Add(MSO_Instance_List, MSO_Descr[i].Instance,
+            &MSO_Descr[i]);
+    }
+}
+
+/* binary search of the instance index for the MSO_Descr[] offset */
 unsigned Multistate_Output_Instance_To_Index(
     uint32_t object_instance)
 {
     MULTI_STATE_OUTPUT_DESCR *CurrentMSO;
-    int index,i;
-    index = max_multi_state_outputs_int;
-    for (i = 0; i < index; i++) {
-    	CurrentMSO = &MSO_Descr[i];
-    	if (CurrentMSO->Instance == object_instance) {
-    		return i;
-    	}
+
+    CurrentMSO = Keylist_Data(MSO_Instance_List, object_instance);
+    if (CurrentMSO) {
+        return (unsigned) (CurrentMSO - MSO_Descr);
     }
+
     return MAX_MULTI_STATE_OUTPUTS;
 }
 
@@ -551,6 +570,8 @@ bool Multistate_Output_Present_Value_Set(
                 CurrentMSO->Priority_Array[15] = (uint8_t) value;
             }
             CurrentMSO->Changed = true;
+            handler_cov_object_changed(OBJECT_MULTI_STATE_OUTPUT,
+                object_instance);
             status = true;
         }
     }
@@ -585,6 +606,7 @@ void Multistate_Output_Out_Of_Service_Set(
         CurrentMSO = &MSO_Descr[index];
         CurrentMSO->Out_Of_Service = value;
         CurrentMSO->Changed = true;
+        handler_cov_object_changed(OBJECT_MULTI_STATE_OUTPUT, object_instance);
     }
 }
 
@@ -695,16 +717,9 @@ static bool Multistate_Output_Description_Write(
                 } else {
                     sprintf(idx_cc,"%d",CurrentMSO->Instance);
                     idx_c = idx_cc;
-                    if(ctx) {
-                        ucix_add_option(ctx, "bacnet_mo", idx_c,
-                            "description", char_string->value);
-                        ucix_commit(ctx, "bacnet_mo");
-#if PRINT_ENABLED
-                    } else {
-                        fprintf(stderr,
-                            "Failed to open config file bacnet_mo\n");
-#endif
-                    }
+                    ucix_wb_add_option("bacnet_mo", idx_c,
+                        "description", char_string->value);
+                    ucix_wb_commit("bacnet_mo");
                 }
             } else {
                 *error_class = ERROR_CLASS_PROPERTY;
@@ -798,18 +813,13 @@ static bool Multistate_Output_Object_Name_Write(
                     *error_class = ERROR_CLASS_PROPERTY;
                     *error_code = ERROR_CODE_VALUE_OUT_OF_RANGE;
                 } else {
+                    Device_Object_Name_Changed(OBJECT_MULTI_STATE_OUTPUT,
+                        object_instance);
                     sprintf(idx_cc,"%d",CurrentMSO->Instance);
                     idx_c = idx_cc;
-                    if(ctx) {
-                        ucix_add_option(ctx, "bacnet_mo", idx_c,
-                            "name", char_string->value);
-                        ucix_commit(ctx, "bacnet_mo");
-#if PRINT_ENABLED
-                    } else {
-                        fprintf(stderr,
-                            "Failed to open config file bacnet_mo\n");
-#endif
-                    }
+                    ucix_wb_add_option("bacnet_mo", idx_c,
+                        "name", char_string->value);
+                    ucix_wb_commit("bacnet_mo");
                 }
             } else {
                 *error_class = ERROR_CLASS_PROPERTY;
@@ -908,7 +918,7 @@ static bool Multistate_Output_State_Text_Write(
                     status =
                         characterstring_ansi_copy(CurrentMSO->State_Text[state_index],
                     sizeof(CurrentMSO->State_Text[state_index]), char_string);
-                    ucix_set_list(ctx, "bacnet_mo", idx_c, "state",
+                    ucix_wb_set_list("bacnet_mo", idx_c, "state",
                         CurrentMSO->State_Text, CurrentMSO->number_of_states);
                     if (!status) {
                         *error_class = ERROR_CLASS_PROPERTY;
@@ -1278,7 +1288,6 @@ bool Multistate_Output_Write_Property(
     BACNET_APPLICATION_DATA_VALUE value;
     uint32_t max_states = 0;
     uint32_t array_index = 0;
-    ctx = ucix_init("bacnet_mo");
 #if defined(INTRINSIC_REPORTING)
     const char index_c[32] = "";
 #endif
@@ -1356,16 +1365,16 @@ bool Multistate_Output_Write_Property(
                         value.type.Unsigned_Int, wp_data->priority)) {
                     status = true;
                     sprintf(cur_value,"%d",value.type.Unsigned_Int);
-                    ucix_add_option(ctx, "bacnet_mo", idx_c, "value",
+                    ucix_wb_add_option("bacnet_mo", idx_c, "value",
                         cur_value);
-                    ucix_add_option(ctx, "bacnet_mo", idx_c, "fb_value",
+                    ucix_wb_add_option("bacnet_mo", idx_c, "fb_value",
                         cur_value);
                     cur_value_time = time(NULL);
-                    ucix_add_option_int(ctx, "bacnet_mo", idx_c, "value_time",
+                    ucix_wb_add_option_int("bacnet_mo", idx_c, "value_time",
                         cur_value_time);
-                    ucix_add_option_int(ctx, "bacnet_mo", idx_c, "write",
+                    ucix_wb_add_option_int("bacnet_mo", idx_c, "write",
                         1);
-                    ucix_save_state(ctx, "bacnet_mo");
+                    ucix_wb_save_state("bacnet_mo");
                 } else if (wp_data->priority == 6) {
                     /* Command priority 6 is reserved for use by Minimum On/Off
                        algorithm and may not be used for other purposes in any
@@ -1501,8 +1510,8 @@ bool Multistate_Output_Write_Property(
             if (status) {
                 CurrentMSO->Time_Delay = value.type.Unsigned_Int;
                 CurrentMSO->Remaining_Time_Delay = CurrentMSO->Time_Delay;
-                ucix_add_option_int(ctx, "bacnet_mo", index_c, "time_delay", value.type.Unsigned_Int);
-                ucix_commit(ctx, "bacnet_mo");
+                ucix_wb_add_option_int("bacnet_mo", index_c, "time_delay", value.type.Unsigned_Int);
+                ucix_wb_commit("bacnet_mo");
             }
             break;
 
@@ -1513,8 +1522,8 @@ bool Multistate_Output_Write_Property(
 
             if (status) {
                 CurrentMSO->Notification_Class = value.type.Unsigned_Int;
-                ucix_add_option_int(ctx, "bacnet_mo", index_c, "nc", value.type.Unsigned_Int);
-                ucix_commit(ctx, "bacnet_mo");
+                ucix_wb_add_option_int("bacnet_mo", index_c, "nc", value.type.Unsigned_Int);
+                ucix_wb_commit("bacnet_mo");
             }
             break;
 
@@ -1526,8 +1535,8 @@ bool Multistate_Output_Write_Property(
             if (status) {
                 if (value.type.Bit_String.bits_used == 3) {
                     CurrentMSO->Event_Enable = value.type.Bit_String.value[0];
-                    ucix_add_option_int(ctx, "bacnet_mo", index_c, "event", value.type.Bit_String.value[0]);
-                    ucix_commit(ctx, "bacnet_mo");
+                    ucix_wb_add_option_int("bacnet_mo", index_c, "event", value.type.Bit_String.value[0]);
+                    ucix_wb_commit("bacnet_mo");
                 } else {
                     wp_data->error_class = ERROR_CLASS_PROPERTY;
                     wp_data->error_code = ERROR_CODE_VALUE_OUT_OF_RANGE;
@@ -1579,7 +1588,6 @@ bool Multistate_Output_Write_Property(
             wp_data->error_code = ERROR_CODE_UNKNOWN_PROPERTY;
             break;
     }
-    ucix_cleanup(ctx);
     return status;
 }
 
@@ -120,6 +120,9 @@ struct mo_inst_itr_ctx {
     unsigned Multistate_Output_Instance_To_Index(
         uint32_t object_instance);
 
+    void Multistate_Output_Instance_Index_Build(
+        void);
+
     int Multistate_Output_Read_Property(
         BACNET_READ_PROPERTY_DATA * rpdata);
 
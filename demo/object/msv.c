@@ -43,6 +43,7 @@
 #include "handlers.h"
 #include "msv.h"
 #include "ucix.h"
+#include "keylist.h"
 
 /* number of demo objects */
 #ifndef MAX_MULTI_STATE_VALUES
@@ -60,6 +61,8 @@ unsigned max_multi_state_values_int = 0;
 #define MULTI_STATE_LEVEL_NULL 255
 
 MULTI_STATE_VALUE_DESCR MSV_Descr[MAX_MULTI_STATE_VALUES];
+/* sorted instance number index into MSV_Descr[] */
+static OS_Keylist MSV_Instance_List;
 
 /* These three arrays are used by the ReadPropertyMultiple handler */
 static const int Multistate_Value_Properties_Required[] = {
@@ -333,6 +336,7 @@ void Multistate_Value_Init(
                 max_multi_state_values_int = i;
             }
         }
+        Multistate_Value_Instance_Index_Build();
 #if PRINT_ENABLED
         fprintf(stderr, "max_multi_state_values: %i\n", max_multi_state_values_int);
 #endif
@@ -342,21 +346,36 @@ void Multistate_Value_Init(
     return;
 }
 
-/* we simply have 0-n object instances.  Yours might be */
-/* more complex, and then you need to return the index */
-/* that correlates to the correct instance number */
+/* (re)builds the sorted instance number index of MSV_Descr[] */
+/* call whenever the table was loaded or changed */
+void Multistate_Value_Instance_Index_Build(
+    void)
+{
+    unsigned i;
+
+    if (!MSV_Instance_List) {
+        MSV_Instance_List = Keylist_Create();
+    }
+    while (Keylist_Count(MSV_Instance_List) > 0) {
+        (void) Keylist_Data_Pop(MSV_Instance_List);
+    }
+    for (i = 0; i < max_multi_state_values_int; i++) {
+        (void) Keylist_Data_Add(MSV_Instance_List, MSV_Descr[i].Instance,
+            &MSV_Descr[i]);
+    }
+}
+
+/* binary search of the instance index for the MSV_Descr[] offset */
 unsigned Multistate_Value_Instance_To_Index(
     uint32_t object_instance)
 {
     MULTI_STATE_VALUE_DESCR *CurrentMSV;
-    int index,i;
-    index = max_multi_state_values_int;
-    for (i = 0; i < index; i++) {
-    	CurrentMSV = &MSV_Descr[i];
-    	if (CurrentMSV->Instance == object_instance) {
-    		return i;
-    	}
+
+    CurrentMSV = Keylist_Data(MSV_Instance_List, object_instance);
+    if (CurrentMSV) {
+        return (unsigned) (CurrentMSV - MSV_Descr);
     }
+
     return MAX_MULTI_STATE_VALUES;
 }
 
@@ -539,6 +558,8 @@ bool Multistate_Value_Present_Value_Set(
                 CurrentMSV->Priority_Array[15] = (uint8_t) value;
             }
             CurrentMSV->Changed = true;
+            handler_cov_object_changed(OBJECT_MULTI_STATE_VALUE,
+                object_instance);
             status = true;
         }
     }
@@ -573,6 +594,7 @@ void Multistate_Value_Out_Of_Service_Set(
         CurrentMSV = &MSV_Descr[index];
         CurrentMSV->Out_Of_Service = value;
         CurrentMSV->Changed = true;
+        handler_cov_object_changed(OBJECT_MULTI_STATE_VALUE, object_instance);
     }
 }
 
@@ -683,16 +705,9 @@ static bool Multistate_Value_Description_Write(
                 } else {
                     sprintf(idx_cc,"%d",CurrentMSV->Instance);
                     idx_c = idx_cc;
-                    if(ctx) {
-                        ucix_add_option(ctx, "bacnet_mv", idx_c,
-                            "description", char_string->value);
-                        ucix_commit(ctx, "bacnet_mv");
-#if PRINT_ENABLED
-                    } else {
-                        fprintf(stderr,
-                            "Failed to open config file bacnet_mv\n");
-#endif
-                    }
+                    ucix_wb_add_option("bacnet_mv", idx_c,
+                        "description", char_string->value);
+                    ucix_wb_commit("bacnet_mv");
                 }
             } else {
                 *error_class = ERROR_CLASS_PROPERTY;
@@ -786,18 +801,13 @@ static bool Multistate_Value_Object_Name_Write(
                     *error_class = ERROR_CLASS_PROPERTY;
                     *error_code = ERROR_CODE_VALUE_OUT_OF_RANGE;
                 } else {
+                    Device_Object_Name_Changed(OBJECT_MULTI_STATE_VALUE,
+                        object_instance);
                     sprintf(idx_cc,"%d",CurrentMSV->Instance);
                     idx_c = idx_cc;
-                    if(ctx) {
-                        ucix_add_option(ctx, "bacnet_mv", idx_c,
-                            "name", char_string->value);
-                        ucix_commit(ctx, "bacnet_mv");
-#if PRINT_ENABLED
-                    } else {
-                        fprintf(stderr,
-                            "Failed to open config file bacnet_mv\n");
-#endif
-                    }
+                    ucix_wb_add_option("bacnet_mv", idx_c,
+                        "name", char_string->value);
+                    ucix_wb_commit("bacnet_mv");
                 }
             } else {
                 *error_class = ERROR_CLASS_PROPERTY;
@@ -900,7 +910,7 @@ static bool Multistate_Value_State_Text_Write(
                     status =
                         characterstring_ansi_copy(CurrentMSV->State_Text[state_index],
                     sizeof(CurrentMSV->State_Text[state_index]), char_string);
-                    ucix_set_list(ctx, "bacnet_mv", idx_c, "state",
+                    ucix_wb_set_list("bacnet_mv", idx_c, "state",
                         CurrentMSV->State_Text, CurrentMSV->number_of_states);
 #if defined(INTRINSIC_REPORTING)
                     ucialarmstate_n = CurrentMSV->number_of_alarmstates;
@@ -910,7 +920,7 @@ static bool Multistate_Value_State_Text_Write(
                         sprintf(ucialarmstate[j], "%s",
                             CurrentMSV->State_Text[alarm_value-1]);
                     }
-                    ucix_set_list(ctx, "bacnet_mv", idx_c, "alarmstate",
+                    ucix_wb_set_list("bacnet_mv", idx_c, "alarmstate",
                         ucialarmstate, ucialarmstate_n);
 #endif
                     if (!status) {
@@ -1285,7 +1295,6 @@ bool Multistate_Value_Write_Property(
     BACNET_APPLICATION_DATA_VALUE value;
     uint32_t max_states = 0;
     uint32_t array_index = 0;
-    ctx = ucix_init("bacnet_mv");
 #if defined(INTRINSIC_REPORTING)
     const char index_c[32] = "";
 #endif
@@ -1363,14 +1372,14 @@ bool Multistate_Value_Write_Property(
                         value.type.Unsigned_Int, wp_data->priority)) {
                     status = true;
                     sprintf(cur_value,"%d",value.type.Unsigned_Int);
-                    ucix_add_option(ctx, "bacnet_mv", idx_c, "value",
+                    ucix_wb_add_option("bacnet_mv", idx_c, "value",
                         cur_value);
                     cur_value_time = time(NULL);
-                    ucix_add_option_int(ctx, "bacnet_mv", idx_c, "value_time",
+                    ucix_wb_add_option_int("bacnet_mv", idx_c, "value_time",
                         cur_value_time);
-                    ucix_add_option_int(ctx, "bacnet_mv", idx_c, "write",
+                    ucix_wb_add_option_int("bacnet_mv", idx_c, "write",
                         1);
-                    ucix_save_state(ctx, "bacnet_mv");
+                    ucix_wb_save_state("bacnet_mv");
                 } else if (wp_data->priority == 6) {
                     /* Command priority 6 is reserved for use by Minimum On/Off
                        algorithm and may not be used for other purposes in any
@@ -1515,9 +1524,9 @@ bool Multistate_Value_Write_Property(
                         array_index++;        
                     }
                     CurrentMSV->number_of_alarmstates = ucialarmstate_n;
-                    ucix_set_list(ctx, "bacnet_mv", idx_c, "alarmstate",
+                    ucix_wb_set_list("bacnet_mv", idx_c, "alarmstate",
                         ucialarmstate, ucialarmstate_n);
-                    ucix_commit(ctx, "bacnet_mv");
+                    ucix_wb_commit("bacnet_mv");
                 }
             }
         case PROP_TIME_DELAY:
@@ -1528,8 +1537,8 @@ bool Multistate_Value_Write_Property(
             if (status) {
                 CurrentMSV->Time_Delay = value.type.Unsigned_Int;
                 CurrentMSV->Remaining_Time_Delay = CurrentMSV->Time_Delay;
-                ucix_add_option_int(ctx, "bacnet_mv", index_c, "time_delay", value.type.Unsigned_Int);
-                ucix_commit(ctx, "bacnet_mv");
+                ucix_wb_add_option_int("bacnet_mv", index_c, "time_delay", value.type.Unsigned_Int);
+                ucix_wb_commit("bacnet_mv");
             }
             break;
 
@@ -1540,8 +1549,8 @@ bool Multistate_Value_Write_Property(
 
             if (status) {
                 CurrentMSV->Notification_Class = value.type.Unsigned_Int;
-                ucix_add_option_int(ctx, "bacnet_mv", index_c, "nc", value.type.Unsigned_Int);
-                ucix_commit(ctx, "bacnet_mv");
+                ucix_wb_add_option_int("bacnet_mv", index_c, "nc", value.type.Unsigned_Int);
+                ucix_wb_commit("bacnet_mv");
             }
             break;
 
@@ -1553,8 +1562,8 @@ bool Multistate_Value_Write_Property(
             if (status) {
                 if (value.type.Bit_String.bits_used == 3) {
                     CurrentMSV->Event_Enable = value.type.Bit_String.value[0];
-                    ucix_add_option_int(ctx, "bacnet_mv", index_c, "event", value.type.Bit_String.value[0]);
-                    ucix_commit(ctx, "bacnet_mv");
+                    ucix_wb_add_option_int("bacnet_mv", index_c, "event", value.type.Bit_String.value[0]);
+                    ucix_wb_commit("bacnet_mv");
                 } else {
                     wp_data->error_class = ERROR_CLASS_PROPERTY;
                     wp_data->error_code = ERROR_CODE_VALUE_OUT_OF_RANGE;
@@ -1606,7 +1615,6 @@ bool Multistate_Value_Write_Property(
             wp_data->error_code = ERROR_CODE_UNKNOWN_PROPERTY;
             break;
     }
-    ucix_cleanup(ctx);
     return status;
 }
 
@@ -119,6 +119,9 @@ struct mv_inst_itr_ctx {
     unsigned Multistate_Value_Instance_To_Index(
         uint32_t object_instance);
 
+    void Multistate_Value_Instance_Index_Build(
+        void);
+
     int Multistate_Value_Read_Property(
         BACNET_READ_PROPERTY_DATA * rpdata);
 
@@ -434,16 +434,9 @@ static bool Notification_Class_Description_Write(
                 } else {
                     sprintf(idx_cc,"%d",index);
                     idx_c = idx_cc;
-                    if(ctx) {
-                        ucix_add_option(ctx, "bacnet_nc", idx_c, 
-                            "description", char_string->value);
-                        ucix_commit(ctx, "bacnet_nc");
-#if PRINT_ENABLED
-                    } else {
-                        fprintf(stderr, 
-                            "Failed to open config file bacnet_nc\n");
-#endif
-                    }
+                    ucix_wb_add_option("bacnet_nc", idx_c, 
+                        "description", char_string->value);
+                    ucix_wb_commit("bacnet_nc");
                 }
             } else {
                 *error_class = ERROR_CLASS_PROPERTY;
@@ -537,18 +530,13 @@ static bool Notification_Class_Object_Name_Write(
                     *error_class = ERROR_CLASS_PROPERTY;
                     *error_code = ERROR_CODE_VALUE_OUT_OF_RANGE;
                 } else {
+                    Device_Object_Name_Changed(OBJECT_NOTIFICATION_CLASS,
+                        object_instance);
                     sprintf(idx_cc,"%d",index);
                     idx_c = idx_cc;
-                    if(ctx) {
-                        ucix_add_option(ctx, "bacnet_nc", idx_c,
-                            "name", char_string->value);
-                        ucix_commit(ctx, "bacnet_nc");
-#if PRINT_ENABLED
-                    } else {
-                        fprintf(stderr,
-                            "Failed to open config file bacnet_nc\n");
-#endif
-                    }
+                    ucix_wb_add_option("bacnet_nc", idx_c,
+                        "name", char_string->value);
+                    ucix_wb_commit("bacnet_nc");
                 }
             } else {
                 *error_class = ERROR_CLASS_PROPERTY;
@@ -807,7 +795,6 @@ bool Notification_Class_Write_Property(
     unsigned index = 0;
     int object_type = 0;
     uint32_t object_instance = 0;
-    ctx = ucix_init("bacnet_nc");
     const char *idx_c;
     char idx_cc[64];
 
@@ -955,10 +942,6 @@ bool Notification_Class_Write_Property(
             char ucirecp[NC_MAX_RECIPIENTS][64];
             int ucirecp_n = 0;
             char uci_str[64];
-#if PRINT_ENABLED
-            if (!ctx)
-                fprintf(stderr,  "Failed to open config file bacnet_nc\n");
-#endif
             idx = 0;
             iOffset = 0;
             /* decode all packed */
@@ -1106,10 +1089,8 @@ bool Notification_Class_Write_Property(
                             TmpNotify.Recipient_List[idx].Recipient._.
                                 Address.mac[3],
                             src_port);
-                        if(ctx) {
-                                sprintf(ucirecp[ucirecp_n], "%s", uci_str);
-                                ucirecp_n++;
-                        }
+                        sprintf(ucirecp[ucirecp_n], "%s", uci_str);
+                        ucirecp_n++;
                     } else if (TmpNotify.Recipient_List[idx].Recipient._.Address.
                         net != 65535) {
                         memcpy(TmpNotify.Recipient_List[idx].Recipient._.
@@ -1132,17 +1113,13 @@ bool Notification_Class_Write_Property(
                             Address.adr[2],
                             TmpNotify.Recipient_List[idx].Recipient._.
                             Address.adr[3], src_port);
-                        if(ctx) {
-                                sprintf(ucirecp[ucirecp_n], "%s", uci_str);
-                                ucirecp_n++;
-                        }
+                        sprintf(ucirecp[ucirecp_n], "%s", uci_str);
+                        ucirecp_n++;
                     } else {
                         sprintf(uci_str,  "%i\n", TmpNotify.
                             Recipient_List[idx].Recipient._.Address.net);
-                        if(ctx) {
-                                sprintf(ucirecp[ucirecp_n], "%s", uci_str);
-                                ucirecp_n++;
-                        }
+                        sprintf(ucirecp[ucirecp_n], "%s", uci_str);
+                        ucirecp_n++;
                     }
 
                     iOffset += len;
@@ -1260,11 +1237,9 @@ bool Notification_Class_Write_Property(
                 }
             }
 
-            if(ctx) {
-                ucix_set_list(ctx, "bacnet_nc", idx_c, "recipient",
-                    ucirecp, ucirecp_n);
-                ucix_commit(ctx, "bacnet_nc");
-            }
+            ucix_wb_set_list("bacnet_nc", idx_c, "recipient",
+                ucirecp, ucirecp_n);
+            ucix_wb_commit("bacnet_nc");
 
             status = true;
 
@@ -1275,9 +1250,6 @@ bool Notification_Class_Write_Property(
             wp_data->error_code = ERROR_CODE_UNKNOWN_PROPERTY;
             break;
     }
-    if(ctx) {
-        ucix_cleanup(ctx);
-    }
     return status;
 }
 
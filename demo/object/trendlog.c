@@ -43,6 +43,7 @@
 #include "handlers.h"
 #include "trendlog.h"
 #include "ucix.h"
+#include "keylist.h"
 
 /* number of demo objects */
 #ifndef MAX_TREND_LOGS
@@ -52,6 +53,8 @@ unsigned max_trend_logs_int = 0;
 
 TL_DATA_REC Logs[MAX_TREND_LOGS][TL_MAX_ENTRIES];
 static TREND_LOG_DESCR TL_Descr[MAX_TREND_LOGS];
+/* sorted instance number index into TL_Descr[] */
+static OS_Keylist TL_Instance_List;
 
 /* These three arrays are used by the ReadPropertyMultiple handler */
 static const int Trend_Log_Properties_Required[] = {
@@ -364,6 +367,7 @@ void Trend_Log_Init(
                 max_trend_logs_int = i;
             }
         }
+        Trend_Log_Instance_Index_Build();
 #if PRINT_ENABLED
         fprintf(stderr, "max_trend_logs: %i\n", max_trend_logs_int);
 #endif
@@ -373,23 +377,36 @@ void Trend_Log_Init(
     return;
 }
 
-/* we simply have 0-n object instances.  Yours might be */
-/* more complex, and then you need to return the index */
-/* that correlates to the correct instance number */
+/* (re)builds the sorted instance number index of TL_Descr[] */
+/* call whenever the table was loaded or changed */
+void Trend_Log_Instance_Index_Build(
+    void)
+{
+    unsigned i;
+
+    if (!TL_Instance_List) {
+        TL_Instance_List = Keylist_Create();
+    }
+    while (Keylist_Count(TL_Instance_List) > 0) {
+        (void) Keylist_Data_Pop(TL_Instance_List);
+    }
+    for (i = 0; i < max_trend_logs_int; i++) {
+        (void) Keylist_Data_Add(TL_Instance_List, TL_Descr[i].Instance,
+            &TL_Descr[i]);
+    }
+}
+
+/* binary search of the instance index for the TL_Descr[] offset */
 unsigned Trend_Log_Instance_To_Index(
     uint32_t object_instance)
 {
     TREND_LOG_DESCR *CurrentTL;
-    int index,i;
-    //int instance;
-    index = max_trend_logs_int;
-    for (i = 0; i < index; i++) {
-    	CurrentTL = &TL_Descr[i];
-    	//instance = CurrentTL->Instance;
-    	if (CurrentTL->Instance == object_instance) {
-    		return i;
-    	}
+
+    CurrentTL = Keylist_Data(TL_Instance_List, object_instance);
+    if (CurrentTL) {
+        return (unsigned) (CurrentTL - TL_Descr);
     }
+
     return MAX_TREND_LOGS;
 }
 
@@ -512,16 +529,9 @@ static bool Trend_Log_Description_Write(
                 } else {
                     sprintf(idx_cc, "%u", index);
                     idx_c = idx_cc;
-                    if(ctx) {
-                        ucix_add_option(ctx, "bacnet_tl", idx_c,
-                            "description", char_string->value);
-                        ucix_commit(ctx, "bacnet_bv");
-#if PRINT_ENABLED
-                    } else {
-                        fprintf(stderr,
-                            "Failed to open config file bacnet_tl\n");
-#endif
-                    }
+                    ucix_wb_add_option("bacnet_tl", idx_c,
+                        "description", char_string->value);
+                    ucix_wb_commit("bacnet_tl");
                 }
             } else {
                 *error_class = ERROR_CLASS_PROPERTY;
@@ -586,18 +596,13 @@ static bool Trend_Log_Object_Name_Write(
                     *error_class = ERROR_CLASS_PROPERTY;
                     *error_code = ERROR_CODE_VALUE_OUT_OF_RANGE;
                 } else {
+                    Device_Object_Name_Changed(OBJECT_TRENDLOG,
+                        object_instance);
                     sprintf(idx_cc, "%d", index);
                     idx_c = idx_cc;
-                    if(ctx) {
-                        ucix_add_option(ctx, "bacnet_tl", idx_c,
-                            "name", char_string->value);
-                        ucix_commit(ctx, "bacnet_tl");
-#if PRINT_ENABLED
-                    } else {
-                        fprintf(stderr,
-                            "Failed to open config file bacnet_tl\n");
-#endif
-                    }
+                    ucix_wb_add_option("bacnet_tl", idx_c,
+                        "name", char_string->value);
+                    ucix_wb_commit("bacnet_tl");
                 }
             } else {
                 *error_class = ERROR_CLASS_PROPERTY;
@@ -815,7 +820,6 @@ bool Trend_Log_Write_Property(
     BACNET_DATE TempDate;       /* build here in case of error in time half of datetime */
     BACNET_DEVICE_OBJECT_PROPERTY_REFERENCE TempSource;
     bool bEffectiveEnable;
-    ctx = ucix_init("bacnet_tl");
     //const char *idx_c;
     char idx_cc[64];
 
@@ -1285,9 +1289,6 @@ bool Trend_Log_Write_Property(
             break;
     }
 
-    if(ctx) {
-        ucix_cleanup(ctx);
-    }
 
     return status;
 }
@@ -167,6 +167,9 @@ struct tl_inst_itr_ctx {
     unsigned Trend_Log_Instance_To_Index(
         uint32_t instance);
 
+    void Trend_Log_Instance_Index_Build(
+        void);
+
     bool Trend_Log_Object_Instance_Add(
         uint32_t instance);
 
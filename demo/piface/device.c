@@ -295,6 +295,10 @@ static const int Device_Properties_Optional[] = {
 #if defined(BACDL_MSTP)
     PROP_MAX_MASTER,
     PROP_MAX_INFO_FRAMES,
+#endif
+#if (MAX_SEGMENTED_RESPONSES)
+    /* required when segmentation is supported */
+    PROP_MAX_SEGMENTS_ACCEPTED,
 #endif
     PROP_DESCRIPTION,
     PROP_LOCAL_TIME,
@@ -649,7 +653,12 @@ uint8_t Device_Protocol_Revision(
 BACNET_SEGMENTATION Device_Segmentation_Supported(
     void)
 {
+#if (MAX_SEGMENTED_RESPONSES)
+    /* large ComplexACKs are sent segmented by the TSM */
+    return SEGMENTATION_TRANSMIT;
+#else
     return SEGMENTATION_NONE;
+#endif
 }
 
 uint32_t Device_Database_Revision(
@@ -759,6 +768,19 @@ bool Device_Object_List_Identifier(
     return status;
 }
 
+/** Object modules report renamed objects here.
+ * This device keeps no object name index, so there is nothing to update.
+ * @param object_type [in] The BACNET_OBJECT_TYPE of the renamed Object.
+ * @param object_instance [in] The object instance number of the renamed Object.
+ */
+void Device_Object_Name_Changed(
+    int object_type,
+    uint32_t object_instance)
+{
+    (void) object_type;
+    (void) object_instance;
+}
+
 /** Determine if we have an object with the given object_name.
  * If the object_type and object_instance pointers are not null,
  * and the lookup succeeds, they will be given the resulting values.
@@ -1112,6 +1134,14 @@ int Device_Read_Property_Local(
                 encode_application_enumerated(&apdu[0],
                 Device_Segmentation_Supported());
             break;
+#if (MAX_SEGMENTED_RESPONSES)
+        case PROP_MAX_SEGMENTS_ACCEPTED:
+            /* the segmented ComplexACKs to our requests, if any */
+            apdu_len =
+                encode_application_unsigned(&apdu[0],
+                MAX_SEGMENTED_CONFIRMATIONS ? MAX_SEGMENTS_ACCEPTED : 1);
+            break;
+#endif
         case PROP_APDU_TIMEOUT:
             apdu_len = encode_application_unsigned(&apdu[0], apdu_timeout());
             break;
@@ -1120,6 +1150,10 @@ int Device_Read_Property_Local(
             break;
         case PROP_DEVICE_ADDRESS_BINDING:
             apdu_len = address_list_encode(&apdu[0], apdu_max);
+            if (apdu_len < 0) {
+                rpdata->error_code =
+                    ERROR_CODE_ABORT_SEGMENTATION_NOT_SUPPORTED;
+            }
             break;
         case PROP_DATABASE_REVISION:
             apdu_len =
@@ -1383,6 +1417,9 @@ bool Device_Write_Property_Local(
         case PROP_OBJECT_LIST:
         case PROP_MAX_APDU_LENGTH_ACCEPTED:
         case PROP_SEGMENTATION_SUPPORTED:
+#if (MAX_SEGMENTED_RESPONSES)
+        case PROP_MAX_SEGMENTS_ACCEPTED:
+#endif
         case PROP_DEVICE_ADDRESS_BINDING:
         case PROP_DATABASE_REVISION:
         case PROP_ACTIVE_COV_SUBSCRIPTIONS:
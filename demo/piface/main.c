@@ -54,6 +54,9 @@
 #include "bi.h"
 #include "bo.h"
 #include "pifacedigital.h"
+#if defined(BAC_UCI)
+#include "ucix.h"
+#endif
 
 /** @file server/main.c  Example server application using the BACnet Stack. */
 
@@ -192,6 +195,26 @@ static void piface_task(void)
     }   
 }
 
+/* set by a signal, to return from main() and run the exit handlers */
+static volatile sig_atomic_t Stop;
+
+static void sig_int(
+    int signo)
+{
+    (void) signo;
+    /* the exit handlers flush the pending config changes, but they
+       are not safe to run in a signal handler */
+    Stop = 1;
+}
+
+static void signal_init(
+    void)
+{
+    signal(SIGINT, sig_int);
+    signal(SIGHUP, sig_int);
+    signal(SIGTERM, sig_int);
+}
+
 /** Main function of server demo.
  *
  * @see Device_Set_Object_Instance_Number, dlenv_init, Send_I_Am,
@@ -234,14 +257,18 @@ int main(
     Init_Service_Handlers();
     dlenv_init();
     atexit(datalink_cleanup);
+#if defined(BAC_UCI)
+    atexit(ucix_wb_flush);
+#endif
     piface_init();
     atexit(piface_cleanup);
+    signal_init();
     /* configure the timeout values */
     last_seconds = time(NULL);
     /* broadcast an I-Am on startup */
     Send_I_Am(&Handler_Transmit_Buffer[0]);
-    /* loop forever */
-    for (;;) {
+    /* loop until stopped */
+    while (!Stop) {
         /* input */
         current_seconds = time(NULL);
 
@@ -263,9 +290,13 @@ int main(
             dlenv_maintenance_timer(elapsed_seconds);
             elapsed_milliseconds = elapsed_seconds * 1000;
             handler_cov_timer_seconds(elapsed_seconds);
+            handler_cov_timer_milliseconds(elapsed_milliseconds);
             tsm_timer_milliseconds(elapsed_milliseconds);
         }
         handler_cov_task();
+#if defined(BAC_UCI)
+        ucix_wb_task();
+#endif
         /* scan cache address */
         address_binding_tmr += elapsed_seconds;
         if (address_binding_tmr >= 60) {
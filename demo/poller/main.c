@@ -0,0 +1,973 @@
+/*************************************************************************
+* Copyright (C) 2014 Steve Karg <skarg@users.sourceforge.net>
+*
+* Permission is hereby granted, free of charge, to any person obtaining
+* a copy of this software and associated documentation files (the
+* "Software"), to deal in the Software without restriction, including
+* without limitation the rights to use, copy, modify, merge, publish,
+* distribute, sublicense, and/or sell copies of the Software, and to
+* permit persons to whom the Software is furnished to do so, subject to
+* the following conditions:
+*
+* The above copyright notice and this permission notice shall be included
+* in all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+* IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+* CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+* TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+* SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*
+*********************************************************************/
+
+/* command line tool that polls a list of points from many devices, and
+   streams the values as CSV or JSON lines.  The due points of a device
+   are read with one ReadPropertyMultiple request, as large as the max
+   APDU of the device allows, and the requests to all the devices are
+   in flight at the same time. */
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <sys/time.h>
+
+#define PRINT_ENABLED 1
+
+#include "config.h"
+#include "bacdef.h"
+#include "bacenum.h"
+#include "bacapp.h"
+#include "bactext.h"
+#include "bacaddr.h"
+#include "address.h"
+#include "apdu.h"
+#include "tsm.h"
+#include "device.h"
+#include "datalink.h"
+#include "rpm.h"
+#include "handlers.h"
+#include "client.h"
+#include "dlenv.h"
+#include "async.h"
+#include "binding.h"
+#include "version.h"
+#include "filename.h"
+
+/* room for the properties of one request */
+#define POLL_MAX_BATCH 256
+/* estimated octets of a property in the ACK, and of an object */
+#define POLL_PROPERTY_SIZE 12
+#define POLL_OBJECT_SIZE 7
+/* seconds before a device that did not answer is asked for again */
+#define POLL_BIND_INTERVAL 60
+/* timeouts in a row before a device is bound again */
+#define POLL_REBIND_TIMEOUTS 3
+/* full requests in a row that were answered before a device that
+   aborted a large one is asked for more points at once again */
+#define POLL_BATCH_GROW_READS 16
+
+typedef struct poll_point {
+    BACNET_OBJECT_TYPE object_type;
+    uint32_t object_instance;
+    BACNET_PROPERTY_ID object_property;
+    uint32_t interval;
+    uint32_t next_due;
+} POLL_POINT;
+
+typedef struct poll_device {
+    uint32_t device_id;
+    bool bound;
+    bool binding;
+    BACNET_ADDRESS address;
+    unsigned max_apdu;
+    uint32_t bind_time;
+    /* the points, sorted by object */
+    POLL_POINT *points;
+    unsigned point_count;
+    /* the request in flight: its points, and when it was sent */
+    unsigned *batch;
+    unsigned batch_count;
+    unsigned batch_max;
+    unsigned batch_reads;
+    bool in_flight;
+    uint32_t sent_time;
+    unsigned timeouts_in_row;
+    /* statistics */
+    unsigned long requests;
+    unsigned long responses;
+    unsigned long errors;
+    unsigned long timeouts;
+    uint32_t latency_min;
+    uint32_t latency_max;
+    unsigned long long latency_total;
+} POLL_DEVICE;
+
+static POLL_DEVICE *Poll_Devices;
+static unsigned Poll_Device_Count;
+static unsigned In_Flight;
+static unsigned Max_In_Flight = 64;
+/* the device polled first, so they all get a turn when few can be */
+static unsigned Poll_Next;
+static uint32_t Default_Interval = 5000;
+static bool Output_JSON;
+static volatile bool Stop;
+
+static BACNET_READ_ACCESS_DATA Batch_Objects[POLL_MAX_BATCH];
+static BACNET_PROPERTY_REFERENCE Batch_Properties[POLL_MAX_BATCH];
+
+static uint32_t milliseconds(
+    void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (uint32_t) now.tv_sec * 1000 + (uint32_t) (now.tv_nsec / 1000000);
+}
+
+static unsigned long long timestamp(
+    void)
+{
+    struct timeval now;
+
+    gettimeofday(&now, NULL);
+
+    return (unsigned long long) now.tv_sec * 1000 + now.tv_usec / 1000;
+}
+
+/* true if the time has come */
+static bool time_reached(
+    uint32_t now,
+    uint32_t time)
+{
+    return ((int32_t) (now - time) >= 0);
+}
+
+static POLL_DEVICE *device_find(
+    uint32_t device_id)
+{
+    unsigned i = 0;
+
+    for (i = 0; i < Poll_Device_Count; i++) {
+        if (Poll_Devices[i].device_id == device_id) {
+            return &Poll_Devices[i];
+        }
+    }
+
+    return NULL;
+}
+
+static POLL_DEVICE *device_add(
+    uint32_t device_id)
+{
+    POLL_DEVICE *device = device_find(device_id);
+    POLL_DEVICE *devices;
+
+    if (device) {
+        return device;
+    }
+    devices = realloc(Poll_Devices, (Poll_Device_Count + 1) * sizeof(POLL_DEVICE));
+    if (!devices) {
+        return NULL;
+    }
+    Poll_Devices = devices;
+    device = &Poll_Devices[Poll_Device_Count];
+    Poll_Device_Count++;
+    memset(device, 0, sizeof(POLL_DEVICE));
+    device->device_id = device_id;
+    device->batch_max = POLL_MAX_BATCH;
+    device->latency_min = UINT32_MAX;
+
+    return device;
+}
+
+static bool point_add(
+    POLL_DEVICE * device,
+    POLL_POINT * point)
+{
+    POLL_POINT *points;
+
+    points =
+        realloc(device->points,
+        (device->point_count + 1) * sizeof(POLL_POINT));
+    if (!points) {
+        return false;
+    }
+    device->points = points;
+    device->points[device->point_count] = *point;
+    device->point_count++;
+
+    return true;
+}
+
+static int point_compare(
+    const void *a,
+    const void *b)
+{
+    const POLL_POINT *pa = a;
+    const POLL_POINT *pb = b;
+
+    if (pa->object_type != pb->object_type) {
+        return (pa->object_type < pb->object_type) ? -1 : 1;
+    }
+    if (pa->object_instance != pb->object_instance) {
+        return (pa->object_instance < pb->object_instance) ? -1 : 1;
+    }
+
+    return 0;
+}
+
+static bool parse_object_type(
+    const char *text,
+    unsigned *object_type)
+{
+    char *end = NULL;
+    unsigned long value;
+
+    value = strtoul(text, &end, 0);
+    if (end && (*end == 0)) {
+        *object_type = (unsigned) value;
+        return (value < MAX_BACNET_OBJECT_TYPE);
+    }
+
+    return bactext_object_type_index(text, object_type);
+}
+
+static bool parse_property(
+    const char *text,
+    unsigned *object_property)
+{
+    char *end = NULL;
+    unsigned long value;
+
+    value = strtoul(text, &end, 0);
+    if (end && (*end == 0)) {
+        *object_property = (unsigned) value;
+        return (value <= MAX_BACNET_PROPERTY_ID);
+    }
+
+    return bactext_property_index(text, object_property);
+}
+
+/* each line: device-instance object-type object-instance property
+   [interval-seconds], where # starts a comment */
+static bool point_list_load(
+    const char *filename)
+{
+    FILE *file;
+    char line[256];
+    char object_type_text[64];
+    char property_text[64];
+    unsigned long device_id;
+    unsigned long object_instance;
+    double interval;
+    unsigned object_type;
+    unsigned object_property;
+    unsigned line_number = 0;
+    POLL_DEVICE *device;
+    POLL_POINT point;
+    char *comment;
+    int count;
+    unsigned i;
+
+    file = fopen(filename, "r");
+    if (!file) {
+        fprintf(stderr, "%s: %s\n", filename, strerror(errno));
+        return false;
+    }
+    while (fgets(line, sizeof(line), file)) {
+        line_number++;
+        comment = strchr(line, '#');
+        if (comment) {
+            *comment = 0;
+        }
+        interval = Default_Interval / 1000.0;
+        count =
+            sscanf(line, "%lu %63s %lu %63s %lf", &device_id,
+            object_type_text, &object_instance, property_text, &interval);
+        if ((count <= 0) && (line[strspn(line, " \t\r\n")] == 0)) {
+            continue;
+        }
+        if ((count < 4) || (device_id >= BACNET_MAX_INSTANCE) ||
+            (object_instance > BACNET_MAX_INSTANCE) ||
+            !parse_object_type(object_type_text, &object_type) ||
+            !parse_property(property_text, &object_property) ||
+            (interval <= 0)) {
+            fprintf(stderr, "%s:%u: invalid point\n", filename, line_number);
+            continue;
+        }
+        device = device_add((uint32_t) device_id);
+        if (!device) {
+            break;
+        }
+        point.object_type = (BACNET_OBJECT_TYPE) object_type;
+        point.object_instance = (uint32_t) object_instance;
+        point.object_property = (BACNET_PROPERTY_ID) object_property;
+        point.interval = (uint32_t) (interval * 1000);
+        point.next_due = 0;
+        if (!point_add(device, &point)) {
+            break;
+        }
+    }
+    fclose(file);
+    for (i = 0; i < Poll_Device_Count; i++) {
+        device = &Poll_Devices[i];
+        qsort(device->points, device->point_count, sizeof(POLL_POINT),
+            point_compare);
+        device->batch = calloc(device->point_count, sizeof(unsigned));
+        if (!device->batch) {
+            return false;
+        }
+    }
+
+    return (Poll_Device_Count > 0);
+}
+
+static void csv_print_string(
+    const char *text)
+{
+    putchar('"');
+    while (*text) {
+        if (*text == '"') {
+            putchar('"');
+        }
+        putchar(*text);
+        text++;
+    }
+    putchar('"');
+}
+
+static void json_print_string(
+    const char *text)
+{
+    putchar('"');
+    while (*text) {
+        if ((*text == '"') || (*text == '\\')) {
+            putchar('\\');
+            putchar(*text);
+        } else if ((unsigned char) *text < 0x20) {
+            printf("\\u%04x", (unsigned char) *text);
+        } else {
+            putchar(*text);
+        }
+        text++;
+    }
+    putchar('"');
+}
+
+/* one line for a value, or else for an error */
+static void value_print(
+    uint32_t device_id,
+    BACNET_OBJECT_TYPE object_type,
+    uint32_t object_instance,
+    BACNET_PROPERTY_ID object_property,
+    const char *value,
+    const char *error)
+{
+    if (Output_JSON) {
+        printf("{\"time\":%llu,\"device\":%lu,\"object-type\":",
+            timestamp(), (unsigned long) device_id);
+        json_print_string(bactext_object_type_name(object_type));
+        printf(",\"object-instance\":%lu,\"property\":",
+            (unsigned long) object_instance);
+        json_print_string(bactext_property_name(object_property));
+        if (value) {
+            printf(",\"value\":");
+            json_print_string(value);
+        }
+        if (error) {
+            printf(",\"error\":");
+            json_print_string(error);
+        }
+        printf("}\n");
+    } else {
+        printf("%llu,%lu,%s,%lu,%s,", timestamp(), (unsigned long) device_id,
+            bactext_object_type_name(object_type),
+            (unsigned long) object_instance,
+            bactext_property_name(object_property));
+        if (value) {
+            csv_print_string(value);
+        }
+        putchar(',');
+        if (error) {
+            csv_print_string(error);
+        }
+        putchar('\n');
+    }
+}
+
+/* all the values of the property, braced if more than one */
+static void value_format(
+    BACNET_READ_ACCESS_DATA * rpm_object,
+    BACNET_PROPERTY_REFERENCE * rpm_property,
+    char *text,
+    size_t text_size)
+{
+    BACNET_OBJECT_PROPERTY_VALUE object_value;
+    BACNET_APPLICATION_DATA_VALUE *value = rpm_property->value;
+    size_t len = 0;
+    int written = 0;
+    bool array = (value && value->next);
+
+    text[0] = 0;
+    object_value.object_type = rpm_object->object_type;
+    object_value.object_instance = rpm_object->object_instance;
+    object_value.object_property = rpm_property->propertyIdentifier;
+    object_value.array_index = rpm_property->propertyArrayIndex;
+    if (array && (len + 1 < text_size)) {
+        text[len++] = '{';
+        text[len] = 0;
+    }
+    while (value && (len + 1 < text_size)) {
+        object_value.value = value;
+        written =
+            bacapp_snprintf_value(&text[len], text_size - len,
+            &object_value);
+        if (written < 0) {
+            break;
+        }
+        len += (size_t) written;
+        if (len >= text_size) {
+            len = text_size - 1;
+            break;
+        }
+        value = value->next;
+        if (value && (len + 1 < text_size)) {
+            text[len++] = ',';
+            text[len] = 0;
+        }
+    }
+    if (array && (len + 1 < text_size)) {
+        text[len++] = '}';
+        text[len] = 0;
+    }
+}
+
+static void rpm_data_free(
+    BACNET_READ_ACCESS_DATA * rpm_data)
+{
+    BACNET_READ_ACCESS_DATA *old_rpm_data;
+    BACNET_PROPERTY_REFERENCE *rpm_property;
+    BACNET_PROPERTY_REFERENCE *old_rpm_property;
+    BACNET_APPLICATION_DATA_VALUE *value;
+    BACNET_APPLICATION_DATA_VALUE *old_value;
+
+    while (rpm_data) {
+        rpm_property = rpm_data->listOfProperties;
+        while (rpm_property) {
+            value = rpm_property->value;
+            while (value) {
+                old_value = value;
+                value = value->next;
+                free(old_value);
+            }
+            old_rpm_property = rpm_property;
+            rpm_property = rpm_property->next;
+            free(old_rpm_property);
+        }
+        old_rpm_data = rpm_data;
+        rpm_data = rpm_data->next;
+        free(old_rpm_data);
+    }
+}
+
+static void ack_print(
+    POLL_DEVICE * device,
+    BACNET_ASYNC_RESULT * result)
+{
+    BACNET_READ_ACCESS_DATA *rpm_data;
+    BACNET_READ_ACCESS_DATA *rpm_object;
+    BACNET_PROPERTY_REFERENCE *rpm_property;
+    char text[1024];
+    char error[128];
+    int len = 0;
+
+    rpm_data = calloc(1, sizeof(BACNET_READ_ACCESS_DATA));
+    if (rpm_data) {
+        len =
+            rpm_ack_decode_service_request(result->service_data,
+            result->service_data_len, rpm_data);
+    }
+    if (len > 0) {
+        for (rpm_object = rpm_data; rpm_object;
+            rpm_object = rpm_object->next) {
+            for (rpm_property = rpm_object->listOfProperties; rpm_property;
+                rpm_property = rpm_property->next) {
+                if (rpm_property->value) {
+                    value_format(rpm_object, rpm_property, text,
+                        sizeof(text));
+                    value_print(device->device_id, rpm_object->object_type,
+                        rpm_object->object_instance,
+                        rpm_property->propertyIdentifier, text, NULL);
+                } else {
+                    snprintf(error, sizeof(error), "%s: %s",
+                        bactext_error_class_name(rpm_property->error.
+                            error_class),
+                        bactext_error_code_name(rpm_property->error.
+                            error_code));
+                    value_print(device->device_id, rpm_object->object_type,
+                        rpm_object->object_instance,
+                        rpm_property->propertyIdentifier, NULL, error);
+                }
+            }
+        }
+    } else {
+        device->errors++;
+    }
+    rpm_data_free(rpm_data);
+}
+
+/* an error line for each point of the request */
+static void batch_error_print(
+    POLL_DEVICE * device,
+    const char *error)
+{
+    POLL_POINT *point;
+    unsigned i;
+
+    for (i = 0; i < device->batch_count; i++) {
+        point = &device->points[device->batch[i]];
+        value_print(device->device_id, point->object_type,
+            point->object_instance, point->object_property, NULL, error);
+    }
+}
+
+/* the points of the request are due again after their interval */
+static void batch_done(
+    POLL_DEVICE * device,
+    uint32_t now)
+{
+    POLL_POINT *point;
+    unsigned i;
+
+    for (i = 0; i < device->batch_count; i++) {
+        point = &device->points[device->batch[i]];
+        point->next_due += point->interval;
+        if (time_reached(now, point->next_due)) {
+            /* fell behind: do not try to catch up */
+            point->next_due = now + point->interval;
+        }
+    }
+    device->batch_count = 0;
+}
+
+static void poll_callback(
+    BACNET_ASYNC_RESULT * result,
+    void *context)
+{
+    POLL_DEVICE *device = context;
+    uint32_t now = milliseconds();
+    uint32_t latency = now - device->sent_time;
+    char error[128];
+
+    device->in_flight = false;
+    In_Flight--;
+    switch (result->status) {
+        case ASYNC_COMPLEX_ACK:
+            device->responses++;
+            device->timeouts_in_row = 0;
+            device->latency_total += latency;
+            if (latency < device->latency_min) {
+                device->latency_min = latency;
+            }
+            if (latency > device->latency_max) {
+                device->latency_max = latency;
+            }
+            ack_print(device, result);
+            if ((device->batch_max < POLL_MAX_BATCH) &&
+                (device->batch_count >= device->batch_max) &&
+                (++device->batch_reads >= POLL_BATCH_GROW_READS)) {
+                /* it answered them all: try a quarter more */
+                device->batch_max += (device->batch_max / 4) + 1;
+                if (device->batch_max > POLL_MAX_BATCH) {
+                    device->batch_max = POLL_MAX_BATCH;
+                }
+                device->batch_reads = 0;
+            }
+            break;
+        case ASYNC_ERROR:
+            device->errors++;
+            device->timeouts_in_row = 0;
+            snprintf(error, sizeof(error), "%s: %s",
+                bactext_error_class_name(result->error_class),
+                bactext_error_code_name(result->error_code));
+            batch_error_print(device, error);
+            break;
+        case ASYNC_REJECT:
+            device->errors++;
+            device->timeouts_in_row = 0;
+            snprintf(error, sizeof(error), "reject: %s",
+                bactext_reject_reason_name(result->reason));
+            batch_error_print(device, error);
+            break;
+        case ASYNC_ABORT:
+            device->errors++;
+            device->timeouts_in_row = 0;
+            if ((device->batch_count > 1) &&
+                ((result->reason == ABORT_REASON_SEGMENTATION_NOT_SUPPORTED)
+                    || (result->reason == ABORT_REASON_BUFFER_OVERFLOW))) {
+                /* the ACK was too large: read them again, fewer at once */
+                device->batch_max = (device->batch_count + 1) / 2;
+                device->batch_reads = 0;
+                device->batch_count = 0;
+                return;
+            }
+            snprintf(error, sizeof(error), "abort: %s",
+                bactext_abort_reason_name(result->reason));
+            batch_error_print(device, error);
+            break;
+        case ASYNC_TIMEOUT:
+        default:
+            device->timeouts++;
+            device->timeouts_in_row++;
+            batch_error_print(device, "timeout");
+            if (device->timeouts_in_row >= POLL_REBIND_TIMEOUTS) {
+                /* it may have a new address */
+                address_remove_device(device->device_id);
+                device->bound = false;
+                device->timeouts_in_row = 0;
+            }
+            break;
+    }
+    batch_done(device, now);
+}
+
+/* the due points of the device, as many as fit in one request */
+static unsigned batch_collect(
+    POLL_DEVICE * device,
+    uint32_t now)
+{
+    unsigned max_apdu = device->max_apdu;
+    unsigned size = 3;
+    unsigned i;
+    POLL_POINT *point;
+    POLL_POINT *last = NULL;
+
+    if (max_apdu > MAX_APDU) {
+        max_apdu = MAX_APDU;
+    }
+    device->batch_count = 0;
+    for (i = 0; i < device->point_count; i++) {
+        point = &device->points[i];
+        if (!time_reached(now, point->next_due)) {
+            continue;
+        }
+        if (!last || point_compare(last, point)) {
+            size += POLL_OBJECT_SIZE;
+        }
+        size += POLL_PROPERTY_SIZE;
+        if (device->batch_count && (size > max_apdu)) {
+            break;
+        }
+        device->batch[device->batch_count] = i;
+        device->batch_count++;
+        last = point;
+        if ((device->batch_count >= device->batch_max) ||
+            (device->batch_count >= POLL_MAX_BATCH)) {
+            break;
+        }
+    }
+
+    return device->batch_count;
+}
+
+static bool batch_send(
+    POLL_DEVICE * device)
+{
+    BACNET_READ_ACCESS_DATA *rpm_object = NULL;
+    BACNET_PROPERTY_REFERENCE *rpm_property;
+    POLL_POINT *point;
+    POLL_POINT *last = NULL;
+    unsigned objects = 0;
+    unsigned i;
+    uint8_t invoke_id;
+
+    for (i = 0; i < device->batch_count; i++) {
+        point = &device->points[device->batch[i]];
+        rpm_property = &Batch_Properties[i];
+        rpm_property->propertyIdentifier = point->object_property;
+        rpm_property->propertyArrayIndex = BACNET_ARRAY_ALL;
+        rpm_property->value = NULL;
+        rpm_property->next = NULL;
+        if (!last || point_compare(last, point)) {
+            if (rpm_object) {
+                rpm_object->next = &Batch_Objects[objects];
+            }
+            rpm_object = &Batch_Objects[objects];
+            objects++;
+            rpm_object->object_type = point->object_type;
+            rpm_object->object_instance = point->object_instance;
+            rpm_object->listOfProperties = rpm_property;
+            rpm_object->next = NULL;
+        } else {
+            Batch_Properties[i - 1].next = rpm_property;
+        }
+        last = point;
+    }
+    device->sent_time = milliseconds();
+    invoke_id =
+        async_read_property_multiple(&device->address, device->max_apdu,
+        &Batch_Objects[0], poll_callback, device);
+    if (!invoke_id) {
+        device->batch_count = 0;
+        return false;
+    }
+    device->in_flight = true;
+    device->requests++;
+    In_Flight++;
+
+    return true;
+}
+
+static void poll_bound(
+    uint32_t device_id,
+    bool bound,
+    void *context)
+{
+    POLL_DEVICE *device = context;
+
+    (void) device_id;
+    device->binding = false;
+    if (!bound) {
+        device->bind_time = milliseconds() + POLL_BIND_INTERVAL * 1000;
+    }
+}
+
+static void devices_poll(
+    void)
+{
+    POLL_DEVICE *device;
+    uint32_t now = milliseconds();
+    unsigned n;
+    unsigned i;
+
+    for (n = 0; n < Poll_Device_Count; n++) {
+        i = (Poll_Next + n) % Poll_Device_Count;
+        device = &Poll_Devices[i];
+        if (device->in_flight) {
+            continue;
+        }
+        if (!device->bound) {
+            device->bound =
+                address_bind_request(device->device_id, &device->max_apdu,
+                &device->address);
+            if (!device->bound) {
+                if (!device->binding && (!device->bind_time ||
+                        time_reached(now, device->bind_time))) {
+                    /* the Who-Is messages are merged and paced */
+                    device->binding =
+                        !binding_request(device->device_id,
+                        BACNET_BROADCAST_NETWORK, poll_bound, device);
+                }
+                continue;
+            }
+        }
+        if (In_Flight >= Max_In_Flight) {
+            /* it goes first next time */
+            Poll_Next = i;
+            break;
+        }
+        if (batch_collect(device, now)) {
+            if (!batch_send(device)) {
+                /* no room in the TSM: try again later */
+                Poll_Next = i;
+                break;
+            }
+        }
+    }
+}
+
+static void stats_print(
+    void)
+{
+    POLL_DEVICE *device;
+    unsigned long average;
+    unsigned i;
+
+    for (i = 0; i < Poll_Device_Count; i++) {
+        device = &Poll_Devices[i];
+        average = 0;
+        if (device->responses) {
+            average =
+                (unsigned long) (device->latency_total / device->responses);
+        }
+        if (Output_JSON) {
+            fprintf(stderr,
+                "{\"stats\":{\"device\":%lu,\"bound\":%s,\"requests\":%lu,"
+                "\"responses\":%lu,\"errors\":%lu,\"timeouts\":%lu,"
+                "\"latency-min\":%lu,\"latency-avg\":%lu,"
+                "\"latency-max\":%lu}}\n", (unsigned long) device->device_id,
+                device->bound ? "true" : "false", device->requests,
+                device->responses, device->errors, device->timeouts,
+                device->responses ? (unsigned long) device->latency_min : 0,
+                average, (unsigned long) device->latency_max);
+        } else {
+            fprintf(stderr, "stats,%lu,%s,%lu,%lu,%lu,%lu,%lu,%lu,%lu\n",
+                (unsigned long) device->device_id,
+                device->bound ? "bound" : "unbound", device->requests,
+                device->responses, device->errors, device->timeouts,
+                device->responses ? (unsigned long) device->latency_min : 0,
+                average, (unsigned long) device->latency_max);
+        }
+    }
+    fflush(stderr);
+}
+
+static void signal_handler(
+    int signum)
+{
+    (void) signum;
+    Stop = true;
+}
+
+static void print_usage(
+    const char *filename)
+{
+    printf("Usage: %s [--json] [--interval seconds] [--concurrency N]\n"
+        "       [--stats seconds] [--duration seconds] point-list\n",
+        filename);
+    printf("       [--version][--help]\n");
+}
+
+static void print_help(
+    const char *filename)
+{
+    printf("Poll the points of a point list from BACnet devices\n"
+        "with ReadPropertyMultiple, and print the values as CSV\n"
+        "or JSON lines.\n");
+    printf("\n"
+        "point-list:\n"
+        "A file with a point on each line:\n"
+        "device-instance object-type object-instance property [interval]\n"
+        "where the object type and property are names or numbers,\n"
+        "and the interval is in seconds.  A # starts a comment.\n"
+        "\n"
+        "--json\n"
+        "Print JSON lines instead of CSV.\n"
+        "\n"
+        "--interval seconds\n"
+        "The interval of the points without one, 5 by default.\n"
+        "\n"
+        "--concurrency N\n"
+        "The number of devices with a request in flight, 64 by default.\n"
+        "\n"
+        "--stats seconds\n"
+        "Print the statistics of each device to stderr this often,\n"
+        "and when done.  60 by default, 0 only when done.\n"
+        "\n"
+        "--duration seconds\n"
+        "Stop after this time.  0, by default, polls until interrupted.\n");
+    printf("\n"
+        "Example:\n" "%s --json points.txt\n"
+        "with points.txt:\n" "1234 analog-input 1 present-value 2\n"
+        "1234 analog-input 1 status-flags 10\n", filename);
+}
+
+int main(
+    int argc,
+    char *argv[])
+{
+    const char *filename = NULL;
+    const char *program;
+    uint32_t stats_interval = 60000;
+    uint32_t duration = 0;
+    uint32_t start_time;
+    uint32_t binding_time;
+    uint32_t stats_time;
+    uint32_t now;
+    int argi;
+
+    program = filename_remove_path(argv[0]);
+    for (argi = 1; argi < argc; argi++) {
+        if (strcmp(argv[argi], "--help") == 0) {
+            print_usage(program);
+            print_help(program);
+            return 0;
+        }
+        if (strcmp(argv[argi], "--version") == 0) {
+            printf("%s %s\n", program, BACNET_VERSION_TEXT);
+            printf("Copyright (C) 2014 by Steve Karg and others.\n"
+                "This is free software; see the source for copying "
+                "conditions.\n"
+                "There is NO warranty; not even for MERCHANTABILITY or\n"
+                "FITNESS FOR A PARTICULAR PURPOSE.\n");
+            return 0;
+        }
+        if (strcmp(argv[argi], "--json") == 0) {
+            Output_JSON = true;
+        } else if ((strcmp(argv[argi], "--interval") == 0) &&
+            (++argi < argc)) {
+            Default_Interval = (uint32_t) (strtod(argv[argi], NULL) * 1000);
+        } else if ((strcmp(argv[argi], "--concurrency") == 0) &&
+            (++argi < argc)) {
+            Max_In_Flight = strtoul(argv[argi], NULL, 0);
+        } else if ((strcmp(argv[argi], "--stats") == 0) && (++argi < argc)) {
+            stats_interval = strtoul(argv[argi], NULL, 0) * 1000;
+        } else if ((strcmp(argv[argi], "--duration") == 0) &&
+            (++argi < argc)) {
+            duration = strtoul(argv[argi], NULL, 0) * 1000;
+        } else if (argv[argi][0] != '-') {
+            filename = argv[argi];
+        } else {
+            print_usage(program);
+            return 1;
+        }
+    }
+    if (!filename || (Default_Interval == 0) || (Max_In_Flight == 0)) {
+        print_usage(program);
+        return 1;
+    }
+    if (!point_list_load(filename)) {
+        fprintf(stderr, "%s: no points\n", filename);
+        return 1;
+    }
+    /* setup my info */
+    address_init();
+    Device_Init(NULL);
+    Device_Set_Object_Instance_Number(BACNET_MAX_INSTANCE);
+    apdu_set_unconfirmed_handler(SERVICE_UNCONFIRMED_WHO_IS, handler_who_is);
+    apdu_set_unrecognized_service_handler_handler
+        (handler_unrecognized_service);
+    apdu_set_confirmed_handler(SERVICE_CONFIRMED_READ_PROPERTY,
+        handler_read_property);
+    async_init();
+    binding_init();
+    dlenv_init();
+    atexit(datalink_cleanup);
+    signal(SIGINT, signal_handler);
+    signal(SIGTERM, signal_handler);
+    if (!Output_JSON) {
+        printf("time,device,object-type,object-instance,property,value,"
+            "error\n");
+    }
+    start_time = stats_time = binding_time = milliseconds();
+    while (!Stop) {
+        devices_poll();
+        async_task(10);
+        fflush(stdout);
+        now = milliseconds();
+        if ((now - binding_time) > UINT16_MAX) {
+            binding_time = now - UINT16_MAX;
+        }
+        binding_timer_milliseconds((uint16_t) (now - binding_time));
+        binding_time = now;
+        if (stats_interval && ((now - stats_time) >= stats_interval)) {
+            stats_print();
+            stats_time = now;
+        }
+        if (duration && ((now - start_time) >= duration)) {
+            break;
+        }
+    }
+    stats_print();
+
+    return 0;
+}
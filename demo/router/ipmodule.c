@@ -82,6 +82,8 @@ void *dl_ip_thread(
     port->state = RUNNING;
 
     while (!shutdown) {
+        /* sleep until a message or a packet comes in */
+        wait_for_msgbox(port->port_id, ip_data.socket, -1);
 
         /* check for incoming messages */
         bacmsg = recv_from_msgbox(port->port_id, &msg_storage);
@@ -97,6 +99,8 @@ void *dl_ip_thread(
 
                         dl_ip_send(&ip_data, &address, msg_data->pdu,
                             msg_data->pdu_len);
+                        PRINT(DEBUG, "Forwarded in %u us\n",
+                            (unsigned) msg_age(bacmsg));
 
                         check_data(msg_data);
 
@@ -119,8 +123,9 @@ void *dl_ip_thread(
                     break;
             }
         } else {
-            status = dl_ip_recv(&ip_data, &msg_data, &address, 5);
+            status = dl_ip_recv(&ip_data, &msg_data, &address, 0);
             if (status > 0) {
+                stamp_msg(&msg_storage);
                 memmove(&msg_data->src.len, &address.mac_len, 1);
                 memmove(&msg_data->src.adr[0], &address.mac[0], MAX_MAC_LEN);
                 msg_storage.origin = port->port_id;
@@ -226,39 +231,45 @@ int dl_ip_send(
     unsigned pdu_len)
 {
     struct sockaddr_in bip_dest = { 0 };
-    int buff_len = 0;
+    uint8_t header[4];
+    struct iovec iov[2];
+    struct msghdr msg = { 0 };
     int bytes_sent = 0;
 
     if (data->socket < 0)
         return -1;
 
-    data->buff[0] = BVLL_TYPE_BACNET_IP;
+    header[0] = BVLL_TYPE_BACNET_IP;
     bip_dest.sin_family = AF_INET;
     if (dest->net == BACNET_BROADCAST_NETWORK) {
         /* broadcast */
         bip_dest.sin_addr.s_addr = data->broadcast_addr.s_addr;
         bip_dest.sin_port = data->port;
-        data->buff[1] = BVLC_ORIGINAL_BROADCAST_NPDU;
+        header[1] = BVLC_ORIGINAL_BROADCAST_NPDU;
     } else if (dest->mac_len == 6) {
         memcpy(&bip_dest.sin_addr.s_addr, &dest->mac[0], 4);
         memcpy(&bip_dest.sin_port, &dest->mac[4], 2);
-        data->buff[1] = BVLC_ORIGINAL_UNICAST_NPDU;
+        header[1] = BVLC_ORIGINAL_UNICAST_NPDU;
     } else {
         /* invalid address */
         return -1;
     }
 
-    buff_len = 2;
-    buff_len +=
-        encode_unsigned16(&data->buff[buff_len],
-        (uint16_t) (pdu_len + 4 /*inclusive */ ));
-    memcpy(&data->buff[buff_len], pdu, pdu_len);
-    buff_len += pdu_len;
+    encode_unsigned16(&header[2], (uint16_t) (pdu_len + 4 /*inclusive */ ));
+
+    /* the PDU may be going out of other ports too, so the header is
+       sent from here instead of being written in front of it */
+    iov[0].iov_base = header;
+    iov[0].iov_len = sizeof(header);
+    iov[1].iov_base = pdu;
+    iov[1].iov_len = pdu_len;
+    msg.msg_name = &bip_dest;
+    msg.msg_namelen = sizeof(bip_dest);
+    msg.msg_iov = iov;
+    msg.msg_iovlen = 2;
 
     /* send the packet */
-    bytes_sent =
-        sendto(data->socket, (char *) data->buff, buff_len, 0,
-        (struct sockaddr *) &bip_dest, sizeof(struct sockaddr));
+    bytes_sent = sendmsg(data->socket, &msg, 0);
 
     PRINT(DEBUG, "send to %s\n", inet_ntoa(bip_dest.sin_addr));
 
@@ -273,6 +284,8 @@ int dl_ip_recv(
 {
     int received_bytes = 0;
     uint16_t buff_len = 0;      /* return value */
+    MSG_DATA *msg;
+    uint8_t *buff;
     fd_set read_fds;
     struct timeval select_timeout;
     struct sockaddr_in sin = { 0 };
@@ -294,33 +307,41 @@ int dl_ip_recv(
     FD_ZERO(&read_fds);
     FD_SET(data->socket, &read_fds);
 
+    /* receive into a pool buffer, after its headroom; with the pool
+       empty the packet is read and discarded */
+    msg = alloc_data();
+    buff = msg ? &msg->buffer[MSG_HEADROOM] : data->buff;
+
 #ifdef TEST_PACKET
     received_bytes = sizeof(test_packet);
-    memmove(data->buff, &test_packet, received_bytes);
+    memmove(buff, &test_packet, received_bytes);
     sin.sin_addr.s_addr = 0x7E1D40A;
     sin.sin_port = 0xC0BA;
 #else
-    int ret = select(data->socket + 1, &read_fds, NULL, NULL, &select_timeout);
+    /* without a timeout the caller knows there is a packet waiting */
+    int ret = 1;
+    if (timeout)
+        ret = select(data->socket + 1, &read_fds, NULL, NULL,
+            &select_timeout);
     /* see if there is a packet for us */
     if (ret > 0)
         received_bytes =
-            recvfrom(data->socket, (char *) &data->buff[0], data->max_buff, 0,
-            (struct sockaddr *) &sin, &sin_len);
-    else
+            recvfrom(data->socket, (char *) &buff[0], data->max_buff,
+            timeout ? 0 : MSG_DONTWAIT, (struct sockaddr *) &sin, &sin_len);
+    else {
+        free_data(msg);
         return 0;
+    }
 #endif
     PRINT(DEBUG, "received from %s\n", inet_ntoa(sin.sin_addr));
 
-    /* check for errors */
-    if (received_bytes <= 0) {
+    /* check for errors, and the signature of a BACnet/IP packet */
+    if (received_bytes <= 0 || buff[0] != BVLL_TYPE_BACNET_IP) {
+        free_data(msg);
         return 0;
     }
 
-    /* the signature of a BACnet/IP packet */
-    if (data->buff[0] != BVLL_TYPE_BACNET_IP)
-        return 0;
-
-    switch (data->buff[1]) {
+    switch (buff[1]) {
         case BVLC_ORIGINAL_UNICAST_NPDU:
         case BVLC_ORIGINAL_BROADCAST_NPDU:{
                 if ((sin.sin_addr.s_addr == data->local_addr.s_addr) &&
@@ -334,20 +355,16 @@ int dl_ip_recv(
                     memcpy(&src->mac[0], &sin.sin_addr.s_addr, 4);
                     memcpy(&src->mac[4], &sin.sin_port, 2);
 
-                    (void) decode_unsigned16(&data->buff[2], &buff_len);
+                    (void) decode_unsigned16(&buff[2], &buff_len);
                     /* subtract off the BVLC header */
                     buff_len -= 4;
                     if (buff_len < data->max_buff) {
-                        /* allocate data message stucture */
-                        (*msg_data) = (MSG_DATA *) malloc(sizeof(MSG_DATA));
-                        (*msg_data)->pdu_len = buff_len;
-                        (*msg_data)->pdu =
-                            (uint8_t *) malloc((*msg_data)->pdu_len);
-                        /* fill up data message structure */
-                        memmove(&(*msg_data)->pdu[0], &data->buff[4],
-                            (*msg_data)->pdu_len);
-                        memmove(&(*msg_data)->src, src,
-                            sizeof(BACNET_ADDRESS));
+                        /* the PDU stays where it was received */
+                        if (msg) {
+                            msg->pdu = &buff[4];
+                            msg->pdu_len = buff_len;
+                            memmove(&msg->src, src, sizeof(BACNET_ADDRESS));
+                        }
                     }
                     /* ignore packets that are too large */
                     else {
@@ -361,8 +378,8 @@ int dl_ip_recv(
             break;
 
         case BVLC_FORWARDED_NPDU:{
-                memcpy(&sin.sin_addr.s_addr, &data->buff[4], 4);
-                memcpy(&sin.sin_port, &data->buff[8], 2);
+                memcpy(&sin.sin_addr.s_addr, &buff[4], 4);
+                memcpy(&sin.sin_port, &buff[8], 2);
                 if ((sin.sin_addr.s_addr == data->local_addr.s_addr) &&
                     (sin.sin_port == data->port)) {
                     buff_len = 0;
@@ -371,20 +388,15 @@ int dl_ip_recv(
                     memcpy(&src->mac[0], &sin.sin_addr.s_addr, 4);
                     memcpy(&src->mac[4], &sin.sin_port, 2);
 
-                    (void) decode_unsigned16(&data->buff[2], &buff_len);
+                    (void) decode_unsigned16(&buff[2], &buff_len);
                     /* subtract off the BVLC header */
                     buff_len -= 10;
                     if (buff_len < data->max_buff) {
-                        /* allocate data message stucture */
-                        (*msg_data) = (MSG_DATA *) malloc(sizeof(MSG_DATA));
-                        (*msg_data)->pdu_len = buff_len;
-                        (*msg_data)->pdu =
-                            (uint8_t *) malloc((*msg_data)->pdu_len);
-                        /* fill up data message structure */
-                        memmove(&(*msg_data)->pdu[0], &data->buff[4 + 6],
-                            (*msg_data)->pdu_len);
-                        memmove(&(*msg_data)->src, src,
-                            sizeof(BACNET_ADDRESS));
+                        if (msg) {
+                            msg->pdu = &buff[4 + 6];
+                            msg->pdu_len = buff_len;
+                            memmove(&msg->src, src, sizeof(BACNET_ADDRESS));
+                        }
                     } else {
                         /* ignore packets that are too large */
                         buff_len = 0;
@@ -398,6 +410,15 @@ int dl_ip_recv(
 
             break;
     }
+
+    if (buff_len && !msg) {
+        buff_len = 0;
+        PRINT(ERROR, "BIP: out of buffers. Discarded!\n");
+    } else if (buff_len) {
+        *msg_data = msg;
+    } else {
+        free_data(msg);
+    }
     return buff_len;
 }
 
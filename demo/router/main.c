@@ -56,6 +56,10 @@
 
 ROUTER_PORT *head = NULL;       /* pointer to list of router ports */
 
+/* the terminal settings to put back at exit */
+static struct termios Saved_Term;
+static bool Term_Saved = false;
+
 int port_count;
 
 void print_help(
@@ -80,7 +84,7 @@ void cleanup(
 void print_msg(
     BACMSG * msg);
 
-uint16_t process_msg(
+int16_t process_msg(
     BACMSG * msg,
     MSG_DATA * data,
     uint8_t ** buff);
@@ -88,6 +92,9 @@ uint16_t process_msg(
 uint16_t get_next_free_dnet(
     );
 
+void keyboard_init(
+    void);
+
 int kbhit(
     );
 
@@ -105,6 +112,7 @@ int main(
     MSG_DATA *msg_data = NULL;
     uint8_t *buff = NULL;
     int16_t buff_len = 0;
+    int keyboard = STDIN_FILENO;
 
     atexit(cleanup);
 
@@ -122,12 +130,21 @@ int main(
     send_network_message(NETWORK_MESSAGE_I_AM_ROUTER_TO_NETWORK, msg_data,
         &buff, NULL);
 
+    /* stdin is only readable after Enter in canonical mode */
+    keyboard_init();
+
     while (true) {
-        if (kbhit()) {
-            char ch = getchar();
-            if (ch == KEY_ESC) {
-                PRINT(INFO, "Received shutdown. Exiting...\n");
-                break;
+        /* sleep until a port sends a message or a key is pressed */
+        if (wait_for_msgbox(head->main_id, keyboard, -1)) {
+            if (kbhit()) {
+                char ch = getchar();
+                if (ch == KEY_ESC) {
+                    PRINT(INFO, "Received shutdown. Exiting...\n");
+                    break;
+                }
+            } else {
+                /* end of input */
+                keyboard = -1;
             }
         }
 
@@ -137,31 +154,38 @@ int main(
                 case DATA:
                     {
                         MSGBOX_ID msg_src = bacmsg->origin;
-
-                        /* allocate message structure */
-                        msg_data = malloc(sizeof(MSG_DATA));
-                        if (!msg_data) {
-                            PRINT(ERROR, "Error: Could not allocate memory\n");
-                            break;
-                        }
+                        unsigned count;
+                        /* read before the incoming buffer is freed */
+                        bool network_msg = is_network_msg(bacmsg);
 
                         print_msg(bacmsg);
 
-                        if (is_network_msg(bacmsg)) {
+                        if (network_msg) {
+                            /* the reply needs its own buffer */
+                            msg_data = alloc_data();
+                            if (!msg_data) {
+                                PRINT(ERROR, "Error: Out of buffers\n");
+                                free_data(bacmsg->data);
+                                break;
+                            }
                             buff_len =
                                 process_network_message(bacmsg, msg_data,
                                 &buff);
+                            free_data(bacmsg->data);
                             if (buff_len == 0) {
-                                free_data(bacmsg->data);
+                                free_data(msg_data);
                                 break;
                             }
                         } else {
+                            /* forwarded in the buffer it came in */
+                            msg_data = (MSG_DATA *) bacmsg->data;
                             buff_len = process_msg(bacmsg, msg_data, &buff);
                         }
 
                         /* if buff_len */
                         /* >0 - form new message and send */
                         /* =-1 - try to find next router */
+                        /* =-2 - discard message, NET busy or not ours */
                         /* other value - discard message */
 
                         if (buff_len > 0) {
@@ -172,30 +196,42 @@ int main(
                             msg_storage.type = DATA;
                             msg_storage.data = msg_data;
 
-                            print_msg(bacmsg);
+                            print_msg(&msg_storage);
 
-                            if (is_network_msg(bacmsg)) {
+                            if (network_msg) {
                                 msg_data->ref_count = 1;
-                                send_to_msgbox(msg_src, &msg_storage);
+                                if (!send_to_msgbox(msg_src, &msg_storage))
+                                    check_data(msg_data);
                             } else if (msg_data->dest.net !=
                                 BACNET_BROADCAST_NETWORK) {
                                 msg_data->ref_count = 1;
                                 port =
                                     find_dnet(msg_data->dest.net,
                                     &msg_data->dest);
-                                send_to_msgbox(port->port_id, &msg_storage);
+                                if (!send_to_msgbox(port->port_id,
+                                        &msg_storage))
+                                    check_data(msg_data);
                             } else {
-                                port = head;
-                                msg_data->ref_count = port_count - 1;
-                                while (port != NULL) {
+                                /* every port sends the same buffer, the
+                                   last one puts it back in the pool */
+                                count = 0;
+                                for (port = head; port; port = port->next) {
+                                    if (port->port_id != msg_src &&
+                                        port->state != FINISHED)
+                                        count++;
+                                }
+                                if (count == 0) {
+                                    free_data(msg_data);
+                                    break;
+                                }
+                                msg_data->ref_count = count;
+                                for (port = head; port; port = port->next) {
                                     if (port->port_id == msg_src ||
-                                        port->state == FINISHED) {
-                                        port = port->next;
+                                        port->state == FINISHED)
                                         continue;
-                                    }
-                                    send_to_msgbox(port->port_id,
-                                        &msg_storage);
-                                    port = port->next;
+                                    if (!send_to_msgbox(port->port_id,
+                                            &msg_storage))
+                                        check_data(msg_data);
                                 }
                             }
                         } else if (buff_len == -1) {
@@ -204,6 +240,8 @@ int main(
                             send_network_message
                                 (NETWORK_MESSAGE_WHO_IS_ROUTER_TO_NETWORK,
                                 msg_data, &buff, &net);
+                        } else if (buff_len == -2) {
+                            free_data(msg_data);
                         } else {
                             /* if invalid message send Reject-Message-To-Network */
                             PRINT(ERROR, "Error: Invalid message\n");
@@ -492,15 +530,18 @@ bool init_router(
 {
     MSGBOX_ID msgboxid;
     ROUTER_PORT *port;
+    BACNET_ADDRESS direct = { 0 };
 
     msgboxid = create_msgbox();
     if (msgboxid == INVALID_MSGBOX_ID)
         return false;
 
     port = head;
-    /* add main message box id to all ports */
+    /* add main message box id to all ports, and their NETs to the
+       routing table */
     while (port != NULL) {
         port->main_id = msgboxid;
+        add_dnet(port, port->route_info.net, direct);
         port = port->next;
     }
 
@@ -531,6 +572,11 @@ void cleanup(
     ROUTER_PORT *port;
     BACMSG msg;
 
+    if (Term_Saved) {
+        tcsetattr(STDIN_FILENO, TCSANOW, &Saved_Term);
+        Term_Saved = false;
+    }
+
     if (head == NULL)
         return;
 
@@ -543,6 +589,9 @@ void cleanup(
     /* send shutdown message to all router ports */
     port = head;
     while (port != NULL) {
+        if (msgbox_dropped(port->port_id))
+            PRINT(INFO, "%s: dropped %u messages\n", port->iface,
+                msgbox_dropped(port->port_id));
         if (port->state == RUNNING)
             send_to_msgbox(port->port_id, &msg);
         port = port->next;
@@ -551,7 +600,6 @@ void cleanup(
     port = head;
     while (port != NULL) {
         if (port->state == FINISHED) {
-            cleanup_dnets(port->route_info.dnets);
             port = port->next;
             free(head->iface);
             free(head);
@@ -559,6 +607,7 @@ void cleanup(
         }
     }
 
+    cleanup_dnets();
     pthread_mutex_destroy(&msg_lock);
 }
 
@@ -578,7 +627,7 @@ void print_msg(
     }
 }
 
-uint16_t process_msg(
+int16_t process_msg(
     BACMSG * msg,
     MSG_DATA * data,
     uint8_t ** buff)
@@ -594,15 +643,23 @@ uint16_t process_msg(
     int apdu_len;
     int npdu_len;
 
-    memmove(data, msg->data, sizeof(MSG_DATA));
-
     apdu_offset = npdu_decode(data->pdu, &data->dest, &addr, &npdu_data);
     apdu_len = data->pdu_len - apdu_offset;
 
     srcport = find_snet(msg->origin);
-    destport = find_dnet(data->dest.net, NULL);
     assert(srcport);
 
+    /* the route back to a NET behind another router stays fresh */
+    if (srcport && addr.net > 0 && addr.net < BACNET_BROADCAST_NETWORK &&
+        addr.net != srcport->route_info.net)
+        add_dnet(srcport, addr.net, data->src);
+
+    destport = find_dnet(data->dest.net, NULL);
+    if (!destport && find_route(data->dest.net)) {
+        PRINT(INFO, "NET %hu is busy or unreachable\n", data->dest.net);
+        return -2;
+    }
+
     if (srcport && destport) {
         data->src.net = srcport->route_info.net;
 
@@ -620,39 +677,44 @@ uint16_t process_msg(
             npdu_len = npdu_encode_pdu(npdu, NULL, &data->src, &npdu_data);
         }
 
-        buff_len = npdu_len + data->pdu_len - apdu_offset;
+        buff_len = npdu_len + apdu_len;
 
-        *buff = (uint8_t *) malloc(buff_len);
-        memmove(*buff, npdu, npdu_len); /* copy newly formed NPDU */
-        memmove(*buff + npdu_len, &data->pdu[apdu_offset], apdu_len);   /* copy APDU */
+        /* write the new NPDU over the old one, the headroom of the buffer
+           leaves space for it to be longer */
+        *buff = data->pdu + apdu_offset - npdu_len;
+        assert(*buff >= data->buffer);
+        memmove(*buff, npdu, npdu_len);
 
     } else {
         /* request net search */
         return -1;
     }
 
-    /* delete received message */
-    free_data((MSG_DATA *) msg->data);
-
     return buff_len;
 }
 
+void keyboard_init(
+    void)
+{
+    struct termios term;
+
+    if (Term_Saved || !isatty(STDIN_FILENO) ||
+        (tcgetattr(STDIN_FILENO, &Saved_Term) != 0))
+        return;
+    /* use termios to turn off line buffering */
+    term = Saved_Term;
+    term.c_lflag &= ~ICANON;
+    term.c_cc[VMIN] = 1;
+    term.c_cc[VTIME] = 0;
+    if (tcsetattr(STDIN_FILENO, TCSANOW, &term) == 0)
+        Term_Saved = true;
+    setbuf(stdin, NULL);
+}
+
 int kbhit(
     )
 {
     static const int STDIN = 0;
-    static bool initialized = false;
-
-    if (!initialized) {
-        /* use termios to turn off line buffering */
-        struct termios term;
-        tcgetattr(STDIN, &term);
-        term.c_lflag &= ~ICANON;
-        tcsetattr(STDIN, TCSANOW, &term);
-        setbuf(stdin, NULL);
-        initialized = true;
-    }
-
     int bytesWaiting;
     ioctl(STDIN, FIONREAD, &bytesWaiting);
     return bytesWaiting;
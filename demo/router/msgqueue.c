@@ -30,85 +30,280 @@
 #include <errno.h>
 #include <string.h>
 #include <stdlib.h>
+#include <unistd.h>
 #include <pthread.h>
+#include <poll.h>
+#include <sys/eventfd.h>
 #include "msgqueue.h"
 
+/* The message boxes are queues in the process, one for the router core
+   and one for each port thread.  The eventfd of a box is readable while
+   messages wait in it, so a thread can sleep on its box and on its
+   socket at the same time. */
+typedef struct _msgbox {
+    bool used;
+    int fd;
+    BACMSG *queue;
+    unsigned size;
+    unsigned first;
+    unsigned count;
+    /* messages not queued past MSGBOX_HIGH_WATER */
+    unsigned dropped;
+    pthread_mutex_t lock;
+} MSGBOX;
+
+static MSGBOX msgboxes[MAX_MSGBOX];
+static pthread_mutex_t msgbox_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* guards the pool of message data */
 pthread_mutex_t msg_lock = PTHREAD_MUTEX_INITIALIZER;
+static MSG_DATA *free_msg_data = NULL;
+
+static MSGBOX *find_msgbox(
+    MSGBOX_ID id)
+{
+    if (id < 0 || id >= MAX_MSGBOX)
+        return NULL;
+
+    return &msgboxes[id];
+}
 
 MSGBOX_ID create_msgbox(
     )
 {
     MSGBOX_ID msgboxid;
+    MSGBOX *box;
 
-    msgboxid = msgget(IPC_PRIVATE, 0666 | IPC_CREAT);
-    if (msgboxid == INVALID_MSGBOX_ID) {
+    pthread_mutex_lock(&msgbox_lock);
+    for (msgboxid = 0; msgboxid < MAX_MSGBOX; msgboxid++) {
+        if (!msgboxes[msgboxid].used)
+            break;
+    }
+    if (msgboxid == MAX_MSGBOX) {
+        pthread_mutex_unlock(&msgbox_lock);
+        return INVALID_MSGBOX_ID;
+    }
+    box = &msgboxes[msgboxid];
+    box->fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (box->fd < 0) {
+        pthread_mutex_unlock(&msgbox_lock);
         return INVALID_MSGBOX_ID;
     }
+    box->queue = NULL;
+    box->size = 0;
+    box->first = 0;
+    box->count = 0;
+    box->dropped = 0;
+    pthread_mutex_init(&box->lock, NULL);
+    box->used = true;
+    pthread_mutex_unlock(&msgbox_lock);
 
     return msgboxid;
 }
 
+/* doubles the queue, keeping the messages in order */
+static bool grow_msgbox(
+    MSGBOX * box)
+{
+    BACMSG *queue;
+    unsigned size = box->size ? box->size * 2 : 64;
+    unsigned i;
+
+    queue = (BACMSG *) malloc(size * sizeof(BACMSG));
+    if (!queue)
+        return false;
+    for (i = 0; i < box->count; i++)
+        queue[i] = box->queue[(box->first + i) % box->size];
+    free(box->queue);
+    box->queue = queue;
+    box->size = size;
+    box->first = 0;
+
+    return true;
+}
+
 bool send_to_msgbox(
     MSGBOX_ID dest,
     BACMSG * msg)
 {
+    MSGBOX *box = find_msgbox(dest);
+    uint64_t one = 1;
+    bool status = false;
 
-    int err;
-
-    err = msgsnd(dest, msg, sizeof(BACMSG)-sizeof(MSGTYPE), 0);
-    if (err) {
+    if (!box)
         return false;
+
+    pthread_mutex_lock(&box->lock);
+    if (box->used && (msg->type == DATA) &&
+        (box->count >= MSGBOX_HIGH_WATER)) {
+        /* the service messages, like a shutdown, still get through */
+        box->dropped++;
+    } else if (box->used && (box->count < box->size || grow_msgbox(box))) {
+        box->queue[(box->first + box->count) % box->size] = *msg;
+        /* wake up the receiver */
+        if (box->count++ == 0)
+            (void) write(box->fd, &one, sizeof(one));
+        status = true;
     }
-    return true;
+    pthread_mutex_unlock(&box->lock);
+
+    return status;
 }
 
 BACMSG *recv_from_msgbox(
     MSGBOX_ID src,
     BACMSG * msg)
 {
+    MSGBOX *box = find_msgbox(src);
+    BACMSG *result = NULL;
+    uint64_t value;
 
-    int recv_bytes;
-
-    recv_bytes = msgrcv(src, msg, sizeof(BACMSG)-sizeof(MSGTYPE), 0, IPC_NOWAIT);
-    if (recv_bytes > 0) {
-        return msg;
-    } else {
+    if (!box)
         return NULL;
+
+    pthread_mutex_lock(&box->lock);
+    if (box->used && box->count) {
+        *msg = box->queue[box->first];
+        box->first = (box->first + 1) % box->size;
+        /* the eventfd stays readable until the queue is empty */
+        if (--box->count == 0)
+            (void) read(box->fd, &value, sizeof(value));
+        result = msg;
     }
+    pthread_mutex_unlock(&box->lock);
+
+    return result;
+}
+
+bool wait_for_msgbox(
+    MSGBOX_ID src,
+    int fd,
+    int timeout)
+{
+    MSGBOX *box = find_msgbox(src);
+    struct pollfd fds[2];
+    nfds_t nfds = 0;
+
+    if (box && box->used) {
+        fds[nfds].fd = box->fd;
+        fds[nfds].events = POLLIN;
+        nfds++;
+    }
+    if (fd >= 0) {
+        fds[nfds].fd = fd;
+        fds[nfds].events = POLLIN;
+        nfds++;
+    }
+    if (poll(fds, nfds, timeout) <= 0)
+        return false;
+
+    return (fd >= 0) && (fds[nfds - 1].revents != 0);
 }
 
 void del_msgbox(
     MSGBOX_ID msgboxid)
 {
+    MSGBOX *box = find_msgbox(msgboxid);
 
-    if (msgboxid == INVALID_MSGBOX_ID)
+    if (!box)
         return;
-    else
-        msgctl(msgboxid, IPC_RMID, NULL);
+
+    pthread_mutex_lock(&msgbox_lock);
+    pthread_mutex_lock(&box->lock);
+    if (box->used) {
+        /* messages still waiting are dropped */
+        close(box->fd);
+        free(box->queue);
+        box->queue = NULL;
+        box->used = false;
+    }
+    pthread_mutex_unlock(&box->lock);
+    pthread_mutex_unlock(&msgbox_lock);
 }
 
-void free_data(
-    MSG_DATA * data)
+unsigned msgbox_dropped(
+    MSGBOX_ID msgboxid)
+{
+    MSGBOX *box = find_msgbox(msgboxid);
+    unsigned dropped = 0;
+
+    if (!box)
+        return 0;
+
+    pthread_mutex_lock(&box->lock);
+    dropped = box->dropped;
+    pthread_mutex_unlock(&box->lock);
+
+    return dropped;
+}
+
+MSG_DATA *alloc_data(
+    void)
 {
+    static MSG_DATA *pool = NULL;
+    MSG_DATA *data;
+    unsigned i;
 
-    if (data->pdu) {
-        free(data->pdu);
-        data->pdu = NULL;
+    pthread_mutex_lock(&msg_lock);
+    if (!pool) {
+        pool = (MSG_DATA *) calloc(MSG_POOL_SIZE, sizeof(MSG_DATA));
+        if (pool) {
+            for (i = 0; i < MSG_POOL_SIZE; i++) {
+                pool[i].next = free_msg_data;
+                free_msg_data = &pool[i];
+            }
+        }
     }
+    data = free_msg_data;
+    if (data)
+        free_msg_data = data->next;
+    pthread_mutex_unlock(&msg_lock);
+
     if (data) {
-        free(data);
-        data = NULL;
+        data->pdu = &data->buffer[MSG_HEADROOM];
+        data->pdu_len = 0;
+        data->ref_count = 1;
     }
+
+    return data;
 }
 
-void check_data(
+void free_data(
     MSG_DATA * data)
 {
 
-    /* lock and decrement messages reference count */
+    if (!data)
+        return;
+
     pthread_mutex_lock(&msg_lock);
-    if (--data->ref_count == 0) {
+    data->next = free_msg_data;
+    free_msg_data = data;
+    pthread_mutex_unlock(&msg_lock);
+}
+
+void check_data(
+    MSG_DATA * data)
+{
+
+    /* the last port to send it puts it back */
+    if (__sync_sub_and_fetch(&data->ref_count, 1) == 0) {
         free_data(data);
     }
-    pthread_mutex_unlock(&msg_lock);
+}
+
+void stamp_msg(
+    BACMSG * msg)
+{
+    clock_gettime(CLOCK_MONOTONIC, &msg->timestamp);
+}
+
+uint32_t msg_age(
+    BACMSG * msg)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (uint32_t) ((now.tv_sec - msg->timestamp.tv_sec) * 1000000L +
+        (now.tv_nsec - msg->timestamp.tv_nsec) / 1000L);
 }
@@ -31,9 +31,8 @@
 
 #include <stdint.h>
 #include <stdbool.h>
-#include <sys/types.h>
-#include <sys/ipc.h>
-#include <sys/msg.h>
+#include <time.h>
+#include <pthread.h>
 #include "bacdef.h"
 #include "npdu.h"
 
@@ -41,6 +40,31 @@ extern pthread_mutex_t msg_lock;
 
 #define INVALID_MSGBOX_ID -1
 
+/* one for the router core and one for each port */
+#ifndef MAX_MSGBOX
+#define MAX_MSGBOX 64
+#endif
+
+/* message data buffers, shared by all the ports */
+#ifndef MSG_POOL_SIZE
+#define MSG_POOL_SIZE 256
+#endif
+
+/* messages a box holds before it drops the new ones - each holds a
+   pool buffer, so a port that stalls takes only its share of the pool
+   and the other ports still get buffers */
+#ifndef MSGBOX_HIGH_WATER
+#define MSGBOX_HIGH_WATER (MSG_POOL_SIZE / 8)
+#endif
+#if (MSGBOX_HIGH_WATER >= MSG_POOL_SIZE)
+#error MSGBOX_HIGH_WATER must be less than MSG_POOL_SIZE
+#endif
+/* room in front of the PDU, so a longer NPDU header can be written
+   over the one it came with */
+#define MSG_HEADROOM MAX_NPDU
+/* the largest MPDU a port receives, a BACnet/IP one */
+#define MSG_MPDU_SIZE (4 + MAX_NPDU + 1476)
+
 typedef int MSGBOX_ID;
 
 typedef enum {
@@ -59,16 +83,18 @@ typedef struct _message {
     MSGBOX_ID origin;
     MSGSUBTYPE subtype;
     void *data;
-    /* add timestamp */
+    struct timespec timestamp;  /* when the PDU came in */
 } BACMSG;
 
 /* specific message type data structures */
 typedef struct _msg_data {
     BACNET_ADDRESS dest;
     BACNET_ADDRESS src;
-    uint8_t *pdu;
+    uint8_t *pdu;       /* points into buffer */
     uint16_t pdu_len;
-    uint8_t ref_count;
+    uint8_t ref_count;  /* ports still to send it, changed atomically */
+    struct _msg_data *next;     /* in the pool */
+    uint8_t buffer[MSG_HEADROOM + MSG_MPDU_SIZE];
 } MSG_DATA;
 
 MSGBOX_ID create_msgbox(
@@ -79,15 +105,32 @@ bool send_to_msgbox(
     MSGBOX_ID dest,
     BACMSG * msg);
 
-/* returns received message */
+/* returns received message, or NULL if there is none */
 BACMSG *recv_from_msgbox(
     MSGBOX_ID src,
     BACMSG * msg);
 
+/* blocks until the message box has a message or the fd (-1 for none)
+   is readable, or for timeout milliseconds (-1 for ever);
+   returns true if the fd is readable */
+bool wait_for_msgbox(
+    MSGBOX_ID src,
+    int fd,
+    int timeout);
+
 void del_msgbox(
     MSGBOX_ID msgboxid);
 
-/* free message data structure */
+/* messages dropped since the box was created, because it was full */
+unsigned msgbox_dropped(
+    MSGBOX_ID msgboxid);
+
+/* returns message data from the pool, with pdu after the headroom,
+   or NULL if the pool is empty */
+MSG_DATA *alloc_data(
+    void);
+
+/* puts message data back in the pool */
 void free_data(
     MSG_DATA * data);
 
@@ -95,4 +138,11 @@ void free_data(
 void check_data(
     MSG_DATA * data);
 
+void stamp_msg(
+    BACMSG * msg);
+
+/* microseconds since the message was stamped */
+uint32_t msg_age(
+    BACMSG * msg);
+
 #endif /* end of MSGQUEUE_H */
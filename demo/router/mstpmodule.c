@@ -108,6 +108,7 @@ void *dl_mstp_thread(
         /* message loop */
         BACMSG msg_storage, *bacmsg;
         MSG_DATA *msg_data;
+        BACNET_ADDRESS dest;
 
         bacmsg = recv_from_msgbox(port->port_id, &msg_storage);
 
@@ -116,15 +117,19 @@ void *dl_mstp_thread(
                 case DATA:
                     msg_data = (MSG_DATA *) bacmsg->data;
 
-                    if (msg_data->dest.net == BACNET_BROADCAST_NETWORK) {
-                        dlmstp_get_broadcast_address(&(msg_data->dest));
+                    /* other ports may be sending the same data */
+                    dest = msg_data->dest;
+                    if (dest.net == BACNET_BROADCAST_NETWORK) {
+                        dlmstp_get_broadcast_address(&dest);
                     } else {
-                        msg_data->dest.mac[0] = msg_data->dest.adr[0];
-                        msg_data->dest.mac_len = 1;
+                        dest.mac[0] = dest.adr[0];
+                        dest.mac_len = 1;
                     }
 
-                    dlmstp_send_pdu(&mstp_port, &(msg_data->dest),
-                        msg_data->pdu, msg_data->pdu_len);
+                    dlmstp_send_pdu(&mstp_port, &dest, msg_data->pdu,
+                        msg_data->pdu_len);
+                    PRINT(DEBUG, "Forwarded in %u us\n",
+                        (unsigned) msg_age(bacmsg));
 
                     check_data(msg_data);
 
@@ -147,18 +152,22 @@ void *dl_mstp_thread(
             pdu_len = dlmstp_receive(&mstp_port, NULL, NULL, 0, 5);
 
             if (pdu_len > 0) {
-                msg_data = (MSG_DATA *) malloc(sizeof(MSG_DATA));
+                msg_data = alloc_data();
+                if (!msg_data) {
+                    mstp_thread_debug("MSTP: out of buffers. Discarded!\n");
+                    continue;
+                }
                 memmove(&(msg_data->src),
                     (const void *) &(shared_port_data.Receive_Packet.address),
                     sizeof(shared_port_data.Receive_Packet.address));
                 msg_data->src.adr[0] = msg_data->src.mac[0];
                 msg_data->src.len = 1;
-                msg_data->pdu = (uint8_t *) malloc(pdu_len);
                 memmove(msg_data->pdu,
                     (const void *) &(shared_port_data.Receive_Packet.pdu),
                     pdu_len);
                 msg_data->pdu_len = pdu_len;
 
+                stamp_msg(&msg_storage);
                 msg_storage.type = DATA;
                 msg_storage.subtype = (MSGSUBTYPE) 0;
                 msg_storage.origin = port->port_id;
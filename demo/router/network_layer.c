@@ -32,7 +32,7 @@
 #include "network_layer.h"
 #include "bacint.h"
 
-uint16_t process_network_message(
+int16_t process_network_message(
     BACMSG * msg,
     MSG_DATA * data,
     uint8_t ** buff)
@@ -47,7 +47,8 @@ uint16_t process_network_message(
     int apdu_offset;
     int apdu_len;
 
-    memmove(data, msg->data, sizeof(MSG_DATA));
+    /* the addresses and the PDU, the reply goes in the buffer of data */
+    memmove(data, msg->data, offsetof(MSG_DATA, next));
 
     apdu_offset = npdu_decode(data->pdu, &data->dest, NULL, &npdu_data);
     apdu_len = data->pdu_len - apdu_offset;
@@ -96,7 +97,7 @@ uint16_t process_network_message(
                 int i;
                 for (i = 0; i < net_count; i++) {
                     decode_unsigned16(&data->pdu[apdu_offset + 2 * i], &net);   /* decode received NET values */
-                    add_dnet(&srcport->route_info, net, data->src);     /* and update routing table */
+                    add_dnet(srcport, net, data->src);  /* and update routing table */
                 }
                 break;
             }
@@ -122,6 +123,36 @@ uint16_t process_network_message(
                         PRINT(ERROR, "Error: Message too long\n");
                         break;
                 }
+                /* stop routing to the NET through this router for now */
+                if (apdu_len >= 3 && (error_code == 1 || error_code == 2)) {
+                    decode_unsigned16(&data->pdu[apdu_offset + 1], &net);
+                    set_dnet_state(srcport, &data->src, net,
+                        error_code == 1 ? DNET_UNREACHABLE : DNET_BUSY);
+                }
+                break;
+            }
+        case NETWORK_MESSAGE_ROUTER_BUSY_TO_NETWORK:
+        case NETWORK_MESSAGE_ROUTER_AVAILABLE_TO_NETWORK:
+            {
+                DNET_STATE state = DNET_REACHABLE;
+                int i;
+
+                if (npdu_data.network_message_type ==
+                    NETWORK_MESSAGE_ROUTER_BUSY_TO_NETWORK) {
+                    PRINT(INFO, "Recieved Router-Busy-To-Network message\n");
+                    state = DNET_BUSY;
+                } else {
+                    PRINT(INFO,
+                        "Recieved Router-Available-To-Network message\n");
+                }
+                /* no NETs means all the NETs of the router */
+                if (apdu_len < 2)
+                    set_dnet_state(srcport, &data->src,
+                        BACNET_BROADCAST_NETWORK, state);
+                for (i = 0; i + 1 < apdu_len; i += 2) {
+                    decode_unsigned16(&data->pdu[apdu_offset + i], &net);
+                    set_dnet_state(srcport, &data->src, net, state);
+                }
                 break;
             }
         case NETWORK_MESSAGE_INIT_RT_TABLE:
@@ -131,7 +162,7 @@ uint16_t process_network_message(
                 while (net_count--) {
                     int i = 1;
                     decode_unsigned16(&data->pdu[apdu_offset + i], &net);       /* decode received NET values */
-                    add_dnet(&srcport->route_info, net, data->src);     /* and update routing table */
+                    add_dnet(srcport, net, data->src);  /* and update routing table */
                     if (data->pdu[apdu_offset + i + 3] > 0)     /* find next NET value */
                         i = data->pdu[apdu_offset + i + 3] + 4;
                     else
@@ -153,7 +184,7 @@ uint16_t process_network_message(
                 while (net_count--) {
                     int i = 1;
                     decode_unsigned16(&data->pdu[apdu_offset + i], &net);       /* decode received NET values */
-                    add_dnet(&srcport->route_info, net, data->src);     /* and update routing table */
+                    add_dnet(srcport, net, data->src);  /* and update routing table */
                     if (data->pdu[apdu_offset + i + 3] > 0)     /* find next NET value */
                         i = data->pdu[apdu_offset + i + 3] + 4;
                     else
@@ -164,8 +195,6 @@ uint16_t process_network_message(
 
         case NETWORK_MESSAGE_INVALID:
         case NETWORK_MESSAGE_I_COULD_BE_ROUTER_TO_NETWORK:
-        case NETWORK_MESSAGE_ROUTER_BUSY_TO_NETWORK:
-        case NETWORK_MESSAGE_ROUTER_AVAILABLE_TO_NETWORK:
         case NETWORK_MESSAGE_ESTABLISH_CONNECTION_TO_NETWORK:
         case NETWORK_MESSAGE_DISCONNECT_CONNECTION_TO_NETWORK:
             /* hell if I know what to do with these messages */
@@ -211,7 +240,7 @@ uint16_t create_network_message(
         data_expecting_reply = true;
     init_npdu(&npdu_data, network_message_type, data_expecting_reply);
 
-    *buff = (uint8_t *) malloc(128);    /* resolve different length */
+    *buff = &data->buffer[MSG_HEADROOM];
 
     /* manual destination setup for Init-RT-Table-Ack message */
     data->dest.net = BACNET_BROADCAST_NETWORK;
@@ -233,29 +262,17 @@ uint16_t create_network_message(
                 uint16_t val16 = (valptr[0]) + (valptr[1] << 8);
                 buff_len += encode_unsigned16(*buff + buff_len, val16);
             } else {
-                ROUTER_PORT *port = head;
                 DNET *dnet;
-                while (port != NULL) {
-                    if (port->route_info.net != data->src.net) {
-                        buff_len +=
-                            encode_unsigned16(*buff + buff_len,
-                            port->route_info.net);
-                        dnet = port->route_info.dnets;
-                        while (dnet != NULL) {
-                            buff_len +=
-                                encode_unsigned16(*buff + buff_len, dnet->net);
-                            dnet = dnet->next;
-                        }
-                        port = port->next;
-                    } else {
-                        dnet = port->route_info.dnets;
-                        while (dnet != NULL) {
-                            buff_len +=
-                                encode_unsigned16(*buff + buff_len, dnet->net);
-                            dnet = dnet->next;
-                        }
-                        port = port->next;
-                    }
+                /* the NETs reachable through the other ports */
+                for (dnet = next_dnet(NULL); dnet != NULL;
+                    dnet = next_dnet(dnet)) {
+                    if (dnet->port->route_info.net == data->src.net ||
+                        dnet->state != DNET_REACHABLE)
+                        continue;
+                    if (buff_len + 2 > MSG_MPDU_SIZE - 4)
+                        break;
+                    buff_len +=
+                        encode_unsigned16(*buff + buff_len, dnet->net);
                 }
             }
             break;
@@ -291,8 +308,6 @@ uint16_t create_network_message(
 
         case NETWORK_MESSAGE_INVALID:
         case NETWORK_MESSAGE_I_COULD_BE_ROUTER_TO_NETWORK:
-        case NETWORK_MESSAGE_ROUTER_BUSY_TO_NETWORK:
-        case NETWORK_MESSAGE_ROUTER_AVAILABLE_TO_NETWORK:
         case NETWORK_MESSAGE_ESTABLISH_CONNECTION_TO_NETWORK:
         case NETWORK_MESSAGE_DISCONNECT_CONNECTION_TO_NETWORK:
             /* hell if I know what to do with these messages */
@@ -329,9 +344,12 @@ void send_network_message(
     int16_t buff_len;
 
     if (!data) {
-        data = (MSG_DATA *) malloc(sizeof(MSG_DATA));
+        data = alloc_data();
+        if (!data)
+            return;
         data->dest.net = BACNET_BROADCAST_NETWORK;
         data->dest.len = 0;
+        data->src.net = 0;
     }
 
     buff_len = create_network_message(network_message_type, data, buff, val);
@@ -342,6 +360,7 @@ void send_network_message(
     msg.origin = head->main_id;
     msg.type = DATA;
     msg.data = data;
+    stamp_msg(&msg);
 
     data->ref_count = port_count;
     while (port != NULL) {
@@ -349,7 +368,8 @@ void send_network_message(
             port = port->next;
             continue;
         }
-        send_to_msgbox(port->port_id, &msg);
+        if (!send_to_msgbox(port->port_id, &msg))
+            check_data(data);
         port = port->next;
     }
 }
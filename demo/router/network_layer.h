@@ -40,7 +40,7 @@
 #include "net.h"
 #include "portthread.h"
 
-uint16_t process_network_message(
+int16_t process_network_message(
     BACMSG * msg,
     MSG_DATA * data,
     uint8_t ** buff);
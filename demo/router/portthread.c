@@ -46,87 +46,181 @@ ROUTER_PORT *find_snet(
     return NULL;
 }
 
+static DNET *dnet_table[DNET_HASH_SIZE];
+
+static unsigned dnet_hash(
+    uint16_t net)
+{
+    return net % DNET_HASH_SIZE;
+}
+
+static void remove_dnet(
+    DNET * dnet)
+{
+    DNET **link = &dnet_table[dnet_hash(dnet->net)];
+
+    while (*link != dnet)
+        link = &(*link)->next;
+    *link = dnet->next;
+    free(dnet);
+}
+
+/* learned routes age out, and busy ones come back; true if the
+   route was removed */
+static bool age_dnet(
+    DNET * dnet,
+    time_t now)
+{
+
+    if (dnet->mac_len == 0)
+        return false;
+
+    if (now - dnet->last_seen > DNET_AGE_TIMEOUT ||
+        (dnet->state == DNET_UNREACHABLE &&
+            now - dnet->state_time > DNET_BUSY_TIMEOUT)) {
+        PRINT(INFO, "Route to NET %hu removed\n", dnet->net);
+        remove_dnet(dnet);
+        return true;
+    }
+    if (dnet->state == DNET_BUSY &&
+        now - dnet->state_time > DNET_BUSY_TIMEOUT)
+        dnet->state = DNET_REACHABLE;
+
+    return false;
+}
+
+DNET *find_route(
+    uint16_t net)
+{
+
+    DNET *dnet = dnet_table[dnet_hash(net)];
+
+    while (dnet != NULL && dnet->net != net)
+        dnet = dnet->next;
+    if (dnet == NULL || age_dnet(dnet, time(NULL)))
+        return NULL;
+
+    return dnet;
+}
+
 ROUTER_PORT *find_dnet(
     uint16_t net,
     BACNET_ADDRESS * addr)
 {
 
-    ROUTER_PORT *port = head;
     DNET *dnet;
 
     /* for broadcast messages no search is needed */
     if (net == BACNET_BROADCAST_NETWORK)
-        return port;
-
-    while (port != NULL) {
+        return head;
 
-        /* check if DNET is directly connected to the router */
-        if (net == port->route_info.net)
-            return port;
+    dnet = find_route(net);
+    if (dnet == NULL || dnet->state != DNET_REACHABLE)
+        return NULL;
 
-        /* else search router ports DNET list */
-        else if (port->route_info.dnets) {
-            dnet = port->route_info.dnets;
-            while (dnet != NULL) {
-                if (net == dnet->net) {
-                    if (addr) {
-                        memmove(&addr->len, &dnet->mac_len, 1);
-                        memmove(&addr->adr[0], &dnet->mac[0], MAX_MAC_LEN);
-                    }
-                    return port;
-                }
-                dnet = dnet->next;
-            }
-        }
-        port = port->next;
+    /* the next router, if DNET is not directly connected */
+    if (addr && dnet->mac_len) {
+        memmove(&addr->len, &dnet->mac_len, 1);
+        memmove(&addr->adr[0], &dnet->mac[0], MAX_MAC_LEN);
     }
 
-    return NULL;
+    return dnet->port;
 }
 
 void add_dnet(
-    RT_ENTRY * route_info,
+    ROUTER_PORT * port,
     uint16_t net,
     BACNET_ADDRESS addr)
 {
 
-    DNET *dnet = route_info->dnets;
-    DNET *tmp;
+    DNET *dnet = find_route(net);
+    unsigned index;
 
     if (dnet == NULL) {
-        route_info->dnets = (DNET *) malloc(sizeof(DNET));
-        memmove(&route_info->dnets->mac_len, &addr.len, 1);
-        memmove(&route_info->dnets->mac[0], &addr.adr[0], MAX_MAC_LEN);
-        route_info->dnets->net = net;
-        route_info->dnets->state = true;
-        route_info->dnets->next = NULL;
-    } else {
-
-        while (dnet != NULL) {
-            if (dnet->net == net)       /* make sure NETs are not repeated */
-                return;
-            tmp = dnet;
-            dnet = dnet->next;
-        }
-
         dnet = (DNET *) malloc(sizeof(DNET));
-        memmove(&dnet->mac_len, &addr.len, 1);
-        memmove(&dnet->mac[0], &addr.adr[0], MAX_MAC_LEN);
+        if (dnet == NULL)
+            return;
         dnet->net = net;
-        dnet->state = true;
-        dnet->next = NULL;
-        tmp->next = dnet;
+        index = dnet_hash(net);
+        dnet->next = dnet_table[index];
+        dnet_table[index] = dnet;
+    } else if (dnet->mac_len == 0) {
+        /* directly connected networks are not learned */
+        return;
+    }
+
+    dnet->port = port;
+    memmove(&dnet->mac_len, &addr.len, 1);
+    memmove(&dnet->mac[0], &addr.adr[0], MAX_MAC_LEN);
+    dnet->state = DNET_REACHABLE;
+    dnet->last_seen = dnet->state_time = time(NULL);
+}
+
+void set_dnet_state(
+    ROUTER_PORT * port,
+    BACNET_ADDRESS * addr,
+    uint16_t net,
+    DNET_STATE state)
+{
+
+    DNET *dnet;
+    unsigned i = 0;
+
+    /* one network is in one bucket */
+    if (net != BACNET_BROADCAST_NETWORK)
+        i = dnet_hash(net);
+    for (; i < DNET_HASH_SIZE; i++) {
+        for (dnet = dnet_table[i]; dnet != NULL; dnet = dnet->next) {
+            if ((net == BACNET_BROADCAST_NETWORK || net == dnet->net) &&
+                dnet->mac_len != 0 && dnet->port == port &&
+                dnet->mac_len == addr->len &&
+                memcmp(dnet->mac, addr->adr, dnet->mac_len) == 0) {
+                dnet->state = state;
+                dnet->state_time = time(NULL);
+            }
+        }
+        if (net != BACNET_BROADCAST_NETWORK)
+            break;
+    }
+}
+
+DNET *next_dnet(
+    DNET * dnet)
+{
+
+    DNET *next = NULL;
+    time_t now = time(NULL);
+    unsigned i = 0;
+
+    if (dnet) {
+        next = dnet->next;
+        i = dnet_hash(dnet->net) + 1;
+    }
+    for (;;) {
+        while (next == NULL && i < DNET_HASH_SIZE)
+            next = dnet_table[i++];
+        if (next == NULL)
+            return NULL;
+        /* the aged routes are removed, as find_route() does */
+        dnet = next;
+        next = next->next;
+        if (!age_dnet(dnet, now))
+            return dnet;
     }
 }
 
 void cleanup_dnets(
-    DNET * dnets)
+    void)
 {
 
-    DNET *dnet = dnets;
-    while (dnet != NULL) {
-        dnet = dnet->next;
-        free(dnets);
-        dnets = dnet;
+    DNET *dnet;
+    unsigned i;
+
+    for (i = 0; i < DNET_HASH_SIZE; i++) {
+        while (dnet_table[i] != NULL) {
+            dnet = dnet_table[i];
+            dnet_table[i] = dnet->next;
+            free(dnet);
+        }
     }
 }
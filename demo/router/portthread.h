@@ -32,6 +32,7 @@
 #include <stdint.h>
 #include <stdbool.h>
 #include <pthread.h>
+#include <time.h>
 #include "msgqueue.h"
 #include "bacdef.h"
 #include "npdu.h"
@@ -40,7 +41,9 @@
 #define INFO 2
 #define DEBUG 3
 
+#ifndef DEBUG_LEVEL
 #define DEBUG_LEVEL 3
+#endif
 #ifdef DEBUG_LEVEL
 #define PRINT(debug_level, ...) if(debug_level <= DEBUG_LEVEL) fprintf(stderr, __VA_ARGS__)
 #else
@@ -85,13 +88,37 @@ typedef union _port_params {
     } mstp_params;
 } PORT_PARAMS;
 
-/* list node for reacheble networks */
+/* routes are kept in a hash table by network number */
+#ifndef DNET_HASH_SIZE
+#define DNET_HASH_SIZE 256
+#endif
+/* seconds a learned route is kept without being heard of */
+#ifndef DNET_AGE_TIMEOUT
+#define DNET_AGE_TIMEOUT 3600
+#endif
+/* seconds a route stays busy or unreachable, T_busy in the standard */
+#ifndef DNET_BUSY_TIMEOUT
+#define DNET_BUSY_TIMEOUT 30
+#endif
+
+typedef enum {
+    DNET_REACHABLE,
+    DNET_BUSY,
+    DNET_UNREACHABLE
+} DNET_STATE;
+
+struct _port;
+
+/* route to a network, directly connected or through another router */
 typedef struct _dnet {
-    uint8_t mac[MAX_MAC_LEN];
+    uint8_t mac[MAX_MAC_LEN];   /* next router, mac_len is 0 if direct */
     uint8_t mac_len;
     uint16_t net;
-    bool state; /* enabled or disabled */
-    struct _dnet *next;
+    DNET_STATE state;
+    time_t state_time;  /* when it became busy or unreachable */
+    time_t last_seen;   /* when the route was learned or used last */
+    struct _port *port;
+    struct _dnet *next; /* in the hash bucket */
 } DNET;
 
 /* information for routing table */
@@ -99,7 +126,6 @@ typedef struct _routing_table_entry {
     uint8_t mac[MAX_MAC_LEN];
     uint8_t mac_len;
     uint16_t net;
-    DNET *dnets;
 } RT_ENTRY;
 
 typedef struct _port {
@@ -121,18 +147,37 @@ extern int port_count;
 ROUTER_PORT *find_snet(
     MSGBOX_ID id);
 
-/* get sending router port */
+/* get the route to a network, or NULL if there is none */
+DNET *find_route(
+    uint16_t net);
+
+/* get sending router port, and the next router address if the network
+   is not directly connected; NULL if the network is not reachable */
 ROUTER_PORT *find_dnet(
     uint16_t net,
     BACNET_ADDRESS * addr);
 
-/* add reacheble network for specified router port */
+/* add or refresh a route to the network through the router at addr;
+   a zero length addr adds a directly connected network */
 void add_dnet(
-    RT_ENTRY * route_info,
+    ROUTER_PORT * port,
     uint16_t net,
     BACNET_ADDRESS addr);
 
+/* set the state of the routes through the router at addr, to one
+   network or to all of them with BACNET_BROADCAST_NETWORK */
+void set_dnet_state(
+    ROUTER_PORT * port,
+    BACNET_ADDRESS * addr,
+    uint16_t net,
+    DNET_STATE state);
+
+/* the route after dnet in the table, the first one if dnet is NULL;
+   the aged routes are removed on the way, as by find_route() */
+DNET *next_dnet(
+    DNET * dnet);
+
 void cleanup_dnets(
-    DNET * dnets);
+    void);
 
 #endif /* end of PORTTHREAD_H */
@@ -0,0 +1,353 @@
+/*************************************************************************
+* Copyright (C) 2014 Steve Karg <skarg@users.sourceforge.net>
+*
+* Permission is hereby granted, free of charge, to any person obtaining
+* a copy of this software and associated documentation files (the
+* "Software"), to deal in the Software without restriction, including
+* without limitation the rights to use, copy, modify, merge, publish,
+* distribute, sublicense, and/or sell copies of the Software, and to
+* permit persons to whom the Software is furnished to do so, subject to
+* the following conditions:
+*
+* The above copyright notice and this permission notice shall be included
+* in all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+* IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+* CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+* TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+* SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*
+*********************************************************************/
+
+/* command line tool that measures how fast a BACnet/IP router forwards.
+   It sends Who-Is messages to the network of the router port it is on,
+   addressed to itself, so the router sends each one back.  The Who-Is
+   range carries the sequence number of the message.  The packets per
+   second and the forwarding latency are printed at the end. */
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include "config.h"
+#include "bacdef.h"
+#include "bacenum.h"
+#include "bacint.h"
+#include "npdu.h"
+#include "bip.h"
+#include "whois.h"
+#include "filename.h"
+
+/* Who-Is limits are device instances */
+#define SEQUENCE_MODULO (BACNET_MAX_INSTANCE + 1)
+
+static unsigned Count = 10000;
+static unsigned Window = 32;
+static unsigned Timeout = 1000;
+static uint16_t Network = 1;
+static uint16_t Local_Port = 47809;
+static struct sockaddr_in Router;
+
+/* nanoseconds on the monotonic clock */
+static uint64_t now_ns(
+    void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint64_t) ts.tv_sec * 1000000000ULL + (uint64_t) ts.tv_nsec;
+}
+
+static int compare_latency(
+    const void *a,
+    const void *b)
+{
+    uint32_t la = *(const uint32_t *) a;
+    uint32_t lb = *(const uint32_t *) b;
+
+    return (la > lb) - (la < lb);
+}
+
+/* the local address the router sees, found by connecting a socket */
+static bool local_address(
+    struct in_addr *addr)
+{
+    struct sockaddr_in sin;
+    socklen_t sin_len = sizeof(sin);
+    int fd;
+    bool status = false;
+
+    fd = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    if (fd < 0) {
+        return false;
+    }
+    if ((connect(fd, (struct sockaddr *) &Router, sizeof(Router)) == 0) &&
+        (getsockname(fd, (struct sockaddr *) &sin, &sin_len) == 0)) {
+        *addr = sin.sin_addr;
+        status = true;
+    }
+    close(fd);
+
+    return status;
+}
+
+/* BVLC, NPDU to ourselves on the network, and Who-Is */
+static int encode_packet(
+    uint8_t * buffer,
+    BACNET_ADDRESS * dest,
+    uint32_t sequence)
+{
+    BACNET_NPDU_DATA npdu_data;
+    int len = 4;
+
+    npdu_encode_npdu_data(&npdu_data, false, MESSAGE_PRIORITY_NORMAL);
+    len += npdu_encode_pdu(&buffer[len], dest, NULL, &npdu_data);
+    len +=
+        whois_encode_apdu(&buffer[len], (int32_t) sequence,
+        (int32_t) sequence);
+    buffer[0] = BVLL_TYPE_BACNET_IP;
+    buffer[1] = BVLC_ORIGINAL_UNICAST_NPDU;
+    encode_unsigned16(&buffer[2], (uint16_t) len);
+
+    return len;
+}
+
+/* returns the sequence number of a forwarded Who-Is, or -1 */
+static int32_t decode_packet(
+    uint8_t * buffer,
+    int len)
+{
+    BACNET_ADDRESS dest;
+    BACNET_ADDRESS src;
+    BACNET_NPDU_DATA npdu_data;
+    int32_t low_limit = -1;
+    int32_t high_limit = -1;
+    int offset;
+
+    if ((len < 4) || (buffer[0] != BVLL_TYPE_BACNET_IP)) {
+        return -1;
+    }
+    if (buffer[1] == BVLC_ORIGINAL_UNICAST_NPDU) {
+        offset = 4;
+    } else if (buffer[1] == BVLC_FORWARDED_NPDU) {
+        offset = 10;
+    } else {
+        return -1;
+    }
+    if (len <= offset) {
+        return -1;
+    }
+    offset += npdu_decode(&buffer[offset], &dest, &src, &npdu_data);
+    if ((offset + 2 > len) || npdu_data.network_layer_message ||
+        (buffer[offset] != PDU_TYPE_UNCONFIRMED_SERVICE_REQUEST) ||
+        (buffer[offset + 1] != SERVICE_UNCONFIRMED_WHO_IS)) {
+        return -1;
+    }
+    offset += 2;
+    if (whois_decode_service_request(&buffer[offset], len - offset,
+            &low_limit, &high_limit) < 0) {
+        return -1;
+    }
+
+    return low_limit;
+}
+
+static void print_usage(
+    char *filename)
+{
+    printf("Usage: %s [-c count] [-w window] [-n net] [-p port]"
+        " router-address [router-port]\n", filename);
+}
+
+static void print_help(
+    char *filename)
+{
+    print_usage(filename);
+    printf("Measure the forwarding rate and latency of a BACnet/IP router.\n"
+        "Who-Is messages are sent to the router for the network of its\n"
+        "port, addressed back to this tool.\n"
+        "-c count: number of messages to send (10000)\n"
+        "-w window: messages in flight at a time (32)\n"
+        "-n net: network number of the router port (1)\n"
+        "-p port: local UDP port (47809)\n"
+        "router-port: UDP port of the router (47808)\n"
+        "Example:\n" "%s -c 100000 -n 1 127.0.0.1\n", filename);
+}
+
+static bool parse_command_line(
+    int argc,
+    char *argv[])
+{
+    char *filename = filename_remove_path(argv[0]);
+    int argi;
+    int target = 0;
+
+    Router.sin_family = AF_INET;
+    Router.sin_port = htons(0xBAC0);
+    for (argi = 1; argi < argc; argi++) {
+        if (strcmp(argv[argi], "--help") == 0) {
+            print_help(filename);
+            exit(0);
+        } else if ((strcmp(argv[argi], "-c") == 0) && (argi + 1 < argc)) {
+            Count = strtoul(argv[++argi], NULL, 0);
+        } else if ((strcmp(argv[argi], "-w") == 0) && (argi + 1 < argc)) {
+            Window = strtoul(argv[++argi], NULL, 0);
+        } else if ((strcmp(argv[argi], "-n") == 0) && (argi + 1 < argc)) {
+            Network = (uint16_t) strtoul(argv[++argi], NULL, 0);
+        } else if ((strcmp(argv[argi], "-p") == 0) && (argi + 1 < argc)) {
+            Local_Port = (uint16_t) strtoul(argv[++argi], NULL, 0);
+        } else if (target == 0) {
+            if (inet_aton(argv[argi], &Router.sin_addr) == 0) {
+                fprintf(stderr, "invalid router address %s\n", argv[argi]);
+                return false;
+            }
+            target++;
+        } else if (target == 1) {
+            Router.sin_port =
+                htons((uint16_t) strtoul(argv[argi], NULL, 0));
+            target++;
+        } else {
+            print_usage(filename);
+            return false;
+        }
+    }
+    if ((target == 0) || (Count == 0) || (Window == 0)) {
+        print_usage(filename);
+        return false;
+    }
+
+    return true;
+}
+
+int main(
+    int argc,
+    char *argv[])
+{
+    BACNET_ADDRESS dest = { 0 };
+    struct sockaddr_in sin = { 0 };
+    struct in_addr addr;
+    struct pollfd fds;
+    uint8_t buffer[MAX_MPDU];
+    uint64_t *sent_time;
+    uint32_t *latency;
+    bool *done;
+    unsigned next = 0;
+    unsigned oldest = 0;
+    unsigned in_flight = 0;
+    unsigned received = 0;
+    unsigned lost = 0;
+    uint64_t start, now, elapsed;
+    int32_t sequence;
+    int fd, len, rc;
+
+    if (!parse_command_line(argc, argv)) {
+        return 1;
+    }
+    if (!local_address(&addr)) {
+        fprintf(stderr, "no route to the router\n");
+        return 1;
+    }
+    fd = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    if (fd < 0) {
+        perror("socket");
+        return 1;
+    }
+    sin.sin_family = AF_INET;
+    sin.sin_addr.s_addr = htonl(INADDR_ANY);
+    sin.sin_port = htons(Local_Port);
+    if (bind(fd, (struct sockaddr *) &sin, sizeof(sin)) < 0) {
+        perror("bind");
+        return 1;
+    }
+    /* the router sends the message back to our B/IP address */
+    dest.net = Network;
+    dest.len = 6;
+    memcpy(&dest.adr[0], &addr.s_addr, 4);
+    memcpy(&dest.adr[4], &sin.sin_port, 2);
+
+    sent_time = calloc(Count, sizeof(uint64_t));
+    latency = calloc(Count, sizeof(uint32_t));
+    done = calloc(Count, sizeof(bool));
+    if (!sent_time || !latency || !done) {
+        fprintf(stderr, "out of memory\n");
+        return 1;
+    }
+
+    start = now_ns();
+    while (oldest < Count) {
+        while ((next < Count) && (in_flight < Window)) {
+            len = encode_packet(buffer, &dest, next % SEQUENCE_MODULO);
+            sent_time[next] = now_ns();
+            if (sendto(fd, buffer, len, 0, (struct sockaddr *) &Router,
+                    sizeof(Router)) < 0) {
+                perror("sendto");
+                return 1;
+            }
+            next++;
+            in_flight++;
+        }
+        fds.fd = fd;
+        fds.events = POLLIN;
+        rc = poll(&fds, 1, 10);
+        if ((rc < 0) && (errno != EINTR)) {
+            perror("poll");
+            return 1;
+        }
+        while ((len = recv(fd, buffer, sizeof(buffer), MSG_DONTWAIT)) > 0) {
+            now = now_ns();
+            sequence = decode_packet(buffer, len);
+            if (sequence < 0) {
+                continue;
+            }
+            /* the one in flight with this sequence number */
+            sequence += (oldest / SEQUENCE_MODULO) * SEQUENCE_MODULO;
+            if ((unsigned) sequence < oldest) {
+                sequence += SEQUENCE_MODULO;
+            }
+            if (((unsigned) sequence >= next) || done[sequence]) {
+                continue;
+            }
+            done[sequence] = true;
+            latency[received++] =
+                (uint32_t) ((now - sent_time[sequence]) / 1000);
+            in_flight--;
+        }
+        /* the ones that did not come back in time are lost */
+        now = now_ns();
+        while ((oldest < next) && (done[oldest] ||
+                ((now - sent_time[oldest]) / 1000000 >= Timeout))) {
+            if (!done[oldest]) {
+                done[oldest] = true;
+                lost++;
+                in_flight--;
+            }
+            oldest++;
+        }
+    }
+    elapsed = now_ns() - start;
+
+    printf("sent %u received %u lost %u in %.3f s\n", Count, received, lost,
+        (double) elapsed / 1e9);
+    printf("%.0f packets/s\n", (double) received * 1e9 / (double) elapsed);
+    if (received) {
+        qsort(latency, received, sizeof(uint32_t), compare_latency);
+        printf("latency us: min %u median %u p99 %u max %u\n", latency[0],
+            latency[received / 2], latency[(received * 99) / 100],
+            latency[received - 1]);
+    }
+    close(fd);
+
+    return 0;
+}
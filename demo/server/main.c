@@ -69,7 +69,12 @@
 
 #if defined(BAC_UCI)
 #include "ucix.h"
+#endif
+#if defined(BAC_SHM)
+#include "shmvalue.h"
+#endif
 
+#if defined(BAC_UCI) || defined(BAC_SHM)
 #if defined(AI)
 #include "ai.h"
 #endif
@@ -106,7 +111,7 @@
 #include "msv.h"
 #endif
 
-#endif /* defined(BAC_UCI) */
+#endif /* defined(BAC_UCI) || defined(BAC_SHM) */
 
 
 /** @file server/main.c  Example server application using the BACnet Stack. */
@@ -121,109 +126,163 @@ static uint8_t Rx_Buf[MAX_MPDU] = { 0 };
 
 #if defined(BAC_UCI)
 #if defined(AI) || defined(AO) || defined(AV) || defined(BI) || defined(BO) || defined(BV) || defined(MSI) || defined(MSO) || defined(MSV)
-static time_t uci_Update(
-	time_t ucimodtime,
-	BACNET_OBJECT_TYPE update_object_type,
-	int ucirewrite
-	)
-{
+#define UCI_RELOAD 1
+/* the configs the object values are reloaded from */
+struct uci_reload {
+	BACNET_OBJECT_TYPE object_type;
 	char *section;
 	char *type;
-	time_t chk_mtime = 0;
-	struct uci_context *ctx;
-	int uci_idx;
-	/* update Value from uci */
-	section = NULL;
-	type = NULL;
-	if (false) {
-		section = NULL;
-		type = NULL;
+	value_tuple_t *applied;	/* the values of the last reload */
+	value_tuple_t **index;	/* applied, sorted by section */
+	unsigned count;
+};
+
+static struct uci_reload Uci_Reload[] = {
 #if defined(AI)
-	} else if (update_object_type == OBJECT_ANALOG_INPUT) {
-		section = "bacnet_ai";
-		type = "ai";
+	{ OBJECT_ANALOG_INPUT, "bacnet_ai", "ai", NULL, NULL, 0 },
 #endif
 #if defined(AO)
-	} else if (update_object_type == OBJECT_ANALOG_OUTPUT) {
-		section = "bacnet_ao";
-		type = "ao";
+	{ OBJECT_ANALOG_OUTPUT, "bacnet_ao", "ao", NULL, NULL, 0 },
 #endif
 #if defined(AV)
-	} else if (update_object_type == OBJECT_ANALOG_VALUE) {
-		section = "bacnet_av";
-		type = "av";
+	{ OBJECT_ANALOG_VALUE, "bacnet_av", "av", NULL, NULL, 0 },
 #endif
 #if defined(BI)
-	} else if (update_object_type == OBJECT_BINARY_INPUT) {
-		section = "bacnet_bi";
-		type = "bi";
+	{ OBJECT_BINARY_INPUT, "bacnet_bi", "bi", NULL, NULL, 0 },
 #endif
 #if defined(BO)
-	} else if (update_object_type == OBJECT_BINARY_OUTPUT) {
-		section = "bacnet_bo";
-		type = "bo";
+	{ OBJECT_BINARY_OUTPUT, "bacnet_bo", "bo", NULL, NULL, 0 },
 #endif
 #if defined(BV)
-	} else if (update_object_type == OBJECT_BINARY_VALUE) {
-		section = "bacnet_bv";
-		type = "bv";
+	{ OBJECT_BINARY_VALUE, "bacnet_bv", "bv", NULL, NULL, 0 },
 #endif
-#if defined(MI)
-	} else if (update_object_type == OBJECT_MULTI_STATE_INPUT) {
-		section = "bacnet_mi";
-		type = "mi";
+#if defined(MSI)
+	{ OBJECT_MULTI_STATE_INPUT, "bacnet_mi", "mi", NULL, NULL, 0 },
 #endif
-#if defined(MO)
-	} else if (update_object_type == OBJECT_MULTI_STATE_OUTPUT) {
-		section = "bacnet_mo";
-		type = "mo";
+#if defined(MSO)
+	{ OBJECT_MULTI_STATE_OUTPUT, "bacnet_mo", "mo", NULL, NULL, 0 },
 #endif
 #if defined(MSV)
-	} else if (update_object_type == OBJECT_MULTI_STATE_VALUE) {
-		section = "bacnet_mv";
-		type = "mv";
+	{ OBJECT_MULTI_STATE_VALUE, "bacnet_mv", "mv", NULL, NULL, 0 },
 #endif
-	} else {
-		return 0;
-	}
-	if ( ucirewrite == 0) {
-		chk_mtime = ucimodtime;
-#if PRINT_ENABLED
-		printf("rewrite type: %s\n", type);
-#endif
-	} else {
-		chk_mtime = check_uci_update(section, ucimodtime);
+};
+
+#define UCI_RELOAD_COUNT (sizeof(Uci_Reload)/sizeof(Uci_Reload[0]))
+
+static void uci_value_list_free(value_tuple_t *list)
+{
+	value_tuple_t *next;
+
+	for (; list; list = next) {
+		next = list->next;
+		free(list);
 	}
-	if(chk_mtime != 0) {
-		sleep(1);
-		ucimodtime = chk_mtime;
-#if PRINT_ENABLED
-		printf("Config changed, reloading %s\n",section);
-#endif
-		ctx = ucix_init(section);
-		struct uci_itr_ctx itr;
-		value_tuple_t *cur;
-		itr.list = NULL;
-		itr.section = section;
+}
+
+static value_tuple_t *uci_value_list_load(struct uci_reload *reload)
+{
+	struct uci_context *ctx;
+	struct uci_itr_ctx itr;
+
+	itr.list = NULL;
+	itr.section = reload->section;
+	ctx = ucix_init(reload->section);
+	if (ctx) {
 		itr.ctx = ctx;
-		ucix_for_each_section_type(ctx, section, type,
+		ucix_for_each_section_type(ctx, reload->section, reload->type,
 			(void *)load_value, &itr);
-		for( cur = itr.list; cur; cur = cur->next ) {
-			uci_idx = atoi(cur->idx);
+		ucix_cleanup(ctx);
+	}
+	return itr.list;
+}
+
+static int uci_value_compare(const void *a, const void *b)
+{
+	return strcmp((*(value_tuple_t * const *)a)->idx,
+		(*(value_tuple_t * const *)b)->idx);
+}
+
+/* keep the values of a reload to diff the next one against */
+static void uci_value_applied_set(struct uci_reload *reload,
+	value_tuple_t *list)
+{
+	value_tuple_t *cur;
+	unsigned count = 0;
+
+	uci_value_list_free(reload->applied);
+	free(reload->index);
+	reload->applied = list;
+	reload->index = NULL;
+	reload->count = 0;
+	for (cur = list; cur; cur = cur->next)
+		count++;
+	if (count)
+		reload->index = malloc(count * sizeof(value_tuple_t *));
+	if (!reload->index)
+		return;
+	for (cur = list; cur; cur = cur->next)
+		reload->index[reload->count++] = cur;
+	qsort(reload->index, reload->count, sizeof(value_tuple_t *),
+		uci_value_compare);
+}
+
+/* find the value of a section in the last reload */
+static value_tuple_t *uci_value_find(struct uci_reload *reload,
+	value_tuple_t *key)
+{
+	value_tuple_t **found;
+
+	if (!reload->count)
+		return NULL;
+	found = bsearch(&key, reload->index, reload->count,
+		sizeof(value_tuple_t *), uci_value_compare);
+	return found ? *found : NULL;
+}
+
+#define UCI_VALUE_CHANGED 1
+#define UCI_OOS_CHANGED 2
+
+/* Update the objects of a changed config.  Only the options that changed
+   since the last reload are applied, so an unchanged instance costs
+   no update and no COV check.  Returns the number of changed instances. */
+static unsigned uci_Update(
+	struct uci_reload *reload
+	)
+{
+	BACNET_OBJECT_TYPE update_object_type = reload->object_type;
+	value_tuple_t *list, *cur, *old;
+	unsigned changed, changed_count = 0;
+	int uci_idx;
+
+	list = uci_value_list_load(reload);
+	for( cur = list; cur; cur = cur->next ) {
+		old = uci_value_find(reload, cur);
+		changed = 0;
+		if (!old || strcmp(old->value, cur->value))
+			changed |= UCI_VALUE_CHANGED;
+		if (!old || (old->Out_Of_Service != cur->Out_Of_Service))
+			changed |= UCI_OOS_CHANGED;
+		if (!changed)
+			continue;
+		changed_count++;
+		uci_idx = atoi(cur->idx);
 #if PRINT_ENABLED
-			printf("section %s idx %i \n", section, uci_idx);
+		printf("section %s idx %i \n", reload->section, uci_idx);
 #endif
-			if (false) {
-			}
+		if (false) {
+		}
 /* update Analog Input from uci */
 #if defined(AI)
-			else if (update_object_type == OBJECT_ANALOG_INPUT) {
-				float ai_val, ai_pval;
+		else if (update_object_type == OBJECT_ANALOG_INPUT) {
+			float ai_val, ai_pval;
+			if (changed & UCI_VALUE_CHANGED) {
 				ai_val = strtof(cur->value,NULL);
 				ai_pval = Analog_Input_Present_Value(uci_idx);
 				if ( ai_val != ai_pval ) {
 					Analog_Input_Present_Value_Set(uci_idx,ai_val,16);
 				}
+			}
+			if (changed & UCI_OOS_CHANGED) {
 				if (cur->Out_Of_Service == 0) {
 					if (Analog_Input_Out_Of_Service(uci_idx))
 						Analog_Input_Out_Of_Service_Set(uci_idx,0);
@@ -240,16 +299,20 @@ static time_t uci_Update(
 						RELIABILITY_COMMUNICATION_FAILURE);
 				}
 			}
+		}
 #endif
 /* update Analog Output from uci */
 #if defined(AO)
-			else if (update_object_type == OBJECT_ANALOG_OUTPUT) {
-				float ao_val, ao_pval;
+		else if (update_object_type == OBJECT_ANALOG_OUTPUT) {
+			float ao_val, ao_pval;
+			if (changed & UCI_VALUE_CHANGED) {
 				ao_val = strtof(cur->value,NULL);
 				ao_pval = Analog_Output_Present_Value(uci_idx);
 				if ( ao_val != ao_pval ) {
 					Analog_Output_Present_Value_Set(uci_idx,ao_val,16);
 				}
+			}
+			if (changed & UCI_OOS_CHANGED) {
 				if (cur->Out_Of_Service == 0) {
 					if (Analog_Output_Out_Of_Service(uci_idx))
 						Analog_Output_Out_Of_Service_Set(uci_idx,0);
@@ -266,16 +329,20 @@ static time_t uci_Update(
 						RELIABILITY_COMMUNICATION_FAILURE);
 				}
 			}
+		}
 #endif
 /* update Analog Value from uci */
 #if defined(AV)
-			else if (update_object_type == OBJECT_ANALOG_VALUE) {
-				float av_val, av_pval;
+		else if (update_object_type == OBJECT_ANALOG_VALUE) {
+			float av_val, av_pval;
+			if (changed & UCI_VALUE_CHANGED) {
 				av_val = strtof(cur->value,NULL);
 				av_pval = Analog_Value_Present_Value(uci_idx);
 				if ( av_val != av_pval ) {
 					Analog_Value_Present_Value_Set(uci_idx,av_val,16);
 				}
+			}
+			if (changed & UCI_OOS_CHANGED) {
 				if (cur->Out_Of_Service == 0) {
 					if (Analog_Value_Out_Of_Service(uci_idx))
 						Analog_Value_Out_Of_Service_Set(uci_idx,0);
@@ -292,16 +359,20 @@ static time_t uci_Update(
 						RELIABILITY_COMMUNICATION_FAILURE);
 				}
 			}
+		}
 #endif
 /* update Binary Input from uci */
 #if defined(BI)
-			else if (update_object_type == OBJECT_BINARY_INPUT) {
-				int bi_val, bi_pval;
+		else if (update_object_type == OBJECT_BINARY_INPUT) {
+			int bi_val, bi_pval;
+			if (changed & UCI_VALUE_CHANGED) {
 				bi_val = atoi(cur->value);
 				bi_pval = Binary_Input_Present_Value(uci_idx);
 				if ( bi_val != bi_pval ) {
 					Binary_Input_Present_Value_Set(uci_idx,bi_val,16);
 				}
+			}
+			if (changed & UCI_OOS_CHANGED) {
 				if (cur->Out_Of_Service == 0) {
 					if (Binary_Input_Out_Of_Service(uci_idx))
 						Binary_Input_Out_Of_Service_Set(uci_idx,0);
@@ -318,16 +389,20 @@ static time_t uci_Update(
 						RELIABILITY_COMMUNICATION_FAILURE);
 				}
 			}
+		}
 #endif
 /* update Binary Output from uci */
 #if defined(BO)
-			else if (update_object_type == OBJECT_BINARY_OUTPUT) {
-				int bo_val, bo_pval;
+		else if (update_object_type == OBJECT_BINARY_OUTPUT) {
+			int bo_val, bo_pval;
+			if (changed & UCI_VALUE_CHANGED) {
 				bo_val = atoi(cur->value);
 				bo_pval = Binary_Output_Present_Value(uci_idx);
 				if ( bo_val != bo_pval ) {
 					Binary_Output_Present_Value_Set(uci_idx,bo_val,16);
 				}
+			}
+			if (changed & UCI_OOS_CHANGED) {
 				if (cur->Out_Of_Service == 0) {
 					if (Binary_Output_Out_Of_Service(uci_idx))
 						Binary_Output_Out_Of_Service_Set(uci_idx,0);
@@ -344,16 +419,20 @@ static time_t uci_Update(
 						RELIABILITY_COMMUNICATION_FAILURE);
 				}
 			}
+		}
 #endif
 /* update Binary Value from uci */
 #if defined(BV)
-			else if (update_object_type == OBJECT_BINARY_VALUE) {
-				int bv_val, bv_pval;
+		else if (update_object_type == OBJECT_BINARY_VALUE) {
+			int bv_val, bv_pval;
+			if (changed & UCI_VALUE_CHANGED) {
 				bv_val = atoi(cur->value);
 				bv_pval = Binary_Value_Present_Value(uci_idx);
 				if ( bv_val != bv_pval ) {
 					Binary_Value_Present_Value_Set(uci_idx,bv_val,16);
 				}
+			}
+			if (changed & UCI_OOS_CHANGED) {
 				if (cur->Out_Of_Service == 0) {
 					if (Binary_Value_Out_Of_Service(uci_idx))
 						Binary_Value_Out_Of_Service_Set(uci_idx,0);
@@ -370,16 +449,20 @@ static time_t uci_Update(
 						RELIABILITY_COMMUNICATION_FAILURE);
 				}
 			}
+		}
 #endif
 /* update Multistate Input from uci */
 #if defined(MSI)
-			else if (update_object_type == OBJECT_MULTI_STATE_INPUT) {
-				int msi_val, msi_pval;
+		else if (update_object_type == OBJECT_MULTI_STATE_INPUT) {
+			int msi_val, msi_pval;
+			if (changed & UCI_VALUE_CHANGED) {
 				msi_val = atoi(cur->value);
 				msi_pval = Multistate_Input_Present_Value(uci_idx);
 				if ( msi_val != msi_pval ) {
 					Multistate_Input_Present_Value_Set(uci_idx,msi_val,16);
 				}
+			}
+			if (changed & UCI_OOS_CHANGED) {
 				if (cur->Out_Of_Service == 0) {
 					if (Multistate_Input_Out_Of_Service(uci_idx))
 						Multistate_Input_Out_Of_Service_Set(uci_idx,0);
@@ -396,16 +479,20 @@ static time_t uci_Update(
 						RELIABILITY_COMMUNICATION_FAILURE);
 				}
 			}
+		}
 #endif
 /* update Multistate Output from uci */
 #if defined(MSO)
-			else if (update_object_type == OBJECT_MULTI_STATE_OUTPUT) {
-				int mso_val, mso_pval;
+		else if (update_object_type == OBJECT_MULTI_STATE_OUTPUT) {
+			int mso_val, mso_pval;
+			if (changed & UCI_VALUE_CHANGED) {
 				mso_val = atoi(cur->value);
 				mso_pval = Multistate_Output_Present_Value(uci_idx);
 				if ( mso_val != mso_pval ) {
 					Multistate_Output_Present_Value_Set(uci_idx,mso_val,16);
 				}
+			}
+			if (changed & UCI_OOS_CHANGED) {
 				if (cur->Out_Of_Service == 0) {
 					if (Multistate_Output_Out_Of_Service(uci_idx))
 						Multistate_Output_Out_Of_Service_Set(uci_idx,0);
@@ -422,16 +509,20 @@ static time_t uci_Update(
 						RELIABILITY_COMMUNICATION_FAILURE);
 				}
 			}
+		}
 #endif
 /* update Multistate Value from uci */
 #if defined(MSV)
-			else if (update_object_type == OBJECT_MULTI_STATE_VALUE) {
-				int msv_val, msv_pval;
+		else if (update_object_type == OBJECT_MULTI_STATE_VALUE) {
+			int msv_val, msv_pval;
+			if (changed & UCI_VALUE_CHANGED) {
 				msv_val = atoi(cur->value);
 				msv_pval = Multistate_Value_Present_Value(uci_idx);
 				if ( msv_val != msv_pval ) {
 					Multistate_Value_Present_Value_Set(uci_idx,msv_val,16);
 				}
+			}
+			if (changed & UCI_OOS_CHANGED) {
 				if (cur->Out_Of_Service == 0) {
 					if (Multistate_Value_Out_Of_Service(uci_idx))
 						Multistate_Value_Out_Of_Service_Set(uci_idx,0);
@@ -448,16 +539,118 @@ static time_t uci_Update(
 						RELIABILITY_COMMUNICATION_FAILURE);
 				}
 			}
-#endif
 		}
-		ucix_cleanup(ctx);
+#endif
 	}
-	/* update end */
-	return ucimodtime;
+	uci_value_applied_set(reload, list);
+#if PRINT_ENABLED
+	printf("Config changed, reloaded %s: %u changed\n", reload->section,
+		changed_count);
+#endif
+
+	return changed_count;
 }
 #endif
 #endif
 
+#if defined(BAC_SHM)
+/** Apply a value that a field I/O process published in the shared memory
+ * table; the Present_Value setters run the COV detection.
+ */
+static void shm_value_apply(
+    const SHM_VALUE_DATA * data,
+    void *context)
+{
+    uint32_t instance = data->object_instance;
+    float analog = (float) data->value;
+    BACNET_BINARY_PV binary = data->value ? BINARY_ACTIVE : BINARY_INACTIVE;
+    uint32_t state = (uint32_t) data->value;
+
+    (void) context;
+    (void) instance;
+    (void) analog;
+    (void) binary;
+    (void) state;
+    switch (data->object_type) {
+#if defined(AI)
+        case OBJECT_ANALOG_INPUT:
+            if (Analog_Input_Present_Value(instance) != analog)
+                Analog_Input_Present_Value_Set(instance, analog, 16);
+            if (Analog_Input_Reliability(instance) != data->reliability)
+                Analog_Input_Reliability_Set(instance, data->reliability);
+            break;
+#endif
+#if defined(AO)
+        case OBJECT_ANALOG_OUTPUT:
+            if (Analog_Output_Present_Value(instance) != analog)
+                Analog_Output_Present_Value_Set(instance, analog, 16);
+            if (Analog_Output_Reliability(instance) != data->reliability)
+                Analog_Output_Reliability_Set(instance, data->reliability);
+            break;
+#endif
+#if defined(AV)
+        case OBJECT_ANALOG_VALUE:
+            if (Analog_Value_Present_Value(instance) != analog)
+                Analog_Value_Present_Value_Set(instance, analog, 16);
+            if (Analog_Value_Reliability(instance) != data->reliability)
+                Analog_Value_Reliability_Set(instance, data->reliability);
+            break;
+#endif
+#if defined(BI)
+        case OBJECT_BINARY_INPUT:
+            if (Binary_Input_Present_Value(instance) != binary)
+                Binary_Input_Present_Value_Set(instance, binary, 16);
+            if (Binary_Input_Reliability(instance) != data->reliability)
+                Binary_Input_Reliability_Set(instance, data->reliability);
+            break;
+#endif
+#if defined(BO)
+        case OBJECT_BINARY_OUTPUT:
+            if (Binary_Output_Present_Value(instance) != binary)
+                Binary_Output_Present_Value_Set(instance, binary, 16);
+            if (Binary_Output_Reliability(instance) != data->reliability)
+                Binary_Output_Reliability_Set(instance, data->reliability);
+            break;
+#endif
+#if defined(BV)
+        case OBJECT_BINARY_VALUE:
+            if (Binary_Value_Present_Value(instance) != binary)
+                Binary_Value_Present_Value_Set(instance, binary, 16);
+            if (Binary_Value_Reliability(instance) != data->reliability)
+                Binary_Value_Reliability_Set(instance, data->reliability);
+            break;
+#endif
+#if defined(MSI)
+        case OBJECT_MULTI_STATE_INPUT:
+            if (Multistate_Input_Present_Value(instance) != state)
+                Multistate_Input_Present_Value_Set(instance, state, 16);
+            if (Multistate_Input_Reliability(instance) != data->reliability)
+                Multistate_Input_Reliability_Set(instance, data->reliability);
+            break;
+#endif
+#if defined(MSO)
+        case OBJECT_MULTI_STATE_OUTPUT:
+            if (Multistate_Output_Present_Value(instance) != state)
+                Multistate_Output_Present_Value_Set(instance, state, 16);
+            if (Multistate_Output_Reliability(instance) != data->reliability)
+                Multistate_Output_Reliability_Set(instance,
+                    data->reliability);
+            break;
+#endif
+#if defined(MSV)
+        case OBJECT_MULTI_STATE_VALUE:
+            if (Multistate_Value_Present_Value(instance) != state)
+                Multistate_Value_Present_Value_Set(instance, state, 16);
+            if (Multistate_Value_Reliability(instance) != data->reliability)
+                Multistate_Value_Reliability_Set(instance, data->reliability);
+            break;
+#endif
+        default:
+            break;
+    }
+}
+#endif
+
 /** Initialize the handlers we will utilize.
  * @see Device_Init, apdu_set_unconfirmed_handler, apdu_set_confirmed_handler
  */
@@ -555,6 +748,39 @@ static void print_help(const char *filename)
         "%s 123 Fred\n", filename);
 }
 
+#if defined(BACNET_ADDRESS_CACHE_FILE)
+/* the file that keeps the learned address bindings over a restart */
+static const char *Address_Snapshot;
+
+static void address_snapshot_flush(
+    void)
+{
+    if (address_snapshot_changed()) {
+        address_snapshot_save(Address_Snapshot);
+    }
+}
+#endif
+
+/* set by a signal, to return from main() and run the exit handlers */
+static volatile sig_atomic_t Stop;
+
+static void sig_int(
+    int signo)
+{
+    (void) signo;
+    /* the exit handlers save the config changes and the bindings, but
+       they are not safe to run in a signal handler */
+    Stop = 1;
+}
+
+static void signal_init(
+    void)
+{
+    signal(SIGINT, sig_int);
+    signal(SIGHUP, sig_int);
+    signal(SIGTERM, sig_int);
+}
+
 /** Main function of server demo.
  *
  * @see Device_Set_Object_Instance_Number, dlenv_init, Send_I_Am,
@@ -575,12 +801,23 @@ int main(
         0
     };  /* address where message came from */
     uint16_t pdu_len = 0;
-    unsigned timeout = 1;       /* milliseconds */
+#if defined(BAC_SHM)
+    /* the shared memory values are polled between the messages */
+    unsigned timeout = 100;     /* milliseconds */
+#else
+    /* the timers tick by the second, and a message or a config
+       change ends the wait early */
+    unsigned timeout = 1000;    /* milliseconds */
+#endif
     time_t last_seconds = 0;
     time_t current_seconds = 0;
     uint32_t elapsed_seconds = 0;
     uint32_t elapsed_milliseconds = 0;
     uint32_t address_binding_tmr = 0;
+#if defined(BACNET_ADDRESS_CACHE_FILE)
+    uint32_t revalidate_id = 0;
+    BACNET_ADDRESS revalidate_dest;
+#endif
 #if defined(INTRINSIC_REPORTING)
     uint32_t recipient_scan_tmr = 0;
 #endif
@@ -591,35 +828,17 @@ int main(
     int uciId = 0;
     const char *uciName;
     struct uci_context *ctx;
-#if defined(AI)
-    time_t ucimodtime_bacnet_ai = 0;
+#if defined(UCI_RELOAD)
+    unsigned uci_reload_idx = 0;
+    int uci_watch_fd = -1;
 #endif
-#if defined(AO)
-    time_t ucimodtime_bacnet_ao = 0;
 #endif
-#if defined(AV)
-    time_t ucimodtime_bacnet_av = 0;
-#endif
-#if defined(BI)
-    time_t ucimodtime_bacnet_bi = 0;
-#endif
-#if defined(BO)
-    time_t ucimodtime_bacnet_bo = 0;
-#endif
-#if defined(BV)
-    time_t ucimodtime_bacnet_bv = 0;
-#endif
-#if defined(MSI)
-    time_t ucimodtime_bacnet_mi = 0;
-#endif
-#if defined(MSO)
-    time_t ucimodtime_bacnet_mo = 0;
-#endif
-#if defined(MSV)
-    time_t ucimodtime_bacnet_mv = 0;
-#endif
-    int rewrite = 0;
+#if defined(BAC_SHM)
+    SHM_VALUE_TABLE *shm_values = NULL;
+    const char *shm_name = NULL;
+    char *shm_points = NULL;
 #endif
+    char *cov_window = NULL;
     int argi = 0;
     const char *filename = NULL;
 
@@ -679,69 +898,6 @@ int main(
 #if defined(BAC_UCI)
     }
 
-#if defined(AI)
-    char ai_path[128];
-    struct stat ai_s;
-	snprintf(ai_path, sizeof(ai_path), "/etc/config/bacnet_ai");
-	if( stat(ai_path, &ai_s) > -1 )
-		ucimodtime_bacnet_ai = ai_s.st_mtime;
-#endif
-#if defined(AO)
-    char ao_path[128];
-    struct stat ao_s;
-	snprintf(ao_path, sizeof(ao_path), "/etc/config/bacnet_ao");
-	if( stat(ao_path, &ao_s) > -1 )
-		ucimodtime_bacnet_ao = ao_s.st_mtime;
-#endif
-#if defined(AV)
-    char av_path[128];
-    struct stat av_s;
-	snprintf(av_path, sizeof(av_path), "/etc/config/bacnet_av");
-	if( stat(av_path, &av_s) > -1 )
-		ucimodtime_bacnet_av = av_s.st_mtime;
-#endif
-#if defined(BI)
-    char bi_path[128];
-    struct stat bi_s;
-	snprintf(bi_path, sizeof(bi_path), "/etc/config/bacnet_bi");
-	if( stat(bi_path, &bi_s) > -1 )
-		ucimodtime_bacnet_bi = bi_s.st_mtime;
-#endif
-#if defined(BO)
-    char bo_path[128];
-    struct stat bo_s;
-	snprintf(bo_path, sizeof(bo_path), "/etc/config/bacnet_bo");
-	if( stat(bo_path, &bo_s) > -1 )
-		ucimodtime_bacnet_bo = bo_s.st_mtime;
-#endif
-#if defined(BV)
-    char bv_path[128];
-    struct stat bv_s;
-	snprintf(bv_path, sizeof(bv_path), "/etc/config/bacnet_bv");
-	if( stat(bv_path, &bv_s) > -1 )
-		ucimodtime_bacnet_bv = bv_s.st_mtime;
-#endif
-#if defined(MSI)
-    char msi_path[128];
-    struct stat msi_s;
-	snprintf(msi_path, sizeof(msi_path), "/etc/config/bacnet_mi");
-	if( stat(msi_path, &msi_s) > -1 )
-		ucimodtime_bacnet_mi = msi_s.st_mtime;
-#endif
-#if defined(MSO)
-    char mso_path[128];
-    struct stat mso_s;
-	snprintf(mso_path, sizeof(mso_path), "/etc/config/bacnet_mo");
-	if( stat(mso_path, &mso_s) > -1 )
-		ucimodtime_bacnet_mo = mso_s.st_mtime;
-#endif
-#if defined(MSV)
-    char msv_path[128];
-    struct stat msv_s;
-	snprintf(msv_path, sizeof(msv_path), "/etc/config/bacnet_mv");
-	if( stat(msv_path, &msv_s) > -1 )
-		ucimodtime_bacnet_mv = msv_s.st_mtime;
-#endif
 #endif /* defined(BAC_UCI) */
 
 #if PRINT_ENABLED
@@ -755,12 +911,65 @@ int main(
     Init_Service_Handlers();
     dlenv_init();
     atexit(datalink_cleanup);
+    /* a signal stops the main loop, so the exit handlers run */
+    signal_init();
+#if defined(BACNET_ADDRESS_CACHE_FILE)
+    /* optionally start with the bindings learned before a restart */
+    Address_Snapshot = getenv("BACNET_ADDRESS_SNAPSHOT");
+    if (Address_Snapshot) {
+        address_snapshot_load(Address_Snapshot);
+        atexit(address_snapshot_flush);
+        /* the I-Am of a binding that is checked confirms it, and
+           the others expire soon */
+        apdu_set_unconfirmed_handler(SERVICE_UNCONFIRMED_I_AM,
+            handler_i_am_bind);
+    }
+#endif
+#if defined(BAC_UCI)
+    /* write out the pending config changes when stopped */
+    atexit(ucix_wb_flush);
+#if defined(UCI_RELOAD)
+    /* reload the object values when their config changes */
+    uci_watch_fd = ucix_watch_init();
+    for (uci_reload_idx = 0; uci_reload_idx < UCI_RELOAD_COUNT;
+        uci_reload_idx++) {
+        ucix_watch_add(Uci_Reload[uci_reload_idx].section);
+        uci_value_applied_set(&Uci_Reload[uci_reload_idx],
+            uci_value_list_load(&Uci_Reload[uci_reload_idx]));
+    }
+#if defined(BACDL_BIP)
+    /* wake up from the datalink wait when a config changes */
+    if (uci_watch_fd >= 0)
+        bip_set_wait_fd(uci_watch_fd, ucix_watch_read);
+#endif
+#endif
+#endif
+#if defined(BAC_SHM)
+    /* take the present values from field I/O processes in shared memory */
+    shm_name = getenv("BACNET_SHM_NAME");
+    if (!shm_name)
+        shm_name = SHM_VALUE_NAME;
+    shm_points = getenv("BACNET_SHM_POINTS");
+    shm_values = shm_value_create(shm_name,
+        shm_points ? (unsigned) strtol(shm_points, NULL, 0) : 1024);
+#if PRINT_ENABLED
+    if (!shm_values)
+        fprintf(stderr, "Failed to create shared memory %s\n", shm_name);
+#endif
+#endif
+    /* optionally batch the COV notifications of each subscriber into
+       COV-Notification-Multiple requests, with a window in milliseconds */
+    cov_window = getenv("BACNET_COV_MULTIPLE_WINDOW");
+    if (cov_window) {
+        handler_cov_notify_multiple_set(true,
+            (uint16_t) strtol(cov_window, NULL, 0));
+    }
     /* configure the timeout values */
     last_seconds = time(NULL);
     /* broadcast an I-Am on startup */
     Send_I_Am(&Handler_Transmit_Buffer[0]);
-    /* loop forever */
-    for (;;) {
+    /* loop until stopped */
+    while (!Stop) {
         /* input */
         current_seconds = time(NULL);
 
@@ -780,11 +989,20 @@ int main(
             bvlc_maintenance_timer(elapsed_seconds);
 #endif
             dlenv_maintenance_timer(elapsed_seconds);
+#if defined(BACNET_ADDRESS_CACHE_FILE)
+            /* check one of the loaded bindings each second */
+            if (Address_Snapshot &&
+                address_revalidate_next(&revalidate_id, &revalidate_dest)) {
+                Send_WhoIs_To_Network(&revalidate_dest, revalidate_id,
+                    revalidate_id);
+            }
+#endif
 #if defined(LC)
             Load_Control_State_Machine_Handler();
 #endif
             elapsed_milliseconds = elapsed_seconds * 1000;
             handler_cov_timer_seconds(elapsed_seconds);
+            handler_cov_timer_milliseconds(elapsed_milliseconds);
             tsm_timer_milliseconds(elapsed_milliseconds);
 #if defined(TRENDLOG)
             trend_log_timer(elapsed_seconds);
@@ -797,12 +1015,23 @@ int main(
             handler_timesync_task(&bdatetime);
 #endif
         }
+#if defined(BAC_SHM)
+        shm_value_poll(shm_values, shm_value_apply, NULL);
+#endif
         handler_cov_task();
+#if defined(BAC_UCI)
+        ucix_wb_task();
+#endif
         /* scan cache address */
         address_binding_tmr += elapsed_seconds;
         if (address_binding_tmr >= 60) {
             address_cache_timer(address_binding_tmr);
             address_binding_tmr = 0;
+#if defined(BACNET_ADDRESS_CACHE_FILE)
+            if (Address_Snapshot) {
+                address_snapshot_flush();
+            }
+#endif
         }
 #if defined(INTRINSIC_REPORTING)
         /* try to find addresses of recipients */
@@ -813,51 +1042,18 @@ int main(
         }
 #endif
         /* output */
-#if defined(BAC_UCI)
-        rewrite++;
-        if (rewrite>100000) {
-#if PRINT_ENABLED
-            printf("rewrite interval %i\n", rewrite);
-#endif
-            rewrite=0;
+#if defined(UCI_RELOAD)
+#if !defined(BACDL_BIP)
+        if ((uci_watch_fd >= 0) && elapsed_seconds)
+            ucix_watch_read(uci_watch_fd);
+#endif
+        /* update the object values from uci */
+        for (uci_reload_idx = 0; uci_reload_idx < UCI_RELOAD_COUNT;
+            uci_reload_idx++) {
+            if (ucix_watch_changed(Uci_Reload[uci_reload_idx].section))
+                uci_Update(&Uci_Reload[uci_reload_idx]);
         }
-#if defined(AI)
-        /* update Analog Input from uci */
-        ucimodtime_bacnet_ai = uci_Update(ucimodtime_bacnet_ai,OBJECT_ANALOG_INPUT,rewrite);
-#endif
-#if defined(AO)
-        /* update Analog Output from uci */
-        ucimodtime_bacnet_ao = uci_Update(ucimodtime_bacnet_ao,OBJECT_ANALOG_OUTPUT,rewrite);
-#endif
-#if defined(AV)
-        /* update Analog Value from uci */
-        ucimodtime_bacnet_av = uci_Update(ucimodtime_bacnet_av,OBJECT_ANALOG_VALUE,rewrite);
-#endif
-#if defined(BI)
-        /* update Binary Input from uci */
-        ucimodtime_bacnet_bi = uci_Update(ucimodtime_bacnet_bi,OBJECT_BINARY_INPUT,rewrite);
 #endif
-#if defined(BO)
-        /* update Binary Output from uci */
-        ucimodtime_bacnet_bo = uci_Update(ucimodtime_bacnet_bo,OBJECT_BINARY_OUTPUT,rewrite);
-#endif
-#if defined(BV)
-        /* update Binary Value from uci */
-        ucimodtime_bacnet_bv = uci_Update(ucimodtime_bacnet_bv,OBJECT_BINARY_VALUE,rewrite);
-#endif
-#if defined(MSI)
-        /* update Multistate Input from uci */
-        ucimodtime_bacnet_mi = uci_Update(ucimodtime_bacnet_mi,OBJECT_MULTI_STATE_INPUT,rewrite);
-#endif
-#if defined(MSO)
-        /* update Multistate Output from uci */
-        ucimodtime_bacnet_mo = uci_Update(ucimodtime_bacnet_mo,OBJECT_MULTI_STATE_OUTPUT,rewrite);
-#endif
-#if defined(MSV)
-        /* update Multistate Value from uci */
-        ucimodtime_bacnet_mv = uci_Update(ucimodtime_bacnet_mv,OBJECT_MULTI_STATE_VALUE,rewrite);
-#endif
-#endif /* defined(BAC_UCI) */
 
         /* blink LEDs, Turn on or off outputs, etc */
     }
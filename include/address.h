@@ -30,6 +30,13 @@
 #include "bacdef.h"
 #include "readrange.h"
 
+/* we are likely compiling the demo command line tools if print enabled */
+#if !defined(BACNET_ADDRESS_CACHE_FILE)
+#if PRINT_ENABLED
+#define BACNET_ADDRESS_CACHE_FILE
+#endif
+#endif
+
 #ifdef __cplusplus
 extern "C" {
 #endif /* __cplusplus */
@@ -53,6 +60,9 @@ extern "C" {
         unsigned *max_apdu,
         BACNET_ADDRESS * src);
 
+    bool address_bound(
+        uint32_t device_id);
+
     bool address_get_by_index(
         unsigned index,
         uint32_t * device_id,
@@ -109,6 +119,34 @@ extern "C" {
     void address_cache_timer(
         uint16_t uSeconds);
 
+    void address_cache_stats(
+        uint32_t * hits,
+        uint32_t * misses,
+        uint32_t * evictions);
+
+    void address_set_device_segmentation(
+        uint32_t device_id,
+        uint8_t segmentation);
+
+    bool address_get_device_segmentation(
+        uint32_t device_id,
+        uint8_t * segmentation);
+
+#ifdef BACNET_ADDRESS_CACHE_FILE
+    bool address_snapshot_changed(
+        void);
+
+    int address_snapshot_save(
+        const char *pFilename);
+
+    int address_snapshot_load(
+        const char *pFilename);
+#endif
+
+    bool address_revalidate_next(
+        uint32_t * device_id,
+        BACNET_ADDRESS * src);
+
     void address_mac_init(
         BACNET_MAC_ADDRESS *mac,
         uint8_t *adr,
@@ -0,0 +1,116 @@
+/**
+* @file
+*
+* Asynchronous confirmed requests: each request is given a callback,
+* which is called once with its ComplexACK, SimpleACK, Error, Reject,
+* Abort or timeout.  The replies are matched by the address and the
+* invoke ID of the destination, so many requests to many devices can
+* be in flight at the same time.
+*
+*   async_init();
+*   async_read_property(&dest, max_apdu, &rpdata, callback, context);
+*   async_run();
+*/
+#ifndef ASYNC_H
+#define ASYNC_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "config.h"
+#include "bacdef.h"
+#include "bacenum.h"
+#include "apdu.h"
+#include "rp.h"
+#include "rpm.h"
+#include "wp.h"
+
+/* number of requests in flight, limited by the TSM too */
+#ifndef MAX_ASYNC_REQUESTS
+#define MAX_ASYNC_REQUESTS MAX_TSM_TRANSACTIONS
+#endif
+
+typedef enum {
+    ASYNC_COMPLEX_ACK,
+    ASYNC_SIMPLE_ACK,
+    ASYNC_ERROR,
+    ASYNC_REJECT,
+    ASYNC_ABORT,
+    ASYNC_TIMEOUT
+} BACNET_ASYNC_STATUS;
+
+/**
+* the reply to a request
+*
+* @{
+*/
+typedef struct bacnet_async_result {
+    BACNET_ASYNC_STATUS status;
+    BACNET_CONFIRMED_SERVICE service_choice;
+    /** the address the request was sent to */
+    BACNET_ADDRESS *address;
+    uint8_t invoke_id;
+    /** ASYNC_COMPLEX_ACK: the service data, only valid in the callback */
+    uint8_t *service_data;
+    uint16_t service_data_len;
+    BACNET_CONFIRMED_SERVICE_ACK_DATA *ack_data;
+    /** ASYNC_ERROR */
+    BACNET_ERROR_CLASS error_class;
+    BACNET_ERROR_CODE error_code;
+    /** ASYNC_REJECT and ASYNC_ABORT */
+    uint8_t reason;
+} BACNET_ASYNC_RESULT;
+/** @} */
+
+typedef void (
+    *async_callback) (
+    BACNET_ASYNC_RESULT * result,
+    void *context);
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/* sets the ACK, Error, Abort and Reject handlers of all the services */
+    void async_init(
+        void);
+
+/* return the invoke ID of the request, or 0 if it was not sent */
+    uint8_t async_read_property(
+        BACNET_ADDRESS * dest,
+        uint16_t max_apdu,
+        BACNET_READ_PROPERTY_DATA * rpdata,
+        async_callback callback,
+        void *context);
+    uint8_t async_read_property_multiple(
+        BACNET_ADDRESS * dest,
+        uint16_t max_apdu,
+        BACNET_READ_ACCESS_DATA * read_access_data,
+        async_callback callback,
+        void *context);
+    uint8_t async_write_property(
+        BACNET_ADDRESS * dest,
+        uint16_t max_apdu,
+        BACNET_WRITE_PROPERTY_DATA * wpdata,
+        async_callback callback,
+        void *context);
+
+    unsigned async_pending(
+        void);
+    bool async_request_pending(
+        BACNET_ADDRESS * dest,
+        uint8_t invoke_id);
+    void async_cancel(
+        BACNET_ADDRESS * dest,
+        uint8_t invoke_id);
+
+/* receives and handles one PDU, and runs the timers */
+    void async_task(
+        unsigned timeout_ms);
+/* until all the requests are done */
+    void async_run(
+        void);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+#endif
@@ -0,0 +1,82 @@
+/**
+* @file
+*
+* Scheduled binding of device IDs to addresses.  The device IDs that
+* wait for their I-Am are sent in ranged Who-Is messages, so nearby
+* IDs share one message, and the Who-Is messages to each network are
+* limited to a rate.  A device that does not answer is asked again
+* after a delay that doubles each time, until it is given up.
+*
+*   binding_init();
+*   if (!binding_request(device_id, BACNET_BROADCAST_NETWORK,
+*           callback, context)) {
+*       callback(device_id, bound, context) is called later
+*   }
+*   binding_timer_milliseconds(elapsed);
+*/
+#ifndef BINDING_H
+#define BINDING_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "config.h"
+#include "bacdef.h"
+
+/* Who-Is messages per second to each network */
+#ifndef BINDING_WHOIS_RATE
+#define BINDING_WHOIS_RATE 5
+#endif
+/* device IDs no further apart than this share a Who-Is */
+#ifndef BINDING_WHOIS_GAP
+#define BINDING_WHOIS_GAP 8
+#endif
+/* milliseconds before the first retry, doubled after each one */
+#ifndef BINDING_RETRY_FIRST
+#define BINDING_RETRY_FIRST 1000
+#endif
+#ifndef BINDING_RETRY_MAX
+#define BINDING_RETRY_MAX 60000
+#endif
+/* Who-Is messages sent before the device is given up */
+#ifndef BINDING_TRIES
+#define BINDING_TRIES 8
+#endif
+
+typedef void (
+    *binding_callback) (
+    uint32_t device_id,
+    bool bound,
+    void *context);
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/* sets the I-Am handler that completes the requests */
+    void binding_init(
+        void);
+
+/* Returns true if the device is bound already.  Otherwise the callback
+   is called when its I-Am comes in, or when it is given up.  The Who-Is
+   goes to the network, 0 for the local one, or to all of them with
+   BACNET_BROADCAST_NETWORK. */
+    bool binding_request(
+        uint32_t device_id,
+        uint16_t net,
+        binding_callback callback,
+        void *context);
+
+    unsigned binding_pending(
+        void);
+
+    void binding_rate_set(
+        unsigned whois_per_second);
+
+/* sends the Who-Is messages that are due */
+    void binding_timer_milliseconds(
+        uint16_t milliseconds);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+#endif
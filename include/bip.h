@@ -39,6 +39,22 @@
 
 extern bool BIP_Debug;
 
+/* takes a packet off a receive queue, returns its length or 0 if empty */
+typedef int (
+    *bip_queue_get_function) (
+    uint8_t * mpdu,
+    uint16_t max_mpdu,
+    struct sockaddr_in * sin);
+
+/* sends one packet to many destinations, see bip_send_mpdu_multi() */
+typedef unsigned (
+    *bip_send_multi_function) (
+    struct sockaddr_in * dest,
+    int *status,
+    unsigned count,
+    uint8_t * mtu,
+    uint16_t mtu_len);
+
 #ifdef __cplusplus
 extern "C" {
 #endif /* __cplusplus */
@@ -60,6 +76,23 @@ extern "C" {
         void);
     bool bip_valid(
         void);
+    void bip_set_wait_fd(
+        int fd,
+        void (*handler) (int fd));
+    int bip_wait_fd_set(
+        fd_set * read_fds,
+        int max);
+    void bip_wait_fd_handle(
+        fd_set * read_fds);
+    void bip_set_receive_queue(
+        int fd,
+        bip_queue_get_function get);
+    /* receives a packet with its BVLC header from the socket or queue */
+    int bip_receive_mpdu(
+        uint8_t * mpdu,
+        uint16_t max_mpdu,
+        struct sockaddr_in *sin,
+        unsigned timeout);
     void bip_get_broadcast_address(
         BACNET_ADDRESS * dest); /* destination address */
     void bip_get_my_address(
@@ -73,6 +106,16 @@ extern "C" {
         uint8_t * pdu,  /* any data to be sent - may be null */
         unsigned pdu_len);      /* number of bytes of data */
 
+    /* sends a packet with its BVLC header to many destinations */
+    void bip_set_send_multi(
+        bip_send_multi_function send);
+    unsigned bip_send_mpdu_multi(
+        struct sockaddr_in *dest,
+        int *status,
+        unsigned count,
+        uint8_t * mtu,
+        uint16_t mtu_len);
+
     /* receives a BACnet/IP packet */
     /* returns the number of octets in the PDU, or zero on failure */
     uint16_t bip_receive(
@@ -55,6 +55,8 @@ extern "C" {
         uint16_t dest_port; /* in network format */
         /* Broadcast Distribution Mask */
         struct in_addr broadcast_mask;      /* in tework format */
+        /* Forwarded-NPDUs that could not be sent to it */
+        uint32_t send_errors;
     } BBMD_TABLE_ENTRY;
 
     uint16_t bvlc_receive(
@@ -143,6 +145,13 @@ extern "C" {
     bool bvlc_add_bdt_entry_local(
         BBMD_TABLE_ENTRY* entry);
 
+    /* Forwarded-NPDUs that could not be sent to a foreign device since
+     * it registered, or -1 if it is not registered. The BDT entries
+     * count theirs in send_errors. */
+    long bvlc_fdt_send_errors(
+        uint32_t address,       /* in network byte order */
+        uint16_t port); /* in network byte order */
+
 
     /* NAT handling
      * If the communication between BBMDs goes through a NAT enabled internet
@@ -112,18 +112,77 @@
 /* that we hold in a queue waiting for timeout. */
 /* Configure to zero if you don't want any confirmed messages */
 /* Configure from 1..255 for number of outstanding confirmed */
-/* requests available. */
+/* requests available, or more when the requests use the */
+/* invoke IDs of each destination. */
 #if !defined(MAX_TSM_TRANSACTIONS)
 #define MAX_TSM_TRANSACTIONS 255
 #endif
+/* the default number of outstanding confirmed requests to one */
+/* destination, for the requests with the invoke IDs of each */
+/* destination, and the one for a destination with a one octet */
+/* address, like MS/TP, which is slow. */
+#if !defined(MAX_TSM_PEER_TRANSACTIONS)
+#define MAX_TSM_PEER_TRANSACTIONS 4
+#endif
+#if !defined(MAX_TSM_MSTP_PEER_TRANSACTIONS)
+#define MAX_TSM_MSTP_PEER_TRANSACTIONS 1
+#endif
+/* for responses that don't fit in one APDU, this is the number of */
+/* segmented ComplexACKs that we can send at the same time. */
+/* Each one holds a complete response of up to MAX_SEGMENTS_SENT */
+/* segments in RAM.  Configure to zero to disable segmentation. */
+/* Segmentation uses the TSM, so needs MAX_TSM_TRANSACTIONS. */
+#if !defined(MAX_SEGMENTED_RESPONSES)
+#if (defined(BACDL_BIP) || defined(BACDL_BIP6) || defined(BACDL_ALL))
+#define MAX_SEGMENTED_RESPONSES 2
+#else
+#define MAX_SEGMENTED_RESPONSES 0
+#endif
+#endif
+/* for responses to our requests, this is the number of segmented */
+/* ComplexACKs that we can receive at the same time, each one up to */
+/* MAX_SEGMENTS_ACCEPTED segments.  Configure to zero to not accept */
+/* segmented responses. */
+#if !defined(MAX_SEGMENTED_CONFIRMATIONS)
+#if (defined(BACDL_BIP) || defined(BACDL_BIP6) || defined(BACDL_ALL))
+#define MAX_SEGMENTED_CONFIRMATIONS 2
+#else
+#define MAX_SEGMENTED_CONFIRMATIONS 0
+#endif
+#endif
+#if !(MAX_TSM_TRANSACTIONS)
+#undef MAX_SEGMENTED_RESPONSES
+#define MAX_SEGMENTED_RESPONSES 0
+#undef MAX_SEGMENTED_CONFIRMATIONS
+#define MAX_SEGMENTED_CONFIRMATIONS 0
+#endif
+#if !defined(MAX_SEGMENTS_SENT)
+#define MAX_SEGMENTS_SENT 32
+#endif
+#if !defined(MAX_SEGMENTS_ACCEPTED)
+#define MAX_SEGMENTS_ACCEPTED 32
+#endif
 /* The address cache is used for binding to BACnet devices */
 /* The number of entries corresponds to the number of */
 /* devices that might respond to an I-Am on the network. */
 /* If your device is a simple server and does not need to bind, */
 /* then you don't need to use this. */
+/* A dynamic cache grows as devices are bound, up to MAX_ADDRESS_CACHE */
+/* entries (65535 at most); otherwise they are all in static RAM. */
+#if !defined(ADDRESS_CACHE_DYNAMIC)
+#if (defined(BACDL_BIP) || defined(BACDL_BIP6) || defined(BACDL_ALL))
+#define ADDRESS_CACHE_DYNAMIC 1
+#else
+#define ADDRESS_CACHE_DYNAMIC 0
+#endif
+#endif
 #if !defined(MAX_ADDRESS_CACHE)
+#if ADDRESS_CACHE_DYNAMIC
+#define MAX_ADDRESS_CACHE 65535
+#else
 #define MAX_ADDRESS_CACHE 255
 #endif
+#endif
 
 /* some modules have debugging enabled using PRINT_ENABLED */
 #if !defined(PRINT_ENABLED)
@@ -37,6 +37,22 @@ typedef struct BACnet_COV_Data {
     BACNET_PROPERTY_VALUE *listOfValues;
 } BACNET_COV_DATA;
 
+/* one monitored object in a COV-Notification-Multiple */
+typedef struct BACnet_COV_Notification {
+    BACNET_OBJECT_ID monitoredObjectIdentifier;
+    /* simple linked list of values */
+    BACNET_PROPERTY_VALUE *listOfValues;
+    struct BACnet_COV_Notification *next;
+} BACNET_COV_NOTIFICATION;
+
+typedef struct BACnet_COV_Multiple_Data {
+    uint32_t subscriberProcessIdentifier;
+    uint32_t initiatingDeviceIdentifier;
+    uint32_t timeRemaining;     /* seconds */
+    /* simple linked list of notifications */
+    BACNET_COV_NOTIFICATION *listOfCOVNotifications;
+} BACNET_COV_MULTIPLE_DATA;
+
 struct BACnet_Subscribe_COV_Data;
 typedef struct BACnet_Subscribe_COV_Data {
     uint32_t subscriberProcessIdentifier;
@@ -89,6 +105,41 @@ extern "C" {
         unsigned apdu_len,
         BACNET_COV_DATA * data);
 
+    int ccov_notify_multiple_encode_apdu(
+        uint8_t * apdu,
+        unsigned max_apdu_len,
+        uint8_t invoke_id,
+        BACNET_COV_MULTIPLE_DATA * data);
+
+    int ucov_notify_multiple_encode_apdu(
+        uint8_t * apdu,
+        unsigned max_apdu_len,
+        BACNET_COV_MULTIPLE_DATA * data);
+
+    /* partial encoding, for building a request one object at a time */
+    int ccov_notify_multiple_encode_apdu_init(
+        uint8_t * apdu,
+        uint8_t invoke_id,
+        BACNET_COV_MULTIPLE_DATA * data);
+
+    int ucov_notify_multiple_encode_apdu_init(
+        uint8_t * apdu,
+        BACNET_COV_MULTIPLE_DATA * data);
+
+    int cov_notify_multiple_encode_apdu_object(
+        uint8_t * apdu,
+        BACNET_OBJECT_ID * object_id,
+        BACNET_PROPERTY_VALUE * value_list);
+
+    int cov_notify_multiple_encode_apdu_end(
+        uint8_t * apdu);
+
+    /* common for both confirmed and unconfirmed */
+    int cov_notify_multiple_decode_service_request(
+        uint8_t * apdu,
+        unsigned apdu_len,
+        BACNET_COV_MULTIPLE_DATA * data);
+
     int cov_subscribe_property_decode_service_request(
         uint8_t * apdu,
         unsigned apdu_len,
@@ -120,6 +171,8 @@ extern "C" {
 #include "ctest.h"
     void testCOVNotify(
         Test * pTest);
+    void testCOVNotifyMultiple(
+        Test * pTest);
     void testCOVSubscribeProperty(
         Test * pTest);
     void testCOVSubscribe(
@@ -256,12 +256,22 @@ extern "C" {
         uint16_t service_len,
         BACNET_ADDRESS * src,
         BACNET_CONFIRMED_SERVICE_DATA * service_data);
+    void handler_cov_object_changed(
+        BACNET_OBJECT_TYPE object_type,
+        uint32_t object_instance);
     bool handler_cov_fsm(
         void);
     void handler_cov_task(
         void);
     void handler_cov_timer_seconds(
         uint32_t elapsed_seconds);
+    void handler_cov_timer_milliseconds(
+        uint16_t elapsed_milliseconds);
+    void handler_cov_notify_multiple_set(
+        bool enable,
+        uint16_t window_milliseconds);
+    uint32_t handler_cov_notify_multiple_frames_saved(
+        void);
     void handler_cov_init(
         void);
     int handler_cov_encode_subscriptions(
@@ -0,0 +1,150 @@
+/**
+* @file
+*
+* Shared memory table of present values, written by field I/O
+* processes and read by the BACnet server.
+*
+* Every point has a seqlock: the writer makes the sequence odd,
+* writes the value, reliability and timestamp, and makes it even
+* again, so a reader never sees a half written point.
+* Each point must have only one writer.
+*
+* Publisher:
+*   table = shm_value_open(SHM_VALUE_NAME);
+*   index = shm_value_register(table, OBJECT_ANALOG_INPUT, 1);
+*   shm_value_publish(table, index, 21.5, RELIABILITY_NO_FAULT_DETECTED);
+*
+* Server:
+*   table = shm_value_create(SHM_VALUE_NAME, 1024);
+*   shm_value_poll(table, callback, context);
+*/
+#ifndef SHMVALUE_H
+#define SHMVALUE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "bacenum.h"
+
+/* default name of the shared memory object */
+#ifndef SHM_VALUE_NAME
+#define SHM_VALUE_NAME "/bacnet_values"
+#endif
+
+#define SHM_VALUE_MAGIC 0x42414356      /* "BACV" */
+#define SHM_VALUE_VERSION 2
+
+/**
+* header at the start of the shared memory
+*
+* @{
+*/
+typedef struct shm_value_header {
+    uint32_t magic;
+    uint32_t version;
+    /** number of points the table can hold */
+    uint32_t size;
+    /** number of registered points */
+    volatile uint32_t count;
+    /** incremented on every publish */
+    volatile uint32_t changes;
+    /** process ID of the publisher that is registering a point, or 0 */
+    volatile uint32_t register_lock;
+} SHM_VALUE_HEADER;
+/** @} */
+
+/**
+* one point in the shared memory
+*
+* @{
+*/
+typedef struct shm_value_point {
+    /** odd while the point is written, zero until first published */
+    volatile uint32_t sequence;
+    uint32_t object_type;
+    uint32_t object_instance;
+    uint32_t reliability;
+    double value;
+    /** milliseconds since the epoch of the last publish */
+    uint64_t timestamp;
+} SHM_VALUE_POINT;
+/** @} */
+
+/**
+* a consistent copy of a point
+*
+* @{
+*/
+typedef struct shm_value_data {
+    BACNET_OBJECT_TYPE object_type;
+    uint32_t object_instance;
+    BACNET_RELIABILITY reliability;
+    double value;
+    uint64_t timestamp;
+} SHM_VALUE_DATA;
+/** @} */
+
+/**
+* process local handle of the mapped table
+*
+* @{
+*/
+typedef struct shm_value_table {
+    SHM_VALUE_HEADER *header;
+    SHM_VALUE_POINT *points;
+    size_t length;
+    /** reader: the change counter at the last poll */
+    uint32_t changes;
+    /** reader: the sequence of each point at the last poll */
+    uint32_t *sequence;
+} SHM_VALUE_TABLE;
+/** @} */
+
+typedef void (
+    *shm_value_function) (
+    const SHM_VALUE_DATA * data,
+    void *context);
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+    SHM_VALUE_TABLE *shm_value_create(
+        const char *name,
+        unsigned size);
+    SHM_VALUE_TABLE *shm_value_open(
+        const char *name);
+    void shm_value_close(
+        SHM_VALUE_TABLE * table);
+
+    int shm_value_register(
+        SHM_VALUE_TABLE * table,
+        BACNET_OBJECT_TYPE object_type,
+        uint32_t object_instance);
+    bool shm_value_publish(
+        SHM_VALUE_TABLE * table,
+        int index,
+        double value,
+        BACNET_RELIABILITY reliability);
+
+    bool shm_value_read(
+        SHM_VALUE_TABLE * table,
+        int index,
+        SHM_VALUE_DATA * data);
+    unsigned shm_value_poll(
+        SHM_VALUE_TABLE * table,
+        shm_value_function callback,
+        void *context);
+
+#ifdef TEST
+#include "ctest.h"
+    void testShmValue(
+        Test * pTest);
+    void testShmValueRegister(
+        Test * pTest);
+#endif
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+#endif
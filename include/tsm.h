@@ -29,18 +29,21 @@
 #include <stddef.h>
 #include "bacdef.h"
 #include "npdu.h"
+#include "apdu.h"
 
 /* note: TSM functionality is optional - only needed if we are
    doing client requests */
 #if (!MAX_TSM_TRANSACTIONS)
 #define tsm_free_invoke_id(x) (void)x;
+#define tsm_free_invoke_id_peer(s,x) (void)x;
 #else
 typedef enum {
     TSM_STATE_IDLE,
     TSM_STATE_AWAIT_CONFIRMATION,
     TSM_STATE_AWAIT_RESPONSE,
     TSM_STATE_SEGMENTED_REQUEST,
-    TSM_STATE_SEGMENTED_CONFIRMATION
+    TSM_STATE_SEGMENTED_CONFIRMATION,
+    TSM_STATE_SEGMENTED_RESPONSE
 } BACNET_TSM_STATE;
 
 /* 5.4.1 Variables And Parameters */
@@ -54,36 +57,115 @@ typedef struct BACnet_TSM_Data {
     /* used to control APDU retries and the acceptance of server replies */
     /*bool SentAllSegments;  */
     /* stores the sequence number of the last segment received in order */
-    /*uint8_t LastSequenceNumber; */
+    uint8_t LastSequenceNumber;
     /* stores the sequence number of the first segment of */
     /* a sequence of segments that fill a window */
-    /*uint8_t InitialSequenceNumber; */
+    uint8_t InitialSequenceNumber;
     /* stores the current window size */
-    /*uint8_t ActualWindowSize; */
+    uint8_t ActualWindowSize;
     /* stores the window size proposed by the segment sender */
-    /*uint8_t ProposedWindowSize;  */
-    /*  used to perform timeout on PDU segments */
-    /*uint8_t SegmentTimer; */
-    /* used to perform timeout on Confirmed Requests */
-    /* in milliseconds */
-    uint16_t RequestTimer;
-    /* unique id */
+    uint8_t ProposedWindowSize;
+    /* the RequestTimer, or the SegmentTimer, of this state: */
+    /* the TSM time in milliseconds when it expires */
+    uint32_t TimerExpires;
+    /* links in the timer wheel, index + 1 or 0 at the ends */
+    uint16_t TimerNext;
+    uint16_t TimerPrev;
+    bool TimerRunning;
+    /* unique id, in the invoke IDs of the peer */
     uint8_t InvokeID;
+    /* the peer: index + 1, or 0 for the invoke IDs shared by all */
+    uint16_t Peer;
+    /* next transaction of the same peer: index + 1, or 0 */
+    uint16_t PeerNext;
     /* state that the TSM is in */
     BACNET_TSM_STATE state;
     /* the address we sent it to */
     BACNET_ADDRESS dest;
     /* the network layer info */
     BACNET_NPDU_DATA npdu_data;
-    /* copy of the APDU, should we need to send it again */
-    uint8_t apdu[MAX_PDU];
+    /* copy of the PDU, should we need to send it again, */
+    /* in the blocks of the PDU pool: first block + 1, or 0 */
+    uint16_t pdu_block;
     unsigned apdu_len;
 } BACNET_TSM_DATA;
 
+/* a destination with its own invoke IDs */
+typedef struct BACnet_TSM_Peer_Data {
+    BACNET_ADDRESS address;
+    /* the next invoke ID to try */
+    uint8_t InvokeID;
+    /* number of transactions in flight */
+    uint16_t Count;
+    /* its first transaction: index + 1, or 0 */
+    uint16_t First;
+    /* next peer in the same hash bucket: index + 1, or 0 */
+    uint16_t HashNext;
+} BACNET_TSM_PEER_DATA;
+
+#if (MAX_SEGMENTED_RESPONSES)
+/* room for the complete unsegmented ComplexACK: the 3 octet header
+   and MAX_SEGMENTS_SENT segments with a 5 octet header each */
+#define TSM_SEGMENTED_APDU_SIZE ((MAX_APDU - 5) * MAX_SEGMENTS_SENT + 3)
+
+/* 5.4.5 Responding BACnet-user sending a segmented ComplexACK */
+typedef struct BACnet_TSM_Segmented_Data {
+    /* the invoke ID of the request we respond to */
+    uint8_t InvokeID;
+    /* IDLE or SEGMENTED_RESPONSE */
+    BACNET_TSM_STATE state;
+    /* used to count segment retries */
+    uint8_t SegmentRetryCount;
+    /* stores the current window size */
+    uint8_t ActualWindowSize;
+    /* stores the window size proposed by us, the segment sender */
+    uint8_t ProposedWindowSize;
+    /* the first segment of the window in flight - the
+       InitialSequenceNumber is this modulo 256 */
+    uint16_t InitialSegment;
+    /* number of segments and service data octets in each */
+    uint16_t SegmentCount;
+    uint16_t SegmentSize;
+    /* used to perform timeout on PDU segments, in milliseconds */
+    uint16_t SegmentTimer;
+    /* the address we respond to */
+    BACNET_ADDRESS dest;
+    /* the network layer info */
+    BACNET_NPDU_DATA npdu_data;
+    /* the complete unsegmented ComplexACK */
+    uint8_t apdu[TSM_SEGMENTED_APDU_SIZE];
+    unsigned apdu_len;
+} BACNET_TSM_SEGMENTED_DATA;
+#endif
+
+#if (MAX_SEGMENTED_CONFIRMATIONS)
+/* room for a ComplexACK of MAX_SEGMENTS_ACCEPTED segments,
+   without the segmentation headers */
+#define TSM_REASSEMBLY_APDU_SIZE ((MAX_APDU - 5) * MAX_SEGMENTS_ACCEPTED + 3)
+
+/* 5.4.4 Requesting BACnet-user receiving a segmented ComplexACK */
+typedef struct BACnet_TSM_Reassembly_Data {
+    /* the transaction of our request: index + 1, or 0 if unused */
+    uint16_t Transaction;
+    /* the ComplexACK as if it was not segmented */
+    uint8_t apdu[TSM_REASSEMBLY_APDU_SIZE];
+    unsigned apdu_len;
+} BACNET_TSM_REASSEMBLY_DATA;
+#endif
+
 typedef void (
     *tsm_timeout_function) (
     uint8_t invoke_id);
 
+typedef void (
+    *tsm_peer_timeout_function) (
+    BACNET_ADDRESS * dest,
+    uint8_t invoke_id);
+
+/* returns the number of requests that may be in flight to dest */
+typedef unsigned (
+    *tsm_peer_limit_function) (
+    BACNET_ADDRESS * dest);
 
 #ifdef __cplusplus
 extern "C" {
@@ -91,10 +173,14 @@ extern "C" {
 
     void tsm_set_timeout_handler(
         tsm_timeout_function pFunction);
+    void tsm_set_peer_timeout_handler(
+        tsm_peer_timeout_function pFunction);
+    void tsm_set_peer_limit_handler(
+        tsm_peer_limit_function pFunction);
 
     bool tsm_transaction_available(
         void);
-    uint8_t tsm_transaction_idle_count(
+    unsigned tsm_transaction_idle_count(
         void);
     void tsm_timer_milliseconds(
         uint16_t milliseconds);
@@ -126,9 +212,87 @@ extern "C" {
     bool tsm_invoke_id_failed(
         uint8_t invokeID);
 
+/* the same, with the invoke IDs of each destination, so that more
+   than 255 requests can be in flight, and a destination gets no more
+   than tsm_peer_transactions_max_dest() of them */
+    uint8_t tsm_next_free_invokeID_peer(
+        BACNET_ADDRESS * dest);
+    void tsm_free_invoke_id_peer(
+        BACNET_ADDRESS * src,
+        uint8_t invokeID);
+    bool tsm_invoke_id_free_peer(
+        BACNET_ADDRESS * dest,
+        uint8_t invokeID);
+    bool tsm_invoke_id_failed_peer(
+        BACNET_ADDRESS * dest,
+        uint8_t invokeID);
+    void tsm_peer_transactions_max_set(
+        unsigned max_transactions);
+    unsigned tsm_peer_transactions_max(
+        void);
+    unsigned tsm_peer_transactions_max_dest(
+        BACNET_ADDRESS * dest);
+
+#if (MAX_SEGMENTED_RESPONSES)
+/* buffer to encode a response that may be sent segmented,
+   or NULL if all the segmented responses are in use */
+    uint8_t *tsm_segmented_response_buffer(
+        unsigned *apdu_max);
+/* sends the complete ComplexACK as segments,
+   returns false if it needs too many segments */
+    bool tsm_set_segmented_response(
+        BACNET_ADDRESS * dest,
+        BACNET_NPDU_DATA * npdu_data,
+        BACNET_CONFIRMED_SERVICE_DATA * service_data,
+        uint8_t * apdu,
+        unsigned apdu_len);
+    void tsm_segment_ack_handler(
+        BACNET_ADDRESS * src,
+        uint8_t invokeID,
+        uint8_t sequence_number,
+        uint8_t actual_window_size,
+        bool nak);
+    void tsm_segmented_response_abort(
+        BACNET_ADDRESS * src,
+        uint8_t invokeID);
+    void tsm_segmented_max_segments_set(
+        unsigned max_segments);
+    unsigned tsm_segmented_max_segments(
+        void);
+#endif
+#if (MAX_SEGMENTED_CONFIRMATIONS)
+/* collects a segment of the ComplexACK to our request,
+   returns true with the complete service data with the last one */
+    bool tsm_segmented_confirmation(
+        BACNET_ADDRESS * src,
+        BACNET_CONFIRMED_SERVICE_ACK_DATA * service_ack_data,
+        uint8_t service_choice,
+        uint8_t ** service_request,
+        uint16_t * service_request_len);
+#endif
+#if (MAX_SEGMENTED_RESPONSES) || (MAX_SEGMENTED_CONFIRMATIONS)
+    void tsm_segmented_window_size_set(
+        uint8_t window_size);
+#endif
+
+#ifdef TEST
+#include "ctest.h"
+    void testTSM(
+        Test * pTest);
+#endif
+
 #ifdef __cplusplus
 }
 #endif /* __cplusplus */
 /* define out any functions necessary for compile */
 #endif
+#if (!MAX_SEGMENTED_RESPONSES)
+#define tsm_segmented_response_buffer(x) ((uint8_t *)NULL)
+#define tsm_set_segmented_response(d,n,s,a,l) (false)
+#define tsm_segment_ack_handler(s,i,q,w,n)
+#define tsm_segmented_response_abort(s,i)
+#endif
+#if (!MAX_SEGMENTED_CONFIRMATIONS)
+#define tsm_segmented_confirmation(s,a,c,r,l) (false)
+#endif
 #endif
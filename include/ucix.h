@@ -69,6 +69,23 @@ void ucix_for_each_section_type(struct uci_context *ctx,
 	void (*cb)(const char*, void*), void *priv);
 /* Check if given uci file was updated */
 time_t check_uci_update(const char *config, time_t mtime);
+/* watch configs for changes */
+int ucix_watch_init(void);
+bool ucix_watch_add(const char *config);
+void ucix_watch_read(int fd);
+bool ucix_watch_changed(const char *config);
 /* Add tuple */
 void load_value(const char *sec_idx, struct uci_itr_ctx *itr);
+/* write-behind persistence of written options */
+void ucix_wb_add_option(const char *p, const char *s, const char *o,
+	const char *t);
+void ucix_wb_add_option_int(const char *p, const char *s, const char *o,
+	int t);
+void ucix_wb_set_list(const char *p, const char *s, const char *o,
+	char value[254][64], int l);
+void ucix_wb_commit(const char *p);
+void ucix_wb_save_state(const char *p);
+void ucix_wb_interval_set(unsigned seconds);
+void ucix_wb_task(void);
+void ucix_wb_flush(void);
 #endif
@@ -1235,6 +1235,10 @@ int Device_Read_Property_Local(
             break;
         case PROP_DEVICE_ADDRESS_BINDING:
             apdu_len = address_list_encode(&apdu[0], apdu_max);
+            if (apdu_len < 0) {
+                rpdata->error_code =
+                    ERROR_CODE_ABORT_SEGMENTATION_NOT_SUPPORTED;
+            }
             break;
         case PROP_DATABASE_REVISION:
             apdu_len =
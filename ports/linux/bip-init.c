@@ -32,9 +32,13 @@
  -------------------------------------------
 ####COPYRIGHTEND####*/
 
+#define _GNU_SOURCE     /* for recvmmsg() and sendmmsg() */
 #include <stdint.h>     /* for standard integer types uint8_t etc. */
 #include <stdbool.h>    /* for the standard bool type. */
+#include <poll.h>
+#include <sys/eventfd.h>
 #include "bacdcode.h"
+#include "bacint.h"
 #include "bip.h"
 #include "net.h"
 
@@ -42,6 +46,42 @@
 
 bool BIP_Debug = false;
 
+/* a packet in the receive queue.  The sequence tells whose turn the
+   slot is: a worker fills it when it equals the position it claimed,
+   and the receiving thread empties it when it is one more.  A slot
+   with no packet, because the one claimed for it was not valid, is
+   skipped. */
+typedef struct bip_queue_slot {
+    unsigned sequence;
+    uint16_t mpdu_len;
+    struct sockaddr_in sin;
+    uint8_t mpdu[MAX_MPDU];
+} BIP_QUEUE_SLOT;
+
+typedef struct bip_worker {
+    pthread_t thread;
+    /* written by the worker thread only */
+    BIP_WORKER_STATS stats;
+} BIP_WORKER;
+
+static BIP_QUEUE_SLOT *BIP_Queue;
+/* The worker that holds the lock is the only one that waits on the
+   socket.  It takes a batch and claims the queue positions for it, so
+   the packets are queued in the order they came in. */
+static pthread_mutex_t BIP_Receive_Lock = PTHREAD_MUTEX_INITIALIZER;
+/* the next position to claim, under the receive lock */
+static unsigned BIP_Queue_Tail;
+/* the next position to empty, used by the receiving thread only */
+static unsigned BIP_Queue_Head;
+/* readable when packets were queued */
+static int BIP_Queue_Event = -1;
+/* readable when the workers are to stop */
+static int BIP_Stop_Event = -1;
+static BIP_WORKER BIP_Workers[BIP_WORKERS_MAX];
+static unsigned BIP_Worker_Count;
+/* the drop counter of the socket, as last reported to a worker */
+static uint32_t BIP_Socket_Overflows;
+
 /* gets an IP address by name, where name can be a
    string that is an IP address in dotted form, or
    a name that is a domain name
@@ -145,6 +185,59 @@ void bip_set_interface(
     }
 }
 
+/* bip_send_mpdu_multi() with as few sendmmsg() calls as it takes */
+static unsigned bip_sendmmsg(
+    struct sockaddr_in *dest,
+    int *status,
+    unsigned count,
+    uint8_t * mtu,
+    uint16_t mtu_len)
+{
+    struct mmsghdr msgs[BIP_SEND_BATCH];
+    struct iovec iov;
+    unsigned first = 0;
+    unsigned batch = 0;
+    unsigned sent = 0;
+    unsigned i = 0;
+    int rv = 0;
+
+    iov.iov_base = mtu;
+    iov.iov_len = mtu_len;
+    while (first < count) {
+        batch = count - first;
+        if (batch > BIP_SEND_BATCH) {
+            batch = BIP_SEND_BATCH;
+        }
+        memset(msgs, 0, batch * sizeof(struct mmsghdr));
+        for (i = 0; i < batch; i++) {
+            dest[first + i].sin_family = AF_INET;
+            msgs[i].msg_hdr.msg_name = &dest[first + i];
+            msgs[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_in);
+            msgs[i].msg_hdr.msg_iov = &iov;
+            msgs[i].msg_hdr.msg_iovlen = 1;
+        }
+        rv = sendmmsg(bip_socket(), msgs, batch, 0);
+        if (rv < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            rv = 0;
+        }
+        for (i = 0; i < (unsigned) rv; i++) {
+            status[first + i] = (int) msgs[i].msg_len;
+        }
+        sent += rv;
+        first += rv;
+        if ((unsigned) rv < batch) {
+            /* the next one failed, go on after it */
+            status[first] = -1;
+            first++;
+        }
+    }
+
+    return sent;
+}
+
 /** Initialize the BACnet/IP services at the given interface.
  * @ingroup DLBIP
  * -# Gets the local IP address and local broadcast address from the system,
@@ -211,6 +304,7 @@ bool bip_init(
         bip_set_socket(-1);
         return false;
     }
+    bip_set_send_multi(bip_sendmmsg);
 
     return true;
 }
@@ -223,6 +317,7 @@ void bip_cleanup(
 {
     int sock_fd = 0;
 
+    bip_workers_stop();
     if (bip_valid()) {
         sock_fd = bip_socket();
         close(sock_fd);
@@ -246,3 +341,540 @@ int bip_get_local_netmask(
     rv = get_local_address_ioctl(ifname, netmask, SIOCGIFNETMASK);
     return rv;
 }
+
+/* claims up to count positions that the receiving thread has emptied,
+   under the receive lock; returns the first in *first */
+static unsigned bip_queue_claim(
+    unsigned count,
+    unsigned *first)
+{
+    BIP_QUEUE_SLOT *slot = NULL;
+    unsigned tail = BIP_Queue_Tail;
+    unsigned claimed = 0;
+
+    while (claimed < count) {
+        slot = &BIP_Queue[(tail + claimed) & (BIP_WORKERS_QUEUE_SIZE - 1)];
+        if (__atomic_load_n(&slot->sequence,
+                __ATOMIC_ACQUIRE) != (tail + claimed)) {
+            /* full */
+            break;
+        }
+        claimed++;
+    }
+    *first = tail;
+    BIP_Queue_Tail = tail + claimed;
+
+    return claimed;
+}
+
+/* fills a claimed position, with no packet if mpdu is NULL */
+static void bip_queue_fill(
+    unsigned position,
+    uint8_t * mpdu,
+    uint16_t mpdu_len,
+    struct sockaddr_in *sin)
+{
+    BIP_QUEUE_SLOT *slot =
+        &BIP_Queue[position & (BIP_WORKERS_QUEUE_SIZE - 1)];
+
+    if (mpdu) {
+        memcpy(slot->mpdu, mpdu, mpdu_len);
+        slot->mpdu_len = mpdu_len;
+        slot->sin = *sin;
+    } else {
+        slot->mpdu_len = 0;
+    }
+    __atomic_store_n(&slot->sequence, position + 1, __ATOMIC_RELEASE);
+}
+
+static int bip_queue_take(
+    uint8_t * mpdu,
+    uint16_t max_mpdu,
+    struct sockaddr_in *sin)
+{
+    BIP_QUEUE_SLOT *slot = NULL;
+    uint16_t mpdu_len = 0;
+
+    while (mpdu_len == 0) {
+        slot = &BIP_Queue[BIP_Queue_Head & (BIP_WORKERS_QUEUE_SIZE - 1)];
+        if (__atomic_load_n(&slot->sequence,
+                __ATOMIC_ACQUIRE) != (BIP_Queue_Head + 1)) {
+            return 0;
+        }
+        mpdu_len = slot->mpdu_len;
+        if (mpdu_len > max_mpdu) {
+            mpdu_len = max_mpdu;
+        }
+        if (mpdu_len) {
+            memcpy(mpdu, slot->mpdu, mpdu_len);
+            *sin = slot->sin;
+        }
+        __atomic_store_n(&slot->sequence,
+            BIP_Queue_Head + BIP_WORKERS_QUEUE_SIZE, __ATOMIC_RELEASE);
+        BIP_Queue_Head++;
+    }
+
+    return mpdu_len;
+}
+
+/* the queue get function for bip_receive_mpdu() */
+static int bip_queue_get(
+    uint8_t * mpdu,
+    uint16_t max_mpdu,
+    struct sockaddr_in *sin)
+{
+    uint64_t value = 0;
+    int mpdu_len = 0;
+
+    mpdu_len = bip_queue_take(mpdu, max_mpdu, sin);
+    if (mpdu_len == 0) {
+        /* clear the event, then look again for the packets queued
+           in the meantime, whose event may have been cleared */
+        (void) read(BIP_Queue_Event, &value, sizeof(value));
+        mpdu_len = bip_queue_take(mpdu, max_mpdu, sin);
+    }
+
+    return mpdu_len;
+}
+
+/* true if the packet is BACnet/IP and holds its BVLC length */
+static bool bip_worker_valid(
+    uint8_t * mpdu,
+    unsigned len,
+    uint16_t * mpdu_len)
+{
+    if ((len < 4) || (mpdu[0] != BVLL_TYPE_BACNET_IP)) {
+        return false;
+    }
+    (void) decode_unsigned16(&mpdu[2], mpdu_len);
+
+    return ((*mpdu_len >= 4) && (*mpdu_len <= len));
+}
+
+static void *bip_worker_thread(
+    void *arg)
+{
+    BIP_WORKER *worker = (BIP_WORKER *) arg;
+    struct mmsghdr msgs[BIP_WORKERS_BATCH];
+    struct iovec iov[BIP_WORKERS_BATCH];
+    struct sockaddr_in sin[BIP_WORKERS_BATCH];
+    uint8_t control[BIP_WORKERS_BATCH][CMSG_SPACE(sizeof(uint32_t))];
+    uint8_t mpdu[BIP_WORKERS_BATCH][MAX_MPDU];
+    struct pollfd fds[2];
+    struct cmsghdr *cmsg = NULL;
+    uint32_t overflows = 0;
+    uint16_t mpdu_len = 0;
+    unsigned first = 0;
+    unsigned claimed = 0;
+    unsigned long queued = 0;
+    unsigned long invalid = 0;
+    uint64_t one = 1;
+    bool stop = false;
+    int count = 0;
+    int i = 0;
+
+    fds[0].fd = bip_socket();
+    fds[0].events = POLLIN;
+    fds[1].fd = BIP_Stop_Event;
+    fds[1].events = POLLIN;
+    while (!stop) {
+        memset(msgs, 0, sizeof(msgs));
+        for (i = 0; i < BIP_WORKERS_BATCH; i++) {
+            iov[i].iov_base = mpdu[i];
+            iov[i].iov_len = MAX_MPDU;
+            msgs[i].msg_hdr.msg_name = &sin[i];
+            msgs[i].msg_hdr.msg_namelen = sizeof(sin[i]);
+            msgs[i].msg_hdr.msg_iov = &iov[i];
+            msgs[i].msg_hdr.msg_iovlen = 1;
+            msgs[i].msg_hdr.msg_control = control[i];
+            msgs[i].msg_hdr.msg_controllen = sizeof(control[i]);
+        }
+        /* the other workers wait for the lock, not on the socket */
+        pthread_mutex_lock(&BIP_Receive_Lock);
+        count = 0;
+        while ((count <= 0) && !stop) {
+            if ((poll(fds, 2, -1) < 0) && (errno != EINTR)) {
+                stop = true;
+            } else if (fds[1].revents ||
+                (fds[0].revents & (POLLERR | POLLNVAL))) {
+                stop = true;
+            } else if (fds[0].revents & POLLIN) {
+                count =
+                    recvmmsg(fds[0].fd, msgs, BIP_WORKERS_BATCH,
+                    MSG_DONTWAIT, NULL);
+            }
+        }
+        claimed = (count > 0) ? bip_queue_claim(count, &first) : 0;
+        pthread_mutex_unlock(&BIP_Receive_Lock);
+        if (count <= 0) {
+            continue;
+        }
+        /* checked and copied while the next worker receives */
+        queued = invalid = 0;
+        for (i = 0; i < count; i++) {
+            if ((msgs[i].msg_hdr.msg_flags & MSG_TRUNC) ||
+                !bip_worker_valid(mpdu[i], msgs[i].msg_len, &mpdu_len)) {
+                invalid++;
+                if ((unsigned) i < claimed) {
+                    bip_queue_fill(first + i, NULL, 0, NULL);
+                }
+            } else if ((unsigned) i < claimed) {
+                bip_queue_fill(first + i, mpdu[i], mpdu_len, &sin[i]);
+                queued++;
+            }
+            for (cmsg = CMSG_FIRSTHDR(&msgs[i].msg_hdr); cmsg;
+                cmsg = CMSG_NXTHDR(&msgs[i].msg_hdr, cmsg)) {
+                if ((cmsg->cmsg_level == SOL_SOCKET) &&
+                    (cmsg->cmsg_type == SO_RXQ_OVFL)) {
+                    memcpy(&overflows, CMSG_DATA(cmsg), sizeof(overflows));
+                    __atomic_store_n(&BIP_Socket_Overflows, overflows,
+                        __ATOMIC_RELAXED);
+                }
+            }
+        }
+        __atomic_add_fetch(&worker->stats.received, count, __ATOMIC_RELAXED);
+        __atomic_add_fetch(&worker->stats.batches, 1, __ATOMIC_RELAXED);
+        __atomic_add_fetch(&worker->stats.invalid, invalid, __ATOMIC_RELAXED);
+        __atomic_add_fetch(&worker->stats.dropped, count - invalid - queued,
+            __ATOMIC_RELAXED);
+        if (queued) {
+            (void) write(BIP_Queue_Event, &one, sizeof(one));
+        }
+    }
+
+    return NULL;
+}
+
+static void bip_workers_free(
+    void)
+{
+    if (BIP_Queue_Event >= 0) {
+        close(BIP_Queue_Event);
+        BIP_Queue_Event = -1;
+    }
+    if (BIP_Stop_Event >= 0) {
+        close(BIP_Stop_Event);
+        BIP_Stop_Event = -1;
+    }
+    free(BIP_Queue);
+    BIP_Queue = NULL;
+}
+
+/** Start threads that receive from the BACnet/IP socket.  They take
+ * the packets from the socket in batches, drop the ones that are not
+ * BACnet/IP, and queue the others for bip_receive() or bvlc_receive(),
+ * which handle the BVLC functions in the calling thread as before.
+ * The threads share the one socket, so each packet, broadcast or not,
+ * is received once.  Only one thread at a time waits on the socket,
+ * and it claims the queue slots of its batch before the next one
+ * receives, so the packets are queued in the order they came in and
+ * the segments of a peer are not reordered.  The threads check and
+ * copy their batches at the same time.
+ *
+ * @param count [in] The number of threads, up to BIP_WORKERS_MAX.
+ * @return True if the threads were started.
+ */
+bool bip_workers_start(
+    unsigned count)
+{
+    int sockopt = 1;
+    unsigned i = 0;
+
+    if ((BIP_Worker_Count > 0) || !bip_valid() || (count == 0)) {
+        return false;
+    }
+    if (count > BIP_WORKERS_MAX) {
+        count = BIP_WORKERS_MAX;
+    }
+    BIP_Queue = calloc(BIP_WORKERS_QUEUE_SIZE, sizeof(BIP_QUEUE_SLOT));
+    if (!BIP_Queue) {
+        return false;
+    }
+    for (i = 0; i < BIP_WORKERS_QUEUE_SIZE; i++) {
+        BIP_Queue[i].sequence = i;
+    }
+    BIP_Queue_Head = 0;
+    BIP_Queue_Tail = 0;
+    BIP_Socket_Overflows = 0;
+    memset(BIP_Workers, 0, sizeof(BIP_Workers));
+    BIP_Queue_Event = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    BIP_Stop_Event = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if ((BIP_Queue_Event < 0) || (BIP_Stop_Event < 0)) {
+        bip_workers_free();
+        return false;
+    }
+    /* the kernel reports its drops to the workers */
+    (void) setsockopt(bip_socket(), SOL_SOCKET, SO_RXQ_OVFL, &sockopt,
+        sizeof(sockopt));
+    for (i = 0; i < count; i++) {
+        if (pthread_create(&BIP_Workers[i].thread, NULL, bip_worker_thread,
+                &BIP_Workers[i]) != 0) {
+            break;
+        }
+        BIP_Worker_Count++;
+    }
+    if (BIP_Worker_Count == 0) {
+        bip_workers_free();
+        return false;
+    }
+    bip_set_receive_queue(BIP_Queue_Event, bip_queue_get);
+
+    return true;
+}
+
+/** Stop the receive threads, and receive from the socket again.
+ * The packets still in the queue are dropped.
+ */
+void bip_workers_stop(
+    void)
+{
+    uint64_t one = 1;
+    unsigned i = 0;
+
+    if (BIP_Worker_Count == 0) {
+        return;
+    }
+    bip_set_receive_queue(-1, NULL);
+    (void) write(BIP_Stop_Event, &one, sizeof(one));
+    for (i = 0; i < BIP_Worker_Count; i++) {
+        pthread_join(BIP_Workers[i].thread, NULL);
+    }
+    BIP_Worker_Count = 0;
+    bip_workers_free();
+}
+
+/** Get the counters of the receive threads since they were started.
+ *
+ * @param stats [out] The counters, summed over the threads.
+ */
+void bip_workers_stats(
+    BIP_WORKER_STATS * stats)
+{
+    unsigned i = 0;
+
+    memset(stats, 0, sizeof(BIP_WORKER_STATS));
+    for (i = 0; i < BIP_Worker_Count; i++) {
+        stats->received +=
+            __atomic_load_n(&BIP_Workers[i].stats.received, __ATOMIC_RELAXED);
+        stats->batches +=
+            __atomic_load_n(&BIP_Workers[i].stats.batches, __ATOMIC_RELAXED);
+        stats->invalid +=
+            __atomic_load_n(&BIP_Workers[i].stats.invalid, __ATOMIC_RELAXED);
+        stats->dropped +=
+            __atomic_load_n(&BIP_Workers[i].stats.dropped, __ATOMIC_RELAXED);
+    }
+    stats->overflows =
+        __atomic_load_n(&BIP_Socket_Overflows, __ATOMIC_RELAXED);
+}
+
+#ifdef TEST
+#include <assert.h>
+#include "ctest.h"
+
+#define TEST_BIP_PORT 0xBAD5
+#define TEST_BIP_SOURCES 4
+#define TEST_BIP_ROUNDS 50
+#define TEST_BIP_ROUND_PACKETS 8
+
+/* sends a numbered packet, or one that is not BACnet/IP */
+static void testBipSend(
+    int sock_fd,
+    uint32_t number,
+    bool valid)
+{
+    struct sockaddr_in sin = { 0 };
+    uint8_t mpdu[8] = { 0 };
+
+    mpdu[0] = valid ? BVLL_TYPE_BACNET_IP : 0;
+    mpdu[1] = BVLC_ORIGINAL_UNICAST_NPDU;
+    (void) encode_unsigned16(&mpdu[2], sizeof(mpdu));
+    (void) encode_unsigned32(&mpdu[4], number);
+    sin.sin_family = AF_INET;
+    sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    sin.sin_port = htons(TEST_BIP_PORT);
+    (void) sendto(sock_fd, mpdu, sizeof(mpdu), 0,
+        (struct sockaddr *) &sin, sizeof(sin));
+}
+
+/* receives the queued packets, checking that each source is in order */
+static unsigned testBipDrain(
+    Test * pTest,
+    uint16_t * ports,
+    uint32_t * next,
+    unsigned timeout)
+{
+    struct sockaddr_in sin = { 0 };
+    uint8_t mpdu[MAX_MPDU] = { 0 };
+    uint32_t number = 0;
+    unsigned delivered = 0;
+    unsigned source = 0;
+    int len = 0;
+
+    while ((len = bip_receive_mpdu(mpdu, sizeof(mpdu), &sin, timeout)) > 0) {
+        ct_test(pTest, len == 8);
+        ct_test(pTest, mpdu[0] == BVLL_TYPE_BACNET_IP);
+        for (source = 0; source < TEST_BIP_SOURCES; source++) {
+            if (ports[source] == sin.sin_port) {
+                break;
+            }
+        }
+        ct_test(pTest, source < TEST_BIP_SOURCES);
+        if (source < TEST_BIP_SOURCES) {
+            (void) decode_unsigned32(&mpdu[4], &number);
+            /* a dropped packet leaves a gap, never a step back */
+            ct_test(pTest, number >= next[source]);
+            next[source] = number + 1;
+        }
+        delivered++;
+    }
+
+    return delivered;
+}
+
+static void testBipWorkers(
+    Test * pTest)
+{
+    int sock_fd[TEST_BIP_SOURCES];
+    uint16_t ports[TEST_BIP_SOURCES];
+    uint32_t next[TEST_BIP_SOURCES] = { 0 };
+    uint32_t number[TEST_BIP_SOURCES] = { 0 };
+    struct sockaddr_in sin = { 0 };
+    socklen_t sin_len = sizeof(sin);
+    BIP_WORKER_STATS stats = { 0 };
+    unsigned delivered = 0;
+    unsigned invalid = 0;
+    unsigned sent = 0;
+    unsigned round = 0;
+    unsigned source = 0;
+    unsigned i = 0;
+    bool status = false;
+
+    bip_set_port(htons(TEST_BIP_PORT));
+    status = bip_init("lo");
+    ct_test(pTest, status);
+    if (!status) {
+        return;
+    }
+    for (source = 0; source < TEST_BIP_SOURCES; source++) {
+        sock_fd[source] = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+        ct_test(pTest, sock_fd[source] >= 0);
+        sin.sin_family = AF_INET;
+        sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        sin.sin_port = 0;
+        ct_test(pTest, bind(sock_fd[source], (struct sockaddr *) &sin,
+                sizeof(sin)) == 0);
+        sin_len = sizeof(sin);
+        (void) getsockname(sock_fd[source], (struct sockaddr *) &sin,
+            &sin_len);
+        ports[source] = sin.sin_port;
+    }
+    status = bip_workers_start(BIP_WORKERS_MAX);
+    ct_test(pTest, status);
+    /* the sources interleave, so the workers take turns within the
+       packets of each source */
+    for (round = 0; round < TEST_BIP_ROUNDS; round++) {
+        for (i = 0; i < TEST_BIP_ROUND_PACKETS; i++) {
+            for (source = 0; source < TEST_BIP_SOURCES; source++) {
+                if (((i + source) % 5) == 0) {
+                    testBipSend(sock_fd[source], 0, false);
+                    invalid++;
+                }
+                testBipSend(sock_fd[source], number[source]++, true);
+                sent++;
+            }
+        }
+        delivered += testBipDrain(pTest, ports, next, 0);
+    }
+    delivered += testBipDrain(pTest, ports, next, 500);
+    bip_workers_stats(&stats);
+    ct_test(pTest, stats.received ==
+        (delivered + stats.invalid + stats.dropped));
+    ct_test(pTest, stats.batches > 0);
+    if (stats.overflows == 0) {
+        ct_test(pTest, stats.received == (sent + invalid));
+        ct_test(pTest, stats.invalid == invalid);
+        ct_test(pTest, delivered == (sent - stats.dropped));
+    }
+    bip_cleanup();
+    for (source = 0; source < TEST_BIP_SOURCES; source++) {
+        close(sock_fd[source]);
+    }
+}
+
+/* the sends that fail are skipped, and the others still go */
+static void testBipSendMulti(
+    Test * pTest)
+{
+    struct sockaddr_in dest[(BIP_SEND_BATCH * 2) + 20];
+    int status[(BIP_SEND_BATCH * 2) + 20];
+    struct sockaddr_in sin = { 0 };
+    socklen_t sin_len = sizeof(sin);
+    uint8_t mtu[8] = { BVLL_TYPE_BACNET_IP, BVLC_ORIGINAL_UNICAST_NPDU, 0, 8 };
+    unsigned count = (BIP_SEND_BATCH * 2) + 20;
+    unsigned failed = 0;
+    unsigned received = 0;
+    unsigned sent = 0;
+    unsigned i = 0;
+    int sock_fd = -1;
+
+    bip_set_port(htons(TEST_BIP_PORT));
+    ct_test(pTest, bip_init("lo"));
+    sock_fd = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    sin.sin_family = AF_INET;
+    sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    ct_test(pTest, bind(sock_fd, (struct sockaddr *) &sin, sizeof(sin)) == 0);
+    (void) getsockname(sock_fd, (struct sockaddr *) &sin, &sin_len);
+    memset(dest, 0, sizeof(dest));
+    for (i = 0; i < count; i++) {
+        dest[i].sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        /* a port of 0 can not be sent to, the first one and the
+           ones at the end of a batch among them */
+        if (((i % 7) == 0) || ((i % BIP_SEND_BATCH) == 0) ||
+            ((i % BIP_SEND_BATCH) == (BIP_SEND_BATCH - 1))) {
+            dest[i].sin_port = 0;
+            failed++;
+        } else {
+            dest[i].sin_port = sin.sin_port;
+        }
+        status[i] = 0;
+    }
+    sent = bip_send_mpdu_multi(dest, status, count, mtu, sizeof(mtu));
+    ct_test(pTest, sent == (count - failed));
+    for (i = 0; i < count; i++) {
+        if (dest[i].sin_port == 0) {
+            ct_test(pTest, status[i] == -1);
+        } else {
+            ct_test(pTest, status[i] == sizeof(mtu));
+        }
+    }
+    while (recv(sock_fd, mtu, sizeof(mtu), MSG_DONTWAIT) == sizeof(mtu)) {
+        received++;
+    }
+    ct_test(pTest, received == sent);
+    close(sock_fd);
+    bip_cleanup();
+}
+
+#ifdef TEST_BIP_WORKERS
+int main(
+    void)
+{
+    Test *pTest;
+    bool rc;
+
+    pTest = ct_create("BACnet/IP Linux Receive and Send", NULL);
+    /* individual tests */
+    rc = ct_addTestFunction(pTest, testBipWorkers);
+    assert(rc);
+    rc = ct_addTestFunction(pTest, testBipSendMulti);
+    assert(rc);
+
+    ct_setStream(pTest, stdout);
+    ct_run(pTest);
+    (void) ct_report(pTest);
+    ct_destroy(pTest);
+
+    return 0;
+}
+#endif /* TEST_BIP_WORKERS */
+#endif /* TEST */
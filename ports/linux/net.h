@@ -26,6 +26,8 @@
 #ifndef NET_H
 #define NET_H
 
+#include <stdbool.h>
+
 /* common unix sockets headers needed */
 #include	<sys/types.h>   /* basic system data types */
 #include	<sys/time.h>    /* timeval{} for select() */
@@ -106,5 +108,44 @@
 extern int bip_get_local_netmask(
     struct in_addr *netmask);
 
+/* BACnet/IP receive threads, which drain the socket with recvmmsg()
+   and queue the packets for bip_receive() and bvlc_receive() */
+#ifndef BIP_WORKERS_MAX
+#define BIP_WORKERS_MAX 8
+#endif
+/* packets in the queue, a power of two */
+#ifndef BIP_WORKERS_QUEUE_SIZE
+#define BIP_WORKERS_QUEUE_SIZE 1024
+#endif
+/* packets taken from the socket in one call */
+#ifndef BIP_WORKERS_BATCH
+#define BIP_WORKERS_BATCH 16
+#endif
+
+/* destinations given to one sendmmsg() call */
+#ifndef BIP_SEND_BATCH
+#define BIP_SEND_BATCH 64
+#endif
+
+typedef struct bip_worker_stats {
+    /* packets taken from the socket */
+    unsigned long received;
+    /* recvmmsg() calls that returned packets */
+    unsigned long batches;
+    /* not BACnet/IP, or shorter than their BVLC length */
+    unsigned long invalid;
+    /* dropped because the queue was full */
+    unsigned long dropped;
+    /* dropped by the kernel because the socket buffer was full */
+    unsigned long overflows;
+} BIP_WORKER_STATS;
+
+extern bool bip_workers_start(
+    unsigned count);
+extern void bip_workers_stop(
+    void);
+extern void bip_workers_stats(
+    BIP_WORKER_STATS * stats);
+
 
 #endif
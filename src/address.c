@@ -36,6 +36,13 @@
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#if defined(_WIN32)
+#include <io.h>     /* for _commit() */
+#else
+#include <unistd.h> /* for fsync() */
+#endif
 #include "config.h"
 #include "bacaddr.h"
 #include "address.h"
@@ -43,13 +50,6 @@
 #include "bacdcode.h"
 #include "readrange.h"
 
-/* we are likely compiling the demo command line tools if print enabled */
-#if !defined(BACNET_ADDRESS_CACHE_FILE)
-#if PRINT_ENABLED
-#define BACNET_ADDRESS_CACHE_FILE
-#endif
-#endif
-
 /** @file address.c  Handle address binding */
 
 /* This module is used to handle the address binding that */
@@ -59,13 +59,59 @@
 static uint32_t Top_Protected_Entry;
 static uint32_t Own_Device_ID = 0xFFFFFFFF;
 
-static struct Address_Cache_Entry {
+/* The entries in use are chained by device ID, and the bound entries
+   by address too, so they are found without a scan.  The links hold
+   the index + 1 of the next entry, or 0 for the end of the chain. */
+struct Address_Cache_Entry {
     uint8_t Flags;
     uint32_t device_id;
     unsigned max_apdu;
     BACNET_ADDRESS address;
     uint32_t TimeToLive;
-} Address_Cache[MAX_ADDRESS_CACHE];
+    uint8_t segmentation;
+    /* the next entry of the device hash chain, or of the free list */
+    uint16_t DeviceNext;
+    uint16_t AddressNext;
+    /* the entries in use, from the most recently used */
+    uint16_t LRUPrev;
+    uint16_t LRUNext;
+};
+
+#if (MAX_ADDRESS_CACHE > 65535)
+#error MAX_ADDRESS_CACHE is limited to 65535 entries
+#endif
+
+#if ADDRESS_CACHE_DYNAMIC
+/* the number of entries, and of hash buckets, of a new cache */
+#define ADDRESS_CACHE_INITIAL 16
+static struct Address_Cache_Entry *Address_Cache;
+static uint16_t *Address_Device_Hash;
+static uint16_t *Address_MAC_Hash;
+static unsigned Address_Capacity;
+static unsigned Address_Hash_Size;
+#else
+#if !defined(ADDRESS_CACHE_HASH_SIZE)
+#define ADDRESS_CACHE_HASH_SIZE 64
+#endif
+static struct Address_Cache_Entry Address_Cache[MAX_ADDRESS_CACHE];
+static uint16_t Address_Device_Hash[ADDRESS_CACHE_HASH_SIZE];
+static uint16_t Address_MAC_Hash[ADDRESS_CACHE_HASH_SIZE];
+#define Address_Capacity MAX_ADDRESS_CACHE
+#define Address_Hash_Size ADDRESS_CACHE_HASH_SIZE
+#endif
+/* entries below this index have been handed out since the init */
+static unsigned Address_Used;
+static uint16_t Address_Free;
+static uint16_t Address_LRU_Head;
+static uint16_t Address_LRU_Tail;
+static unsigned Address_Bound_Count;
+static uint32_t Address_Hits;
+static uint32_t Address_Misses;
+static uint32_t Address_Evictions;
+/* a binding changed since the last snapshot */
+static bool Address_Snapshot_Changed;
+/* the next entry to check for address_revalidate_next() */
+static unsigned Address_Revalidate_Index;
 
 /* State flags for cache entries */
 
@@ -73,7 +119,7 @@ static struct Address_Cache_Entry {
 #define BAC_ADDR_BIND_REQ  2    /* Bind request outstanding for entry */
 #define BAC_ADDR_STATIC    4    /* Static address mapping - does not expire */
 #define BAC_ADDR_SHORT_TTL 8    /* Oppertunistaclly added address with short TTL */
-#define BAC_ADDR_RESERVED  128  /* Freed up but held for caller to fill */
+#define BAC_ADDR_UNCONFIRMED 16 /* Loaded from a snapshot, not heard from since */
 
 #define BAC_ADDR_SECS_1HOUR 3600        /* 60x60 */
 #define BAC_ADDR_SECS_1DAY  86400       /* 60x60x24 */
@@ -81,7 +127,277 @@ static struct Address_Cache_Entry {
 #define BAC_ADDR_LONG_TIME  BAC_ADDR_SECS_1DAY
 #define BAC_ADDR_SHORT_TIME BAC_ADDR_SECS_1HOUR
 #define BAC_ADDR_FOREVER    0xFFFFFFFF  /* Permenant entry */
+/* seconds a binding that is checked is kept, unless its I-Am comes back */
+#ifndef BAC_ADDR_REVALIDATE_TIME
+#define BAC_ADDR_REVALIDATE_TIME 120
+#endif
+
+#define ACACHE_MAX_ENC 17       /* Maximum size of encoded cache entry, see below */
+
+static unsigned address_device_hash(
+    uint32_t device_id)
+{
+    uint32_t hash = device_id * 2654435761UL;
+
+    return hash % Address_Hash_Size;
+}
+
+/* the same fields as bacnet_address_same() compares */
+static unsigned address_mac_hash(
+    BACNET_ADDRESS * address)
+{
+    uint32_t hash = 2166136261UL;
+    unsigned i = 0;
+
+    hash = (hash ^ (address->net & 0xFF)) * 16777619UL;
+    hash = (hash ^ (address->net >> 8)) * 16777619UL;
+    for (i = 0; (i < address->len) && (i < MAX_MAC_LEN); i++) {
+        hash = (hash ^ address->adr[i]) * 16777619UL;
+    }
+    if (address->net == 0) {
+        for (i = 0; (i < address->mac_len) && (i < MAX_MAC_LEN); i++) {
+            hash = (hash ^ address->mac[i]) * 16777619UL;
+        }
+    }
+
+    return hash % Address_Hash_Size;
+}
+
+/* adds the entry to the hash chains: call it after a change of the
+   device ID, the address or the bind request flag */
+static void address_entry_link(
+    struct Address_Cache_Entry *pMatch)
+{
+    uint16_t index = (uint16_t) (pMatch - Address_Cache);
+    unsigned bucket = 0;
+
+    bucket = address_device_hash(pMatch->device_id);
+    pMatch->DeviceNext = Address_Device_Hash[bucket];
+    Address_Device_Hash[bucket] = index + 1;
+    if ((pMatch->Flags & BAC_ADDR_BIND_REQ) == 0) {
+        bucket = address_mac_hash(&pMatch->address);
+        pMatch->AddressNext = Address_MAC_Hash[bucket];
+        Address_MAC_Hash[bucket] = index + 1;
+        Address_Bound_Count++;
+    }
+    Address_Snapshot_Changed = true;
+}
+
+/* removes the entry from the hash chains: call it before a change */
+static void address_entry_unlink(
+    struct Address_Cache_Entry *pMatch)
+{
+    uint16_t index = (uint16_t) (pMatch - Address_Cache);
+    uint16_t *link = NULL;
+
+    link = &Address_Device_Hash[address_device_hash(pMatch->device_id)];
+    while (*link) {
+        if (*link == (index + 1)) {
+            *link = pMatch->DeviceNext;
+            break;
+        }
+        link = &Address_Cache[*link - 1].DeviceNext;
+    }
+    if ((pMatch->Flags & BAC_ADDR_BIND_REQ) == 0) {
+        link = &Address_MAC_Hash[address_mac_hash(&pMatch->address)];
+        while (*link) {
+            if (*link == (index + 1)) {
+                *link = pMatch->AddressNext;
+                break;
+            }
+            link = &Address_Cache[*link - 1].AddressNext;
+        }
+        Address_Bound_Count--;
+    }
+    Address_Snapshot_Changed = true;
+}
+
+static void address_lru_remove(
+    struct Address_Cache_Entry *pMatch)
+{
+    if (pMatch->LRUPrev) {
+        Address_Cache[pMatch->LRUPrev - 1].LRUNext = pMatch->LRUNext;
+    } else {
+        Address_LRU_Head = pMatch->LRUNext;
+    }
+    if (pMatch->LRUNext) {
+        Address_Cache[pMatch->LRUNext - 1].LRUPrev = pMatch->LRUPrev;
+    } else {
+        Address_LRU_Tail = pMatch->LRUPrev;
+    }
+}
+
+static void address_lru_insert(
+    struct Address_Cache_Entry *pMatch)
+{
+    uint16_t index = (uint16_t) (pMatch - Address_Cache);
+
+    pMatch->LRUPrev = 0;
+    pMatch->LRUNext = Address_LRU_Head;
+    if (Address_LRU_Head) {
+        Address_Cache[Address_LRU_Head - 1].LRUPrev = index + 1;
+    } else {
+        Address_LRU_Tail = index + 1;
+    }
+    Address_LRU_Head = index + 1;
+}
+
+/* marks the entry as the most recently used */
+static void address_lru_touch(
+    struct Address_Cache_Entry *pMatch)
+{
+    if (Address_LRU_Head != (pMatch - Address_Cache) + 1) {
+        address_lru_remove(pMatch);
+        address_lru_insert(pMatch);
+    }
+}
+
+/* the entry in use for the device, or NULL */
+static struct Address_Cache_Entry *address_entry_find(
+    uint32_t device_id)
+{
+    uint16_t next = 0;
+
+    if (Address_Hash_Size == 0) {
+        return NULL;
+    }
+    next = Address_Device_Hash[address_device_hash(device_id)];
+    while (next) {
+        if (Address_Cache[next - 1].device_id == device_id) {
+            return &Address_Cache[next - 1];
+        }
+        next = Address_Cache[next - 1].DeviceNext;
+    }
+
+    return NULL;
+}
+
+/* the bound entry with the address, or NULL */
+static struct Address_Cache_Entry *address_entry_find_mac(
+    BACNET_ADDRESS * src)
+{
+    uint16_t next = 0;
+
+    if (Address_Hash_Size == 0) {
+        return NULL;
+    }
+    next = Address_MAC_Hash[address_mac_hash(src)];
+    while (next) {
+        if (bacnet_address_same(&Address_Cache[next - 1].address, src)) {
+            return &Address_Cache[next - 1];
+        }
+        next = Address_Cache[next - 1].AddressNext;
+    }
+
+    return NULL;
+}
+
+/* the entry, filled in by the caller, joins the chains and the LRU list */
+static void address_entry_insert(
+    struct Address_Cache_Entry *pMatch)
+{
+    address_entry_link(pMatch);
+    address_lru_insert(pMatch);
+}
+
+static void address_entry_free(
+    struct Address_Cache_Entry *pMatch)
+{
+    address_entry_unlink(pMatch);
+    address_lru_remove(pMatch);
+    pMatch->Flags = 0;
+    pMatch->DeviceNext = Address_Free;
+    Address_Free = (uint16_t) (pMatch - Address_Cache) + 1;
+}
 
+static void address_cache_clear(
+    void)
+{
+    unsigned i = 0;
+
+    for (i = 0; i < Address_Used; i++) {
+        Address_Cache[i].Flags = 0;
+    }
+    for (i = 0; i < Address_Hash_Size; i++) {
+        Address_Device_Hash[i] = 0;
+        Address_MAC_Hash[i] = 0;
+    }
+    Address_Used = 0;
+    Address_Free = 0;
+    Address_LRU_Head = 0;
+    Address_LRU_Tail = 0;
+    Address_Bound_Count = 0;
+    Address_Revalidate_Index = 0;
+}
+
+#if ADDRESS_CACHE_DYNAMIC
+/* doubles the number of entries, and of hash buckets to match */
+static bool address_cache_grow(
+    void)
+{
+    struct Address_Cache_Entry *cache = NULL;
+    uint16_t *device_hash = NULL;
+    uint16_t *mac_hash = NULL;
+    unsigned capacity = 0;
+    unsigned hash_size = 0;
+    unsigned i = 0;
+
+    if (Address_Capacity >= MAX_ADDRESS_CACHE) {
+        return false;
+    }
+    capacity = ADDRESS_CACHE_INITIAL;
+    if (Address_Capacity) {
+        capacity = Address_Capacity * 2;
+    }
+    if (capacity > MAX_ADDRESS_CACHE) {
+        capacity = MAX_ADDRESS_CACHE;
+    }
+    cache = realloc(Address_Cache, capacity * sizeof(*cache));
+    if (!cache) {
+        return false;
+    }
+    Address_Cache = cache;
+    Address_Capacity = capacity;
+    hash_size = ADDRESS_CACHE_INITIAL;
+    while (hash_size < capacity) {
+        hash_size *= 2;
+    }
+    if (hash_size == Address_Hash_Size) {
+        return true;
+    }
+    device_hash = malloc(hash_size * sizeof(uint16_t));
+    mac_hash = malloc(hash_size * sizeof(uint16_t));
+    if (!device_hash || !mac_hash) {
+        /* the old buckets still work, only the chains are longer */
+        free(device_hash);
+        free(mac_hash);
+        return true;
+    }
+    free(Address_Device_Hash);
+    free(Address_MAC_Hash);
+    Address_Device_Hash = device_hash;
+    Address_MAC_Hash = mac_hash;
+    Address_Hash_Size = hash_size;
+    for (i = 0; i < hash_size; i++) {
+        Address_Device_Hash[i] = 0;
+        Address_MAC_Hash[i] = 0;
+    }
+    Address_Bound_Count = 0;
+    for (i = 0; i < Address_Used; i++) {
+        if ((Address_Cache[i].Flags & BAC_ADDR_IN_USE) != 0) {
+            address_entry_link(&Address_Cache[i]);
+        }
+    }
+
+    return true;
+}
+#else
+static bool address_cache_grow(
+    void)
+{
+    return false;
+}
+#endif
 
 void address_protected_entry_index_set(uint32_t top_protected_entry_index)
 {
@@ -93,6 +409,24 @@ void address_own_device_id_set(uint32_t own_id)
     Own_Device_ID = own_id;
 }
 
+/* counters of the lookups by device ID and by address that found a
+   bound entry or not, and of the entries dropped to make room */
+void address_cache_stats(
+    uint32_t * hits,
+    uint32_t * misses,
+    uint32_t * evictions)
+{
+    if (hits) {
+        *hits = Address_Hits;
+    }
+    if (misses) {
+        *misses = Address_Misses;
+    }
+    if (evictions) {
+        *evictions = Address_Evictions;
+    }
+}
+
 bool address_match(
     BACNET_ADDRESS * dest,
     BACNET_ADDRESS * src)
@@ -135,87 +469,83 @@ void address_remove_device(
     struct Address_Cache_Entry *pMatch;
     uint32_t index = 0;
 
-    pMatch = Address_Cache;
-    while (pMatch <= &Address_Cache[MAX_ADDRESS_CACHE - 1]) {
-        if (((pMatch->Flags & BAC_ADDR_IN_USE) != 0) &&
-            (pMatch->device_id == device_id)) {
-            pMatch->Flags = 0;
-            if (index < Top_Protected_Entry) {
-                Top_Protected_Entry--;
-            }
-            break;
+    pMatch = address_entry_find(device_id);
+    if (pMatch) {
+        index = (uint32_t) (pMatch - Address_Cache);
+        address_entry_free(pMatch);
+        if (index < Top_Protected_Entry) {
+            Top_Protected_Entry--;
         }
-        pMatch++;
-        index++;
     }
 
     return;
 }
 
 /*****************************************************************************
- * Search the cache for the entry nearest expiry and delete it. Mark the     *
- * entry as reserved with a 1 hour TTL and return a pointer to the reserved  *
- * entry. Will not delete a static entry and returns NULL pointer if no      *
- * entry available to free up. Does not check for free entries as it is      *
- * assumed we are calling this due to the lack of those.                     *
+ * Drop the least recently used entry to make room for a new one, and return *
+ * it, taken out of the cache. Bound entries go first, then as a last resort *
+ * the entries with a bind request outstanding. Will not delete a static or  *
+ * protected entry, and returns NULL pointer if none can be freed up.        *
  *****************************************************************************/
 
-
 static struct Address_Cache_Entry *address_remove_oldest(
     void)
 {
     struct Address_Cache_Entry *pMatch;
-    struct Address_Cache_Entry *pCandidate;
-    uint32_t ulTime;
-
-    pCandidate = NULL;
-    if (Top_Protected_Entry > (MAX_ADDRESS_CACHE - 1)) {
-       return pCandidate;
-    }
-    ulTime = BAC_ADDR_FOREVER - 1;      /* Longest possible non static time to live */
-
-    /* First pass - try only in use and bound entries */
-
-    pMatch = &Address_Cache[Top_Protected_Entry];
-    while (pMatch <= &Address_Cache[MAX_ADDRESS_CACHE - 1]) {
-        if ((pMatch->
-                Flags & (BAC_ADDR_IN_USE | BAC_ADDR_BIND_REQ |
-                    BAC_ADDR_STATIC)) == BAC_ADDR_IN_USE) {
-            if (pMatch->TimeToLive <= ulTime) { /* Shorter lived entry found */
-                ulTime = pMatch->TimeToLive;
-                pCandidate = pMatch;
-            }
+    struct Address_Cache_Entry *pCandidate = NULL;
+    uint16_t next = 0;
+
+    next = Address_LRU_Tail;
+    while (next) {
+        pMatch = &Address_Cache[next - 1];
+        next = pMatch->LRUPrev;
+        if ((uint32_t) (pMatch - Address_Cache) < Top_Protected_Entry) {
+            continue;
+        }
+        if ((pMatch->Flags & (BAC_ADDR_BIND_REQ | BAC_ADDR_STATIC)) == 0) {
+            pCandidate = pMatch;
+            break;
+        }
+        if (!pCandidate &&
+            ((pMatch->Flags & (BAC_ADDR_BIND_REQ | BAC_ADDR_STATIC)) ==
+                BAC_ADDR_BIND_REQ)) {
+            pCandidate = pMatch;
         }
-        pMatch++;
     }
-
-    if (pCandidate != NULL) {   /* Found something to free up */
-        pCandidate->Flags = BAC_ADDR_RESERVED;
-        pCandidate->TimeToLive = BAC_ADDR_SHORT_TIME;   /* only reserve it for a short while */
-        return (pCandidate);
+    if (pCandidate != NULL) {
+        address_entry_unlink(pCandidate);
+        address_lru_remove(pCandidate);
+        pCandidate->Flags = 0;
+        Address_Evictions++;
     }
 
-    /* Second pass - try in use and un bound as last resort */
-    pMatch = Address_Cache;
-    while (pMatch <= &Address_Cache[MAX_ADDRESS_CACHE - 1]) {
-        if ((pMatch->
-                Flags & (BAC_ADDR_IN_USE | BAC_ADDR_BIND_REQ |
-                    BAC_ADDR_STATIC)) ==
-            ((uint8_t) (BAC_ADDR_IN_USE | BAC_ADDR_BIND_REQ))) {
-            if (pMatch->TimeToLive <= ulTime) { /* Shorter lived entry found */
-                ulTime = pMatch->TimeToLive;
-                pCandidate = pMatch;
-            }
-        }
-        pMatch++;
-    }
+    return (pCandidate);
+}
 
-    if (pCandidate != NULL) {   /* Found something to free up */
-        pCandidate->Flags = BAC_ADDR_RESERVED;
-        pCandidate->TimeToLive = BAC_ADDR_SHORT_TIME;   /* only reserve it for a short while */
+/* a free entry for the caller to fill in, from the free list, a larger
+   cache, or else the least recently used entry; NULL if none */
+static struct Address_Cache_Entry *address_entry_new(
+    void)
+{
+    struct Address_Cache_Entry *pMatch = NULL;
+
+    if (Address_Free) {
+        pMatch = &Address_Cache[Address_Free - 1];
+        Address_Free = pMatch->DeviceNext;
+    } else if ((Address_Used < Address_Capacity) || address_cache_grow()) {
+        pMatch = &Address_Cache[Address_Used];
+        Address_Used++;
+    } else {
+        pMatch = address_remove_oldest();
+    }
+    if (pMatch) {
+        pMatch->Flags = 0;
+        pMatch->segmentation = SEGMENTATION_NONE;
+        pMatch->DeviceNext = 0;
+        pMatch->AddressNext = 0;
     }
 
-    return (pCandidate);
+    return pMatch;
 }
 
 /** Initialize a BACNET_MAC_ADDRESS
@@ -369,15 +699,11 @@ static void address_file_init(
 void address_init(
     void)
 {
-    struct Address_Cache_Entry *pMatch;
-
-   Top_Protected_Entry = 0;
-
-    pMatch = Address_Cache;
-    while (pMatch <= &Address_Cache[MAX_ADDRESS_CACHE - 1]) {
-        pMatch->Flags = 0;
-        pMatch++;
-    }
+    Top_Protected_Entry = 0;
+    address_cache_clear();
+    Address_Hits = 0;
+    Address_Misses = 0;
+    Address_Evictions = 0;
 #ifdef BACNET_ADDRESS_CACHE_FILE
     address_file_init(Address_Cache_Filename);
 #endif
@@ -385,7 +711,7 @@ void address_init(
 }
 
 /****************************************************************************
- * Clear down the cache of any non bound, expired  or reserved entries.     *
+ * Clear down the cache of any non bound or expired entries.                *
  * Leave static and unexpired bound entries alone. For use where the cache  *
  * is held in persistant memory which can survive a reset or power cycle.   *
  * This reduces the network traffic on restarts as the cache will have much *
@@ -396,20 +722,27 @@ void address_init_partial(
     void)
 {
     struct Address_Cache_Entry *pMatch;
-
-    pMatch = Address_Cache;
-    while (pMatch <= &Address_Cache[MAX_ADDRESS_CACHE - 1]) {
+    unsigned used = Address_Used;
+    unsigned i = 0;
+
+    /* the links may not have survived, so build them again */
+    address_cache_clear();
+    Address_Used = used;
+    for (i = used; i > 0; i--) {
+        pMatch = &Address_Cache[i - 1];
         if ((pMatch->Flags & BAC_ADDR_IN_USE) != 0) {   /* It's in use so let's check further */
             if (((pMatch->Flags & BAC_ADDR_BIND_REQ) != 0) ||
                 (pMatch->TimeToLive == 0))
                 pMatch->Flags = 0;
-        }
-
-        if ((pMatch->Flags & BAC_ADDR_RESERVED) != 0) { /* Reserved entries should be cleared */
+        } else {
             pMatch->Flags = 0;
         }
-
-        pMatch++;
+        if (pMatch->Flags) {
+            address_entry_insert(pMatch);
+        } else {
+            pMatch->DeviceNext = Address_Free;
+            Address_Free = (uint16_t) i;
+        }
     }
  #ifdef BACNET_ADDRESS_CACHE_FILE
     address_file_init(Address_Cache_Filename);
@@ -433,27 +766,54 @@ void address_set_device_TTL(
 {
     struct Address_Cache_Entry *pMatch;
 
-    pMatch = Address_Cache;
-    while (pMatch <= &Address_Cache[MAX_ADDRESS_CACHE - 1]) {
-        if (((pMatch->Flags & BAC_ADDR_IN_USE) != 0) &&
-            (pMatch->device_id == device_id)) {
-            if ((pMatch->Flags & BAC_ADDR_BIND_REQ) == 0) {     /* If bound then we have either static or normaal */
-                if (StaticFlag) {
-                    pMatch->Flags |= BAC_ADDR_STATIC;
-                    pMatch->TimeToLive = BAC_ADDR_FOREVER;
-                } else {
-                    pMatch->Flags &= ~BAC_ADDR_STATIC;
-                    pMatch->TimeToLive = TimeOut;
-                }
+    pMatch = address_entry_find(device_id);
+    if (pMatch) {
+        if ((pMatch->Flags & BAC_ADDR_BIND_REQ) == 0) { /* If bound then we have either static or normaal */
+            if (StaticFlag) {
+                pMatch->Flags |= BAC_ADDR_STATIC;
+                pMatch->TimeToLive = BAC_ADDR_FOREVER;
             } else {
-                pMatch->TimeToLive = TimeOut;   /* For unbound we can only set the time to live */
+                pMatch->Flags &= ~BAC_ADDR_STATIC;
+                pMatch->TimeToLive = TimeOut;
             }
-            break;      /* Exit now if found at all - bound or unbound */
+        } else {
+            pMatch->TimeToLive = TimeOut;       /* For unbound we can only set the time to live */
         }
-        pMatch++;
     }
 }
 
+/* the segmentation support from the I-Am of the device */
+void address_set_device_segmentation(
+    uint32_t device_id,
+    uint8_t segmentation)
+{
+    struct Address_Cache_Entry *pMatch;
+
+    pMatch = address_entry_find(device_id);
+    if (pMatch && (segmentation < MAX_BACNET_SEGMENTATION)) {
+        if (pMatch->segmentation != segmentation) {
+            pMatch->segmentation = segmentation;
+            Address_Snapshot_Changed = true;
+        }
+    }
+}
+
+/* returns false, and SEGMENTATION_NONE, if the device is not bound */
+bool address_get_device_segmentation(
+    uint32_t device_id,
+    uint8_t * segmentation)
+{
+    struct Address_Cache_Entry *pMatch;
+
+    pMatch = address_entry_find(device_id);
+    if (pMatch && ((pMatch->Flags & BAC_ADDR_BIND_REQ) == 0)) {
+        *segmentation = pMatch->segmentation;
+        return true;
+    }
+    *segmentation = SEGMENTATION_NONE;
+
+    return false;
+}
 
 bool address_get_by_device(
     uint32_t device_id,
@@ -463,23 +823,33 @@ bool address_get_by_device(
     struct Address_Cache_Entry *pMatch;
     bool found = false; /* return value */
 
-    pMatch = Address_Cache;
-    while (pMatch <= &Address_Cache[MAX_ADDRESS_CACHE - 1]) {
-        if (((pMatch->Flags & BAC_ADDR_IN_USE) != 0) &&
-            (pMatch->device_id == device_id)) {
-            if ((pMatch->Flags & BAC_ADDR_BIND_REQ) == 0) {     /* If bound then fetch data */
-                bacnet_address_copy(src, &pMatch->address);
-                *max_apdu = pMatch->max_apdu;
-                found = true;   /* Prove we found it */
-            }
-            break;      /* Exit now if found at all - bound or unbound */
-        }
-        pMatch++;
+    pMatch = address_entry_find(device_id);
+    if (pMatch && ((pMatch->Flags & BAC_ADDR_BIND_REQ) == 0)) {
+        /* If bound then fetch data */
+        bacnet_address_copy(src, &pMatch->address);
+        *max_apdu = pMatch->max_apdu;
+        address_lru_touch(pMatch);
+        found = true;   /* Prove we found it */
+        Address_Hits++;
+    } else {
+        Address_Misses++;
     }
 
     return found;
 }
 
+/* true if the device is bound; unlike a lookup, it counts no hit or
+   miss, for the callers that only check on a binding */
+bool address_bound(
+    uint32_t device_id)
+{
+    struct Address_Cache_Entry *pMatch;
+
+    pMatch = address_entry_find(device_id);
+
+    return (pMatch && ((pMatch->Flags & BAC_ADDR_BIND_REQ) == 0));
+}
+
 /* find a device id from a given MAC address */
 
 bool address_get_device_id(
@@ -489,18 +859,16 @@ bool address_get_device_id(
     struct Address_Cache_Entry *pMatch;
     bool found = false; /* return value */
 
-    pMatch = Address_Cache;
-    while (pMatch <= &Address_Cache[MAX_ADDRESS_CACHE - 1]) {
-        if ((pMatch->Flags & (BAC_ADDR_IN_USE | BAC_ADDR_BIND_REQ)) == BAC_ADDR_IN_USE) {       /* If bound */
-            if (bacnet_address_same(&pMatch->address, src)) {
-                if (device_id) {
-                    *device_id = pMatch->device_id;
-                }
-                found = true;
-                break;
-            }
+    pMatch = address_entry_find_mac(src);
+    if (pMatch) {
+        if (device_id) {
+            *device_id = pMatch->device_id;
         }
-        pMatch++;
+        address_lru_touch(pMatch);
+        found = true;
+        Address_Hits++;
+    } else {
+        Address_Misses++;
     }
 
     return found;
@@ -511,7 +879,6 @@ void address_add(
     unsigned max_apdu,
     BACNET_ADDRESS * src)
 {
-    bool found = false; /* return value */
     struct Address_Cache_Entry *pMatch;
 
     if (Own_Device_ID == device_id) {
@@ -525,58 +892,39 @@ void address_add(
        bind request if it exists */
 
     /* existing device or bind request outstanding - update address */
-    pMatch = Address_Cache;
-    while (pMatch <= &Address_Cache[MAX_ADDRESS_CACHE - 1]) {
-        if (((pMatch->Flags & BAC_ADDR_IN_USE) != 0) &&
-            (pMatch->device_id == device_id)) {
-            bacnet_address_copy(&pMatch->address, src);
-            pMatch->max_apdu = max_apdu;
-
-            /* Pick the right time to live */
-
-            if ((pMatch->Flags & BAC_ADDR_BIND_REQ) != 0)       /* Bind requested so long time */
-                pMatch->TimeToLive = BAC_ADDR_LONG_TIME;
-            else if ((pMatch->Flags & BAC_ADDR_STATIC) != 0)    /* Static already so make sure it never expires */
-                pMatch->TimeToLive = BAC_ADDR_FOREVER;
-            else if ((pMatch->Flags & BAC_ADDR_SHORT_TTL) != 0) /* Opportunistic entry so leave on short fuse */
-                pMatch->TimeToLive = BAC_ADDR_SHORT_TIME;
-            else
-                pMatch->TimeToLive = BAC_ADDR_LONG_TIME;        /* Renewing existing entry */
-
-            pMatch->Flags &= ~BAC_ADDR_BIND_REQ;        /* Clear bind request flag just in case */
-            found = true;
-            break;
-        }
-        pMatch++;
-    }
+    pMatch = address_entry_find(device_id);
+    if (pMatch) {
+        address_entry_unlink(pMatch);
+        bacnet_address_copy(&pMatch->address, src);
+        pMatch->max_apdu = max_apdu;
+
+        /* Pick the right time to live */
+
+        if ((pMatch->Flags & BAC_ADDR_BIND_REQ) != 0)   /* Bind requested so long time */
+            pMatch->TimeToLive = BAC_ADDR_LONG_TIME;
+        else if ((pMatch->Flags & BAC_ADDR_STATIC) != 0)        /* Static already so make sure it never expires */
+            pMatch->TimeToLive = BAC_ADDR_FOREVER;
+        else if ((pMatch->Flags & BAC_ADDR_SHORT_TTL) != 0)     /* Opportunistic entry so leave on short fuse */
+            pMatch->TimeToLive = BAC_ADDR_SHORT_TIME;
+        else
+            pMatch->TimeToLive = BAC_ADDR_LONG_TIME;    /* Renewing existing entry */
 
-    /* new device - add to cache if there is room */
-    if (!found) {
-        pMatch = Address_Cache;
-        while (pMatch <= &Address_Cache[MAX_ADDRESS_CACHE - 1]) {
-            if ((pMatch->Flags & BAC_ADDR_IN_USE) == 0) {
-                pMatch->Flags = BAC_ADDR_IN_USE;
-                pMatch->device_id = device_id;
-                pMatch->max_apdu = max_apdu;
-                bacnet_address_copy(&pMatch->address, src);
-                pMatch->TimeToLive = BAC_ADDR_SHORT_TIME;       /* Opportunistic entry so leave on short fuse */
-                found = true;
-                break;
-            }
-            pMatch++;
-        }
+        pMatch->Flags &= ~BAC_ADDR_BIND_REQ;    /* Clear bind request flag just in case */
+        pMatch->Flags &= ~BAC_ADDR_UNCONFIRMED;
+        address_entry_link(pMatch);
+        address_lru_touch(pMatch);
+        return;
     }
 
-    /* See if we can squeeze it in */
-    if (!found) {
-        pMatch = address_remove_oldest();
-        if (pMatch != NULL) {
-            pMatch->Flags = BAC_ADDR_IN_USE;
-            pMatch->device_id = device_id;
-            pMatch->max_apdu = max_apdu;
-            bacnet_address_copy(&pMatch->address, src);
-            pMatch->TimeToLive = BAC_ADDR_SHORT_TIME;   /* Opportunistic entry so leave on short fuse */
-        }
+    /* new device - add to cache if there is room, or we can squeeze it in */
+    pMatch = address_entry_new();
+    if (pMatch != NULL) {
+        pMatch->Flags = BAC_ADDR_IN_USE;
+        pMatch->device_id = device_id;
+        pMatch->max_apdu = max_apdu;
+        bacnet_address_copy(&pMatch->address, src);
+        pMatch->TimeToLive = BAC_ADDR_SHORT_TIME;       /* Opportunistic entry so leave on short fuse */
+        address_entry_insert(pMatch);
     }
     return;
 }
@@ -593,53 +941,43 @@ bool address_device_bind_request(
     struct Address_Cache_Entry *pMatch;
 
     /* existing device - update address info if currently bound */
-    pMatch = Address_Cache;
-    while (pMatch <= &Address_Cache[MAX_ADDRESS_CACHE - 1]) {
-        if (((pMatch->Flags & BAC_ADDR_IN_USE) != 0) &&
-            (pMatch->device_id == device_id)) {
-            if ((pMatch->Flags & BAC_ADDR_BIND_REQ) == 0) {     /* Already bound */
-                found = true;
-                if (src) {
-                    bacnet_address_copy(src, &pMatch->address);
-                }
-                if (max_apdu) {
-                    *max_apdu = pMatch->max_apdu;
-                }
-                if (device_ttl) {
-                    *device_ttl = pMatch->TimeToLive;
-                }
-                if ((pMatch->Flags & BAC_ADDR_SHORT_TTL) != 0) {        /* Was picked up opportunistacilly */
-                    pMatch->Flags &= ~BAC_ADDR_SHORT_TTL;       /* Convert to normal entry  */
-                    pMatch->TimeToLive = BAC_ADDR_LONG_TIME;    /* And give it a decent time to live */
-                }
+    pMatch = address_entry_find(device_id);
+    if (pMatch) {
+        if ((pMatch->Flags & BAC_ADDR_BIND_REQ) == 0) { /* Already bound */
+            found = true;
+            if (src) {
+                bacnet_address_copy(src, &pMatch->address);
             }
-            return (found);     /* True if bound, false if bind request outstanding */
-        }
-        pMatch++;
-    }
-
-    /* Not there already so look for a free entry to put it in */
-    pMatch = Address_Cache;
-    while (pMatch <= &Address_Cache[MAX_ADDRESS_CACHE - 1]) {
-        if ((pMatch->Flags & (BAC_ADDR_IN_USE | BAC_ADDR_RESERVED)) == 0) {
-            /* In use and awaiting binding */
-            pMatch->Flags = (uint8_t) (BAC_ADDR_IN_USE | BAC_ADDR_BIND_REQ);
-            pMatch->device_id = device_id;
-            /* No point in leaving bind requests in for long haul */
-            pMatch->TimeToLive = BAC_ADDR_SHORT_TIME;
-            /* now would be a good time to do a Who-Is request */
-            return (false);
+            if (max_apdu) {
+                *max_apdu = pMatch->max_apdu;
+            }
+            if (device_ttl) {
+                *device_ttl = pMatch->TimeToLive;
+            }
+            if ((pMatch->Flags & BAC_ADDR_SHORT_TTL) != 0) {    /* Was picked up opportunistacilly */
+                pMatch->Flags &= ~BAC_ADDR_SHORT_TTL;   /* Convert to normal entry  */
+                pMatch->TimeToLive = BAC_ADDR_LONG_TIME;        /* And give it a decent time to live */
+            }
+            Address_Hits++;
+        } else {
+            Address_Misses++;
         }
-        pMatch++;
+        address_lru_touch(pMatch);
+        return (found); /* True if bound, false if bind request outstanding */
     }
+    Address_Misses++;
 
-    /* No free entries, See if we can squeeze it in by dropping an existing one */
-    pMatch = address_remove_oldest();
+    /* Not there already so look for a free entry to put it in,
+       or see if we can squeeze it in by dropping an existing one */
+    pMatch = address_entry_new();
     if (pMatch != NULL) {
+        /* In use and awaiting binding */
         pMatch->Flags = (uint8_t) (BAC_ADDR_IN_USE | BAC_ADDR_BIND_REQ);
         pMatch->device_id = device_id;
         /* No point in leaving bind requests in for long haul */
         pMatch->TimeToLive = BAC_ADDR_SHORT_TIME;
+        address_entry_insert(pMatch);
+        /* now would be a good time to do a Who-Is request */
     }
     return (false);
 }
@@ -662,22 +1000,20 @@ void address_add_binding(
     struct Address_Cache_Entry *pMatch;
 
     /* existing device or bind request - update address */
-    pMatch = Address_Cache;
-    while (pMatch <= &Address_Cache[MAX_ADDRESS_CACHE - 1]) {
-        if (((pMatch->Flags & BAC_ADDR_IN_USE) != 0) &&
-            (pMatch->device_id == device_id)) {
-            bacnet_address_copy(&pMatch->address, src);
-            pMatch->max_apdu = max_apdu;
-            /* Clear bind request flag in case it was set */
-            pMatch->Flags &= ~BAC_ADDR_BIND_REQ;
-            /* Only update TTL if not static */
-            if ((pMatch->Flags & BAC_ADDR_STATIC) == 0) {
-                /* and set it on a long fuse */
-                pMatch->TimeToLive = BAC_ADDR_LONG_TIME;
-            }
-            break;
+    pMatch = address_entry_find(device_id);
+    if (pMatch) {
+        address_entry_unlink(pMatch);
+        bacnet_address_copy(&pMatch->address, src);
+        pMatch->max_apdu = max_apdu;
+        /* Clear bind request flag in case it was set */
+        pMatch->Flags &= ~(BAC_ADDR_BIND_REQ | BAC_ADDR_UNCONFIRMED);
+        /* Only update TTL if not static */
+        if ((pMatch->Flags & BAC_ADDR_STATIC) == 0) {
+            /* and set it on a long fuse */
+            pMatch->TimeToLive = BAC_ADDR_LONG_TIME;
         }
-        pMatch++;
+        address_entry_link(pMatch);
+        address_lru_touch(pMatch);
     }
     return;
 }
@@ -692,7 +1028,7 @@ bool address_device_get_by_index(
     struct Address_Cache_Entry *pMatch;
     bool found = false; /* return value */
 
-    if (index < MAX_ADDRESS_CACHE) {
+    if (index < Address_Used) {
         pMatch = &Address_Cache[index];
         if ((pMatch->Flags & (BAC_ADDR_IN_USE | BAC_ADDR_BIND_REQ)) ==
             BAC_ADDR_IN_USE) {
@@ -727,20 +1063,8 @@ bool address_get_by_index(
 unsigned address_count(
     void)
 {
-    struct Address_Cache_Entry *pMatch;
-    unsigned count = 0; /* return value */
-
-    pMatch = Address_Cache;
-    while (pMatch <= &Address_Cache[MAX_ADDRESS_CACHE - 1]) {
-        /* Only count bound entries */
-        if ((pMatch->Flags & (BAC_ADDR_IN_USE | BAC_ADDR_BIND_REQ)) ==
-            BAC_ADDR_IN_USE)
-            count++;
-
-        pMatch++;
-    }
-
-    return count;
+    /* Only count bound entries */
+    return Address_Bound_Count;
 }
 
 /****************************************************************************
@@ -755,16 +1079,17 @@ int address_list_encode(
     int iLen = 0;
     struct Address_Cache_Entry *pMatch;
     BACNET_OCTET_STRING MAC_Address;
+    unsigned i = 0;
 
-    /* FIXME: I really shouild check the length remaining here but it is
-       fairly pointless until we have the true length remaining in
-       the packet to work with as at the moment it is just MAX_APDU */
-    unused_var(apdu_len);
     /* look for matching address */
-    pMatch = Address_Cache;
-    while (pMatch <= &Address_Cache[MAX_ADDRESS_CACHE - 1]) {
+    for (i = 0; i < Address_Used; i++) {
+        pMatch = &Address_Cache[i];
         if ((pMatch->Flags & (BAC_ADDR_IN_USE | BAC_ADDR_BIND_REQ)) ==
             BAC_ADDR_IN_USE) {
+            if ((iLen + ACACHE_MAX_ENC) > apdu_len) {
+                /* too many bindings for the APDU */
+                return BACNET_STATUS_ABORT;
+            }
             iLen +=
                 encode_application_object_id(&apdu[iLen], OBJECT_DEVICE,
                 pMatch->device_id);
@@ -785,7 +1110,6 @@ int address_list_encode(
                     encode_application_octet_string(&apdu[iLen], &MAC_Address);
             }
         }
-        pMatch++;
     }
 
     return (iLen);
@@ -814,8 +1138,6 @@ int address_list_encode(
  * oct string to give 17 bytes (the minimum possible is 5 + 2 + 3 = 10).    *
  ****************************************************************************/
 
-#define ACACHE_MAX_ENC 17       /* Maximum size of encoded cache entry, see above */
-
 int rr_address_list_encode(
     uint8_t * apdu,
     BACNET_READ_RANGE_DATA * pRequest)
@@ -945,7 +1267,7 @@ int rr_address_list_encode(
         pMatch++;
         pRequest->ItemCount++;  /* Chalk up another one for the response count */
 
-        while ((pMatch->Flags & (BAC_ADDR_IN_USE | BAC_ADDR_BIND_REQ)) != BAC_ADDR_IN_USE)      /* Find next bound entry */
+        while ((uiIndex <= uiTarget) && ((pMatch->Flags & (BAC_ADDR_IN_USE | BAC_ADDR_BIND_REQ)) != BAC_ADDR_IN_USE))  /* Find next bound entry */
             pMatch++;
     }
 
@@ -971,22 +1293,260 @@ void address_cache_timer(
     uint16_t uSeconds)
 {       /* Approximate number of seconds since last call to this function */
     struct Address_Cache_Entry *pMatch;
+    unsigned i = 0;
 
-    pMatch = Address_Cache;
-    while (pMatch <= &Address_Cache[MAX_ADDRESS_CACHE - 1]) {
-        if (((pMatch->Flags & (BAC_ADDR_IN_USE | BAC_ADDR_RESERVED)) != 0)
+    for (i = 0; i < Address_Used; i++) {
+        pMatch = &Address_Cache[i];
+        if (((pMatch->Flags & BAC_ADDR_IN_USE) != 0)
             && ((pMatch->Flags & BAC_ADDR_STATIC) == 0)) {      /* Check all entries holding a slot except statics */
             if (pMatch->TimeToLive >= uSeconds)
                 pMatch->TimeToLive -= uSeconds;
             else
-                pMatch->Flags = 0;
+                address_entry_free(pMatch);
         }
+    }
+}
 
-        pMatch++;
+
+
+#ifdef BACNET_ADDRESS_CACHE_FILE
+/* Snapshot file format, from the least to the most recently used:
+; saved SECONDS-SINCE-EPOCH
+DeviceID MAC SNET SADR MAX-APDU SEGMENTATION TTL
+55555 c0:a8:00:18:ba:c0 26001 19 480 3 86000
+where an empty MAC or SADR is -
+*/
+static void address_hex_write(
+    FILE * pFile,
+    uint8_t * adr,
+    uint8_t len)
+{
+    uint8_t i = 0;
+
+    if (len == 0) {
+        fputc('-', pFile);
+    }
+    for (i = 0; i < len; i++) {
+        fprintf(pFile, (i == 0) ? "%02x" : ":%02x", adr[i]);
+    }
+}
+
+/* returns false if it is not hex bytes separated by colons */
+static bool address_hex_read(
+    const char *arg,
+    uint8_t * adr,
+    uint8_t * len)
+{
+    unsigned long value = 0;
+    char *end = NULL;
+    uint8_t count = 0;
+
+    if (strcmp(arg, "-") == 0) {
+        *len = 0;
+        return true;
+    }
+    for (;;) {
+        value = strtoul(arg, &end, 16);
+        if ((end == arg) || (value > 0xFF) || (count >= MAX_MAC_LEN)) {
+            return false;
+        }
+        adr[count++] = (uint8_t) value;
+        if (*end == 0) {
+            break;
+        }
+        if (*end != ':') {
+            return false;
+        }
+        arg = end + 1;
+    }
+    *len = count;
+
+    return true;
+}
+
+bool address_snapshot_changed(
+    void)
+{
+    return Address_Snapshot_Changed;
+}
+
+/* writes the file to the disk, not only to the system's cache;
+   returns 0 if written */
+static int address_file_sync(
+    FILE * pFile)
+{
+    if (fflush(pFile) != 0) {
+        return -1;
+    }
+#if defined(_WIN32)
+    return _commit(_fileno(pFile));
+#else
+    return fsync(fileno(pFile));
+#endif
+}
+
+/* Write the learned bindings, but not the static ones, to the file.
+   It is written to a temporary file and synced to the disk first,
+   then renamed, so a power failure leaves either the old or the new
+   snapshot.
+   Returns the number of bindings written, or -1 on error. */
+int address_snapshot_save(
+    const char *pFilename)
+{
+    struct Address_Cache_Entry *pMatch;
+    FILE *pFile = NULL;
+    char tmp_filename[256] = { "" };
+    uint16_t next = 0;
+    int count = 0;
+
+    if (strlen(pFilename) + 5 > sizeof(tmp_filename)) {
+        return -1;
+    }
+    strcpy(tmp_filename, pFilename);
+    strcat(tmp_filename, ".tmp");
+    pFile = fopen(tmp_filename, "w");
+    if (!pFile) {
+        return -1;
+    }
+    fprintf(pFile, "; saved %lu\n", (unsigned long) time(NULL));
+    for (next = Address_LRU_Tail; next; next = pMatch->LRUPrev) {
+        pMatch = &Address_Cache[next - 1];
+        if ((pMatch->Flags & (BAC_ADDR_BIND_REQ | BAC_ADDR_STATIC)) != 0) {
+            continue;
+        }
+        fprintf(pFile, "%lu ", (unsigned long) pMatch->device_id);
+        address_hex_write(pFile, pMatch->address.mac,
+            pMatch->address.mac_len);
+        fprintf(pFile, " %u ", (unsigned) pMatch->address.net);
+        address_hex_write(pFile, pMatch->address.adr, pMatch->address.len);
+        fprintf(pFile, " %u %u %lu\n", pMatch->max_apdu,
+            (unsigned) pMatch->segmentation,
+            (unsigned long) pMatch->TimeToLive);
+        count++;
+    }
+    if (address_file_sync(pFile) != 0) {
+        fclose(pFile);
+        remove(tmp_filename);
+        return -1;
     }
+    if (fclose(pFile) != 0) {
+        remove(tmp_filename);
+        return -1;
+    }
+    if (rename(tmp_filename, pFilename) != 0) {
+        /* some systems won't rename over an existing file */
+        remove(pFilename);
+        if (rename(tmp_filename, pFilename) != 0) {
+            remove(tmp_filename);
+            return -1;
+        }
+    }
+    Address_Snapshot_Changed = false;
+
+    return count;
 }
 
+/* Load the bindings of a snapshot, less the time since it was saved.
+   They can be used at once, and address_revalidate_next() returns them
+   until an I-Am is heard from the device.  A binding already in the
+   cache, like a static one, is kept.
+   Returns the number of bindings loaded, or -1 if there is no file. */
+int address_snapshot_load(
+    const char *pFilename)
+{
+    struct Address_Cache_Entry *pMatch;
+    FILE *pFile = NULL;
+    char line[256] = { "" };
+    char mac_string[80] = { "" };
+    char sadr_string[80] = { "" };
+    unsigned long saved = 0;
+    unsigned long elapsed = 0;
+    unsigned long device_id = 0;
+    unsigned long ttl = 0;
+    unsigned snet = 0;
+    unsigned max_apdu = 0;
+    unsigned segmentation = 0;
+    BACNET_ADDRESS src = { 0 };
+    unsigned long now = (unsigned long) time(NULL);
+    int count = 0;
 
+    pFile = fopen(pFilename, "r");
+    if (!pFile) {
+        return -1;
+    }
+    while (fgets(line, (int) sizeof(line), pFile) != NULL) {
+        if (line[0] == ';') {
+            if ((sscanf(line, "; saved %lu", &saved) == 1) &&
+                (now > saved)) {
+                elapsed = now - saved;
+            }
+            continue;
+        }
+        if (sscanf(line, "%7lu %79s %5u %79s %5u %1u %10lu", &device_id,
+                &mac_string[0], &snet, &sadr_string[0], &max_apdu,
+                &segmentation, &ttl) != 7) {
+            continue;
+        }
+        if ((device_id >= BACNET_MAX_INSTANCE) || (snet > 65535) ||
+            (segmentation >= MAX_BACNET_SEGMENTATION) ||
+            (ttl <= elapsed) || (device_id == Own_Device_ID) ||
+            !address_hex_read(mac_string, src.mac, &src.mac_len) ||
+            !address_hex_read(sadr_string, src.adr, &src.len)) {
+            continue;
+        }
+        src.net = (uint16_t) snet;
+        if (address_entry_find((uint32_t) device_id)) {
+            continue;
+        }
+        pMatch = address_entry_new();
+        if (!pMatch) {
+            break;
+        }
+        pMatch->Flags = BAC_ADDR_IN_USE | BAC_ADDR_UNCONFIRMED;
+        pMatch->device_id = (uint32_t) device_id;
+        pMatch->max_apdu = max_apdu;
+        pMatch->segmentation = (uint8_t) segmentation;
+        bacnet_address_copy(&pMatch->address, &src);
+        pMatch->TimeToLive = (uint32_t) (ttl - elapsed);
+        address_entry_insert(pMatch);
+        count++;
+    }
+    fclose(pFile);
+    Address_Revalidate_Index = 0;
+    /* what was loaded is what the file already holds */
+    Address_Snapshot_Changed = false;
+
+    return count;
+}
+#endif
+
+/* The next binding loaded from a snapshot, and not heard from since,
+   for the caller to check with a Who-Is sent to the address.  Each
+   one is returned once, and expires after BAC_ADDR_REVALIDATE_TIME
+   unless its I-Am comes back. */
+bool address_revalidate_next(
+    uint32_t * device_id,
+    BACNET_ADDRESS * src)
+{
+    struct Address_Cache_Entry *pMatch;
+
+    while (Address_Revalidate_Index < Address_Used) {
+        pMatch = &Address_Cache[Address_Revalidate_Index];
+        Address_Revalidate_Index++;
+        if ((pMatch->Flags & (BAC_ADDR_IN_USE | BAC_ADDR_BIND_REQ |
+                    BAC_ADDR_UNCONFIRMED)) ==
+            (BAC_ADDR_IN_USE | BAC_ADDR_UNCONFIRMED)) {
+            *device_id = pMatch->device_id;
+            bacnet_address_copy(src, &pMatch->address);
+            if (pMatch->TimeToLive > BAC_ADDR_REVALIDATE_TIME) {
+                pMatch->TimeToLive = BAC_ADDR_REVALIDATE_TIME;
+            }
+            return true;
+        }
+    }
+
+    return false;
+}
 
 #ifdef TEST
 #include <assert.h>
@@ -1008,8 +1568,10 @@ static void set_address(
     for (i = 0; i < MAX_MAC_LEN; i++) {
         dest->adr[i] = index;
     }
+    dest->adr[1] = index >> 8;
 }
 
+#ifdef BACNET_ADDRESS_CACHE_FILE
 static void set_file_address(
     const char *pFilename,
     uint32_t device_id,
@@ -1089,8 +1651,9 @@ void testAddressFile(
             &test_address));
     ct_test(pTest, test_max_apdu == max_apdu);
     ct_test(pTest, bacnet_address_same(&test_address, &src));
-
+    remove(Address_Cache_Filename);
 }
+#endif
 
 void testAddress(
     Test * pTest)
@@ -1141,6 +1704,229 @@ void testAddress(
     }
 }
 
+#if ADDRESS_CACHE_DYNAMIC
+/* the cache grows from nothing, and finds the entries after a rehash */
+void testAddressGrow(
+    Test * pTest)
+{
+    BACNET_ADDRESS src = { 0 };
+    BACNET_ADDRESS test_address = { 0 };
+    uint32_t device_id = 0;
+    uint32_t evictions = 0;
+    uint32_t test_evictions = 0;
+    unsigned max_apdu = 0;
+    unsigned capacity = 0;
+    unsigned grown = 0;
+    unsigned i = 0;
+    unsigned j = 0;
+
+    free(Address_Cache);
+    free(Address_Device_Hash);
+    free(Address_MAC_Hash);
+    Address_Cache = NULL;
+    Address_Device_Hash = NULL;
+    Address_MAC_Hash = NULL;
+    Address_Capacity = 0;
+    Address_Hash_Size = 0;
+    address_init();
+    set_address(0, &src);
+    ct_test(pTest, !address_get_by_device(0, &max_apdu, &test_address));
+    ct_test(pTest, !address_get_device_id(&src, &device_id));
+    for (i = 0; i < MAX_ADDRESS_CACHE; i++) {
+        capacity = Address_Capacity;
+        set_address(i, &src);
+        address_add(i, 480, &src);
+        if (Address_Capacity == capacity) {
+            continue;
+        }
+        grown++;
+        if (capacity == 0) {
+            ct_test(pTest, Address_Capacity == ADDRESS_CACHE_INITIAL);
+        } else if ((capacity * 2) > MAX_ADDRESS_CACHE) {
+            ct_test(pTest, Address_Capacity == MAX_ADDRESS_CACHE);
+        } else {
+            ct_test(pTest, Address_Capacity == (capacity * 2));
+        }
+        ct_test(pTest, Address_Hash_Size >= Address_Capacity);
+        ct_test(pTest, (Address_Hash_Size & (Address_Hash_Size - 1)) == 0);
+        /* the ones added before are in the new buckets */
+        for (j = 0; j <= i; j++) {
+            set_address(j, &src);
+            ct_test(pTest, address_get_device_id(&src, &device_id));
+            ct_test(pTest, device_id == j);
+            ct_test(pTest, address_get_by_device(j, &max_apdu,
+                    &test_address));
+            ct_test(pTest, bacnet_address_same(&test_address, &src));
+        }
+    }
+    ct_test(pTest, grown > 1);
+    ct_test(pTest, address_count() == MAX_ADDRESS_CACHE);
+    ct_test(pTest, Address_Capacity == MAX_ADDRESS_CACHE);
+    /* full, so the next one takes the place of the oldest */
+    address_cache_stats(NULL, NULL, &evictions);
+    set_address(MAX_ADDRESS_CACHE, &src);
+    address_add(MAX_ADDRESS_CACHE, 480, &src);
+    ct_test(pTest, Address_Capacity == MAX_ADDRESS_CACHE);
+    ct_test(pTest, address_count() == MAX_ADDRESS_CACHE);
+    ct_test(pTest, address_get_by_device(MAX_ADDRESS_CACHE, &max_apdu,
+            &test_address));
+    ct_test(pTest, !address_get_by_device(0, &max_apdu, &test_address));
+    address_cache_stats(NULL, NULL, &test_evictions);
+    ct_test(pTest, test_evictions == (evictions + 1));
+    address_init();
+}
+#endif
+
+void testAddressEviction(
+    Test * pTest)
+{
+    unsigned i;
+    BACNET_ADDRESS src;
+    unsigned max_apdu = 480;
+    BACNET_ADDRESS test_address;
+    uint32_t test_device_id = 0;
+    unsigned test_max_apdu = 0;
+    uint32_t hits = 0, misses = 0, evictions = 0;
+
+    address_init();
+    for (i = 0; i < MAX_ADDRESS_CACHE; i++) {
+        set_address(i, &src);
+        address_add(i, max_apdu, &src);
+    }
+    ct_test(pTest, address_count() == MAX_ADDRESS_CACHE);
+    /* the oldest entry was used again, and the next one is static */
+    ct_test(pTest, address_get_by_device(0, &test_max_apdu, &test_address));
+    address_set_device_TTL(1, 0, true);
+    address_cache_stats(&hits, &misses, &evictions);
+    ct_test(pTest, hits == 1);
+    ct_test(pTest, misses == 0);
+    ct_test(pTest, evictions == 0);
+    /* so the third one is dropped to make room */
+    set_address(MAX_ADDRESS_CACHE, &src);
+    address_add(MAX_ADDRESS_CACHE, max_apdu, &src);
+    ct_test(pTest, address_count() == MAX_ADDRESS_CACHE);
+    ct_test(pTest, address_get_by_device(0, &test_max_apdu, &test_address));
+    ct_test(pTest, address_get_by_device(1, &test_max_apdu, &test_address));
+    ct_test(pTest, !address_get_by_device(2, &test_max_apdu, &test_address));
+    ct_test(pTest, address_get_by_device(MAX_ADDRESS_CACHE, &test_max_apdu,
+            &test_address));
+    ct_test(pTest, bacnet_address_same(&test_address, &src));
+    set_address(2, &src);
+    ct_test(pTest, !address_get_device_id(&src, &test_device_id));
+    set_address(MAX_ADDRESS_CACHE, &src);
+    ct_test(pTest, address_get_device_id(&src, &test_device_id));
+    ct_test(pTest, test_device_id == MAX_ADDRESS_CACHE);
+    address_cache_stats(&hits, &misses, &evictions);
+    ct_test(pTest, hits == 5);
+    ct_test(pTest, misses == 2);
+    ct_test(pTest, evictions == 1);
+    /* a bind request takes the place of the least recently used */
+    ct_test(pTest, !address_bind_request(MAX_ADDRESS_CACHE + 1,
+            &test_max_apdu, &test_address));
+    ct_test(pTest, !address_get_by_device(3, &test_max_apdu, &test_address));
+    ct_test(pTest, address_count() == (MAX_ADDRESS_CACHE - 1));
+    set_address(MAX_ADDRESS_CACHE + 1, &src);
+    address_add_binding(MAX_ADDRESS_CACHE + 1, max_apdu, &src);
+    ct_test(pTest, address_bind_request(MAX_ADDRESS_CACHE + 1,
+            &test_max_apdu, &test_address));
+    ct_test(pTest, bacnet_address_same(&test_address, &src));
+    ct_test(pTest, address_count() == MAX_ADDRESS_CACHE);
+    /* expired entries are removed, except the static one */
+    address_cache_timer(UINT16_MAX);
+    address_cache_timer(UINT16_MAX);
+    ct_test(pTest, address_count() == 1);
+    ct_test(pTest, address_get_by_device(1, &test_max_apdu, &test_address));
+    address_remove_device(1);
+    ct_test(pTest, address_count() == 0);
+    address_init();
+}
+
+#ifdef BACNET_ADDRESS_CACHE_FILE
+void testAddressSnapshot(
+    Test * pTest)
+{
+    const char *filename = "address_snapshot";
+    BACNET_ADDRESS src;
+    BACNET_ADDRESS test_address;
+    uint32_t device_id = 0;
+    unsigned test_max_apdu = 0;
+    uint8_t segmentation = 0;
+    unsigned i;
+
+    address_init();
+    for (i = 0; i < 10; i++) {
+        set_address(i, &src);
+        address_add(i, 480 + i, &src);
+        address_set_device_segmentation(i, SEGMENTATION_BOTH);
+    }
+    /* a remote device, and a local one with a 1 octet MAC */
+    set_address(10, &src);
+    src.len = 1;
+    address_add(10, 50, &src);
+    src.net = 0;
+    src.len = 0;
+    src.mac_len = 1;
+    address_add(11, 50, &src);
+    /* neither bind requests nor static bindings are saved */
+    address_bind_request(12, &test_max_apdu, &test_address);
+    address_set_device_TTL(0, 0, true);
+    ct_test(pTest, address_snapshot_changed());
+    ct_test(pTest, address_snapshot_save(filename) == 11);
+    ct_test(pTest, !address_snapshot_changed());
+    ct_test(pTest, !address_revalidate_next(&device_id, &test_address));
+
+    address_init();
+    ct_test(pTest, address_snapshot_load(filename) == 11);
+    ct_test(pTest, address_count() == 11);
+    ct_test(pTest, !address_get_by_device(0, &test_max_apdu, &test_address));
+    for (i = 1; i < 10; i++) {
+        set_address(i, &src);
+        ct_test(pTest, address_get_by_device(i, &test_max_apdu,
+                &test_address));
+        ct_test(pTest, test_max_apdu == (480 + i));
+        ct_test(pTest, bacnet_address_same(&test_address, &src));
+        ct_test(pTest, address_get_device_segmentation(i, &segmentation));
+        ct_test(pTest, segmentation == SEGMENTATION_BOTH);
+    }
+    set_address(10, &src);
+    src.len = 1;
+    ct_test(pTest, address_get_device_id(&src, &device_id));
+    ct_test(pTest, device_id == 10);
+    src.net = 0;
+    src.len = 0;
+    src.mac_len = 1;
+    ct_test(pTest, address_get_device_id(&src, &device_id));
+    ct_test(pTest, device_id == 11);
+    ct_test(pTest, address_get_device_segmentation(11, &segmentation));
+    ct_test(pTest, segmentation == SEGMENTATION_NONE);
+    ct_test(pTest, !address_get_device_segmentation(12, &segmentation));
+    /* the bindings are checked, except the ones heard from since */
+    set_address(5, &src);
+    address_add_binding(5, 480 + 5, &src);
+    for (i = 0; address_revalidate_next(&device_id, &test_address); i++) {
+        ct_test(pTest, device_id != 5);
+        ct_test(pTest, address_get_device_id(&test_address, &device_id));
+    }
+    ct_test(pTest, i == 10);
+    /* the ones that did not answer expire soon */
+    address_cache_timer(BAC_ADDR_REVALIDATE_TIME);
+    ct_test(pTest, address_count() == 11);
+    address_cache_timer(1);
+    ct_test(pTest, address_count() == 1);
+    ct_test(pTest, address_get_by_device(5, &test_max_apdu, &test_address));
+    /* the bindings that are already known stay */
+    address_init();
+    set_address(20, &src);
+    address_add(1, 50, &src);
+    ct_test(pTest, address_snapshot_load(filename) == 10);
+    ct_test(pTest, address_get_by_device(1, &test_max_apdu, &test_address));
+    ct_test(pTest, bacnet_address_same(&test_address, &src));
+    remove(filename);
+    ct_test(pTest, address_snapshot_load(filename) == -1);
+    address_init();
+}
+#endif
+
 #ifdef TEST_ADDRESS
 int main(
     void)
@@ -1152,8 +1938,18 @@ int main(
     /* individual tests */
     rc = ct_addTestFunction(pTest, testAddress);
     assert(rc);
+    rc = ct_addTestFunction(pTest, testAddressEviction);
+    assert(rc);
+#if ADDRESS_CACHE_DYNAMIC
+    rc = ct_addTestFunction(pTest, testAddressGrow);
+    assert(rc);
+#endif
+#ifdef BACNET_ADDRESS_CACHE_FILE
     rc = ct_addTestFunction(pTest, testAddressFile);
     assert(rc);
+    rc = ct_addTestFunction(pTest, testAddressSnapshot);
+    assert(rc);
+#endif
 
 
     ct_setStream(pTest, stdout);
@@ -89,7 +89,9 @@ static BACNET_SERVICES_SUPPORTED
     SERVICE_SUPPORTED_READ_RANGE,
     SERVICE_SUPPORTED_LIFE_SAFETY_OPERATION,
     SERVICE_SUPPORTED_SUBSCRIBE_COV_PROPERTY,
-    SERVICE_SUPPORTED_GET_EVENT_INFORMATION
+    SERVICE_SUPPORTED_GET_EVENT_INFORMATION,
+    SERVICE_SUPPORTED_SUBSCRIBE_COV_PROPERTY_MULTIPLE,
+    SERVICE_SUPPORTED_CONFIRMED_COV_NOTIFICATION_MULTIPLE
 };
 
 /* a simple table for crossing the services supported */
@@ -104,7 +106,9 @@ static BACNET_SERVICES_SUPPORTED
     SERVICE_SUPPORTED_TIME_SYNCHRONIZATION,
     SERVICE_SUPPORTED_WHO_HAS,
     SERVICE_SUPPORTED_WHO_IS,
-    SERVICE_SUPPORTED_UTC_TIME_SYNCHRONIZATION
+    SERVICE_SUPPORTED_UTC_TIME_SYNCHRONIZATION,
+    SERVICE_SUPPORTED_WRITE_GROUP,
+    SERVICE_SUPPORTED_UNCONFIRMED_COV_NOTIFICATION_MULTIPLE
 };
 
 /* Confirmed Function Handlers */
@@ -242,6 +246,8 @@ void apdu_set_confirmed_simple_ack_handler(
         case SERVICE_CONFIRMED_SUBSCRIBE_COV:
         case SERVICE_CONFIRMED_SUBSCRIBE_COV_PROPERTY:
         case SERVICE_CONFIRMED_LIFE_SAFETY_OPERATION:
+        case SERVICE_CONFIRMED_SUBSCRIBE_COV_PROPERTY_MULTIPLE:
+        case SERVICE_CONFIRMED_COV_NOTIFICATION_MULTIPLE:
             /* Object Access Services */
         case SERVICE_CONFIRMED_ADD_LIST_ELEMENT:
         case SERVICE_CONFIRMED_REMOVE_LIST_ELEMENT:
@@ -526,7 +532,7 @@ void apdu_handler(
                                 Confirmed_ACK_Function[service_choice]) (src,
                                 invoke_id);
                         }
-                        tsm_free_invoke_id(invoke_id);
+                        tsm_free_invoke_id_peer(src, invoke_id);
                         break;
                     default:
                         break;
@@ -546,6 +552,15 @@ void apdu_handler(
                 service_choice = apdu[len++];
                 service_request = &apdu[len];
                 service_request_len = apdu_len - (uint16_t) len;
+                if (service_ack_data.segmented_message) {
+                    /* the TSM collects the segments, and gives
+                       the complete ACK with the last one */
+                    if (!tsm_segmented_confirmation(src, &service_ack_data,
+                            service_choice, &service_request,
+                            &service_request_len)) {
+                        break;
+                    }
+                }
                 switch (service_choice) {
                     case SERVICE_CONFIRMED_GET_ALARM_SUMMARY:
                     case SERVICE_CONFIRMED_GET_ENROLLMENT_SUMMARY:
@@ -570,16 +585,27 @@ void apdu_handler(
                                 (service_request, service_request_len, src,
                                 &service_ack_data);
                         }
-                        tsm_free_invoke_id(invoke_id);
+                        tsm_free_invoke_id_peer(src, invoke_id);
                         break;
                     default:
                         break;
                 }
                 break;
             case PDU_TYPE_SEGMENT_ACK:
-                /* FIXME: what about a denial of service attack here?
-                   we could check src to see if that matched the tsm */
-                tsm_free_invoke_id(invoke_id);
+                if (apdu_len < 4) {
+                    break;
+                }
+                server = apdu[0] & 0x01;
+                invoke_id = apdu[1];
+                if (server) {
+                    /* we don't send segmented requests */
+                    tsm_free_invoke_id_peer(src, invoke_id);
+                } else {
+                    /* the client acknowledges our segmented response,
+                       which is matched by src and invoke ID */
+                    tsm_segment_ack_handler(src, invoke_id, apdu[2], apdu[3],
+                        (apdu[0] & BIT(1)) ? true : false);
+                }
                 break;
             case PDU_TYPE_ERROR:
                 invoke_id = apdu[1];
@@ -618,22 +644,26 @@ void apdu_handler(
                             (BACNET_ERROR_CLASS) error_class,
                             (BACNET_ERROR_CODE) error_code);
                 }
-                tsm_free_invoke_id(invoke_id);
+                tsm_free_invoke_id_peer(src, invoke_id);
                 break;
             case PDU_TYPE_REJECT:
                 invoke_id = apdu[1];
                 reason = apdu[2];
                 if (Reject_Function)
                     Reject_Function(src, invoke_id, reason);
-                tsm_free_invoke_id(invoke_id);
+                tsm_free_invoke_id_peer(src, invoke_id);
                 break;
             case PDU_TYPE_ABORT:
                 server = apdu[0] & 0x01;
                 invoke_id = apdu[1];
                 reason = apdu[2];
+                if (!server) {
+                    /* the client aborts our segmented response */
+                    tsm_segmented_response_abort(src, invoke_id);
+                }
                 if (Abort_Function)
                     Abort_Function(src, invoke_id, reason, server);
-                tsm_free_invoke_id(invoke_id);
+                tsm_free_invoke_id_peer(src, invoke_id);
                 break;
             default:
                 break;
@@ -75,6 +75,10 @@ INDTEXT_DATA bacnet_confirmed_service_names[] = {
     {SERVICE_CONFIRMED_LIFE_SAFETY_OPERATION, "Life-Safety_Operation"},
     {SERVICE_CONFIRMED_SUBSCRIBE_COV_PROPERTY, "Subscribe-COV-Property"},
     {SERVICE_CONFIRMED_GET_EVENT_INFORMATION, "Get-Event-Information"},
+    {SERVICE_CONFIRMED_SUBSCRIBE_COV_PROPERTY_MULTIPLE,
+        "Subscribe-COV-Property-Multiple"},
+    {SERVICE_CONFIRMED_COV_NOTIFICATION_MULTIPLE,
+        "COV-Notification-Multiple"},
     {0, NULL}
 };
 
@@ -110,6 +114,9 @@ INDTEXT_DATA bacnet_unconfirmed_service_names[] = {
     {SERVICE_UNCONFIRMED_WRITE_GROUP,
         "Write-Group"}
     ,
+    {SERVICE_UNCONFIRMED_COV_NOTIFICATION_MULTIPLE,
+        "COV-Notification-Multiple"}
+    ,
     {0, NULL}
 };
 
@@ -52,6 +52,14 @@ static uint16_t BIP_Port = 0;   /* this will force initialization in demos */
 static struct in_addr BIP_Address;
 /* Broadcast Address - stored in network byte order */
 static struct in_addr BIP_Broadcast_Address;
+/* optional descriptor that is waited on together with the socket */
+static int BIP_Wait_Fd = -1;
+static void (*BIP_Wait_Handler) (int fd);
+/* optional queue that receive threads fill from the socket */
+static int BIP_Queue_Fd = -1;
+static bip_queue_get_function BIP_Queue_Get;
+/* optional function that sends to many destinations in one call */
+static bip_send_multi_function BIP_Send_Multi;
 
 /** Setter for the BACnet/IP socket handle.
  *
@@ -79,6 +87,138 @@ bool bip_valid(
     return (BIP_Socket != -1);
 }
 
+/** Set a descriptor to wait on in bip_receive() along with the socket,
+ * so that the main loop wakes up for other events without polling.
+ *
+ * @param fd [in] The descriptor, or -1 for none.
+ * @param handler [in] Called with fd when it is readable.
+ */
+void bip_set_wait_fd(
+    int fd,
+    void (*handler) (int fd))
+{
+    BIP_Wait_Fd = fd;
+    BIP_Wait_Handler = handler;
+}
+
+/** Add the wait descriptor, if any, to a select() read set.
+ *
+ * @param read_fds [in,out] The read set.
+ * @param max [in] The highest descriptor in the set.
+ * @return The highest descriptor in the set.
+ */
+int bip_wait_fd_set(
+    fd_set * read_fds,
+    int max)
+{
+    if (BIP_Wait_Fd >= 0) {
+        FD_SET(BIP_Wait_Fd, read_fds);
+        if (BIP_Wait_Fd > max)
+            max = BIP_Wait_Fd;
+    }
+    return max;
+}
+
+/** Call the wait handler if its descriptor is readable after select().
+ *
+ * @param read_fds [in] The read set returned by select().
+ */
+void bip_wait_fd_handle(
+    fd_set * read_fds)
+{
+    if ((BIP_Wait_Fd >= 0) && FD_ISSET(BIP_Wait_Fd, read_fds) &&
+        BIP_Wait_Handler) {
+        BIP_Wait_Handler(BIP_Wait_Fd);
+    }
+}
+
+/** Receive from a queue instead of the socket, for ports that drain the
+ * socket in other threads.  The get function returns a packet from the
+ * queue, or 0 when it is empty; fd is readable when packets were queued.
+ *
+ * @param fd [in] The descriptor to wait on, or -1 for none.
+ * @param get [in] The function that takes a packet off the queue,
+ *  or NULL to receive from the socket again.
+ */
+void bip_set_receive_queue(
+    int fd,
+    bip_queue_get_function get)
+{
+    BIP_Queue_Fd = fd;
+    BIP_Queue_Get = get;
+}
+
+/** Wait for a BACnet/IP packet, with the BVLC header, from the socket
+ * or from the receive queue.  The wait descriptor is handled as well.
+ *
+ * @param mpdu [out] The buffer for the packet.
+ * @param max_mpdu [in] Size of the mpdu[] buffer.
+ * @param sin [out] The address the packet came from.
+ * @param timeout [in] The number of milliseconds to wait for a packet.
+ * @return The number of octets received, or zero if none.
+ */
+int bip_receive_mpdu(
+    uint8_t * mpdu,
+    uint16_t max_mpdu,
+    struct sockaddr_in *sin,
+    unsigned timeout)
+{
+    int received_bytes = 0;
+    fd_set read_fds;
+    int max = 0;
+    int fd = BIP_Socket;
+    struct timeval select_timeout;
+    socklen_t sin_len = sizeof(struct sockaddr_in);
+
+    if (BIP_Queue_Get) {
+        received_bytes = BIP_Queue_Get(mpdu, max_mpdu, sin);
+        if (received_bytes > 0) {
+            if (BIP_Wait_Fd < 0) {
+                return received_bytes;
+            }
+            /* only look at the wait descriptor */
+            timeout = 0;
+        }
+        fd = BIP_Queue_Fd;
+    }
+    if (fd < 0) {
+        return received_bytes;
+    }
+    /* we could just use a non-blocking socket, but that consumes all
+       the CPU time.  We can use a timeout; it is only supported as
+       a select. */
+    if (timeout >= 1000) {
+        select_timeout.tv_sec = timeout / 1000;
+        select_timeout.tv_usec =
+            1000 * (timeout - select_timeout.tv_sec * 1000);
+    } else {
+        select_timeout.tv_sec = 0;
+        select_timeout.tv_usec = 1000 * timeout;
+    }
+    FD_ZERO(&read_fds);
+    FD_SET(fd, &read_fds);
+    max = bip_wait_fd_set(&read_fds, fd);
+    /* see if there is a packet for us */
+    if (select(max + 1, &read_fds, NULL, NULL, &select_timeout) <= 0) {
+        return received_bytes;
+    }
+    bip_wait_fd_handle(&read_fds);
+    if ((received_bytes > 0) || !FD_ISSET(fd, &read_fds)) {
+        return received_bytes;
+    }
+    if (BIP_Queue_Get) {
+        return BIP_Queue_Get(mpdu, max_mpdu, sin);
+    }
+    received_bytes =
+        recvfrom(BIP_Socket, (char *) &mpdu[0], max_mpdu, 0,
+        (struct sockaddr *) sin, &sin_len);
+    if (received_bytes < 0) {
+        return 0;
+    }
+
+    return received_bytes;
+}
+
 void bip_set_addr(
     uint32_t net_address)
 {       /* in network byte order */
@@ -205,6 +345,59 @@ int bip_send_pdu(
     return bytes_sent;
 }
 
+/** Set the function that sends one packet to many destinations, for
+ * ports that can do it in fewer system calls than one per destination.
+ *
+ * @param send [in] The function, or NULL to call sendto() for each one.
+ */
+void bip_set_send_multi(
+    bip_send_multi_function send)
+{
+    BIP_Send_Multi = send;
+}
+
+/** Send one packet, with its BVLC header, to many destinations.
+ *
+ * @param dest [in] The destination addresses, in network byte order.
+ * @param status [out] For each destination, the number of bytes sent,
+ *  or -1 if the send failed.
+ * @param count [in] The number of destinations.
+ * @param mtu [in] The packet.
+ * @param mtu_len [in] The number of bytes in the packet.
+ * @return The number of destinations the packet was sent to.
+ */
+unsigned bip_send_mpdu_multi(
+    struct sockaddr_in *dest,
+    int *status,
+    unsigned count,
+    uint8_t * mtu,
+    uint16_t mtu_len)
+{
+    unsigned sent = 0;
+    unsigned i = 0;
+
+    if (BIP_Socket < 0) {
+        for (i = 0; i < count; i++) {
+            status[i] = -1;
+        }
+        return 0;
+    }
+    if (BIP_Send_Multi) {
+        return BIP_Send_Multi(dest, status, count, mtu, mtu_len);
+    }
+    for (i = 0; i < count; i++) {
+        dest[i].sin_family = AF_INET;
+        status[i] =
+            sendto(BIP_Socket, (char *) mtu, mtu_len, 0,
+            (struct sockaddr *) &dest[i], sizeof(struct sockaddr));
+        if (status[i] >= 0) {
+            sent++;
+        }
+    }
+
+    return sent;
+}
+
 /** Implementation of the receive() function for BACnet/IP; receives one
  * packet, verifies its BVLC header, and removes the BVLC header from
  * the PDU data before returning.
@@ -224,11 +417,7 @@ uint16_t bip_receive(
 {
     int received_bytes = 0;
     uint16_t pdu_len = 0;       /* return value */
-    fd_set read_fds;
-    int max = 0;
-    struct timeval select_timeout;
     struct sockaddr_in sin = { 0 };
-    socklen_t sin_len = sizeof(sin);
     uint16_t i = 0;
     int function = 0;
 
@@ -236,27 +425,7 @@ uint16_t bip_receive(
     if (BIP_Socket < 0)
         return 0;
 
-    /* we could just use a non-blocking socket, but that consumes all
-       the CPU time.  We can use a timeout; it is only supported as
-       a select. */
-    if (timeout >= 1000) {
-        select_timeout.tv_sec = timeout / 1000;
-        select_timeout.tv_usec =
-            1000 * (timeout - select_timeout.tv_sec * 1000);
-    } else {
-        select_timeout.tv_sec = 0;
-        select_timeout.tv_usec = 1000 * timeout;
-    }
-    FD_ZERO(&read_fds);
-    FD_SET(BIP_Socket, &read_fds);
-    max = BIP_Socket;
-    /* see if there is a packet for us */
-    if (select(max + 1, &read_fds, NULL, NULL, &select_timeout) > 0)
-        received_bytes =
-            recvfrom(BIP_Socket, (char *) &pdu[0], max_pdu, 0,
-            (struct sockaddr *) &sin, &sin_len);
-    else
-        return 0;
+    received_bytes = bip_receive_mpdu(pdu, max_pdu, &sin, timeout);
 
     /* See if there is a problem */
     if (received_bytes < 0) {
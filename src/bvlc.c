@@ -34,6 +34,7 @@
 
 #include <stdint.h>     /* for standard integer types uint8_t etc. */
 #include <stdbool.h>    /* for the standard bool type. */
+#include <stdlib.h>
 #include <time.h>
 #include "bacenum.h"
 #include "bacdcode.h"
@@ -88,23 +89,182 @@ seconds remaining before the BBMD will purge the registrant's FDT
 entry if no re-registration occurs. This value will be initialized
 to the 2-octet Time-to-Live value supplied at the time of
 registration.*/
-typedef struct {
-    bool valid;
+typedef struct fd_table_entry {
     /* BACnet/IP address */
     struct in_addr dest_address;
     /* BACnet/IP port number - not always 47808=BAC0h */
     uint16_t dest_port;
     /* seconds for valid entry lifetime */
     uint16_t time_to_live;
-    /* our counter */
-    time_t seconds_remaining;   /* includes 30 second grace period */
+    /* when it is purged, on the FDT clock */
+    uint32_t expire_time;       /* includes 30 second grace period */
+    /* Forwarded-NPDUs that could not be sent to it */
+    uint32_t send_errors;
+    /* registrations it may send now, and when the credit was counted */
+    uint8_t register_credit;
+    uint32_t credit_time;
+    /* its place in FD_List */
+    unsigned index;
+    /* the next one in its hash bucket */
+    struct fd_table_entry *hash_next;
+    /* its neighbours in its timer wheel slot */
+    struct fd_table_entry *wheel_prev;
+    struct fd_table_entry *wheel_next;
 } FD_TABLE_ENTRY;
 
+/* the FDT grows as devices register, up to this many */
 #ifndef MAX_FD_ENTRIES
-#define MAX_FD_ENTRIES 128
+#define MAX_FD_ENTRIES 1024
 #endif
-static FD_TABLE_ENTRY FD_Table[MAX_FD_ENTRIES];
+/* seconds covered by one turn of the timer wheel */
+#ifndef FDT_WHEEL_SIZE
+#define FDT_WHEEL_SIZE 256
+#endif
+/* A foreign device may register this many times at once, and once more
+   for each interval in seconds that goes by.  The registrations over
+   that are dropped without a reply.  An interval of 0 has no limit. */
+#ifndef FDT_REGISTER_BURST
+#define FDT_REGISTER_BURST 4
+#endif
+#ifndef FDT_REGISTER_INTERVAL
+#define FDT_REGISTER_INTERVAL 10
+#endif
+
+/* the entries in no order, for the forwarding and the Read-FDT */
+static FD_TABLE_ENTRY **FD_List;
+static unsigned FD_Count;
+static unsigned FD_Size;
+/* the entries by B/IP address, in a power of two buckets */
+static FD_TABLE_ENTRY **FD_Hash;
+static unsigned FD_Hash_Size;
+/* the entries by the second they expire in, modulo the wheel size */
+static FD_TABLE_ENTRY *FD_Wheel[FDT_WHEEL_SIZE];
+/* seconds counted by the maintenance timer */
+static uint32_t FD_Time;
+
+static unsigned bvlc_fdt_hash(
+    uint32_t address,
+    uint16_t port,
+    unsigned size)
+{
+    uint32_t key = (address ^ ((uint32_t) port << 16) ^ port) * 0x9E3779B1UL;
+
+    return (unsigned) (key ^ (key >> 16)) & (size - 1);
+}
+
+/** Find a Foreign Device in the FDT
+ *
+ * @param address - IP address, in network order
+ * @param port - UDP port, in network order
+ *
+ * @return The entry, or NULL if it is not in the FDT.
+ */
+static FD_TABLE_ENTRY *bvlc_fdt_find(
+    uint32_t address,
+    uint16_t port)
+{
+    FD_TABLE_ENTRY *entry = NULL;
 
+    if (FD_Hash_Size == 0) {
+        return NULL;
+    }
+    entry = FD_Hash[bvlc_fdt_hash(address, port, FD_Hash_Size)];
+    while (entry) {
+        if ((entry->dest_address.s_addr == address) &&
+            (entry->dest_port == port)) {
+            break;
+        }
+        entry = entry->hash_next;
+    }
+
+    return entry;
+}
+
+/* doubles the hash buckets, so there are no more entries than buckets */
+static bool bvlc_fdt_hash_grow(
+    void)
+{
+    FD_TABLE_ENTRY **hash = NULL;
+    FD_TABLE_ENTRY *entry = NULL;
+    unsigned size = FD_Hash_Size ? FD_Hash_Size * 2 : 16;
+    unsigned bucket = 0;
+    unsigned i = 0;
+
+    hash = calloc(size, sizeof(FD_TABLE_ENTRY *));
+    if (!hash) {
+        return false;
+    }
+    for (i = 0; i < FD_Count; i++) {
+        entry = FD_List[i];
+        bucket =
+            bvlc_fdt_hash(entry->dest_address.s_addr, entry->dest_port, size);
+        entry->hash_next = hash[bucket];
+        hash[bucket] = entry;
+    }
+    free(FD_Hash);
+    FD_Hash = hash;
+    FD_Hash_Size = size;
+
+    return true;
+}
+
+static void bvlc_fdt_wheel_insert(
+    FD_TABLE_ENTRY * entry)
+{
+    FD_TABLE_ENTRY **slot = &FD_Wheel[entry->expire_time % FDT_WHEEL_SIZE];
+
+    entry->wheel_prev = NULL;
+    entry->wheel_next = *slot;
+    if (*slot) {
+        (*slot)->wheel_prev = entry;
+    }
+    *slot = entry;
+}
+
+static void bvlc_fdt_wheel_remove(
+    FD_TABLE_ENTRY * entry)
+{
+    if (entry->wheel_prev) {
+        entry->wheel_prev->wheel_next = entry->wheel_next;
+    } else {
+        FD_Wheel[entry->expire_time % FDT_WHEEL_SIZE] = entry->wheel_next;
+    }
+    if (entry->wheel_next) {
+        entry->wheel_next->wheel_prev = entry->wheel_prev;
+    }
+}
+
+/* Upon receipt of a BVLL Register-Foreign-Device message, a BBMD shall
+   start a timer with a value equal to the Time-to-Live parameter
+   supplied plus a fixed grace period of 30 seconds. */
+static void bvlc_fdt_timer_start(
+    FD_TABLE_ENTRY * entry,
+    uint16_t time_to_live)
+{
+    entry->time_to_live = time_to_live;
+    entry->expire_time = FD_Time + time_to_live + 30;
+    bvlc_fdt_wheel_insert(entry);
+}
+
+static void bvlc_fdt_remove(
+    FD_TABLE_ENTRY * entry)
+{
+    FD_TABLE_ENTRY **link = NULL;
+
+    link =
+        &FD_Hash[bvlc_fdt_hash(entry->dest_address.s_addr, entry->dest_port,
+            FD_Hash_Size)];
+    while (*link != entry) {
+        link = &(*link)->hash_next;
+    }
+    *link = entry->hash_next;
+    bvlc_fdt_wheel_remove(entry);
+    /* the last one takes its place in the list */
+    FD_Count--;
+    FD_List[entry->index] = FD_List[FD_Count];
+    FD_List[entry->index]->index = entry->index;
+    free(entry);
+}
 
 /** A timer function that is called about once a second.
  *
@@ -113,22 +273,33 @@ static FD_TABLE_ENTRY FD_Table[MAX_FD_ENTRIES];
 void bvlc_maintenance_timer(
     time_t seconds)
 {
-    unsigned i = 0;
-
-    for (i = 0; i < MAX_FD_ENTRIES; i++) {
-        if (FD_Table[i].valid) {
-            if (FD_Table[i].seconds_remaining) {
-                if (FD_Table[i].seconds_remaining < seconds) {
-                    FD_Table[i].seconds_remaining = 0;
-                } else {
-                    FD_Table[i].seconds_remaining -= seconds;
-                }
-                if (FD_Table[i].seconds_remaining == 0) {
-                    FD_Table[i].valid = false;
-                }
+    FD_TABLE_ENTRY *entry = NULL;
+    FD_TABLE_ENTRY *next = NULL;
+    uint32_t now = 0;
+    uint32_t slots = 0;
+    uint32_t i = 0;
+
+    if (seconds <= 0) {
+        return;
+    }
+    now = FD_Time + (uint32_t) seconds;
+    slots = (uint32_t) seconds;
+    if (slots > FDT_WHEEL_SIZE) {
+        slots = FDT_WHEEL_SIZE;
+    }
+    /* only the slots of the seconds gone by; the entries in them that
+       expire in a later turn of the wheel stay */
+    for (i = 1; i <= slots; i++) {
+        entry = FD_Wheel[(FD_Time + i) % FDT_WHEEL_SIZE];
+        while (entry) {
+            next = entry->wheel_next;
+            if ((int32_t) (now - entry->expire_time) >= 0) {
+                bvlc_fdt_remove(entry);
             }
+            entry = next;
         }
     }
+    FD_Time = now;
 }
 
 /** Copy the source internet address to the BACnet address
@@ -511,48 +682,53 @@ static int bvlc_encode_read_fdt_ack_init(
     return len;
 }
 
-/** Encode a Read Foreign Device Table Ack
+/** Encode a Read Foreign Device Table Ack with the entries that fit,
+ * starting from one of them.
  *
  * @param pdu - buffer to store the encoding
  * @param max_pdu - number of bytes available to encode
+ * @param index - the first entry to encode; returns the one after the
+ *  last entry that was encoded
  *
  * @return number of bytes encoded
  */
 static int bvlc_encode_read_fdt_ack(
     uint8_t * pdu,
-    uint16_t max_pdu)
+    uint16_t max_pdu,
+    unsigned *index)
 {
     int pdu_len = 0;    /* return value */
     int len = 0;
     unsigned count = 0;
     unsigned i;
-    uint16_t seconds_remaining = 0;
+    uint32_t seconds_remaining = 0;
+    FD_TABLE_ENTRY *entry = NULL;
 
-    for (i = 0; i < MAX_FD_ENTRIES; i++) {
-        if (FD_Table[i].valid) {
-            count++;
-        }
+    if (max_pdu < 4) {
+        return 0;
+    }
+    count = FD_Count - *index;
+    if (count > (unsigned) ((max_pdu - 4) / 10)) {
+        count = (max_pdu - 4) / 10;
     }
     len = bvlc_encode_read_fdt_ack_init(&pdu[0], count);
     pdu_len += len;
-    for (i = 0; i < MAX_FD_ENTRIES; i++) {
-        if (FD_Table[i].valid) {
-            /* too much to send */
-            if ((pdu_len + 10) > max_pdu) {
-                pdu_len = 0;
-                break;
-            }
-            len =
-                bvlc_encode_bip_address(&pdu[pdu_len],
-                &FD_Table[i].dest_address, FD_Table[i].dest_port);
-            pdu_len += len;
-            len = encode_unsigned16(&pdu[pdu_len], FD_Table[i].time_to_live);
-            pdu_len += len;
-            seconds_remaining = (uint16_t) FD_Table[i].seconds_remaining;
-            len = encode_unsigned16(&pdu[pdu_len], seconds_remaining);
-            pdu_len += len;
+    for (i = 0; i < count; i++) {
+        entry = FD_List[*index + i];
+        len =
+            bvlc_encode_bip_address(&pdu[pdu_len], &entry->dest_address,
+            entry->dest_port);
+        pdu_len += len;
+        len = encode_unsigned16(&pdu[pdu_len], entry->time_to_live);
+        pdu_len += len;
+        seconds_remaining = entry->expire_time - FD_Time;
+        if (seconds_remaining > 0xFFFF) {
+            seconds_remaining = 0xFFFF;
         }
+        len = encode_unsigned16(&pdu[pdu_len], (uint16_t) seconds_remaining);
+        pdu_len += len;
     }
+    *index += count;
 
     return pdu_len;
 }
@@ -690,12 +866,14 @@ static bool bvlc_create_bdt(
             pdu_offset += 2;
             memcpy(&BBMD_Table[i].broadcast_mask.s_addr, &npdu[pdu_offset], 4);
             pdu_offset += 4;
+            BBMD_Table[i].send_errors = 0;
             npdu_length -= (4 + 2 + 4);
         } else {
             BBMD_Table[i].valid = false;
             BBMD_Table[i].dest_address.s_addr = 0;
             BBMD_Table[i].dest_port = 0;
             BBMD_Table[i].broadcast_mask.s_addr = 0;
+            BBMD_Table[i].send_errors = 0;
         }
     }
     /* did they all fit? */
@@ -711,47 +889,77 @@ static bool bvlc_create_bdt(
  * @param sin - source address in network order
  * @param time_to_live - time in seconds
  *
- * @return true if the Foreign Device was added
+ * @return 1 if the Foreign Device was added or its timer restarted,
+ *  0 if the FDT is full, or -1 if it registered too often and the
+ *  registration was dropped.
  */
-static bool bvlc_register_foreign_device(
+static int bvlc_register_foreign_device(
     struct sockaddr_in *sin,
     uint16_t time_to_live)
 {
-    unsigned i = 0;
-    bool status = false;
+    FD_TABLE_ENTRY *entry = NULL;
+    FD_TABLE_ENTRY **list = NULL;
+    uint32_t intervals = 0;
+    unsigned bucket = 0;
+    unsigned size = 0;
 
     /* am I here already?  If so, update my time to live... */
-    for (i = 0; i < MAX_FD_ENTRIES; i++) {
-        if (FD_Table[i].valid) {
-            if ((FD_Table[i].dest_address.s_addr == sin->sin_addr.s_addr) &&
-                (FD_Table[i].dest_port == sin->sin_port)) {
-                status = true;
-                FD_Table[i].time_to_live = time_to_live;
-                /*  Upon receipt of a BVLL Register-Foreign-Device message,
-                   a BBMD shall start a timer with a value equal to the
-                   Time-to-Live parameter supplied plus a fixed grace
-                   period of 30 seconds. */
-                FD_Table[i].seconds_remaining = time_to_live + 30;
-                break;
+    entry = bvlc_fdt_find(sin->sin_addr.s_addr, sin->sin_port);
+    if (entry) {
+        if (FDT_REGISTER_INTERVAL) {
+            intervals = (FD_Time - entry->credit_time) / FDT_REGISTER_INTERVAL;
+            if ((entry->register_credit + intervals) >= FDT_REGISTER_BURST) {
+                entry->register_credit = FDT_REGISTER_BURST;
+                entry->credit_time = FD_Time;
+            } else {
+                entry->register_credit += (uint8_t) intervals;
+                entry->credit_time += intervals * FDT_REGISTER_INTERVAL;
+            }
+            if (entry->register_credit == 0) {
+                return -1;
             }
+            entry->register_credit--;
         }
+        bvlc_fdt_wheel_remove(entry);
+        bvlc_fdt_timer_start(entry, time_to_live);
+        return 1;
     }
-    if (!status) {
-        for (i = 0; i < MAX_FD_ENTRIES; i++) {
-            if (!FD_Table[i].valid) {
-                FD_Table[i].dest_address.s_addr = sin->sin_addr.s_addr;
-                FD_Table[i].dest_port = sin->sin_port;
-                FD_Table[i].time_to_live = time_to_live;
-                FD_Table[i].seconds_remaining = time_to_live + 30;
-                FD_Table[i].valid = true;
-                status = true;
-                break;
-            }
+    if (FD_Count >= MAX_FD_ENTRIES) {
+        return 0;
+    }
+    if (FD_Count >= FD_Size) {
+        size = FD_Size ? FD_Size * 2 : 16;
+        if (size > MAX_FD_ENTRIES) {
+            size = MAX_FD_ENTRIES;
+        }
+        list = realloc(FD_List, size * sizeof(FD_TABLE_ENTRY *));
+        if (!list) {
+            return 0;
         }
+        FD_List = list;
+        FD_Size = size;
     }
-
-
-    return status;
+    if ((FD_Count >= FD_Hash_Size) && !bvlc_fdt_hash_grow()) {
+        return 0;
+    }
+    entry = calloc(1, sizeof(FD_TABLE_ENTRY));
+    if (!entry) {
+        return 0;
+    }
+    entry->dest_address.s_addr = sin->sin_addr.s_addr;
+    entry->dest_port = sin->sin_port;
+    entry->register_credit = FDT_REGISTER_BURST - 1;
+    entry->credit_time = FD_Time;
+    entry->index = FD_Count;
+    FD_List[FD_Count++] = entry;
+    bucket =
+        bvlc_fdt_hash(entry->dest_address.s_addr, entry->dest_port,
+        FD_Hash_Size);
+    entry->hash_next = FD_Hash[bucket];
+    FD_Hash[bucket] = entry;
+    bvlc_fdt_timer_start(entry, time_to_live);
+
+    return 1;
 }
 
 /** Delete a Foreign Device from the Foreign Device Table
@@ -764,22 +972,16 @@ static bool bvlc_delete_foreign_device(
     uint8_t * pdu)
 {
     struct sockaddr_in sin = { 0 };     /* the ip address */
-    bool status = false;        /* return value */
-    unsigned i = 0;
+    FD_TABLE_ENTRY *entry = NULL;
 
     bvlc_decode_bip_address(pdu, &sin.sin_addr, &sin.sin_port);
-    for (i = 0; i < MAX_FD_ENTRIES; i++) {
-        if (FD_Table[i].valid) {
-            if ((FD_Table[i].dest_address.s_addr == sin.sin_addr.s_addr) &&
-                (FD_Table[i].dest_port == sin.sin_port)) {
-                FD_Table[i].valid = false;
-                FD_Table[i].seconds_remaining = 0;
-                status = true;
-                break;
-            }
-        }
+    entry = bvlc_fdt_find(sin.sin_addr.s_addr, sin.sin_port);
+    if (entry) {
+        bvlc_fdt_remove(entry);
+        return true;
     }
-    return status;
+
+    return false;
 }
 #endif
 
@@ -817,46 +1019,64 @@ int bvlc_send_mpdu(
 }
 
 #if defined(BBMD_ENABLED) && BBMD_ENABLED
-/** Sends all Broadcast Devices a Forwarded NPDU
- *
- * @param sin - source address in network order
- * @param npdu - the NPDU
- * @param max_npdu - amount of space available in the NPDU
- * @param npdu_length - length of the NPDU
- * @param original - was the message an original (not forwarded)
+/* The destinations of a Forwarded-NPDU, which is encoded once and sent
+   to all of them together. */
+static struct sockaddr_in *Forward_Dest;
+/* the send error counter of each destination, or NULL */
+static uint32_t **Forward_Errors;
+static int *Forward_Status;
+static unsigned Forward_Count;
+static unsigned Forward_Size;
+
+/* grows the destinations with the FDT */
+static bool bvlc_forward_grow(
+    void)
+{
+    struct sockaddr_in *dest = NULL;
+    uint32_t **errors = NULL;
+    int *status = NULL;
+    unsigned size = Forward_Size ? Forward_Size * 2 : 64;
+
+    dest = realloc(Forward_Dest, size * sizeof(struct sockaddr_in));
+    if (dest) {
+        Forward_Dest = dest;
+    }
+    errors = realloc(Forward_Errors, size * sizeof(uint32_t *));
+    if (errors) {
+        Forward_Errors = errors;
+    }
+    status = realloc(Forward_Status, size * sizeof(int));
+    if (status) {
+        Forward_Status = status;
+    }
+    if (!dest || !errors || !status) {
+        return false;
+    }
+    Forward_Size = size;
+
+    return true;
+}
+
+static void bvlc_forward_add(
+    struct sockaddr_in *dest,
+    uint32_t * send_errors)
+{
+    if ((Forward_Count < Forward_Size) || bvlc_forward_grow()) {
+        Forward_Dest[Forward_Count] = *dest;
+        Forward_Errors[Forward_Count] = send_errors;
+        Forward_Count++;
+    }
+}
+
+/** Adds all Broadcast Devices to the destinations of a Forwarded NPDU
  */
-static void bvlc_bdt_forward_npdu(
-    struct sockaddr_in *sin,
-    uint8_t * npdu,
-    uint16_t max_npdu,
-    uint16_t npdu_length,
-    bool original)
+static void bvlc_bdt_forward_add(
+    void)
 {
-    uint8_t mtu[MAX_MPDU] = { 0 };
-    uint16_t mtu_len = 0;
     unsigned i = 0;     /* loop counter */
     struct sockaddr_in bip_dest = { 0 };
 
-    /* If we are forwarding an original broadcast message and the NAT
-     * handling is enabled, change the source address to NAT routers
-     * global IP address so the recipient can reply (local IP address
-     * is not accesible from internet side).
-     *
-     * If we are forwarding a message from peer BBMD or foreign device
-     * or the NAT handling is disabled, leave the source address as is.
-     */
-    if(BVLC_NAT_Handling && original) {
-        struct sockaddr_in nat_addr = *sin;
-        nat_addr.sin_addr = BVLC_Global_Address;
-        mtu_len = (uint16_t) bvlc_encode_forwarded_npdu(&mtu[0],
-                             &nat_addr, npdu, max_npdu, npdu_length);
-    }
-    else {
-        mtu_len = (uint16_t) bvlc_encode_forwarded_npdu(&mtu[0],
-                             sin, npdu, max_npdu, npdu_length);
-    }
-
-    /* loop through the BDT and send one to each entry, except us */
+    /* loop through the BDT and add each entry, except us */
     for (i = 0; i < MAX_BBMD_ENTRIES; i++) {
         if (BBMD_Table[i].valid) {
             /* The B/IP address to which the Forwarded-NPDU message is
@@ -886,8 +1106,8 @@ static void bvlc_bdt_forward_npdu(
                 (bip_dest.sin_port == bip_get_port())) {
                 continue;
             }
-            bvlc_send_mpdu(&bip_dest, mtu, mtu_len);
-            debug_printf("BVLC: BDT Sent Forwarded-NPDU to %s:%04X\n",
+            bvlc_forward_add(&bip_dest, &BBMD_Table[i].send_errors);
+            debug_printf("BVLC: BDT Forwarded-NPDU to %s:%04X\n",
                 inet_ntoa(bip_dest.sin_addr), ntohs(bip_dest.sin_port));
         }
     }
@@ -895,42 +1115,71 @@ static void bvlc_bdt_forward_npdu(
     return;
 }
 
-/** Send a BVLL Forwarded-NPDU message on its local IP subnet using
- * the local B/IP broadcast address as the destination address.
- *
- * @param sin - source address in network order
- * @param npdu - the NPDU
- * @param max_npdu - amount of space available in the NPDU
- * @param npdu_length - reported length of the NPDU
+/** Adds the local B/IP broadcast address to the destinations of a
+ * Forwarded NPDU, to send it on the local IP subnet.
  */
-static void bvlc_forward_npdu(
-    struct sockaddr_in *sin,
-    uint8_t * npdu,
-    uint16_t max_npdu,
-    uint16_t npdu_length)
+static void bvlc_local_forward_add(
+    void)
 {
-    uint8_t mtu[MAX_MPDU] = { 0 };
-    uint16_t mtu_len = 0;
     struct sockaddr_in bip_dest = { 0 };
 
-    mtu_len =
-        (uint16_t) bvlc_encode_forwarded_npdu(&mtu[0], sin, npdu,
-        max_npdu, npdu_length);
     bip_dest.sin_addr.s_addr = bip_get_broadcast_addr();
     bip_dest.sin_port = bip_get_port();
-    bvlc_send_mpdu(&bip_dest, mtu, mtu_len);
-    debug_printf("BVLC: Sent Forwarded-NPDU as local broadcast.\n");
+    bvlc_forward_add(&bip_dest, NULL);
+    debug_printf("BVLC: Forwarded-NPDU as local broadcast.\n");
 }
 
-/** Sends all Foreign Devices a Forwarded NPDU
+/** Adds all Foreign Devices to the destinations of a Forwarded NPDU
  *
  * @param sin - source address in network order
- * @param npdu - returns the NPDU
+ */
+static void bvlc_fdt_forward_add(
+    struct sockaddr_in *sin)
+{
+    unsigned i = 0;     /* loop counter */
+    struct sockaddr_in bip_dest = { 0 };
+
+    /* loop through the FDT and add each entry */
+    for (i = 0; i < FD_Count; i++) {
+        bip_dest.sin_addr.s_addr = FD_List[i]->dest_address.s_addr;
+        bip_dest.sin_port = FD_List[i]->dest_port;
+        /* don't send to my ip address and same port */
+        if ((bip_dest.sin_addr.s_addr == bip_get_addr()) &&
+            (bip_dest.sin_port == bip_get_port())) {
+            continue;
+        }
+        /* don't send to src ip address and same port */
+        if ((bip_dest.sin_addr.s_addr == sin->sin_addr.s_addr) &&
+            (bip_dest.sin_port == sin->sin_port)) {
+            continue;
+        }
+        /* NAT router port forwards BACnet packets from global IP to us.
+         * Packets sent to that global IP by us would end up back, creating
+         * a loop.
+         */
+        if (BVLC_NAT_Handling &&
+            (bip_dest.sin_addr.s_addr == BVLC_Global_Address.s_addr) &&
+            (bip_dest.sin_port == bip_get_port())) {
+            continue;
+        }
+        bvlc_forward_add(&bip_dest, &FD_List[i]->send_errors);
+        debug_printf("BVLC: FDT Forwarded-NPDU to %s:%04X\n",
+            inet_ntoa(bip_dest.sin_addr), ntohs(bip_dest.sin_port));
+    }
+
+    return;
+}
+
+/** Sends a Forwarded NPDU to the destinations that were added, and
+ * counts the failed sends of each BDT and FDT entry.
+ *
+ * @param sin - source address in network order
+ * @param npdu - the NPDU
  * @param max_npdu - amount of space available in the NPDU
  * @param npdu_length - reported length of the NPDU
  * @param original - was the message an original (not forwarded)
  */
-static void bvlc_fdt_forward_npdu(
+static void bvlc_forward_send(
     struct sockaddr_in *sin,
     uint8_t * npdu,
     uint16_t max_npdu,
@@ -939,58 +1188,36 @@ static void bvlc_fdt_forward_npdu(
 {
     uint8_t mtu[MAX_MPDU] = { 0 };
     uint16_t mtu_len = 0;
-    unsigned i = 0;     /* loop counter */
-    struct sockaddr_in bip_dest = { 0 };
+    unsigned i = 0;
 
+    if (Forward_Count == 0) {
+        return;
+    }
     /* If we are forwarding an original broadcast message and the NAT
      * handling is enabled, change the source address to NAT routers
      * global IP address so the recipient can reply (local IP address
-     * is not accesible from internet side.
+     * is not accesible from internet side).
      *
      * If we are forwarding a message from peer BBMD or foreign device
      * or the NAT handling is disabled, leave the source address as is.
      */
-    if(BVLC_NAT_Handling && original) {
+    if (BVLC_NAT_Handling && original) {
         struct sockaddr_in nat_addr = *sin;
         nat_addr.sin_addr = BVLC_Global_Address;
-        mtu_len = (uint16_t)bvlc_encode_forwarded_npdu(&mtu[0],
+        mtu_len = (uint16_t) bvlc_encode_forwarded_npdu(&mtu[0],
                              &nat_addr, npdu, max_npdu, npdu_length);
     } else {
-        mtu_len = (uint16_t)bvlc_encode_forwarded_npdu(&mtu[0],
+        mtu_len = (uint16_t) bvlc_encode_forwarded_npdu(&mtu[0],
                              sin, npdu, max_npdu, npdu_length);
     }
-
-    /* loop through the FDT and send one to each entry */
-    for (i = 0; i < MAX_FD_ENTRIES; i++) {
-        if (FD_Table[i].valid && FD_Table[i].seconds_remaining) {
-            bip_dest.sin_addr.s_addr = FD_Table[i].dest_address.s_addr;
-            bip_dest.sin_port = FD_Table[i].dest_port;
-            /* don't send to my ip address and same port */
-            if ((bip_dest.sin_addr.s_addr == bip_get_addr()) &&
-                (bip_dest.sin_port == bip_get_port())) {
-                continue;
-            }
-            /* don't send to src ip address and same port */
-            if ((bip_dest.sin_addr.s_addr == sin->sin_addr.s_addr) &&
-                (bip_dest.sin_port == sin->sin_port)) {
-                continue;
-            }
-            /* NAT router port forwards BACnet packets from global IP to us.
-             * Packets sent to that global IP by us would end up back, creating
-             * a loop.
-             */
-            if (BVLC_NAT_Handling &&
-                (bip_dest.sin_addr.s_addr == BVLC_Global_Address.s_addr) &&
-                (bip_dest.sin_port == bip_get_port())) {
-                continue;
-            }
-            bvlc_send_mpdu(&bip_dest, mtu, mtu_len);
-            debug_printf("BVLC: FDT Sent Forwarded-NPDU to %s:%04X\n",
-                inet_ntoa(bip_dest.sin_addr), ntohs(bip_dest.sin_port));
+    bip_send_mpdu_multi(Forward_Dest, Forward_Status, Forward_Count, mtu,
+        mtu_len);
+    for (i = 0; i < Forward_Count; i++) {
+        if ((Forward_Status[i] < 0) && Forward_Errors[i]) {
+            (*Forward_Errors[i])++;
         }
     }
-
-    return;
+    Forward_Count = 0;
 }
 #endif
 
@@ -1038,7 +1265,9 @@ static int bvlc_send_bdt(
     return mtu_len;
 }
 
-/** Sends a Read Foreign Device Table ACK
+/** Sends a Read Foreign Device Table ACK.  An FDT that does not fit
+ * in one is sent in as many as it takes, each with the entries that
+ * follow those of the one before.
  *
  * @param dest - destination address
  *
@@ -1049,13 +1278,19 @@ static int bvlc_send_fdt(
 {
     uint8_t mtu[MAX_MPDU] = { 0 };
     uint16_t mtu_len = 0;
+    unsigned index = 0;
+    int len = 0;
 
-    mtu_len = (uint16_t) bvlc_encode_read_fdt_ack(&mtu[0], sizeof(mtu));
-    if (mtu_len) {
-        bvlc_send_mpdu(dest, &mtu[0], mtu_len);
-    }
+    do {
+        mtu_len =
+            (uint16_t) bvlc_encode_read_fdt_ack(&mtu[0], sizeof(mtu), &index);
+        if (mtu_len) {
+            bvlc_send_mpdu(dest, &mtu[0], mtu_len);
+        }
+        len += mtu_len;
+    } while (mtu_len && (index < FD_Count));
 
-    return mtu_len;
+    return len;
 }
 
 /** Determines if a BDT member has a unicast mask
@@ -1110,17 +1345,14 @@ uint16_t bvlc_receive(
     unsigned timeout)
 {
     uint16_t npdu_len = 0;      /* return value */
-    fd_set read_fds;
-    int max = 0;
-    struct timeval select_timeout;
     struct sockaddr_in sin = { 0 };
     struct sockaddr_in original_sin = { 0 };
     struct sockaddr_in dest = { 0 };
-    socklen_t sin_len = sizeof(sin);
     int received_bytes = 0;
     uint16_t result_code = 0;
     uint16_t i = 0;
     bool status = false;
+    int registered = 0;
     uint16_t time_to_live = 0;
 
     /* Make sure the socket is open */
@@ -1128,28 +1360,7 @@ uint16_t bvlc_receive(
         return 0;
     }
 
-    /* we could just use a non-blocking socket, but that consumes all
-       the CPU time.  We can use a timeout; it is only supported as
-       a select. */
-    if (timeout >= 1000) {
-        select_timeout.tv_sec = timeout / 1000;
-        select_timeout.tv_usec =
-            1000 * (timeout - select_timeout.tv_sec * 1000);
-    } else {
-        select_timeout.tv_sec = 0;
-        select_timeout.tv_usec = 1000 * timeout;
-    }
-    FD_ZERO(&read_fds);
-    FD_SET(bip_socket(), &read_fds);
-    max = bip_socket();
-    /* see if there is a packet for us */
-    if (select(max + 1, &read_fds, NULL, NULL, &select_timeout) > 0) {
-        received_bytes =
-            recvfrom(bip_socket(), (char *) &npdu[0], max_npdu, 0,
-            (struct sockaddr *) &sin, &sin_len);
-    } else {
-        return 0;
-    }
+    received_bytes = bip_receive_mpdu(npdu, max_npdu, &sin, timeout);
     /* See if there is a problem */
     if (received_bytes < 0) {
         return 0;
@@ -1261,7 +1472,8 @@ uint16_t bvlc_receive(
             /* use the original addr from the BVLC for src */
             dest.sin_addr.s_addr = original_sin.sin_addr.s_addr;
             dest.sin_port = original_sin.sin_port;
-            bvlc_fdt_forward_npdu(&dest, &npdu[4 + 6], max_npdu-(4 + 6),
+            bvlc_fdt_forward_add(&dest);
+            bvlc_forward_send(&dest, &npdu[4 + 6], max_npdu-(4 + 6),
                 npdu_len, false);
             debug_printf("BVLC: Received Forwarded-NPDU from %s:%04X.\n",
                 inet_ntoa(dest.sin_addr), ntohs(dest.sin_port));
@@ -1288,9 +1500,13 @@ uint16_t bvlc_receive(
                message from the same foreign device, the FDT entry for this
                device shall be cleared. */
             (void) decode_unsigned16(&npdu[4], &time_to_live);
-            if (bvlc_register_foreign_device(&sin, time_to_live)) {
+            registered = bvlc_register_foreign_device(&sin, time_to_live);
+            if (registered > 0) {
                 bvlc_send_result(&sin, BVLC_RESULT_SUCCESSFUL_COMPLETION);
                 debug_printf("BVLC: Registered a Foreign Device.\n");
+            } else if (registered < 0) {
+                debug_printf("BVLC: Dropped a Foreign Device registration"
+                    " over the rate limit.\n");
             } else {
                 bvlc_send_result(&sin,
                     BVLC_RESULT_REGISTER_FOREIGN_DEVICE_NAK);
@@ -1356,9 +1572,10 @@ uint16_t bvlc_receive(
                it shall return a BVLC-Result message to the foreign device
                with a result code of X'0060' indicating that the forwarding
                attempt was unsuccessful */
-            bvlc_forward_npdu(&sin, &npdu[4], max_npdu-4, npdu_len);
-            bvlc_bdt_forward_npdu(&sin, &npdu[4], max_npdu-4, npdu_len, false);
-            bvlc_fdt_forward_npdu(&sin, &npdu[4], max_npdu-4, npdu_len, false);
+            bvlc_local_forward_add();
+            bvlc_bdt_forward_add();
+            bvlc_fdt_forward_add(&sin);
+            bvlc_forward_send(&sin, &npdu[4], max_npdu-4, npdu_len, false);
             /* not an NPDU */
             npdu_len = 0;
             break;
@@ -1410,8 +1627,9 @@ uint16_t bvlc_receive(
                     npdu[i] = npdu[4 + i];
                 }
                 /* if BDT or FDT entries exist, Forward the NPDU */
-                bvlc_bdt_forward_npdu(&sin, &npdu[0], max_npdu, npdu_len, true);
-                bvlc_fdt_forward_npdu(&sin, &npdu[0], max_npdu, npdu_len, true);
+                bvlc_bdt_forward_add();
+                bvlc_fdt_forward_add(&sin);
+                bvlc_forward_send(&sin, &npdu[0], max_npdu, npdu_len, true);
             } else {
                 /* ignore packets that are too large */
                 npdu_len = 0;
@@ -1695,6 +1913,7 @@ void bvlc_clear_bdt_local(
         BBMD_Table[i].dest_address.s_addr = 0;
         BBMD_Table[i].dest_port = 0;
         BBMD_Table[i].broadcast_mask.s_addr = 0;
+        BBMD_Table[i].send_errors = 0;
     }
 }
 
@@ -1732,9 +1951,31 @@ bool bvlc_add_bdt_entry_local(
     /* Copy new entry to the empty slot */
     BBMD_Table[i] = *entry;
     BBMD_Table[i].valid = true;
+    BBMD_Table[i].send_errors = 0;
 
     return true;
 }
+
+/** Get the number of Forwarded-NPDUs that could not be sent to a
+ * Foreign Device since it registered.
+ *
+ * @param address - IP address of the Foreign Device, in network order
+ * @param port - its UDP port, in network order
+ *
+ * @return The number of failed sends, or -1 if it is not in the FDT.
+ */
+long bvlc_fdt_send_errors(
+    uint32_t address,
+    uint16_t port)
+{
+    FD_TABLE_ENTRY *entry = bvlc_fdt_find(address, port);
+
+    if (entry) {
+        return (long) entry->send_errors;
+    }
+
+    return -1;
+}
 #endif
 
 /** Enable NAT handling and set the global IP address
@@ -1811,6 +2052,276 @@ void testInternetAddress(
     ct_test(pTest, sin.sin_addr.s_addr == test_sin.sin_addr.s_addr);
 }
 
+#if defined(BBMD_ENABLED) && BBMD_ENABLED
+/* removes all the foreign devices */
+static void testFDTClear(
+    void)
+{
+    while (FD_Count) {
+        bvlc_fdt_remove(FD_List[0]);
+    }
+}
+
+/* the address of a foreign device */
+static void testFDTAddress(
+    struct sockaddr_in *sin,
+    unsigned i)
+{
+    sin->sin_family = AF_INET;
+    sin->sin_addr.s_addr = htonl(0x0A000000UL + (i / 3));
+    sin->sin_port = htons((uint16_t) (0xBAC0 + (i % 3)));
+}
+
+void testFDTHash(
+    Test * pTest)
+{
+    struct sockaddr_in sin = { 0 };
+    uint8_t pdu[6] = { 0 };
+    unsigned i = 0;
+
+    for (i = 0; i < 300; i++) {
+        testFDTAddress(&sin, i);
+        ct_test(pTest, bvlc_register_foreign_device(&sin, 60) == 1);
+    }
+    ct_test(pTest, FD_Count == 300);
+    ct_test(pTest, FD_Hash_Size >= FD_Count);
+    for (i = 0; i < 300; i++) {
+        testFDTAddress(&sin, i);
+        ct_test(pTest, bvlc_fdt_find(sin.sin_addr.s_addr,
+                sin.sin_port) != NULL);
+    }
+    testFDTAddress(&sin, 300);
+    ct_test(pTest, bvlc_fdt_find(sin.sin_addr.s_addr, sin.sin_port) == NULL);
+    /* delete every other one */
+    for (i = 0; i < 300; i += 2) {
+        testFDTAddress(&sin, i);
+        bvlc_encode_bip_address(&pdu[0], &sin.sin_addr, sin.sin_port);
+        ct_test(pTest, bvlc_delete_foreign_device(&pdu[0]));
+        ct_test(pTest, !bvlc_delete_foreign_device(&pdu[0]));
+    }
+    ct_test(pTest, FD_Count == 150);
+    for (i = 0; i < 300; i++) {
+        testFDTAddress(&sin, i);
+        ct_test(pTest, (bvlc_fdt_find(sin.sin_addr.s_addr,
+                    sin.sin_port) != NULL) == ((i % 2) == 1));
+    }
+    for (i = 0; i < FD_Count; i++) {
+        ct_test(pTest, FD_List[i]->index == i);
+    }
+    testFDTClear();
+}
+
+void testFDTWheel(
+    Test * pTest)
+{
+    struct sockaddr_in sin[3] = { {0} };
+    unsigned i = 0;
+
+    for (i = 0; i < 3; i++) {
+        testFDTAddress(&sin[i], i);
+    }
+    /* the entries expire at TTL + 30 seconds, the last one after more
+       than one turn of the wheel */
+    ct_test(pTest, bvlc_register_foreign_device(&sin[0], 10) == 1);
+    ct_test(pTest, bvlc_register_foreign_device(&sin[1], 60) == 1);
+    ct_test(pTest, bvlc_register_foreign_device(&sin[2],
+            FDT_WHEEL_SIZE + 100) == 1);
+    bvlc_maintenance_timer(39);
+    ct_test(pTest, FD_Count == 3);
+    bvlc_maintenance_timer(1);
+    ct_test(pTest, FD_Count == 2);
+    ct_test(pTest, bvlc_fdt_find(sin[0].sin_addr.s_addr,
+            sin[0].sin_port) == NULL);
+    for (i = 0; i < 49; i++) {
+        bvlc_maintenance_timer(1);
+    }
+    ct_test(pTest, FD_Count == 2);
+    bvlc_maintenance_timer(1);
+    ct_test(pTest, FD_Count == 1);
+    /* its slot went by once */
+    bvlc_maintenance_timer(FDT_WHEEL_SIZE);
+    ct_test(pTest, FD_Count == 1);
+    bvlc_maintenance_timer(39);
+    ct_test(pTest, FD_Count == 1);
+    bvlc_maintenance_timer(1);
+    ct_test(pTest, FD_Count == 0);
+    /* a gap longer than the wheel */
+    ct_test(pTest, bvlc_register_foreign_device(&sin[0], 10) == 1);
+    ct_test(pTest, bvlc_register_foreign_device(&sin[1],
+            FDT_WHEEL_SIZE * 3) == 1);
+    bvlc_maintenance_timer(FDT_WHEEL_SIZE * 2);
+    ct_test(pTest, FD_Count == 1);
+    bvlc_maintenance_timer(100000);
+    ct_test(pTest, FD_Count == 0);
+}
+
+void testFDTRateLimit(
+    Test * pTest)
+{
+    struct sockaddr_in sin = { 0 };
+    unsigned i = 0;
+
+    testFDTAddress(&sin, 0);
+    for (i = 0; i < FDT_REGISTER_BURST; i++) {
+        ct_test(pTest, bvlc_register_foreign_device(&sin, 60) == 1);
+    }
+#if FDT_REGISTER_INTERVAL
+    ct_test(pTest, bvlc_register_foreign_device(&sin, 60) == -1);
+    bvlc_maintenance_timer(FDT_REGISTER_INTERVAL - 1);
+    ct_test(pTest, bvlc_register_foreign_device(&sin, 60) == -1);
+    bvlc_maintenance_timer(1);
+    ct_test(pTest, bvlc_register_foreign_device(&sin, 60) == 1);
+    ct_test(pTest, bvlc_register_foreign_device(&sin, 60) == -1);
+    /* the credit does not grow past the burst */
+    bvlc_maintenance_timer(FDT_REGISTER_INTERVAL * (FDT_REGISTER_BURST + 2));
+    for (i = 0; i < FDT_REGISTER_BURST; i++) {
+        ct_test(pTest, bvlc_register_foreign_device(&sin, 60) == 1);
+    }
+    ct_test(pTest, bvlc_register_foreign_device(&sin, 60) == -1);
+#endif
+    /* the others have their own */
+    testFDTAddress(&sin, 1);
+    ct_test(pTest, bvlc_register_foreign_device(&sin, 60) == 1);
+    testFDTClear();
+}
+
+void testFDTReadAck(
+    Test * pTest)
+{
+    struct sockaddr_in sin = { 0 };
+    struct in_addr address = { 0 };
+    uint16_t port = 0;
+    uint16_t value = 0;
+    uint8_t pdu[MAX_MPDU] = { 0 };
+    /* more than fit in one ack */
+    unsigned count = ((MAX_MPDU - 4) / 10) + 50;
+    unsigned index = 0;
+    unsigned first = 0;
+    unsigned acks = 0;
+    int pdu_len = 0;
+    unsigned i = 0;
+
+    for (i = 0; i < count; i++) {
+        testFDTAddress(&sin, i);
+        ct_test(pTest, bvlc_register_foreign_device(&sin, 60) == 1);
+    }
+    bvlc_maintenance_timer(5);
+    ct_test(pTest, bvlc_encode_read_fdt_ack(pdu, 3, &index) == 0);
+    ct_test(pTest, index == 0);
+    /* each ack fits in MAX_MPDU, and has the entries after the last */
+    do {
+        first = index;
+        pdu_len = bvlc_encode_read_fdt_ack(pdu, sizeof(pdu), &index);
+        ct_test(pTest, pdu_len > 4);
+        ct_test(pTest, pdu_len <= MAX_MPDU);
+        ct_test(pTest, pdu_len == (int) (4 + ((index - first) * 10)));
+        ct_test(pTest, pdu[0] == BVLL_TYPE_BACNET_IP);
+        ct_test(pTest, pdu[1] == BVLC_READ_FOREIGN_DEVICE_TABLE_ACK);
+        decode_unsigned16(&pdu[2], &value);
+        ct_test(pTest, value == pdu_len);
+        for (i = first; i < index; i++) {
+            bvlc_decode_bip_address(&pdu[4 + ((i - first) * 10)], &address,
+                &port);
+            ct_test(pTest, bvlc_fdt_find(address.s_addr,
+                    port) == FD_List[i]);
+            decode_unsigned16(&pdu[4 + ((i - first) * 10) + 6], &value);
+            ct_test(pTest, value == 60);
+            decode_unsigned16(&pdu[4 + ((i - first) * 10) + 8], &value);
+            ct_test(pTest, value == (60 + 30 - 5));
+        }
+        acks++;
+    } while (pdu_len && (index < FD_Count) && (acks < 10));
+    ct_test(pTest, index == count);
+    ct_test(pTest, acks == 2);
+    testFDTClear();
+    index = 0;
+    ct_test(pTest, bvlc_encode_read_fdt_ack(pdu, sizeof(pdu), &index) == 4);
+}
+
+/* the destinations of the last send to many */
+static struct sockaddr_in Test_Send_Dest[16];
+static unsigned Test_Send_Count;
+
+/* sends to many, failing the odd ports */
+static unsigned testSendMulti(
+    struct sockaddr_in *dest,
+    int *status,
+    unsigned count,
+    uint8_t * mtu,
+    uint16_t mtu_len)
+{
+    unsigned sent = 0;
+    unsigned i = 0;
+
+    Test_Send_Count = count;
+    for (i = 0; i < count; i++) {
+        if (i < 16) {
+            Test_Send_Dest[i] = dest[i];
+        }
+        if (ntohs(dest[i].sin_port) & 1) {
+            status[i] = -1;
+        } else {
+            status[i] = mtu_len;
+            sent++;
+        }
+    }
+
+    return sent;
+}
+
+void testFDTSendErrors(
+    Test * pTest)
+{
+    struct sockaddr_in sin = { 0 };
+    struct sockaddr_in src = { 0 };
+    uint8_t npdu[4] = { 1, 0, 0x10, 0x08 };
+    int status[4] = { 0 };
+    unsigned i = 0;
+    unsigned j = 0;
+
+    /* no socket, no sends */
+    bip_set_socket(-1);
+    ct_test(pTest, bip_send_mpdu_multi(&sin, status, 1, npdu,
+            sizeof(npdu)) == 0);
+    ct_test(pTest, status[0] == -1);
+    bip_set_socket(0);
+    bip_set_send_multi(testSendMulti);
+    for (i = 0; i < 6; i++) {
+        testFDTAddress(&sin, i);
+        ct_test(pTest, bvlc_register_foreign_device(&sin, 60) == 1);
+    }
+    /* two sends from the first one, to the others */
+    testFDTAddress(&src, 0);
+    for (j = 0; j < 2; j++) {
+        bvlc_fdt_forward_add(&src);
+        bvlc_forward_send(&src, npdu, sizeof(npdu), sizeof(npdu), true);
+        ct_test(pTest, Test_Send_Count == 5);
+        ct_test(pTest, Forward_Count == 0);
+    }
+    for (i = 0; i < Test_Send_Count; i++) {
+        ct_test(pTest, (Test_Send_Dest[i].sin_addr.s_addr !=
+                src.sin_addr.s_addr) ||
+            (Test_Send_Dest[i].sin_port != src.sin_port));
+    }
+    for (i = 0; i < 6; i++) {
+        testFDTAddress(&sin, i);
+        if ((i == 0) || !(ntohs(sin.sin_port) & 1)) {
+            ct_test(pTest, bvlc_fdt_send_errors(sin.sin_addr.s_addr,
+                    sin.sin_port) == 0);
+        } else {
+            ct_test(pTest, bvlc_fdt_send_errors(sin.sin_addr.s_addr,
+                    sin.sin_port) == 2);
+        }
+    }
+    testFDTAddress(&sin, 6);
+    ct_test(pTest, bvlc_fdt_send_errors(sin.sin_addr.s_addr,
+            sin.sin_port) == -1);
+    bip_set_send_multi(NULL);
+    bip_set_socket(-1);
+    testFDTClear();
+}
+#endif
+
 #ifdef TEST_BVLC
 int main(
     void)
@@ -1824,6 +2335,18 @@ int main(
     assert(rc);
     rc = ct_addTestFunction(pTest, testInternetAddress);
     assert(rc);
+#if defined(BBMD_ENABLED) && BBMD_ENABLED
+    rc = ct_addTestFunction(pTest, testFDTHash);
+    assert(rc);
+    rc = ct_addTestFunction(pTest, testFDTWheel);
+    assert(rc);
+    rc = ct_addTestFunction(pTest, testFDTRateLimit);
+    assert(rc);
+    rc = ct_addTestFunction(pTest, testFDTReadAck);
+    assert(rc);
+    rc = ct_addTestFunction(pTest, testFDTSendErrors);
+    assert(rc);
+#endif
     /* configure output */
     ct_setStream(pTest, stdout);
     ct_run(pTest);
@@ -334,6 +334,427 @@ int cov_notify_decode_service_request(
     return len;
 }
 
+/*
+COVNotificationMultiple-Request ::= SEQUENCE {
+    subscriberProcessIdentifier [0] Unsigned32,
+    initiatingDeviceIdentifier  [1] BACnetObjectIdentifier,
+    timeRemaining               [2] Unsigned,
+    timestamp                   [3] BACnetDateTime OPTIONAL,
+    listOfCOVNotifications      [4] SEQUENCE OF SEQUENCE {
+        monitoredObjectIdentifier [0] BACnetObjectIdentifier,
+        listOfValues              [1] SEQUENCE OF SEQUENCE {
+            propertyIdentifier    [0] BACnetPropertyIdentifier,
+            arrayIndex            [1] Unsigned OPTIONAL,
+            value                 [2] ABSTRACT-SYNTAX.&Type,
+            timeOfChange          [3] Time OPTIONAL
+            }
+        }
+    }
+*/
+
+/** Encode the fixed part of a COV-Notification-Multiple service request,
+ * up to and including the opening tag of the listOfCOVNotifications.
+ * The optional timestamp is not encoded.
+ *
+ * @param apdu - buffer to encode into, or NULL to get the length only
+ * @param data - the subscriber, device and timeRemaining to encode
+ * @return number of bytes encoded
+ */
+static int notify_multiple_encode_apdu_init(
+    uint8_t * apdu,
+    BACNET_COV_MULTIPLE_DATA * data)
+{
+    int len = 0;        /* length of each encoding */
+    int apdu_len = 0;   /* total length of the apdu, return value */
+
+    if (apdu) {
+        /* tag 0 - subscriberProcessIdentifier */
+        len =
+            encode_context_unsigned(&apdu[apdu_len], 0,
+            data->subscriberProcessIdentifier);
+        apdu_len += len;
+        /* tag 1 - initiatingDeviceIdentifier */
+        len =
+            encode_context_object_id(&apdu[apdu_len], 1, OBJECT_DEVICE,
+            data->initiatingDeviceIdentifier);
+        apdu_len += len;
+        /* tag 2 - timeRemaining */
+        len = encode_context_unsigned(&apdu[apdu_len], 2, data->timeRemaining);
+        apdu_len += len;
+        /* tag 4 - listOfCOVNotifications */
+        len = encode_opening_tag(&apdu[apdu_len], 4);
+        apdu_len += len;
+    }
+
+    return apdu_len;
+}
+
+/** Encode the header of a confirmed COV-Notification-Multiple request.
+ * The notifications are added with cov_notify_multiple_encode_apdu_object()
+ * and the request is finished with cov_notify_multiple_encode_apdu_end().
+ *
+ * @param apdu - buffer of at least MAX_APDU bytes
+ * @param invoke_id - invoke ID of the confirmed request
+ * @param data - the subscriber, device and timeRemaining to encode
+ * @return number of bytes encoded
+ */
+int ccov_notify_multiple_encode_apdu_init(
+    uint8_t * apdu,
+    uint8_t invoke_id,
+    BACNET_COV_MULTIPLE_DATA * data)
+{
+    int apdu_len = 0;   /* total length of the apdu, return value */
+
+    if (apdu && data) {
+        apdu[0] = PDU_TYPE_CONFIRMED_SERVICE_REQUEST;
+        apdu[1] = encode_max_segs_max_apdu(0, MAX_APDU);
+        apdu[2] = invoke_id;
+        apdu[3] = SERVICE_CONFIRMED_COV_NOTIFICATION_MULTIPLE;
+        apdu_len = 4;
+        apdu_len += notify_multiple_encode_apdu_init(&apdu[apdu_len], data);
+    }
+
+    return apdu_len;
+}
+
+/** Encode the header of an unconfirmed COV-Notification-Multiple request.
+ *
+ * @param apdu - buffer of at least MAX_APDU bytes
+ * @param data - the subscriber, device and timeRemaining to encode
+ * @return number of bytes encoded
+ */
+int ucov_notify_multiple_encode_apdu_init(
+    uint8_t * apdu,
+    BACNET_COV_MULTIPLE_DATA * data)
+{
+    int apdu_len = 0;   /* total length of the apdu, return value */
+
+    if (apdu && data) {
+        apdu[0] = PDU_TYPE_UNCONFIRMED_SERVICE_REQUEST;
+        apdu[1] = SERVICE_UNCONFIRMED_COV_NOTIFICATION_MULTIPLE;
+        apdu_len = 2;
+        apdu_len += notify_multiple_encode_apdu_init(&apdu[apdu_len], data);
+    }
+
+    return apdu_len;
+}
+
+/** Encode one monitored object and its list of values into a
+ * COV-Notification-Multiple request.  Property priorities are not part of
+ * this service and are ignored; the optional timeOfChange is not encoded.
+ *
+ * @param apdu - buffer to encode into
+ * @param object_id - the monitored object
+ * @param value_list - the values of the monitored object
+ * @return number of bytes encoded
+ */
+int cov_notify_multiple_encode_apdu_object(
+    uint8_t * apdu,
+    BACNET_OBJECT_ID * object_id,
+    BACNET_PROPERTY_VALUE * value_list)
+{
+    int len = 0;        /* length of each encoding */
+    int apdu_len = 0;   /* total length of the apdu, return value */
+    BACNET_PROPERTY_VALUE *value = NULL;        /* value in list */
+    BACNET_APPLICATION_DATA_VALUE *app_data = NULL;
+
+    if (apdu && object_id) {
+        /* tag 0 - monitoredObjectIdentifier */
+        len =
+            encode_context_object_id(&apdu[apdu_len], 0,
+            (int) object_id->type, object_id->instance);
+        apdu_len += len;
+        /* tag 1 - listOfValues */
+        len = encode_opening_tag(&apdu[apdu_len], 1);
+        apdu_len += len;
+        value = value_list;
+        while (value != NULL) {
+            /* tag 0 - propertyIdentifier */
+            len =
+                encode_context_enumerated(&apdu[apdu_len], 0,
+                value->propertyIdentifier);
+            apdu_len += len;
+            /* tag 1 - arrayIndex OPTIONAL */
+            if (value->propertyArrayIndex != BACNET_ARRAY_ALL) {
+                len =
+                    encode_context_unsigned(&apdu[apdu_len], 1,
+                    value->propertyArrayIndex);
+                apdu_len += len;
+            }
+            /* tag 2 - value */
+            len = encode_opening_tag(&apdu[apdu_len], 2);
+            apdu_len += len;
+            app_data = &value->value;
+            while (app_data != NULL) {
+                len =
+                    bacapp_encode_application_data(&apdu[apdu_len],
+                    app_data);
+                apdu_len += len;
+                app_data = app_data->next;
+            }
+            len = encode_closing_tag(&apdu[apdu_len], 2);
+            apdu_len += len;
+            value = value->next;
+        }
+        len = encode_closing_tag(&apdu[apdu_len], 1);
+        apdu_len += len;
+    }
+
+    return apdu_len;
+}
+
+/** Close the listOfCOVNotifications of a COV-Notification-Multiple request.
+ *
+ * @param apdu - buffer to encode into
+ * @return number of bytes encoded
+ */
+int cov_notify_multiple_encode_apdu_end(
+    uint8_t * apdu)
+{
+    int apdu_len = 0;
+
+    if (apdu) {
+        apdu_len = encode_closing_tag(&apdu[0], 4);
+    }
+
+    return apdu_len;
+}
+
+static int notify_multiple_encode_apdu(
+    uint8_t * apdu,
+    unsigned max_apdu_len,
+    int apdu_len,
+    BACNET_COV_MULTIPLE_DATA * data)
+{
+    int len = 0;        /* length of each encoding */
+    BACNET_COV_NOTIFICATION *notification = NULL;
+    /* big enough for any single notification that fits an APDU */
+    uint8_t buffer[MAX_APDU] = { 0 };
+
+    notification = data->listOfCOVNotifications;
+    while (notification != NULL) {
+        len =
+            cov_notify_multiple_encode_apdu_object(&buffer[0],
+            &notification->monitoredObjectIdentifier,
+            notification->listOfValues);
+        /* leave room for the closing tag */
+        if (!memcopylen(apdu_len, max_apdu_len, len + 1)) {
+            return BACNET_STATUS_ABORT;
+        }
+        apdu_len += memcopy(&apdu[0], &buffer[0], apdu_len, len,
+            max_apdu_len);
+        notification = notification->next;
+    }
+    apdu_len += cov_notify_multiple_encode_apdu_end(&apdu[apdu_len]);
+
+    return apdu_len;
+}
+
+int ccov_notify_multiple_encode_apdu(
+    uint8_t * apdu,
+    unsigned max_apdu_len,
+    uint8_t invoke_id,
+    BACNET_COV_MULTIPLE_DATA * data)
+{
+    int apdu_len = BACNET_STATUS_ERROR;   /* return value */
+
+    if (apdu && data && (max_apdu_len >= MAX_APDU)) {
+        apdu_len = ccov_notify_multiple_encode_apdu_init(apdu, invoke_id,
+            data);
+        apdu_len = notify_multiple_encode_apdu(apdu, max_apdu_len,
+            apdu_len, data);
+    }
+
+    return apdu_len;
+}
+
+int ucov_notify_multiple_encode_apdu(
+    uint8_t * apdu,
+    unsigned max_apdu_len,
+    BACNET_COV_MULTIPLE_DATA * data)
+{
+    int apdu_len = BACNET_STATUS_ERROR;   /* return value */
+
+    if (apdu && data && (max_apdu_len >= MAX_APDU)) {
+        apdu_len = ucov_notify_multiple_encode_apdu_init(apdu, data);
+        apdu_len = notify_multiple_encode_apdu(apdu, max_apdu_len,
+            apdu_len, data);
+    }
+
+    return apdu_len;
+}
+
+/* decode the service request only */
+/* COV-Multiple and Unconfirmed COV-Multiple are the same */
+int cov_notify_multiple_decode_service_request(
+    uint8_t * apdu,
+    unsigned apdu_len,
+    BACNET_COV_MULTIPLE_DATA * data)
+{
+    int len = 0;        /* return value */
+    int app_len = 0;
+    uint8_t tag_number = 0;
+    uint32_t len_value = 0;
+    uint32_t decoded_value = 0; /* for decoding */
+    uint16_t decoded_type = 0;  /* for decoding */
+    uint32_t property = 0;      /* for decoding */
+    BACNET_COV_NOTIFICATION *notification = NULL;
+    BACNET_PROPERTY_VALUE *value = NULL;        /* value in list */
+    BACNET_APPLICATION_DATA_VALUE *app_data = NULL;
+
+    if (!apdu_len || !data) {
+        return BACNET_STATUS_ERROR;
+    }
+    /* tag 0 - subscriberProcessIdentifier */
+    if (!decode_is_context_tag(&apdu[len], 0)) {
+        return BACNET_STATUS_ERROR;
+    }
+    len += decode_tag_number_and_value(&apdu[len], &tag_number, &len_value);
+    len += decode_unsigned(&apdu[len], len_value, &decoded_value);
+    data->subscriberProcessIdentifier = decoded_value;
+    /* tag 1 - initiatingDeviceIdentifier */
+    if (!decode_is_context_tag(&apdu[len], 1)) {
+        return BACNET_STATUS_ERROR;
+    }
+    len += decode_tag_number_and_value(&apdu[len], &tag_number, &len_value);
+    len +=
+        decode_object_id(&apdu[len], &decoded_type,
+        &data->initiatingDeviceIdentifier);
+    if (decoded_type != OBJECT_DEVICE) {
+        return BACNET_STATUS_ERROR;
+    }
+    /* tag 2 - timeRemaining */
+    if (!decode_is_context_tag(&apdu[len], 2)) {
+        return BACNET_STATUS_ERROR;
+    }
+    len += decode_tag_number_and_value(&apdu[len], &tag_number, &len_value);
+    len += decode_unsigned(&apdu[len], len_value, &decoded_value);
+    data->timeRemaining = decoded_value;
+    /* tag 3 - timestamp OPTIONAL - skipped */
+    if (decode_is_opening_tag_number(&apdu[len], 3)) {
+        len++;
+        while (!decode_is_closing_tag_number(&apdu[len], 3)) {
+            if ((unsigned) len >= apdu_len) {
+                return BACNET_STATUS_ERROR;
+            }
+            len +=
+                decode_tag_number_and_value(&apdu[len], &tag_number,
+                &len_value);
+            len += len_value;
+        }
+        len++;
+    }
+    /* tag 4: opening context tag - listOfCOVNotifications */
+    if (!decode_is_opening_tag_number(&apdu[len], 4)) {
+        return BACNET_STATUS_ERROR;
+    }
+    len++;
+    notification = data->listOfCOVNotifications;
+    if (notification == NULL) {
+        /* no space to store any notifications */
+        return BACNET_STATUS_ERROR;
+    }
+    while (notification != NULL) {
+        /* tag 0 - monitoredObjectIdentifier */
+        if (!decode_is_context_tag(&apdu[len], 0)) {
+            return BACNET_STATUS_ERROR;
+        }
+        len +=
+            decode_tag_number_and_value(&apdu[len], &tag_number, &len_value);
+        len +=
+            decode_object_id(&apdu[len], &decoded_type,
+            &notification->monitoredObjectIdentifier.instance);
+        notification->monitoredObjectIdentifier.type = decoded_type;
+        /* tag 1: opening context tag - listOfValues */
+        if (!decode_is_opening_tag_number(&apdu[len], 1)) {
+            return BACNET_STATUS_ERROR;
+        }
+        len++;
+        value = notification->listOfValues;
+        if (value == NULL) {
+            /* no space to store any values */
+            return BACNET_STATUS_ERROR;
+        }
+        while (value != NULL) {
+            /* tag 0 - propertyIdentifier */
+            if (!decode_is_context_tag(&apdu[len], 0)) {
+                return BACNET_STATUS_ERROR;
+            }
+            len +=
+                decode_tag_number_and_value(&apdu[len], &tag_number,
+                &len_value);
+            len += decode_enumerated(&apdu[len], len_value, &property);
+            value->propertyIdentifier = (BACNET_PROPERTY_ID) property;
+            /* tag 1 - arrayIndex OPTIONAL */
+            if (decode_is_context_tag(&apdu[len], 1)) {
+                len +=
+                    decode_tag_number_and_value(&apdu[len], &tag_number,
+                    &len_value);
+                len += decode_unsigned(&apdu[len], len_value, &decoded_value);
+                value->propertyArrayIndex = decoded_value;
+            } else {
+                value->propertyArrayIndex = BACNET_ARRAY_ALL;
+            }
+            /* tag 2: opening context tag - value */
+            if (!decode_is_opening_tag_number(&apdu[len], 2)) {
+                return BACNET_STATUS_ERROR;
+            }
+            len++;
+            app_data = &value->value;
+            while (!decode_is_closing_tag_number(&apdu[len], 2)) {
+                if (app_data == NULL) {
+                    /* out of room to store more values */
+                    return BACNET_STATUS_ERROR;
+                }
+                app_len =
+                    bacapp_decode_application_data(&apdu[len],
+                    apdu_len - len, app_data);
+                if (app_len < 0) {
+                    return BACNET_STATUS_ERROR;
+                }
+                len += app_len;
+                app_data = app_data->next;
+            }
+            len++;
+            /* tag 3 - timeOfChange OPTIONAL - skipped */
+            if (decode_is_context_tag(&apdu[len], 3)) {
+                len +=
+                    decode_tag_number_and_value(&apdu[len], &tag_number,
+                    &len_value);
+                len += len_value;
+            }
+            /* priority is not part of this service */
+            value->priority = BACNET_NO_PRIORITY;
+            /* end of list? */
+            if (decode_is_closing_tag_number(&apdu[len], 1)) {
+                value->next = NULL;
+                break;
+            }
+            value = value->next;
+            if (value == NULL) {
+                /* out of room to store more values */
+                return BACNET_STATUS_ERROR;
+            }
+        }
+        /* closing tag 1 */
+        len++;
+        /* end of list? */
+        if (decode_is_closing_tag_number(&apdu[len], 4)) {
+            notification->next = NULL;
+            break;
+        }
+        notification = notification->next;
+        if (notification == NULL) {
+            /* out of room to store more notifications */
+            return BACNET_STATUS_ERROR;
+        }
+    }
+    /* closing tag 4 */
+    len++;
+
+    return len;
+}
+
 /*
 12.11.38Active_COV_Subscriptions
 The Active_COV_Subscriptions property is a List of BACnetCOVSubscription,
@@ -938,6 +1359,129 @@ void testCOVNotify(
     testCCOVNotifyData(pTest, invoke_id, &data);
 }
 
+static void testCOVNotifyMultipleData(
+    Test * pTest,
+    BACNET_COV_MULTIPLE_DATA * data,
+    BACNET_COV_MULTIPLE_DATA * test_data)
+{
+    BACNET_COV_NOTIFICATION *notification = NULL;
+    BACNET_COV_NOTIFICATION *test_notification = NULL;
+    BACNET_PROPERTY_VALUE *value = NULL;
+    BACNET_PROPERTY_VALUE *test_value = NULL;
+
+    ct_test(pTest,
+        test_data->subscriberProcessIdentifier ==
+        data->subscriberProcessIdentifier);
+    ct_test(pTest,
+        test_data->initiatingDeviceIdentifier ==
+        data->initiatingDeviceIdentifier);
+    ct_test(pTest, test_data->timeRemaining == data->timeRemaining);
+    notification = data->listOfCOVNotifications;
+    test_notification = test_data->listOfCOVNotifications;
+    while (notification) {
+        ct_test(pTest, test_notification);
+        if (!test_notification) {
+            break;
+        }
+        ct_test(pTest,
+            test_notification->monitoredObjectIdentifier.type ==
+            notification->monitoredObjectIdentifier.type);
+        ct_test(pTest,
+            test_notification->monitoredObjectIdentifier.instance ==
+            notification->monitoredObjectIdentifier.instance);
+        value = notification->listOfValues;
+        test_value = test_notification->listOfValues;
+        while (value) {
+            ct_test(pTest, test_value);
+            if (test_value) {
+                ct_test(pTest,
+                    test_value->propertyIdentifier ==
+                    value->propertyIdentifier);
+                ct_test(pTest,
+                    test_value->propertyArrayIndex ==
+                    value->propertyArrayIndex);
+                ct_test(pTest,
+                    bacapp_same_value(&test_value->value, &value->value));
+                test_value = test_value->next;
+            }
+            value = value->next;
+        }
+        ct_test(pTest, test_value == NULL);
+        test_notification = test_notification->next;
+        notification = notification->next;
+    }
+    ct_test(pTest, test_notification == NULL);
+}
+
+void testCOVNotifyMultiple(
+    Test * pTest)
+{
+    uint8_t apdu[MAX_APDU] = { 0 };
+    int len = 0;
+    BACNET_COV_MULTIPLE_DATA data;
+    BACNET_COV_MULTIPLE_DATA test_data;
+    BACNET_COV_NOTIFICATION notification[2];
+    BACNET_COV_NOTIFICATION test_notification[3];
+    BACNET_PROPERTY_VALUE value_list[4] = {{0}};
+    BACNET_PROPERTY_VALUE test_value_list[3][3] = {{{0}}};
+    BACNET_COV_DATA link;
+    unsigned i = 0;
+
+    data.subscriberProcessIdentifier = 1;
+    data.initiatingDeviceIdentifier = 123;
+    data.timeRemaining = 456;
+    data.listOfCOVNotifications = &notification[0];
+    notification[0].monitoredObjectIdentifier.type = OBJECT_ANALOG_INPUT;
+    notification[0].monitoredObjectIdentifier.instance = 321;
+    cov_data_value_list_link(&link, &value_list[0], 2);
+    notification[0].listOfValues = link.listOfValues;
+    notification[0].next = &notification[1];
+    notification[1].monitoredObjectIdentifier.type = OBJECT_BINARY_OUTPUT;
+    notification[1].monitoredObjectIdentifier.instance = 4;
+    cov_data_value_list_link(&link, &value_list[2], 2);
+    notification[1].listOfValues = link.listOfValues;
+    notification[1].next = NULL;
+    for (i = 0; i < 4; i += 2) {
+        value_list[i].propertyIdentifier = PROP_PRESENT_VALUE;
+        value_list[i].propertyArrayIndex = BACNET_ARRAY_ALL;
+        value_list[i + 1].propertyIdentifier = PROP_STATUS_FLAGS;
+        value_list[i + 1].propertyArrayIndex = BACNET_ARRAY_ALL;
+        bacapp_parse_application_data(BACNET_APPLICATION_TAG_BIT_STRING,
+            "0100", &value_list[i + 1].value);
+    }
+    bacapp_parse_application_data(BACNET_APPLICATION_TAG_REAL, "21.0",
+        &value_list[0].value);
+    bacapp_parse_application_data(BACNET_APPLICATION_TAG_ENUMERATED, "1",
+        &value_list[2].value);
+    /* decode storage with room to spare */
+    test_data.listOfCOVNotifications = &test_notification[0];
+    for (i = 0; i < 3; i++) {
+        cov_data_value_list_link(&link, &test_value_list[i][0], 3);
+        test_notification[i].listOfValues = link.listOfValues;
+        test_notification[i].next =
+            (i < 2) ? &test_notification[i + 1] : NULL;
+    }
+
+    len = ucov_notify_multiple_encode_apdu(&apdu[0], sizeof(apdu), &data);
+    ct_test(pTest, len > 0);
+    ct_test(pTest, apdu[1] == SERVICE_UNCONFIRMED_COV_NOTIFICATION_MULTIPLE);
+    len =
+        cov_notify_multiple_decode_service_request(&apdu[2], len - 2,
+        &test_data);
+    ct_test(pTest, len > 0);
+    testCOVNotifyMultipleData(pTest, &data, &test_data);
+
+    len = ccov_notify_multiple_encode_apdu(&apdu[0], sizeof(apdu), 12, &data);
+    ct_test(pTest, len > 0);
+    ct_test(pTest, apdu[2] == 12);
+    ct_test(pTest, apdu[3] == SERVICE_CONFIRMED_COV_NOTIFICATION_MULTIPLE);
+    len =
+        cov_notify_multiple_decode_service_request(&apdu[4], len - 4,
+        &test_data);
+    ct_test(pTest, len > 0);
+    testCOVNotifyMultipleData(pTest, &data, &test_data);
+}
+
 void testCOVSubscribeData(
     Test * pTest,
     BACNET_SUBSCRIBE_COV_DATA * data,
@@ -1088,6 +1632,8 @@ int main(
     /* individual tests */
     rc = ct_addTestFunction(pTest, testCOVNotify);
     assert(rc);
+    rc = ct_addTestFunction(pTest, testCOVNotifyMultiple);
+    assert(rc);
     rc = ct_addTestFunction(pTest, testCOVSubscribe);
     assert(rc);
     rc = ct_addTestFunction(pTest, testCOVSubscribeProperty);
@@ -581,6 +581,56 @@ void tsm_free_invoke_id(
     (void) invokeID;
 }
 
+void tsm_free_invoke_id_peer(
+    BACNET_ADDRESS * src,
+    uint8_t invokeID)
+{
+    (void) src;
+    (void) invokeID;
+}
+
+#if (MAX_SEGMENTED_RESPONSES)
+void tsm_segment_ack_handler(
+    BACNET_ADDRESS * src,
+    uint8_t invokeID,
+    uint8_t sequence_number,
+    uint8_t actual_window_size,
+    bool nak)
+{
+    (void) src;
+    (void) invokeID;
+    (void) sequence_number;
+    (void) actual_window_size;
+    (void) nak;
+}
+
+void tsm_segmented_response_abort(
+    BACNET_ADDRESS * src,
+    uint8_t invokeID)
+{
+    (void) src;
+    (void) invokeID;
+}
+#endif
+
+#if (MAX_SEGMENTED_CONFIRMATIONS)
+bool tsm_segmented_confirmation(
+    BACNET_ADDRESS * src,
+    BACNET_CONFIRMED_SERVICE_ACK_DATA * service_ack_data,
+    uint8_t service_choice,
+    uint8_t ** service_request,
+    uint16_t * service_request_len)
+{
+    (void) src;
+    (void) service_ack_data;
+    (void) service_choice;
+    (void) service_request;
+    (void) service_request_len;
+
+    return false;
+}
+#endif
+
 void iam_handler(
     uint8_t * service_request,
     uint16_t service_len,
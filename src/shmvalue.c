@@ -0,0 +1,569 @@
+/**
+* @file
+*
+* @section LICENSE
+*
+* This program is free software; you can redistribute it and/or
+* modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation; either version 2
+* of the License, or (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program; if not, write to:
+* The Free Software Foundation, Inc.
+* 59 Temple Place - Suite 330
+* Boston, MA  02111-1307, USA.
+*
+* @section DESCRIPTION
+*
+* Shared memory table of present values.  Field I/O processes publish
+* values at a high rate without touching the file system, and the
+* BACnet server picks up the changed points from the change counter
+* and the per point sequence.
+*/
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include "shmvalue.h"
+
+/* how often a reader retries a point that is being written */
+#ifndef SHM_VALUE_READ_RETRIES
+#define SHM_VALUE_READ_RETRIES 100
+#endif
+/* how often a publisher waits for the register lock before it checks
+   that the process holding it is still there */
+#ifndef SHM_VALUE_LOCK_SPINS
+#define SHM_VALUE_LOCK_SPINS 1000
+#endif
+
+static size_t shm_value_length(
+    unsigned size)
+{
+    return sizeof(SHM_VALUE_HEADER) + (size * sizeof(SHM_VALUE_POINT));
+}
+
+static SHM_VALUE_TABLE *shm_value_map(
+    int fd,
+    size_t length)
+{
+    SHM_VALUE_TABLE *table;
+    void *addr;
+
+    addr = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (addr == MAP_FAILED) {
+        return NULL;
+    }
+    table = calloc(1, sizeof(SHM_VALUE_TABLE));
+    if (!table) {
+        munmap(addr, length);
+        return NULL;
+    }
+    table->header = (SHM_VALUE_HEADER *) addr;
+    table->points =
+        (SHM_VALUE_POINT *) ((uint8_t *) addr + sizeof(SHM_VALUE_HEADER));
+    table->length = length;
+
+    return table;
+}
+
+/** Create the table, or attach to it if it exists with the same size,
+ * so that the registered points survive a restart of the server.
+ *
+ * @param name - name of the shared memory object, e.g. SHM_VALUE_NAME
+ * @param size - number of points the table can hold
+ * @return the table, or NULL on failure
+ */
+SHM_VALUE_TABLE *shm_value_create(
+    const char *name,
+    unsigned size)
+{
+    SHM_VALUE_TABLE *table = NULL;
+    SHM_VALUE_HEADER *header;
+    size_t length = shm_value_length(size);
+    struct stat s;
+    int fd;
+
+    if (!size) {
+        return NULL;
+    }
+    fd = shm_open(name, O_RDWR | O_CREAT, 0666);
+    if (fd < 0) {
+        return NULL;
+    }
+    if ((fstat(fd, &s) == 0) && ((size_t) s.st_size == length)) {
+        table = shm_value_map(fd, length);
+        header = table ? table->header : NULL;
+        if (header && ((header->magic != SHM_VALUE_MAGIC) ||
+                (header->version != SHM_VALUE_VERSION) ||
+                (header->size != size))) {
+            shm_value_close(table);
+            table = NULL;
+        }
+    }
+    if (!table) {
+        /* start with an empty table */
+        if ((ftruncate(fd, 0) != 0) || (ftruncate(fd, length) != 0)) {
+            close(fd);
+            return NULL;
+        }
+        table = shm_value_map(fd, length);
+        if (table) {
+            header = table->header;
+            header->version = SHM_VALUE_VERSION;
+            header->size = size;
+            header->count = 0;
+            header->changes = 0;
+            header->register_lock = 0;
+            __sync_synchronize();
+            header->magic = SHM_VALUE_MAGIC;
+        }
+    }
+    close(fd);
+    if (table) {
+        table->sequence = calloc(size, sizeof(uint32_t));
+        if (!table->sequence) {
+            shm_value_close(table);
+            table = NULL;
+        }
+    }
+
+    return table;
+}
+
+/** Attach to a table created by the server.
+ *
+ * @param name - name of the shared memory object, e.g. SHM_VALUE_NAME
+ * @return the table, or NULL if it does not exist or is not valid
+ */
+SHM_VALUE_TABLE *shm_value_open(
+    const char *name)
+{
+    SHM_VALUE_TABLE *table = NULL;
+    SHM_VALUE_HEADER *header;
+    struct stat s;
+    int fd;
+
+    fd = shm_open(name, O_RDWR, 0);
+    if (fd < 0) {
+        return NULL;
+    }
+    if ((fstat(fd, &s) == 0) &&
+        ((size_t) s.st_size >= sizeof(SHM_VALUE_HEADER))) {
+        table = shm_value_map(fd, s.st_size);
+    }
+    close(fd);
+    if (table) {
+        header = table->header;
+        if ((header->magic != SHM_VALUE_MAGIC) ||
+            (header->version != SHM_VALUE_VERSION) ||
+            (shm_value_length(header->size) > table->length)) {
+            shm_value_close(table);
+            table = NULL;
+        }
+    }
+
+    return table;
+}
+
+void shm_value_close(
+    SHM_VALUE_TABLE * table)
+{
+    if (table) {
+        munmap(table->header, table->length);
+        free(table->sequence);
+        free(table);
+    }
+}
+
+static unsigned shm_value_count(
+    SHM_VALUE_TABLE * table)
+{
+    unsigned count = table->header->count;
+
+    if (count > table->header->size) {
+        count = table->header->size;
+    }
+    return count;
+}
+
+/* The publishers register one at a time.  The lock holds the process
+   ID of its owner, so it is taken over from a publisher that died. */
+static void shm_value_lock(
+    SHM_VALUE_HEADER * header)
+{
+    uint32_t self = (uint32_t) getpid();
+    uint32_t owner;
+    unsigned spins = 0;
+
+    for (;;) {
+        owner = __sync_val_compare_and_swap(&header->register_lock, 0, self);
+        if (owner == 0) {
+            return;
+        }
+        if (++spins < SHM_VALUE_LOCK_SPINS) {
+            sched_yield();
+            continue;
+        }
+        spins = 0;
+        if ((kill((pid_t) owner, 0) < 0) && (errno == ESRCH) &&
+            __sync_bool_compare_and_swap(&header->register_lock, owner,
+                self)) {
+            return;
+        }
+    }
+}
+
+static void shm_value_unlock(
+    SHM_VALUE_HEADER * header)
+{
+    __sync_synchronize();
+    header->register_lock = 0;
+}
+
+/** Find the point of an object, or add it to the table.
+ *
+ * @return index of the point, or -1 if the table is full
+ */
+int shm_value_register(
+    SHM_VALUE_TABLE * table,
+    BACNET_OBJECT_TYPE object_type,
+    uint32_t object_instance)
+{
+    SHM_VALUE_POINT *point;
+    unsigned count, index;
+    int status = -1;
+
+    if (!table) {
+        return -1;
+    }
+    shm_value_lock(table->header);
+    count = shm_value_count(table);
+    for (index = 0; index < count; index++) {
+        point = &table->points[index];
+        if ((point->object_type == (uint32_t) object_type) &&
+            (point->object_instance == object_instance)) {
+            status = (int) index;
+            break;
+        }
+    }
+    if ((status < 0) && (count < table->header->size)) {
+        point = &table->points[count];
+        point->object_type = object_type;
+        point->object_instance = object_instance;
+        point->reliability = RELIABILITY_NO_FAULT_DETECTED;
+        /* the reader skips the point until it is published */
+        point->sequence = 0;
+        /* counted once it is written */
+        __sync_synchronize();
+        table->header->count = count + 1;
+        status = (int) count;
+    }
+    shm_value_unlock(table->header);
+
+    return status;
+}
+
+/** Write a new value of a point.
+ *
+ * @return true if the point was written
+ */
+bool shm_value_publish(
+    SHM_VALUE_TABLE * table,
+    int index,
+    double value,
+    BACNET_RELIABILITY reliability)
+{
+    SHM_VALUE_POINT *point;
+    struct timeval tv;
+
+    if (!table || (index < 0) ||
+        ((unsigned) index >= shm_value_count(table))) {
+        return false;
+    }
+    point = &table->points[index];
+    gettimeofday(&tv, NULL);
+    point->sequence++;
+    __sync_synchronize();
+    point->value = value;
+    point->reliability = reliability;
+    point->timestamp = ((uint64_t) tv.tv_sec * 1000) + (tv.tv_usec / 1000);
+    __sync_synchronize();
+    point->sequence++;
+    __sync_fetch_and_add(&table->header->changes, 1);
+
+    return true;
+}
+
+/* copy a point; returns its sequence, or zero if it was not readable */
+static uint32_t shm_value_copy(
+    SHM_VALUE_POINT * point,
+    SHM_VALUE_DATA * data)
+{
+    uint32_t sequence;
+    unsigned retries = SHM_VALUE_READ_RETRIES;
+
+    do {
+        sequence = point->sequence;
+        if (sequence & 1) {
+            continue;
+        }
+        __sync_synchronize();
+        data->object_type = (BACNET_OBJECT_TYPE) point->object_type;
+        data->object_instance = point->object_instance;
+        data->reliability = (BACNET_RELIABILITY) point->reliability;
+        data->value = point->value;
+        data->timestamp = point->timestamp;
+        __sync_synchronize();
+        if (sequence == point->sequence) {
+            return sequence;
+        }
+    } while (--retries);
+
+    return 0;
+}
+
+/** Read a consistent copy of a point.
+ *
+ * @return true if the point was published and could be read
+ */
+bool shm_value_read(
+    SHM_VALUE_TABLE * table,
+    int index,
+    SHM_VALUE_DATA * data)
+{
+    if (!table || !data || (index < 0) ||
+        ((unsigned) index >= shm_value_count(table))) {
+        return false;
+    }
+
+    return (shm_value_copy(&table->points[index], data) != 0);
+}
+
+/** Call back for every point that was published since the last poll.
+ * Only the change counter is read when nothing was published.
+ *
+ * @return the number of changed points
+ */
+unsigned shm_value_poll(
+    SHM_VALUE_TABLE * table,
+    shm_value_function callback,
+    void *context)
+{
+    SHM_VALUE_DATA data;
+    unsigned count, index, changed = 0;
+    uint32_t changes, sequence;
+
+    if (!table || !table->sequence) {
+        return 0;
+    }
+    changes = table->header->changes;
+    if (changes == table->changes) {
+        return 0;
+    }
+    table->changes = changes;
+    __sync_synchronize();
+    count = shm_value_count(table);
+    for (index = 0; index < count; index++) {
+        if (table->points[index].sequence == table->sequence[index]) {
+            continue;
+        }
+        sequence = shm_value_copy(&table->points[index], &data);
+        if (!sequence) {
+            /* still being written; look again on the next poll */
+            table->changes--;
+            continue;
+        }
+        table->sequence[index] = sequence;
+        changed++;
+        if (callback) {
+            callback(&data, context);
+        }
+    }
+
+    return changed;
+}
+
+#ifdef TEST
+#include <assert.h>
+#include <stdio.h>
+#include <sys/wait.h>
+#include "ctest.h"
+
+static unsigned Test_Callback_Count;
+static SHM_VALUE_DATA Test_Callback_Data;
+
+static void testShmValueCallback(
+    const SHM_VALUE_DATA * data,
+    void *context)
+{
+    (void) context;
+    Test_Callback_Count++;
+    Test_Callback_Data = *data;
+}
+
+void testShmValue(
+    Test * pTest)
+{
+    SHM_VALUE_TABLE *server, *publisher;
+    SHM_VALUE_DATA data;
+    char name[32];
+    int index, index2;
+
+    snprintf(name, sizeof(name), "/bacnet_test_%d", (int) getpid());
+    publisher = shm_value_open(name);
+    ct_test(pTest, publisher == NULL);
+    server = shm_value_create(name, 2);
+    ct_test(pTest, server != NULL);
+    publisher = shm_value_open(name);
+    ct_test(pTest, publisher != NULL);
+    /* nothing published yet */
+    ct_test(pTest, shm_value_poll(server, testShmValueCallback, NULL) == 0);
+
+    index = shm_value_register(publisher, OBJECT_ANALOG_INPUT, 5);
+    ct_test(pTest, index == 0);
+    ct_test(pTest, shm_value_register(publisher, OBJECT_ANALOG_INPUT,
+            5) == index);
+    index2 = shm_value_register(publisher, OBJECT_BINARY_INPUT, 5);
+    ct_test(pTest, index2 == 1);
+    ct_test(pTest, shm_value_register(publisher, OBJECT_BINARY_INPUT,
+            6) == -1);
+    ct_test(pTest, shm_value_read(server, index, &data) == false);
+    ct_test(pTest, shm_value_poll(server, testShmValueCallback, NULL) == 0);
+
+    ct_test(pTest, shm_value_publish(publisher, index, 21.5,
+            RELIABILITY_NO_FAULT_DETECTED));
+    ct_test(pTest, shm_value_publish(publisher, index, 22.5,
+            RELIABILITY_OVER_RANGE));
+    Test_Callback_Count = 0;
+    ct_test(pTest, shm_value_poll(server, testShmValueCallback, NULL) == 1);
+    ct_test(pTest, Test_Callback_Count == 1);
+    ct_test(pTest, Test_Callback_Data.object_type == OBJECT_ANALOG_INPUT);
+    ct_test(pTest, Test_Callback_Data.object_instance == 5);
+    ct_test(pTest, Test_Callback_Data.value == 22.5);
+    ct_test(pTest, Test_Callback_Data.reliability == RELIABILITY_OVER_RANGE);
+    ct_test(pTest, Test_Callback_Data.timestamp != 0);
+    ct_test(pTest, shm_value_poll(server, testShmValueCallback, NULL) == 0);
+
+    ct_test(pTest, shm_value_publish(publisher, index2, 1,
+            RELIABILITY_NO_FAULT_DETECTED));
+    ct_test(pTest, shm_value_publish(publisher, 2, 1,
+            RELIABILITY_NO_FAULT_DETECTED) == false);
+    ct_test(pTest, shm_value_poll(server, testShmValueCallback, NULL) == 1);
+    ct_test(pTest, Test_Callback_Data.object_type == OBJECT_BINARY_INPUT);
+    ct_test(pTest, shm_value_read(server, index, &data));
+    ct_test(pTest, data.value == 22.5);
+
+    /* a restarted server keeps the registered points */
+    shm_value_close(server);
+    server = shm_value_create(name, 2);
+    ct_test(pTest, server != NULL);
+    ct_test(pTest, shm_value_poll(server, testShmValueCallback, NULL) == 2);
+    ct_test(pTest, shm_value_register(publisher, OBJECT_BINARY_INPUT,
+            5) == index2);
+
+    shm_value_close(publisher);
+    shm_value_close(server);
+    shm_unlink(name);
+}
+
+/* publishers in several processes register the same points at once */
+void testShmValueRegister(
+    Test * pTest)
+{
+    SHM_VALUE_TABLE *server, *publisher;
+    SHM_VALUE_DATA data;
+    char name[32];
+    unsigned points = 64;
+    unsigned publishers = 4;
+    unsigned i, j;
+    int status;
+    pid_t pid;
+
+    snprintf(name, sizeof(name), "/bacnet_test_%d", (int) getpid());
+    server = shm_value_create(name, points);
+    ct_test(pTest, server != NULL);
+    for (i = 0; i < publishers; i++) {
+        pid = fork();
+        if (pid == 0) {
+            publisher = shm_value_open(name);
+            for (j = 0; publisher && (j < points); j++) {
+                /* half of them in the other order */
+                if (shm_value_register(publisher, OBJECT_ANALOG_INPUT,
+                        (i & 1) ? j : points - 1 - j) < 0) {
+                    _exit(1);
+                }
+            }
+            _exit(publisher ? 0 : 1);
+        }
+        ct_test(pTest, pid > 0);
+    }
+    for (i = 0; i < publishers; i++) {
+        ct_test(pTest, wait(&status) > 0);
+        ct_test(pTest, WIFEXITED(status) && (WEXITSTATUS(status) == 0));
+    }
+    /* each point once, and no more than fit */
+    ct_test(pTest, server->header->count == points);
+    ct_test(pTest, server->header->register_lock == 0);
+    for (i = 0; i < points; i++) {
+        for (j = i + 1; j < points; j++) {
+            ct_test(pTest,
+                server->points[i].object_instance !=
+                server->points[j].object_instance);
+        }
+    }
+    ct_test(pTest, shm_value_register(server, OBJECT_ANALOG_INPUT,
+            points) == -1);
+    ct_test(pTest, server->header->count == points);
+    ct_test(pTest, shm_value_read(server, 0, &data) == false);
+
+    /* the lock of a publisher that died is taken over */
+    pid = fork();
+    if (pid == 0) {
+        _exit(0);
+    }
+    ct_test(pTest, waitpid(pid, &status, 0) == pid);
+    server->header->register_lock = (uint32_t) pid;
+    ct_test(pTest, shm_value_register(server, OBJECT_ANALOG_INPUT, 0) >= 0);
+    ct_test(pTest, server->header->register_lock == 0);
+
+    shm_value_close(server);
+    shm_unlink(name);
+}
+
+#ifdef TEST_SHM_VALUE
+int main(
+    void)
+{
+    Test *pTest;
+    bool rc;
+
+    pTest = ct_create("BACnet Shared Memory Values", NULL);
+    /* individual tests */
+    rc = ct_addTestFunction(pTest, testShmValue);
+    assert(rc);
+    rc = ct_addTestFunction(pTest, testShmValueRegister);
+    assert(rc);
+
+    ct_setStream(pTest, stdout);
+    ct_run(pTest);
+    (void) ct_report(pTest);
+    ct_destroy(pTest);
+
+    return 0;
+}
+#endif /* TEST_SHM_VALUE */
+#endif /* TEST */
@@ -35,6 +35,7 @@
 #include <stdbool.h>
 #include <stdint.h>
 #include <stddef.h>
+#include <string.h>
 #include "bits.h"
 #include "apdu.h"
 #include "bacdef.h"
@@ -46,6 +47,7 @@
 #include "handlers.h"
 #include "address.h"
 #include "bacaddr.h"
+#include "abort.h"
 
 /** @file tsm.c  BACnet Transaction State Machine operations  */
 
@@ -55,16 +57,90 @@
 /* If we are only a server and only initiate broadcasts, */
 /* then we don't need a TSM layer. */
 
-/* FIXME: not coded for segmentation */
-
 /* declare space for the TSM transactions, and set it up in the init. */
 /* table rules: an Invoke ID = 0 is an unused spot in the table */
 static BACNET_TSM_DATA TSM_List[MAX_TSM_TRANSACTIONS];
 
+/* the spot in the table of each invoke ID shared by all
+   destinations: index + 1, or 0 if unused */
+static uint16_t TSM_Invoke_Index[256];
+
+/* unused spots in the table: the ones given back are on the free
+   stack, and the ones after TSM_Used were never used */
+static uint16_t TSM_Free_Stack[MAX_TSM_TRANSACTIONS];
+static unsigned TSM_Free_Count;
+static unsigned TSM_Used;
+
 /* invoke ID for incrementing between subsequent calls. */
 static uint8_t Current_Invoke_ID = 1;
 
+/* The destinations with their own invoke IDs, found by a hash of
+   the address.  A peer is only kept while it has transactions, so
+   there are never more peers than transactions.  An invoke ID is
+   either shared by all, or used by peers: TSM_Invoke_Peers counts
+   the peers using it.  The peers use no more than 255 less
+   TSM_SHARED_INVOKE_IDS different invoke IDs, and then take the ones
+   other peers use, so the shared ones do not run out. */
+#ifndef TSM_PEER_HASH_SIZE
+#define TSM_PEER_HASH_SIZE 64
+#endif
+#ifndef TSM_SHARED_INVOKE_IDS
+#define TSM_SHARED_INVOKE_IDS 64
+#endif
+static BACNET_TSM_PEER_DATA TSM_Peer_List[MAX_TSM_TRANSACTIONS];
+/* first peer of each bucket: index + 1, or 0 */
+static uint16_t TSM_Peer_Hash[TSM_PEER_HASH_SIZE];
+static uint16_t TSM_Peer_Free_Stack[MAX_TSM_TRANSACTIONS];
+static unsigned TSM_Peer_Free_Count;
+static unsigned TSM_Peers_Used;
+static uint16_t TSM_Invoke_Peers[256];
+/* the number of invoke IDs used by peers */
+static unsigned TSM_Invoke_Peers_Used;
+static unsigned TSM_Peer_Transactions_Max = MAX_TSM_PEER_TRANSACTIONS;
+
 static tsm_timeout_function Timeout_Function;
+static tsm_peer_timeout_function Peer_Timeout_Function;
+static tsm_peer_limit_function Peer_Limit_Function;
+
+/* The request and segment timers are kept in a timer wheel: each
+   bucket lists the transactions that expire in one tick of the wheel,
+   modulo the wheel size, so a timer tick only visits the buckets that
+   the time went past, and only the transactions that have a timer. */
+#ifndef TSM_TIMER_WHEEL_SIZE
+#define TSM_TIMER_WHEEL_SIZE 64
+#endif
+#ifndef TSM_TIMER_WHEEL_TICK
+#define TSM_TIMER_WHEEL_TICK 100
+#endif
+/* first transaction of each bucket: index + 1, or 0 */
+static uint16_t TSM_Timer_Wheel[TSM_TIMER_WHEEL_SIZE];
+/* the TSM time, milliseconds since start */
+static uint32_t TSM_Time;
+
+/* The copies of the PDUs for retries are kept in a pool of blocks,
+   so that each one takes the blocks it needs.  The pool has room
+   for two blocks per transaction and four PDUs of MAX_PDU, but not
+   more than MAX_PDU per transaction. */
+#ifndef TSM_PDU_BLOCK_SIZE
+#define TSM_PDU_BLOCK_SIZE 64
+#endif
+#define TSM_PDU_BLOCKS_PER_PDU \
+    ((MAX_PDU + TSM_PDU_BLOCK_SIZE - 1) / TSM_PDU_BLOCK_SIZE)
+#ifndef TSM_PDU_BLOCKS
+#define TSM_PDU_BLOCKS \
+    (((2 * MAX_TSM_TRANSACTIONS) + (4 * TSM_PDU_BLOCKS_PER_PDU)) < \
+    (MAX_TSM_TRANSACTIONS * TSM_PDU_BLOCKS_PER_PDU) ? \
+    ((2 * MAX_TSM_TRANSACTIONS) + (4 * TSM_PDU_BLOCKS_PER_PDU)) : \
+    (MAX_TSM_TRANSACTIONS * TSM_PDU_BLOCKS_PER_PDU))
+#endif
+static uint8_t TSM_PDU_Pool[TSM_PDU_BLOCKS][TSM_PDU_BLOCK_SIZE];
+/* next block of a PDU, or of the free list: block + 1, or 0 */
+static uint16_t TSM_PDU_Block_Next[TSM_PDU_BLOCKS];
+/* unused blocks: the free list, and the ones after TSM_PDU_Blocks_Used */
+static uint16_t TSM_PDU_Block_Free;
+static unsigned TSM_PDU_Blocks_Used;
+/* a retry is sent from here */
+static uint8_t TSM_Retry_PDU[MAX_PDU];
 
 void tsm_set_timeout_handler(
     tsm_timeout_function pFunction)
@@ -72,71 +148,343 @@ void tsm_set_timeout_handler(
     Timeout_Function = pFunction;
 }
 
+/* called with the destination for every transaction that fails */
+void tsm_set_peer_timeout_handler(
+    tsm_peer_timeout_function pFunction)
+{
+    Peer_Timeout_Function = pFunction;
+}
+
+/* replaces the limit of requests in flight to each destination */
+void tsm_set_peer_limit_handler(
+    tsm_peer_limit_function pFunction)
+{
+    Peer_Limit_Function = pFunction;
+}
+
+/* hash of the address octets that bacnet_address_same() compares:
+   the network and the remote address, and the MAC only when local */
+static unsigned tsm_peer_hash(
+    BACNET_ADDRESS * address)
+{
+    uint32_t hash = 2166136261UL;
+    unsigned i = 0;
+
+    hash = (hash ^ (address->net & 0xFF)) * 16777619UL;
+    hash = (hash ^ (address->net >> 8)) * 16777619UL;
+    for (i = 0; (i < address->len) && (i < MAX_MAC_LEN); i++) {
+        hash = (hash ^ address->adr[i]) * 16777619UL;
+    }
+    if (address->net == 0) {
+        for (i = 0; (i < address->mac_len) && (i < MAX_MAC_LEN); i++) {
+            hash = (hash ^ address->mac[i]) * 16777619UL;
+        }
+    }
+
+    return hash % TSM_PEER_HASH_SIZE;
+}
+
 /* returns MAX_TSM_TRANSACTIONS if not found */
-static uint8_t tsm_find_invokeID_index(
-    uint8_t invokeID)
+static uint16_t tsm_peer_find(
+    BACNET_ADDRESS * address)
+{
+    uint16_t next = TSM_Peer_Hash[tsm_peer_hash(address)];
+
+    while (next) {
+        if (bacnet_address_same(&TSM_Peer_List[next - 1].address, address)) {
+            return next - 1;
+        }
+        next = TSM_Peer_List[next - 1].HashNext;
+    }
+
+    return MAX_TSM_TRANSACTIONS;
+}
+
+/* returns MAX_TSM_TRANSACTIONS if there is no room */
+static uint16_t tsm_peer_add(
+    BACNET_ADDRESS * address)
 {
-    unsigned i = 0;     /* counter */
-    uint8_t index = MAX_TSM_TRANSACTIONS;       /* return value */
+    uint16_t peer = MAX_TSM_TRANSACTIONS;
+    unsigned bucket = 0;
 
-    for (i = 0; i < MAX_TSM_TRANSACTIONS; i++) {
-        if (TSM_List[i].InvokeID == invokeID) {
-            index = (uint8_t) i;
+    if (TSM_Peer_Free_Count) {
+        TSM_Peer_Free_Count--;
+        peer = TSM_Peer_Free_Stack[TSM_Peer_Free_Count];
+    } else if (TSM_Peers_Used < MAX_TSM_TRANSACTIONS) {
+        peer = (uint16_t) TSM_Peers_Used;
+        TSM_Peers_Used++;
+    } else {
+        return peer;
+    }
+    bacnet_address_copy(&TSM_Peer_List[peer].address, address);
+    /* start where the shared ones are, and move those on, not to
+       reuse the invoke ID of a peer that was just removed, whose
+       reply may still be handled */
+    TSM_Peer_List[peer].InvokeID = Current_Invoke_ID;
+    Current_Invoke_ID++;
+    if (Current_Invoke_ID == 0) {
+        Current_Invoke_ID = 1;
+    }
+    TSM_Peer_List[peer].Count = 0;
+    TSM_Peer_List[peer].First = 0;
+    bucket = tsm_peer_hash(address);
+    TSM_Peer_List[peer].HashNext = TSM_Peer_Hash[bucket];
+    TSM_Peer_Hash[bucket] = peer + 1;
+
+    return peer;
+}
+
+static void tsm_peer_remove(
+    uint16_t peer)
+{
+    uint16_t *link = &TSM_Peer_Hash[tsm_peer_hash(&TSM_Peer_List[peer].
+            address)];
+
+    while (*link) {
+        if (*link == peer + 1) {
+            *link = TSM_Peer_List[peer].HashNext;
             break;
         }
+        link = &TSM_Peer_List[*link - 1].HashNext;
+    }
+    TSM_Peer_List[peer].HashNext = 0;
+    TSM_Peer_Free_Stack[TSM_Peer_Free_Count] = peer;
+    TSM_Peer_Free_Count++;
+}
+
+/* the transaction of the peer with the invoke ID,
+   returns MAX_TSM_TRANSACTIONS if not found */
+static uint16_t tsm_peer_find_index(
+    uint16_t peer,
+    uint8_t invokeID)
+{
+    uint16_t next = TSM_Peer_List[peer].First;
+
+    while (next) {
+        if (TSM_List[next - 1].InvokeID == invokeID) {
+            return next - 1;
+        }
+        next = TSM_List[next - 1].PeerNext;
+    }
+
+    return MAX_TSM_TRANSACTIONS;
+}
+
+/* with the invoke IDs shared by all,
+   returns MAX_TSM_TRANSACTIONS if not found */
+static uint16_t tsm_find_invokeID_index(
+    uint8_t invokeID)
+{
+    uint16_t index = MAX_TSM_TRANSACTIONS;      /* return value */
+
+    if (invokeID && TSM_Invoke_Index[invokeID]) {
+        index = TSM_Invoke_Index[invokeID] - 1;
     }
 
     return index;
 }
 
-static uint8_t tsm_find_first_free_index(
-    void)
+/* with the invoke IDs of the address, then with the ones shared
+   by all, returns MAX_TSM_TRANSACTIONS if not found */
+static uint16_t tsm_find_index(
+    BACNET_ADDRESS * address,
+    uint8_t invokeID)
 {
-    unsigned i = 0;     /* counter */
-    uint8_t index = MAX_TSM_TRANSACTIONS;       /* return value */
+    uint16_t peer = MAX_TSM_TRANSACTIONS;
+    uint16_t index = MAX_TSM_TRANSACTIONS;
 
-    for (i = 0; i < MAX_TSM_TRANSACTIONS; i++) {
-        if (TSM_List[i].InvokeID == 0) {
-            index = (uint8_t) i;
-            break;
+    if (invokeID && address && (TSM_Peer_Free_Count < TSM_Peers_Used)) {
+        peer = tsm_peer_find(address);
+        if (peer < MAX_TSM_TRANSACTIONS) {
+            index = tsm_peer_find_index(peer, invokeID);
         }
     }
+    if (index == MAX_TSM_TRANSACTIONS) {
+        index = tsm_find_invokeID_index(invokeID);
+    }
 
     return index;
 }
 
-bool tsm_transaction_available(
+/* takes a spot from the free ones,
+   returns MAX_TSM_TRANSACTIONS if there is none */
+static uint16_t tsm_take_free_index(
     void)
 {
-    bool status = false;        /* return value */
-    unsigned i = 0;     /* counter */
+    uint16_t index = MAX_TSM_TRANSACTIONS;      /* return value */
 
-    for (i = 0; i < MAX_TSM_TRANSACTIONS; i++) {
-        if (TSM_List[i].InvokeID == 0) {
-            /* one is available! */
-            status = true;
-            break;
+    if (TSM_Free_Count) {
+        TSM_Free_Count--;
+        index = TSM_Free_Stack[TSM_Free_Count];
+    } else if (TSM_Used < MAX_TSM_TRANSACTIONS) {
+        index = (uint16_t) TSM_Used;
+        TSM_Used++;
+    }
+
+    return index;
+}
+
+/* the transaction failed: IDLE with a valid invoke ID */
+static void tsm_transaction_failed(
+    uint16_t index)
+{
+    BACNET_TSM_DATA *tsm = &TSM_List[index];
+
+    tsm->state = TSM_STATE_IDLE;
+    if (tsm->InvokeID != 0) {
+        if (Timeout_Function) {
+            Timeout_Function(tsm->InvokeID);
+        }
+        if (Peer_Timeout_Function) {
+            Peer_Timeout_Function(&tsm->dest, tsm->InvokeID);
         }
     }
+}
 
-    return status;
+static void tsm_timer_stop(
+    uint16_t index)
+{
+    BACNET_TSM_DATA *tsm = &TSM_List[index];
+    unsigned bucket = 0;
+
+    if (!tsm->TimerRunning) {
+        return;
+    }
+    if (tsm->TimerPrev) {
+        TSM_List[tsm->TimerPrev - 1].TimerNext = tsm->TimerNext;
+    } else {
+        bucket =
+            (tsm->TimerExpires / TSM_TIMER_WHEEL_TICK) % TSM_TIMER_WHEEL_SIZE;
+        TSM_Timer_Wheel[bucket] = tsm->TimerNext;
+    }
+    if (tsm->TimerNext) {
+        TSM_List[tsm->TimerNext - 1].TimerPrev = tsm->TimerPrev;
+    }
+    tsm->TimerNext = 0;
+    tsm->TimerPrev = 0;
+    tsm->TimerRunning = false;
+}
+
+/* (re)starts the timer of the transaction */
+static void tsm_timer_start(
+    uint16_t index,
+    uint32_t milliseconds)
+{
+    BACNET_TSM_DATA *tsm = &TSM_List[index];
+    unsigned bucket = 0;
+
+    tsm_timer_stop(index);
+    tsm->TimerExpires = TSM_Time + milliseconds;
+    bucket = (tsm->TimerExpires / TSM_TIMER_WHEEL_TICK) % TSM_TIMER_WHEEL_SIZE;
+    tsm->TimerPrev = 0;
+    tsm->TimerNext = TSM_Timer_Wheel[bucket];
+    if (tsm->TimerNext) {
+        TSM_List[tsm->TimerNext - 1].TimerPrev = index + 1;
+    }
+    TSM_Timer_Wheel[bucket] = index + 1;
+    tsm->TimerRunning = true;
 }
 
-uint8_t tsm_transaction_idle_count(
+static void tsm_pdu_free(
+    BACNET_TSM_DATA * tsm)
+{
+    uint16_t block = tsm->pdu_block;
+    uint16_t next = 0;
+
+    while (block) {
+        next = TSM_PDU_Block_Next[block - 1];
+        TSM_PDU_Block_Next[block - 1] = TSM_PDU_Block_Free;
+        TSM_PDU_Block_Free = block;
+        block = next;
+    }
+    tsm->pdu_block = 0;
+    tsm->apdu_len = 0;
+}
+
+static uint16_t tsm_pdu_block_take(
     void)
 {
-    uint8_t count = 0;  /* return value */
-    unsigned i = 0;     /* counter */
+    uint16_t block = 0;
+
+    if (TSM_PDU_Block_Free) {
+        block = TSM_PDU_Block_Free;
+        TSM_PDU_Block_Free = TSM_PDU_Block_Next[block - 1];
+    } else if (TSM_PDU_Blocks_Used < TSM_PDU_BLOCKS) {
+        TSM_PDU_Blocks_Used++;
+        block = (uint16_t) TSM_PDU_Blocks_Used;
+    }
+
+    return block;
+}
+
+/* copies the PDU into blocks of the pool,
+   returns false if the pool is out of blocks */
+static bool tsm_pdu_store(
+    BACNET_TSM_DATA * tsm,
+    uint8_t * pdu,
+    unsigned pdu_len)
+{
+    uint16_t block = 0;
+    uint16_t *link = &tsm->pdu_block;
+    unsigned offset = 0;
+    unsigned len = 0;
+
+    tsm_pdu_free(tsm);
+    if (pdu_len > MAX_PDU) {
+        return false;
+    }
+    while (offset < pdu_len) {
+        block = tsm_pdu_block_take();
+        if (!block) {
+            tsm_pdu_free(tsm);
+            return false;
+        }
+        TSM_PDU_Block_Next[block - 1] = 0;
+        *link = block;
+        link = &TSM_PDU_Block_Next[block - 1];
+        len = pdu_len - offset;
+        if (len > TSM_PDU_BLOCK_SIZE) {
+            len = TSM_PDU_BLOCK_SIZE;
+        }
+        memcpy(&TSM_PDU_Pool[block - 1][0], &pdu[offset], len);
+        offset += len;
+    }
+    tsm->apdu_len = pdu_len;
+
+    return true;
+}
+
+/* copies the PDU out of the blocks of the pool */
+static void tsm_pdu_load(
+    BACNET_TSM_DATA * tsm,
+    uint8_t * pdu)
+{
+    uint16_t block = tsm->pdu_block;
+    unsigned offset = 0;
+    unsigned len = 0;
 
-    for (i = 0; i < MAX_TSM_TRANSACTIONS; i++) {
-        if ((TSM_List[i].InvokeID == 0) &&
-            (TSM_List[i].state == TSM_STATE_IDLE)) {
-            /* one is available! */
-            count++;
+    while (block && (offset < tsm->apdu_len)) {
+        len = tsm->apdu_len - offset;
+        if (len > TSM_PDU_BLOCK_SIZE) {
+            len = TSM_PDU_BLOCK_SIZE;
         }
+        memcpy(&pdu[offset], &TSM_PDU_Pool[block - 1][0], len);
+        offset += len;
+        block = TSM_PDU_Block_Next[block - 1];
     }
+}
+
+bool tsm_transaction_available(
+    void)
+{
+    return ((TSM_Free_Count > 0) || (TSM_Used < MAX_TSM_TRANSACTIONS));
+}
 
-    return count;
+unsigned tsm_transaction_idle_count(
+    void)
+{
+    /* unused spots are always IDLE */
+    return TSM_Free_Count + (MAX_TSM_TRANSACTIONS - TSM_Used);
 }
 
 /* sets the invokeID */
@@ -156,38 +504,37 @@ void tsm_invokeID_set(
 uint8_t tsm_next_free_invokeID(
     void)
 {
-    uint8_t index = 0;
+    uint16_t index = 0;
     uint8_t invokeID = 0;
-    bool found = false;
+    unsigned tries = 0;
 
     /* is there even space available? */
     if (tsm_transaction_available()) {
-        while (!found) {
-            index = tsm_find_invokeID_index(Current_Invoke_ID);
-            if (index == MAX_TSM_TRANSACTIONS) {
-                /* Not found, so this invokeID is not used */
-                found = true;
-                /* set this id into the table */
-                index = tsm_find_first_free_index();
-                if (index != MAX_TSM_TRANSACTIONS) {
-                    TSM_List[index].InvokeID = invokeID = Current_Invoke_ID;
-                    TSM_List[index].state = TSM_STATE_IDLE;
-                    TSM_List[index].RequestTimer = apdu_timeout();
-                    /* update for the next call or check */
-                    Current_Invoke_ID++;
-                    /* skip zero - we treat that internally as invalid or no free */
-                    if (Current_Invoke_ID == 0) {
-                        Current_Invoke_ID = 1;
-                    }
-                }
-            } else {
-                /* found! This invokeID is already used */
-                /* try next one */
-                Current_Invoke_ID++;
-                /* skip zero - we treat that internally as invalid or no free */
-                if (Current_Invoke_ID == 0) {
-                    Current_Invoke_ID = 1;
-                }
+        /* skip the invoke IDs in use, by us or by the peers */
+        while (TSM_Invoke_Index[Current_Invoke_ID] ||
+            TSM_Invoke_Peers[Current_Invoke_ID]) {
+            tries++;
+            if (tries >= 255) {
+                return 0;
+            }
+            Current_Invoke_ID++;
+            /* skip zero - we treat that internally as invalid or no free */
+            if (Current_Invoke_ID == 0) {
+                Current_Invoke_ID = 1;
+            }
+        }
+        index = tsm_take_free_index();
+        if (index != MAX_TSM_TRANSACTIONS) {
+            TSM_List[index].InvokeID = invokeID = Current_Invoke_ID;
+            TSM_List[index].state = TSM_STATE_IDLE;
+            TSM_List[index].RetryCount = 0;
+            TSM_List[index].Peer = 0;
+            TSM_Invoke_Index[invokeID] = index + 1;
+            /* update for the next call or check */
+            Current_Invoke_ID++;
+            /* skip zero - we treat that internally as invalid or no free */
+            if (Current_Invoke_ID == 0) {
+                Current_Invoke_ID = 1;
             }
         }
     }
@@ -195,6 +542,116 @@ uint8_t tsm_next_free_invokeID(
     return invokeID;
 }
 
+/** Reserve a spot in the table for a request to the destination,
+ * with an invoke ID of its own.
+ * @param dest [in] the address the request is sent to
+ * @return the invoke ID, or 0 if the table is full, or the destination
+ *  has tsm_peer_transactions_max_dest() requests in flight
+ */
+uint8_t tsm_next_free_invokeID_peer(
+    BACNET_ADDRESS * dest)
+{
+    BACNET_TSM_PEER_DATA *peer_data;
+    uint16_t peer = 0;
+    uint16_t index = 0;
+    uint8_t invokeID = 0;
+    unsigned max_transactions = 0;
+    unsigned tries = 0;
+
+    if (!dest || !tsm_transaction_available()) {
+        return 0;
+    }
+    max_transactions = tsm_peer_transactions_max_dest(dest);
+    peer = tsm_peer_find(dest);
+    if (peer < MAX_TSM_TRANSACTIONS) {
+        if (TSM_Peer_List[peer].Count >= max_transactions) {
+            return 0;
+        }
+    } else if (max_transactions) {
+        /* there are fewer peers than transactions */
+        peer = tsm_peer_add(dest);
+    }
+    if (peer >= MAX_TSM_TRANSACTIONS) {
+        return 0;
+    }
+    peer_data = &TSM_Peer_List[peer];
+    /* skip the invoke IDs shared by all, and the ones of the peer,
+       and when the peers use too many, the ones no peer uses */
+    for (;;) {
+        if (peer_data->InvokeID == 0) {
+            peer_data->InvokeID = 1;
+        }
+        if (!TSM_Invoke_Index[peer_data->InvokeID] &&
+            (TSM_Invoke_Peers[peer_data->InvokeID] ||
+                (TSM_Invoke_Peers_Used < (255 - TSM_SHARED_INVOKE_IDS))) &&
+            (tsm_peer_find_index(peer,
+                    peer_data->InvokeID) == MAX_TSM_TRANSACTIONS)) {
+            break;
+        }
+        tries++;
+        if (tries >= 255) {
+            if (peer_data->Count == 0) {
+                tsm_peer_remove(peer);
+            }
+            return 0;
+        }
+        peer_data->InvokeID++;
+    }
+    index = tsm_take_free_index();
+    invokeID = peer_data->InvokeID;
+    peer_data->InvokeID++;
+    TSM_List[index].InvokeID = invokeID;
+    TSM_List[index].state = TSM_STATE_IDLE;
+    TSM_List[index].RetryCount = 0;
+    TSM_List[index].Peer = peer + 1;
+    TSM_List[index].PeerNext = peer_data->First;
+    bacnet_address_copy(&TSM_List[index].dest, dest);
+    peer_data->First = index + 1;
+    peer_data->Count++;
+    if (TSM_Invoke_Peers[invokeID] == 0) {
+        TSM_Invoke_Peers_Used++;
+    }
+    TSM_Invoke_Peers[invokeID]++;
+
+    return invokeID;
+}
+
+void tsm_peer_transactions_max_set(
+    unsigned max_transactions)
+{
+    TSM_Peer_Transactions_Max = max_transactions;
+}
+
+unsigned tsm_peer_transactions_max(
+    void)
+{
+    return TSM_Peer_Transactions_Max;
+}
+
+/** The number of requests that may be in flight to the destination:
+ * the one of the limit handler, if set, else tsm_peer_transactions_max(),
+ * and no more than MAX_TSM_MSTP_PEER_TRANSACTIONS for a one octet
+ * address, like MS/TP.
+ * @param dest [in] the address the requests are sent to
+ * @return the number of requests
+ */
+unsigned tsm_peer_transactions_max_dest(
+    BACNET_ADDRESS * dest)
+{
+    unsigned max_transactions = TSM_Peer_Transactions_Max;
+    uint8_t len = 0;
+
+    if (Peer_Limit_Function) {
+        return Peer_Limit_Function(dest);
+    }
+    len = dest->net ? dest->len : dest->mac_len;
+    if ((len == 1) && (max_transactions > MAX_TSM_MSTP_PEER_TRANSACTIONS)) {
+        max_transactions = MAX_TSM_MSTP_PEER_TRANSACTIONS;
+    }
+
+    return max_transactions;
+}
+
 void tsm_set_confirmed_unsegmented_transaction(
     uint8_t invokeID,
     BACNET_ADDRESS * dest,
@@ -202,22 +659,21 @@ void tsm_set_confirmed_unsegmented_transaction(
     uint8_t * apdu,
     uint16_t apdu_len)
 {
-    uint16_t j = 0;
-    uint8_t index;
+    uint16_t index;
 
     if (invokeID) {
-        index = tsm_find_invokeID_index(invokeID);
+        index = tsm_find_index(dest, invokeID);
         if (index < MAX_TSM_TRANSACTIONS) {
             /* SendConfirmedUnsegmented */
             TSM_List[index].state = TSM_STATE_AWAIT_CONFIRMATION;
             TSM_List[index].RetryCount = 0;
             /* start the timer */
-            TSM_List[index].RequestTimer = apdu_timeout();
-            /* copy the data */
-            for (j = 0; j < apdu_len; j++) {
-                TSM_List[index].apdu[j] = apdu[j];
+            tsm_timer_start(index, apdu_timeout());
+            /* copy the data - without room in the pool,
+               the request times out without retries */
+            if (!tsm_pdu_store(&TSM_List[index], apdu, apdu_len)) {
+                TSM_List[index].RetryCount = apdu_retries();
             }
-            TSM_List[index].apdu_len = apdu_len;
             npdu_copy_data(&TSM_List[index].npdu_data, ndpu_data);
             bacnet_address_copy(&TSM_List[index].dest, dest);
         }
@@ -235,8 +691,7 @@ bool tsm_get_transaction_pdu(
     uint8_t * apdu,
     uint16_t * apdu_len)
 {
-    uint16_t j = 0;
-    uint8_t index;
+    uint16_t index;
     bool found = false;
 
     if (invokeID) {
@@ -245,11 +700,8 @@ bool tsm_get_transaction_pdu(
         if (index < MAX_TSM_TRANSACTIONS) {
             /* FIXME: we may want to free the transaction so it doesn't timeout */
             /* retrieve the transaction */
-            /* FIXME: bounds check the pdu_len? */
             *apdu_len = (uint16_t) TSM_List[index].apdu_len;
-            for (j = 0; j < *apdu_len; j++) {
-                apdu[j] = TSM_List[index].apdu[j];
-            }
+            tsm_pdu_load(&TSM_List[index], apdu);
             npdu_copy_data(ndpu_data, &TSM_List[index].npdu_data);
             bacnet_address_copy(dest, &TSM_List[index].dest);
             found = true;
@@ -259,52 +711,684 @@ bool tsm_get_transaction_pdu(
     return found;
 }
 
+#if (MAX_SEGMENTED_RESPONSES) || (MAX_SEGMENTED_CONFIRMATIONS)
+/* buffer to encode each segment or Segment-ACK with its NPDU */
+static uint8_t TSM_Segment_PDU[MAX_PDU];
+/* the window size we propose as segment sender,
+   and the most we accept as segment receiver, 1..127 */
+#ifndef TSM_PROPOSED_WINDOW_SIZE
+#define TSM_PROPOSED_WINDOW_SIZE 16
+#endif
+static uint8_t TSM_Window_Size = TSM_PROPOSED_WINDOW_SIZE;
+
+/** Set the window size we propose when sending segments,
+ * and accept when receiving them.
+ * @param window_size [in] 1..127
+ */
+void tsm_segmented_window_size_set(
+    uint8_t window_size)
+{
+    if ((window_size >= 1) && (window_size <= 127)) {
+        TSM_Window_Size = window_size;
+    }
+}
+#endif
+
+#if (MAX_SEGMENTED_RESPONSES)
+/* segmented ComplexACKs we are sending as the responding BACnet-user */
+static BACNET_TSM_SEGMENTED_DATA TSM_Segmented_List[MAX_SEGMENTED_RESPONSES];
+/* our limit on the number of segments in one response */
+static unsigned TSM_Max_Segments = MAX_SEGMENTS_SENT;
+
+/** Set the most segments that we send in one segmented response.
+ * @param max_segments [in] 2..MAX_SEGMENTS_SENT, bigger values are limited
+ */
+void tsm_segmented_max_segments_set(
+    unsigned max_segments)
+{
+    if (max_segments > MAX_SEGMENTS_SENT) {
+        max_segments = MAX_SEGMENTS_SENT;
+    }
+    if (max_segments < 2) {
+        max_segments = 2;
+    }
+    TSM_Max_Segments = max_segments;
+}
+
+unsigned tsm_segmented_max_segments(
+    void)
+{
+    return TSM_Max_Segments;
+}
+
+static BACNET_TSM_SEGMENTED_DATA *tsm_segmented_find(
+    BACNET_ADDRESS * src,
+    uint8_t invokeID)
+{
+    unsigned i = 0;
+
+    for (i = 0; i < MAX_SEGMENTED_RESPONSES; i++) {
+        if ((TSM_Segmented_List[i].state == TSM_STATE_SEGMENTED_RESPONSE) &&
+            (TSM_Segmented_List[i].InvokeID == invokeID) &&
+            bacnet_address_same(&TSM_Segmented_List[i].dest, src)) {
+            return &TSM_Segmented_List[i];
+        }
+    }
+
+    return NULL;
+}
+
+static BACNET_TSM_SEGMENTED_DATA *tsm_segmented_free(
+    void)
+{
+    unsigned i = 0;
+
+    for (i = 0; i < MAX_SEGMENTED_RESPONSES; i++) {
+        if (TSM_Segmented_List[i].state == TSM_STATE_IDLE) {
+            return &TSM_Segmented_List[i];
+        }
+    }
+
+    return NULL;
+}
+
+/* send one segment of the ComplexACK */
+static void tsm_segment_send(
+    BACNET_TSM_SEGMENTED_DATA * data,
+    uint16_t segment)
+{
+    BACNET_ADDRESS my_address;
+    unsigned offset = 0;
+    unsigned len = 0;
+    int pdu_len = 0;
+
+    datalink_get_my_address(&my_address);
+    pdu_len =
+        npdu_encode_pdu(&TSM_Segment_PDU[0], &data->dest, &my_address,
+        &data->npdu_data);
+    /* the unsegmented header is pdu type, invoke ID and service choice */
+    offset = 3 + (unsigned) segment *data->SegmentSize;
+    len = data->apdu_len - offset;
+    if (len > data->SegmentSize) {
+        len = data->SegmentSize;
+    }
+    TSM_Segment_PDU[pdu_len] = PDU_TYPE_COMPLEX_ACK | BIT(3);
+    if ((segment + 1) < data->SegmentCount) {
+        TSM_Segment_PDU[pdu_len] |= BIT(2);
+    }
+    TSM_Segment_PDU[pdu_len + 1] = data->InvokeID;
+    TSM_Segment_PDU[pdu_len + 2] = (uint8_t) segment;
+    TSM_Segment_PDU[pdu_len + 3] = data->ProposedWindowSize;
+    TSM_Segment_PDU[pdu_len + 4] = data->apdu[2];
+    pdu_len += 5;
+    memcpy(&TSM_Segment_PDU[pdu_len], &data->apdu[offset], len);
+    pdu_len += len;
+    datalink_send_pdu(&data->dest, &data->npdu_data, &TSM_Segment_PDU[0],
+        pdu_len);
+}
+
+/* FillWindow: send the segments of the window and start the timer */
+static void tsm_segment_fill_window(
+    BACNET_TSM_SEGMENTED_DATA * data)
+{
+    unsigned i = 0;
+
+    for (i = 0; i < data->ActualWindowSize; i++) {
+        if ((data->InitialSegment + i) >= data->SegmentCount) {
+            break;
+        }
+        tsm_segment_send(data, (uint16_t) (data->InitialSegment + i));
+    }
+    data->SegmentTimer = apdu_timeout();
+}
+
+/** Get a buffer to encode a response that might need segmentation.
+ * The buffer belongs to a free segmented response, and stays valid
+ * until the next call of tsm_set_segmented_response().
+ * @param apdu_max [out] size of the buffer
+ * @return the buffer, or NULL if no segmented response is free
+ */
+uint8_t *tsm_segmented_response_buffer(
+    unsigned *apdu_max)
+{
+    BACNET_TSM_SEGMENTED_DATA *data;
+
+    data = tsm_segmented_free();
+    if (!data) {
+        return NULL;
+    }
+    if (apdu_max) {
+        *apdu_max = sizeof(data->apdu);
+    }
+
+    return &data->apdu[0];
+}
+
+/** Start sending a ComplexACK that is too big for one APDU as segments.
+ * The first segment is sent, the rest follow as the receiver sends
+ * the Segment-ACKs.
+ * @param dest [in] the address of the requester
+ * @param npdu_data [in] the network layer info of the response
+ * @param service_data [in] the decoded request header
+ * @param apdu [in] the complete unsegmented ComplexACK
+ * @param apdu_len [in] its length
+ * @return true if the response is sent segmented, false if it needs more
+ *  segments than the requester or we accept, or none is free
+ */
+bool tsm_set_segmented_response(
+    BACNET_ADDRESS * dest,
+    BACNET_NPDU_DATA * npdu_data,
+    BACNET_CONFIRMED_SERVICE_DATA * service_data,
+    uint8_t * apdu,
+    unsigned apdu_len)
+{
+    BACNET_TSM_SEGMENTED_DATA *data;
+    unsigned segment_size = 0;
+    unsigned segment_count = 0;
+    unsigned max_segments = TSM_Max_Segments;
+
+    if (!service_data->segmented_response_accepted || (apdu_len <= 3)) {
+        return false;
+    }
+    segment_size = MAX_APDU;
+    if ((service_data->max_resp > 0) &&
+        ((unsigned) service_data->max_resp < segment_size)) {
+        segment_size = service_data->max_resp;
+    }
+    segment_size -= 5;
+    segment_count = (apdu_len - 3 + segment_size - 1) / segment_size;
+    /* zero is unspecified, and 65 is more than 64 */
+    if ((service_data->max_segs > 0) && (service_data->max_segs <= 64) &&
+        ((unsigned) service_data->max_segs < max_segments)) {
+        max_segments = service_data->max_segs;
+    }
+    if (segment_count > max_segments) {
+        return false;
+    }
+    /* a repeated request replaces the response in progress */
+    data = tsm_segmented_find(dest, service_data->invoke_id);
+    if (data) {
+        data->state = TSM_STATE_IDLE;
+    }
+    data = tsm_segmented_free();
+    if (!data || (apdu_len > sizeof(data->apdu))) {
+        return false;
+    }
+    if (apdu != &data->apdu[0]) {
+        memmove(&data->apdu[0], apdu, apdu_len);
+    }
+    data->apdu_len = apdu_len;
+    data->InvokeID = service_data->invoke_id;
+    data->SegmentSize = (uint16_t) segment_size;
+    data->SegmentCount = (uint16_t) segment_count;
+    data->SegmentRetryCount = 0;
+    data->InitialSegment = 0;
+    data->ActualWindowSize = 1;
+    data->ProposedWindowSize = TSM_Window_Size;
+    npdu_copy_data(&data->npdu_data, npdu_data);
+    bacnet_address_copy(&data->dest, dest);
+    data->state = TSM_STATE_SEGMENTED_RESPONSE;
+    tsm_segment_fill_window(data);
+
+    return true;
+}
+
+/** Handle a Segment-ACK from the receiver of a segmented response.
+ * @param src [in] the address of the receiver
+ * @param invokeID [in] the invoke ID of the response
+ * @param sequence_number [in] the last segment received in order
+ * @param actual_window_size [in] the window size the receiver accepts
+ * @param nak [in] true if a segment was received out of order
+ */
+void tsm_segment_ack_handler(
+    BACNET_ADDRESS * src,
+    uint8_t invokeID,
+    uint8_t sequence_number,
+    uint8_t actual_window_size,
+    bool nak)
+{
+    BACNET_TSM_SEGMENTED_DATA *data;
+    uint8_t offset = 0;
+    unsigned segment = 0;
+
+    (void) nak;
+    data = tsm_segmented_find(src, invokeID);
+    if (!data) {
+        return;
+    }
+    /* InWindow: is the acknowledged segment one we sent last? */
+    offset = (uint8_t) (sequence_number - (uint8_t) data->InitialSegment);
+    if (offset >= data->ActualWindowSize) {
+        /* DuplicateACK_Received */
+        data->SegmentTimer = apdu_timeout();
+        return;
+    }
+    segment = data->InitialSegment + offset;
+    if ((segment + 1) >= data->SegmentCount) {
+        /* FinalACK_Received */
+        data->state = TSM_STATE_IDLE;
+        return;
+    }
+    /* NewACK_Received - a NAK asks for the segments after the
+       sequence number again, which is the same */
+    data->InitialSegment = (uint16_t) (segment + 1);
+    if (actual_window_size < 1) {
+        actual_window_size = 1;
+    } else if (actual_window_size > 127) {
+        actual_window_size = 127;
+    }
+    data->ActualWindowSize = actual_window_size;
+    data->SegmentRetryCount = 0;
+    tsm_segment_fill_window(data);
+}
+
+/** Stop sending a segmented response, when the receiver aborts it.
+ * @param src [in] the address of the receiver
+ * @param invokeID [in] the invoke ID of the response
+ */
+void tsm_segmented_response_abort(
+    BACNET_ADDRESS * src,
+    uint8_t invokeID)
+{
+    BACNET_TSM_SEGMENTED_DATA *data;
+
+    data = tsm_segmented_find(src, invokeID);
+    if (data) {
+        data->state = TSM_STATE_IDLE;
+    }
+}
+
+static void tsm_segmented_timer_milliseconds(
+    uint16_t milliseconds)
+{
+    unsigned i = 0;
+    BACNET_TSM_SEGMENTED_DATA *data;
+
+    for (i = 0; i < MAX_SEGMENTED_RESPONSES; i++) {
+        data = &TSM_Segmented_List[i];
+        if (data->state != TSM_STATE_SEGMENTED_RESPONSE) {
+            continue;
+        }
+        if (data->SegmentTimer > milliseconds) {
+            data->SegmentTimer -= milliseconds;
+            continue;
+        }
+        if (data->SegmentRetryCount < apdu_retries()) {
+            /* Timeout: send the window again */
+            data->SegmentRetryCount++;
+            tsm_segment_fill_window(data);
+        } else {
+            /* FinalTimeout */
+            data->state = TSM_STATE_IDLE;
+        }
+    }
+}
+#endif
+
+#if (MAX_SEGMENTED_CONFIRMATIONS)
+/* segmented ComplexACKs to our requests, as the requesting BACnet-user */
+static BACNET_TSM_REASSEMBLY_DATA TSM_Reassembly_List[MAX_SEGMENTED_CONFIRMATIONS];
+
+/* transaction is index + 1, or 0 to find an unused one */
+static BACNET_TSM_REASSEMBLY_DATA *tsm_reassembly_find(
+    uint16_t transaction)
+{
+    unsigned i = 0;
+
+    for (i = 0; i < MAX_SEGMENTED_CONFIRMATIONS; i++) {
+        if (TSM_Reassembly_List[i].Transaction == transaction) {
+            return &TSM_Reassembly_List[i];
+        }
+    }
+
+    return NULL;
+}
+
+static void tsm_reassembly_free(
+    uint16_t index)
+{
+    BACNET_TSM_REASSEMBLY_DATA *data;
+
+    if (index < MAX_TSM_TRANSACTIONS) {
+        data = tsm_reassembly_find(index + 1);
+        if (data) {
+            data->Transaction = 0;
+            data->apdu_len = 0;
+        }
+    }
+}
+
+/* the timeout while waiting for the next segment: 4 times Tseg */
+static uint32_t tsm_segment_receive_timeout(
+    void)
+{
+    return (uint32_t) apdu_timeout() * 4;
+}
+
+static void tsm_segment_ack_send(
+    BACNET_TSM_DATA * tsm,
+    uint8_t sequence_number,
+    bool nak)
+{
+    BACNET_ADDRESS my_address;
+    BACNET_NPDU_DATA npdu_data;
+    int pdu_len = 0;
+
+    datalink_get_my_address(&my_address);
+    npdu_encode_npdu_data(&npdu_data, false, MESSAGE_PRIORITY_NORMAL);
+    pdu_len =
+        npdu_encode_pdu(&TSM_Segment_PDU[0], &tsm->dest, &my_address,
+        &npdu_data);
+    /* sent by the client, so the server bit is clear */
+    TSM_Segment_PDU[pdu_len] = PDU_TYPE_SEGMENT_ACK;
+    if (nak) {
+        TSM_Segment_PDU[pdu_len] |= BIT(1);
+    }
+    TSM_Segment_PDU[pdu_len + 1] = tsm->InvokeID;
+    TSM_Segment_PDU[pdu_len + 2] = sequence_number;
+    TSM_Segment_PDU[pdu_len + 3] = tsm->ActualWindowSize;
+    pdu_len += 4;
+    datalink_send_pdu(&tsm->dest, &npdu_data, &TSM_Segment_PDU[0], pdu_len);
+}
+
+/* abort the segmented ComplexACK, which fails our request */
+static void tsm_segmented_confirmation_abort(
+    BACNET_TSM_DATA * tsm,
+    BACNET_ABORT_REASON reason)
+{
+    BACNET_ADDRESS my_address;
+    BACNET_NPDU_DATA npdu_data;
+    int pdu_len = 0;
+
+    datalink_get_my_address(&my_address);
+    npdu_encode_npdu_data(&npdu_data, false, MESSAGE_PRIORITY_NORMAL);
+    pdu_len =
+        npdu_encode_pdu(&TSM_Segment_PDU[0], &tsm->dest, &my_address,
+        &npdu_data);
+    pdu_len +=
+        abort_encode_apdu(&TSM_Segment_PDU[pdu_len], tsm->InvokeID, reason,
+        false);
+    datalink_send_pdu(&tsm->dest, &npdu_data, &TSM_Segment_PDU[0], pdu_len);
+    tsm_reassembly_free((uint16_t) (tsm - &TSM_List[0]));
+    tsm_timer_stop((uint16_t) (tsm - &TSM_List[0]));
+    tsm_transaction_failed((uint16_t) (tsm - &TSM_List[0]));
+}
+
+static bool tsm_reassembly_append(
+    BACNET_TSM_REASSEMBLY_DATA * data,
+    uint8_t * service_request,
+    uint16_t service_request_len)
+{
+    if ((data->apdu_len + service_request_len) > sizeof(data->apdu)) {
+        return false;
+    }
+    if ((data->apdu_len + service_request_len) > UINT16_MAX) {
+        return false;
+    }
+    memcpy(&data->apdu[data->apdu_len], service_request, service_request_len);
+    data->apdu_len += service_request_len;
+
+    return true;
+}
+
+/** Collect a segment of the ComplexACK to one of our requests.
+ * Sends the Segment-ACKs for the window we accept, and a negative
+ * one for a segment out of order.
+ * @param src [in] the address of the server
+ * @param service_ack_data [in,out] the decoded segment header,
+ *  not segmented anymore when the ACK is complete
+ * @param service_choice [in] the service of the ACK
+ * @param service_request [in,out] the service data of the segment,
+ *  then of the complete ACK
+ * @param service_request_len [in,out] its length
+ * @return true when the last segment completes the ACK
+ */
+bool tsm_segmented_confirmation(
+    BACNET_ADDRESS * src,
+    BACNET_CONFIRMED_SERVICE_ACK_DATA * service_ack_data,
+    uint8_t service_choice,
+    uint8_t ** service_request,
+    uint16_t * service_request_len)
+{
+    BACNET_TSM_DATA *tsm;
+    BACNET_TSM_REASSEMBLY_DATA *data;
+    uint16_t index;
+    uint8_t sequence_number = service_ack_data->sequence_number;
+
+    if (service_ack_data->invoke_id == 0) {
+        return false;
+    }
+    index = tsm_find_index(src, service_ack_data->invoke_id);
+    if (index >= MAX_TSM_TRANSACTIONS) {
+        return false;
+    }
+    tsm = &TSM_List[index];
+    if (!bacnet_address_same(&tsm->dest, src)) {
+        return false;
+    }
+    if (tsm->state == TSM_STATE_AWAIT_CONFIRMATION) {
+        if (sequence_number != 0) {
+            tsm_segmented_confirmation_abort(tsm,
+                ABORT_REASON_INVALID_APDU_IN_THIS_STATE);
+            return false;
+        }
+        data = tsm_reassembly_find(0);
+        if (!data) {
+            tsm_segmented_confirmation_abort(tsm,
+                ABORT_REASON_PREEMPTED_BY_HIGHER_PRIORITY_TASK);
+            return false;
+        }
+        data->Transaction = index + 1;
+        data->apdu[0] = PDU_TYPE_COMPLEX_ACK;
+        data->apdu[1] = tsm->InvokeID;
+        data->apdu[2] = service_choice;
+        data->apdu_len = 3;
+        if (!tsm_reassembly_append(data, *service_request,
+                *service_request_len)) {
+            tsm_segmented_confirmation_abort(tsm,
+                ABORT_REASON_BUFFER_OVERFLOW);
+            return false;
+        }
+        tsm->ProposedWindowSize = service_ack_data->proposed_window_number;
+        tsm->ActualWindowSize = tsm->ProposedWindowSize;
+        if (tsm->ActualWindowSize > TSM_Window_Size) {
+            tsm->ActualWindowSize = TSM_Window_Size;
+        }
+        if (tsm->ActualWindowSize < 1) {
+            tsm->ActualWindowSize = 1;
+        }
+        tsm->LastSequenceNumber = 0;
+        tsm->InitialSequenceNumber = 0;
+        tsm->state = TSM_STATE_SEGMENTED_CONFIRMATION;
+        tsm_timer_start(index, tsm_segment_receive_timeout());
+        tsm_segment_ack_send(tsm, 0, false);
+        if (service_ack_data->more_follows) {
+            return false;
+        }
+    } else if (tsm->state == TSM_STATE_SEGMENTED_CONFIRMATION) {
+        data = tsm_reassembly_find(index + 1);
+        if (!data) {
+            return false;
+        }
+        tsm_timer_start(index, tsm_segment_receive_timeout());
+        if (sequence_number != (uint8_t) (tsm->LastSequenceNumber + 1)) {
+            /* SegmentReceivedOutOfOrder, or a duplicate */
+            tsm_segment_ack_send(tsm, tsm->LastSequenceNumber, true);
+            tsm->InitialSequenceNumber = tsm->LastSequenceNumber;
+            return false;
+        }
+        if (!tsm_reassembly_append(data, *service_request,
+                *service_request_len)) {
+            tsm_segmented_confirmation_abort(tsm,
+                ABORT_REASON_BUFFER_OVERFLOW);
+            return false;
+        }
+        tsm->LastSequenceNumber = sequence_number;
+        if (service_ack_data->more_follows) {
+            /* NewSegmentReceived: acknowledge a full window */
+            if (sequence_number ==
+                (uint8_t) (tsm->InitialSequenceNumber +
+                    tsm->ActualWindowSize)) {
+                tsm_segment_ack_send(tsm, sequence_number, false);
+                tsm->InitialSequenceNumber = sequence_number;
+            }
+            return false;
+        }
+        /* LastSegmentOfComplexACK_Received */
+        tsm_segment_ack_send(tsm, sequence_number, false);
+    } else {
+        return false;
+    }
+    /* the complete ACK is freed with the invoke ID */
+    service_ack_data->segmented_message = false;
+    service_ack_data->more_follows = false;
+    *service_request = &data->apdu[3];
+    *service_request_len = (uint16_t) (data->apdu_len - 3);
+
+    return true;
+}
+
+/* the server stopped sending segments */
+static void tsm_segmented_confirmation_timeout(
+    uint16_t index)
+{
+    tsm_reassembly_free(index);
+    tsm_transaction_failed(index);
+}
+#endif
+
+/* the request timer of the transaction expired */
+static void tsm_request_timeout(
+    uint16_t index)
+{
+    BACNET_TSM_DATA *tsm = &TSM_List[index];
+
+    if ((tsm->RetryCount < apdu_retries()) && tsm->apdu_len) {
+        tsm_timer_start(index, apdu_timeout());
+        tsm->RetryCount++;
+        tsm_pdu_load(tsm, &TSM_Retry_PDU[0]);
+        datalink_send_pdu(&tsm->dest, &tsm->npdu_data, &TSM_Retry_PDU[0],
+            tsm->apdu_len);
+    } else {
+        /* note: the invoke id has not been cleared yet
+           and this indicates a failed message:
+           IDLE and a valid invoke id */
+        tsm_transaction_failed(index);
+    }
+}
+
 /* called once a millisecond or slower */
 void tsm_timer_milliseconds(
     uint16_t milliseconds)
 {
-    unsigned i = 0;     /* counter */
-
-    for (i = 0; i < MAX_TSM_TRANSACTIONS; i++) {
-        if (TSM_List[i].state == TSM_STATE_AWAIT_CONFIRMATION) {
-            if (TSM_List[i].RequestTimer > milliseconds)
-                TSM_List[i].RequestTimer -= milliseconds;
-            else
-                TSM_List[i].RequestTimer = 0;
-            /* AWAIT_CONFIRMATION */
-            if (TSM_List[i].RequestTimer == 0) {
-                if (TSM_List[i].RetryCount < apdu_retries()) {
-                    TSM_List[i].RequestTimer = apdu_timeout();
-                    TSM_List[i].RetryCount++;
-                    datalink_send_pdu(&TSM_List[i].dest,
-                        &TSM_List[i].npdu_data, &TSM_List[i].apdu[0],
-                        TSM_List[i].apdu_len);
-                } else {
-                    /* note: the invoke id has not been cleared yet
-                       and this indicates a failed message:
-                       IDLE and a valid invoke id */
-                    TSM_List[i].state = TSM_STATE_IDLE;
-                    if (TSM_List[i].InvokeID != 0) {
-                        if (Timeout_Function) {
-                            Timeout_Function(TSM_List[i].InvokeID);
-                        }
-                    }
-                }
+    uint32_t tick = TSM_Time / TSM_TIMER_WHEEL_TICK;
+    uint32_t last_tick = 0;
+    unsigned buckets = 0;
+    uint16_t next = 0;
+    uint16_t index = 0;
+
+    TSM_Time += milliseconds;
+    last_tick = TSM_Time / TSM_TIMER_WHEEL_TICK;
+    /* visit the buckets the time went past, each one once */
+    buckets = (unsigned) (last_tick - tick) + 1;
+    if (buckets > TSM_TIMER_WHEEL_SIZE) {
+        buckets = TSM_TIMER_WHEEL_SIZE;
+    }
+    while (buckets) {
+        next = TSM_Timer_Wheel[tick % TSM_TIMER_WHEEL_SIZE];
+        while (next) {
+            index = next - 1;
+            next = TSM_List[index].TimerNext;
+            /* the bucket also has timers of later turns of the wheel */
+            if (!TSM_List[index].TimerRunning ||
+                ((int32_t) (TSM_Time - TSM_List[index].TimerExpires) < 0)) {
+                continue;
+            }
+            tsm_timer_stop(index);
+            if (TSM_List[index].state == TSM_STATE_AWAIT_CONFIRMATION) {
+                tsm_request_timeout(index);
+#if (MAX_SEGMENTED_CONFIRMATIONS)
+            } else if (TSM_List[index].state ==
+                TSM_STATE_SEGMENTED_CONFIRMATION) {
+                tsm_segmented_confirmation_timeout(index);
+#endif
+            }
+        }
+        tick++;
+        buckets--;
+    }
+#if (MAX_SEGMENTED_RESPONSES)
+    tsm_segmented_timer_milliseconds(milliseconds);
+#endif
+}
+
+/* frees the transaction and sets its state to IDLE */
+static void tsm_free_index(
+    uint16_t index)
+{
+    BACNET_TSM_DATA *tsm = &TSM_List[index];
+    BACNET_TSM_PEER_DATA *peer_data;
+    uint16_t *link;
+
+    tsm_timer_stop(index);
+    tsm_pdu_free(tsm);
+#if (MAX_SEGMENTED_CONFIRMATIONS)
+    tsm_reassembly_free(index);
+#endif
+    if (tsm->Peer) {
+        peer_data = &TSM_Peer_List[tsm->Peer - 1];
+        link = &peer_data->First;
+        while (*link) {
+            if (*link == index + 1) {
+                *link = tsm->PeerNext;
+                break;
             }
+            link = &TSM_List[*link - 1].PeerNext;
+        }
+        TSM_Invoke_Peers[tsm->InvokeID]--;
+        if (TSM_Invoke_Peers[tsm->InvokeID] == 0) {
+            TSM_Invoke_Peers_Used--;
+        }
+        peer_data->Count--;
+        if (peer_data->Count == 0) {
+            tsm_peer_remove(tsm->Peer - 1);
         }
+        tsm->Peer = 0;
+        tsm->PeerNext = 0;
+    } else {
+        TSM_Invoke_Index[tsm->InvokeID] = 0;
     }
+    TSM_Free_Stack[TSM_Free_Count] = index;
+    TSM_Free_Count++;
+    tsm->state = TSM_STATE_IDLE;
+    tsm->InvokeID = 0;
 }
 
 /* frees the invokeID and sets its state to IDLE */
 void tsm_free_invoke_id(
     uint8_t invokeID)
 {
-    uint8_t index;
+    uint16_t index;
 
     index = tsm_find_invokeID_index(invokeID);
     if (index < MAX_TSM_TRANSACTIONS) {
-        TSM_List[index].state = TSM_STATE_IDLE;
-        TSM_List[index].InvokeID = 0;
+        tsm_free_index(index);
+    }
+}
+
+/** Free the invoke ID of the destination, or else the one shared by all.
+ * @param src [in] the address of the reply
+ * @param invokeID [in] the invoke ID of the reply
+ */
+void tsm_free_invoke_id_peer(
+    BACNET_ADDRESS * src,
+    uint8_t invokeID)
+{
+    uint16_t index;
+
+    index = tsm_find_index(src, invokeID);
+    if (index < MAX_TSM_TRANSACTIONS) {
+        tsm_free_index(index);
     }
 }
 
@@ -316,7 +1400,7 @@ bool tsm_invoke_id_free(
     uint8_t invokeID)
 {
     bool status = true;
-    uint8_t index;
+    uint16_t index;
 
     index = tsm_find_invokeID_index(invokeID);
     if (index < MAX_TSM_TRANSACTIONS)
@@ -325,6 +1409,18 @@ bool tsm_invoke_id_free(
     return status;
 }
 
+/** Check if the invoke ID of the destination has been made free.
+ * @param dest [in] The address the message was sent to.
+ * @param invokeID [in] The invokeID of the message.
+ * @return True if it is free (done with), False if still pending in the TSM.
+ */
+bool tsm_invoke_id_free_peer(
+    BACNET_ADDRESS * dest,
+    uint8_t invokeID)
+{
+    return (tsm_find_index(dest, invokeID) == MAX_TSM_TRANSACTIONS);
+}
+
 /** See if we failed get a confirmation for the message associated
  *  with this invoke ID.
  * @param invokeID [in] The invokeID to be checked, normally of last message sent.
@@ -335,7 +1431,7 @@ bool tsm_invoke_id_failed(
     uint8_t invokeID)
 {
     bool status = false;
-    uint8_t index;
+    uint16_t index;
 
     index = tsm_find_invokeID_index(invokeID);
     if (index < MAX_TSM_TRANSACTIONS) {
@@ -348,6 +1444,28 @@ bool tsm_invoke_id_failed(
     return status;
 }
 
+/** See if we failed to get a confirmation for the message to the
+ *  destination with this invoke ID.
+ * @param dest [in] The address the message was sent to.
+ * @param invokeID [in] The invokeID of the message.
+ * @return True if already failed, False if done or segmented or still waiting
+ *         for a confirmation.
+ */
+bool tsm_invoke_id_failed_peer(
+    BACNET_ADDRESS * dest,
+    uint8_t invokeID)
+{
+    bool status = false;
+    uint16_t index;
+
+    index = tsm_find_index(dest, invokeID);
+    if (index < MAX_TSM_TRANSACTIONS) {
+        if (TSM_List[index].state == TSM_STATE_IDLE)
+            status = true;
+    }
+
+    return status;
+}
 
 #ifdef TEST
 #include <assert.h>
@@ -357,6 +1475,11 @@ bool tsm_invoke_id_failed(
 /* flag to send an I-Am */
 bool I_Am_Request = true;
 
+/* the last PDU sent, and the number sent */
+static uint8_t Test_PDU[MAX_PDU];
+static unsigned Test_PDU_Len;
+static unsigned Test_PDU_Count;
+
 /* dummy function stubs */
 int datalink_send_pdu(
     BACNET_ADDRESS * dest,
@@ -366,10 +1489,11 @@ int datalink_send_pdu(
 {
     (void) dest;
     (void) npdu_data;
-    (void) pdu;
-    (void) pdu_len;
+    memcpy(Test_PDU, pdu, pdu_len);
+    Test_PDU_Len = pdu_len;
+    Test_PDU_Count++;
 
-    return 0;
+    return pdu_len;
 }
 
 /* dummy function stubs */
@@ -379,10 +1503,594 @@ void datalink_get_broadcast_address(
     (void) dest;
 }
 
+/* dummy function stubs */
+void datalink_get_my_address(
+    BACNET_ADDRESS * my_address)
+{
+    memset(my_address, 0, sizeof(BACNET_ADDRESS));
+}
+
+#if (MAX_SEGMENTED_RESPONSES) || (MAX_SEGMENTED_CONFIRMATIONS)
+/* the APDU of the last PDU sent */
+static uint8_t *testSegmentAPDU(
+    void)
+{
+    BACNET_ADDRESS dest, src;
+    BACNET_NPDU_DATA npdu_data;
+    int len;
+
+    len = npdu_decode(&Test_PDU[0], &dest, &src, &npdu_data);
+
+    return &Test_PDU[len];
+}
+#endif
+
+static uint8_t Test_Timeout_Invoke_ID;
+
+static void testTimeoutHandler(
+    uint8_t invokeID)
+{
+    Test_Timeout_Invoke_ID = invokeID;
+}
+
+static void testTransaction(
+    Test * pTest)
+{
+    BACNET_ADDRESS dest = { 0 };
+    BACNET_ADDRESS test_dest = { 0 };
+    BACNET_NPDU_DATA npdu_data = { 0 };
+    BACNET_NPDU_DATA test_npdu_data = { 0 };
+    uint8_t pdu[MAX_PDU] = { 0 };
+    uint8_t test_pdu[MAX_PDU] = { 0 };
+    uint16_t test_pdu_len = 0;
+    uint8_t invoke_id = 0;
+    uint8_t first_invoke_id = 0;
+    unsigned count = 0;
+    unsigned i = 0;
+    bool status = false;
+
+    dest.mac_len = 1;
+    dest.mac[0] = 0x42;
+    npdu_encode_npdu_data(&npdu_data, true, MESSAGE_PRIORITY_NORMAL);
+    for (i = 0; i < sizeof(pdu); i++) {
+        pdu[i] = (uint8_t) i;
+    }
+    tsm_set_timeout_handler(testTimeoutHandler);
+    ct_test(pTest, tsm_transaction_idle_count() == MAX_TSM_TRANSACTIONS);
+    /* a copy is kept for the retries, in the blocks of the pool */
+    invoke_id = tsm_next_free_invokeID();
+    ct_test(pTest, invoke_id != 0);
+    ct_test(pTest, tsm_transaction_idle_count() == MAX_TSM_TRANSACTIONS - 1);
+    tsm_set_confirmed_unsegmented_transaction(invoke_id, &dest, &npdu_data,
+        &pdu[0], 3 * TSM_PDU_BLOCK_SIZE + 1);
+    status =
+        tsm_get_transaction_pdu(invoke_id, &test_dest, &test_npdu_data,
+        &test_pdu[0], &test_pdu_len);
+    ct_test(pTest, status == true);
+    ct_test(pTest, test_pdu_len == 3 * TSM_PDU_BLOCK_SIZE + 1);
+    ct_test(pTest, memcmp(pdu, test_pdu, test_pdu_len) == 0);
+    ct_test(pTest, bacnet_address_same(&dest, &test_dest));
+    /* the retries, then the timeout */
+    Test_PDU_Count = 0;
+    Test_Timeout_Invoke_ID = 0;
+    tsm_timer_milliseconds(apdu_timeout() - 1);
+    ct_test(pTest, Test_PDU_Count == 0);
+    for (i = 0; i < apdu_retries(); i++) {
+        tsm_timer_milliseconds(apdu_timeout());
+        ct_test(pTest, Test_PDU_Count == i + 1);
+        ct_test(pTest, Test_PDU_Len == 3 * TSM_PDU_BLOCK_SIZE + 1);
+        ct_test(pTest, memcmp(pdu, Test_PDU, Test_PDU_Len) == 0);
+        ct_test(pTest, tsm_invoke_id_failed(invoke_id) == false);
+    }
+    tsm_timer_milliseconds(apdu_timeout());
+    ct_test(pTest, Test_PDU_Count == apdu_retries());
+    ct_test(pTest, Test_Timeout_Invoke_ID == invoke_id);
+    ct_test(pTest, tsm_invoke_id_failed(invoke_id) == true);
+    tsm_free_invoke_id(invoke_id);
+    ct_test(pTest, tsm_invoke_id_free(invoke_id));
+    /* a confirmed request stops the timer */
+    invoke_id = tsm_next_free_invokeID();
+    tsm_set_confirmed_unsegmented_transaction(invoke_id, &dest, &npdu_data,
+        &pdu[0], MAX_PDU);
+    tsm_free_invoke_id(invoke_id);
+    Test_PDU_Count = 0;
+    Test_Timeout_Invoke_ID = 0;
+    for (i = 0; i <= apdu_retries(); i++) {
+        tsm_timer_milliseconds(apdu_timeout());
+    }
+    ct_test(pTest, Test_PDU_Count == 0);
+    ct_test(pTest, Test_Timeout_Invoke_ID == 0);
+    /* every spot in the table, each one with a PDU */
+    first_invoke_id = invoke_id = tsm_next_free_invokeID();
+    while (invoke_id) {
+        count++;
+        tsm_set_confirmed_unsegmented_transaction(invoke_id, &dest,
+            &npdu_data, &pdu[0], 2 * TSM_PDU_BLOCK_SIZE);
+        invoke_id = tsm_next_free_invokeID();
+    }
+#if (MAX_TSM_TRANSACTIONS > 255)
+    /* the shared invoke IDs run out first */
+    ct_test(pTest, count == 255);
+    ct_test(pTest, tsm_transaction_idle_count() == MAX_TSM_TRANSACTIONS - 255);
+#else
+    ct_test(pTest, count == MAX_TSM_TRANSACTIONS);
+    ct_test(pTest, tsm_transaction_available() == false);
+    ct_test(pTest, tsm_transaction_idle_count() == 0);
+#endif
+    for (i = 0; i < count; i++) {
+        invoke_id = (uint8_t) (first_invoke_id + i);
+        if (invoke_id < first_invoke_id) {
+            /* skip zero */
+            invoke_id++;
+        }
+        ct_test(pTest, tsm_invoke_id_free(invoke_id) == false);
+        tsm_free_invoke_id(invoke_id);
+    }
+    ct_test(pTest, tsm_transaction_idle_count() == MAX_TSM_TRANSACTIONS);
+    invoke_id = tsm_next_free_invokeID();
+    ct_test(pTest, invoke_id != 0);
+    tsm_free_invoke_id(invoke_id);
+    tsm_set_timeout_handler(NULL);
+}
+
+static BACNET_ADDRESS Test_Timeout_Address;
+
+static void testPeerTimeoutHandler(
+    BACNET_ADDRESS * dest,
+    uint8_t invokeID)
+{
+    bacnet_address_copy(&Test_Timeout_Address, dest);
+    Test_Timeout_Invoke_ID = invokeID;
+}
+
+static void testPeerTransaction(
+    Test * pTest)
+{
+    BACNET_ADDRESS dest[3] = { {0} };
+    BACNET_NPDU_DATA npdu_data = { 0 };
+    uint8_t pdu[8] = { 0 };
+    uint8_t invoke_id[3][MAX_TSM_PEER_TRANSACTIONS] = { {0} };
+    uint8_t shared_invoke_id = 0;
+    unsigned i = 0;
+    unsigned j = 0;
+
+    for (i = 0; i < 3; i++) {
+        dest[i].mac_len = 6;
+        dest[i].mac[0] = 192;
+        dest[i].mac[1] = 168;
+        dest[i].mac[3] = (uint8_t) (0x10 + i);
+        dest[i].mac[4] = 0xBA;
+        dest[i].mac[5] = 0xC0;
+    }
+    npdu_encode_npdu_data(&npdu_data, true, MESSAGE_PRIORITY_NORMAL);
+    tsm_set_peer_timeout_handler(testPeerTimeoutHandler);
+    tsm_peer_transactions_max_set(MAX_TSM_PEER_TRANSACTIONS);
+    /* each peer has its own invoke IDs, up to its limit */
+    for (i = 0; i < 3; i++) {
+        for (j = 0; j < MAX_TSM_PEER_TRANSACTIONS; j++) {
+            invoke_id[i][j] = tsm_next_free_invokeID_peer(&dest[i]);
+            ct_test(pTest, invoke_id[i][j] != 0);
+            if (j) {
+                ct_test(pTest, invoke_id[i][j] != invoke_id[i][j - 1]);
+            }
+        }
+        ct_test(pTest, tsm_next_free_invokeID_peer(&dest[i]) == 0);
+    }
+    /* the same invoke ID in use by two peers */
+    ct_test(pTest, invoke_id[0][1] == invoke_id[1][0]);
+    ct_test(pTest, tsm_invoke_id_free_peer(&dest[0], invoke_id[0][1]) ==
+        false);
+    ct_test(pTest, tsm_invoke_id_free(invoke_id[0][1]) == true);
+    /* not in use by the shared invoke IDs */
+    shared_invoke_id = tsm_next_free_invokeID();
+    ct_test(pTest, shared_invoke_id != 0);
+    for (i = 0; i < 3; i++) {
+        for (j = 0; j < MAX_TSM_PEER_TRANSACTIONS; j++) {
+            ct_test(pTest, shared_invoke_id != invoke_id[i][j]);
+        }
+    }
+    /* a reply frees the invoke ID of its source */
+    tsm_free_invoke_id_peer(&dest[1], invoke_id[1][0]);
+    ct_test(pTest, tsm_invoke_id_free_peer(&dest[1], invoke_id[1][0]));
+    ct_test(pTest, tsm_invoke_id_free_peer(&dest[0], invoke_id[0][0]) ==
+        false);
+    invoke_id[1][0] = tsm_next_free_invokeID_peer(&dest[1]);
+    ct_test(pTest, invoke_id[1][0] != 0);
+    /* and the shared ones by invoke ID only, as before */
+    tsm_free_invoke_id_peer(&dest[2], shared_invoke_id);
+    ct_test(pTest, tsm_invoke_id_free(shared_invoke_id));
+    /* a timeout tells the destination */
+    tsm_set_confirmed_unsegmented_transaction(invoke_id[2][1], &dest[2],
+        &npdu_data, &pdu[0], sizeof(pdu));
+    Test_Timeout_Invoke_ID = 0;
+    for (i = 0; i <= apdu_retries(); i++) {
+        tsm_timer_milliseconds(apdu_timeout());
+    }
+    ct_test(pTest, Test_Timeout_Invoke_ID == invoke_id[2][1]);
+    ct_test(pTest, bacnet_address_same(&Test_Timeout_Address, &dest[2]));
+    ct_test(pTest, tsm_invoke_id_failed_peer(&dest[2], invoke_id[2][1]));
+    /* all freed, the peers are gone */
+    for (i = 0; i < 3; i++) {
+        for (j = 0; j < MAX_TSM_PEER_TRANSACTIONS; j++) {
+            tsm_free_invoke_id_peer(&dest[i], invoke_id[i][j]);
+        }
+    }
+    ct_test(pTest, tsm_transaction_idle_count() == MAX_TSM_TRANSACTIONS);
+    ct_test(pTest, TSM_Peer_Free_Count == TSM_Peers_Used);
+    /* a limit of one, for slow devices */
+    tsm_peer_transactions_max_set(1);
+    invoke_id[0][0] = tsm_next_free_invokeID_peer(&dest[0]);
+    ct_test(pTest, invoke_id[0][0] != 0);
+    ct_test(pTest, tsm_next_free_invokeID_peer(&dest[0]) == 0);
+    tsm_free_invoke_id_peer(&dest[0], invoke_id[0][0]);
+    tsm_peer_transactions_max_set(MAX_TSM_PEER_TRANSACTIONS);
+    tsm_set_peer_timeout_handler(NULL);
+}
+
+static unsigned testPeerLimit(
+    BACNET_ADDRESS * dest)
+{
+    return dest->mac[0];
+}
+
+static void testPeerLimits(
+    Test * pTest)
+{
+    BACNET_ADDRESS dest = { 0 };
+    BACNET_ADDRESS router_dest = { 0 };
+    uint8_t invoke_id[MAX_TSM_PEER_TRANSACTIONS] = { 0 };
+    unsigned i = 0;
+
+    tsm_peer_transactions_max_set(MAX_TSM_PEER_TRANSACTIONS);
+    /* an MS/TP device behind a router */
+    dest.net = 5;
+    dest.len = 1;
+    dest.adr[0] = 0x22;
+    dest.mac_len = 6;
+    dest.mac[0] = 10;
+    ct_test(pTest,
+        tsm_peer_transactions_max_dest(&dest) ==
+        MAX_TSM_MSTP_PEER_TRANSACTIONS);
+    invoke_id[0] = tsm_next_free_invokeID_peer(&dest);
+    ct_test(pTest, invoke_id[0] != 0);
+    /* the same device, through another router MAC, is the same peer */
+    router_dest = dest;
+    router_dest.mac[0] = 11;
+    ct_test(pTest, tsm_next_free_invokeID_peer(&router_dest) == 0);
+    ct_test(pTest, tsm_invoke_id_free_peer(&router_dest,
+            invoke_id[0]) == false);
+    tsm_free_invoke_id_peer(&router_dest, invoke_id[0]);
+    ct_test(pTest, tsm_invoke_id_free_peer(&dest, invoke_id[0]));
+    /* a BACnet/IP device gets the default */
+    dest.net = 0;
+    dest.len = 0;
+    ct_test(pTest,
+        tsm_peer_transactions_max_dest(&dest) == MAX_TSM_PEER_TRANSACTIONS);
+    /* and the handler decides for each destination */
+    tsm_set_peer_limit_handler(testPeerLimit);
+    dest.mac[0] = 2;
+    ct_test(pTest, tsm_peer_transactions_max_dest(&dest) == 2);
+    for (i = 0; i < 2; i++) {
+        invoke_id[i] = tsm_next_free_invokeID_peer(&dest);
+        ct_test(pTest, invoke_id[i] != 0);
+    }
+    ct_test(pTest, tsm_next_free_invokeID_peer(&dest) == 0);
+    for (i = 0; i < 2; i++) {
+        tsm_free_invoke_id_peer(&dest, invoke_id[i]);
+    }
+    tsm_set_peer_limit_handler(NULL);
+    ct_test(pTest, tsm_transaction_idle_count() == MAX_TSM_TRANSACTIONS);
+}
+
+#if (MAX_TSM_TRANSACTIONS >= 255)
+/* the peers leave invoke IDs to the shared ones */
+static void testPeerInvokeIDs(
+    Test * pTest)
+{
+    static BACNET_ADDRESS dest[60];
+    static uint8_t invoke_id[60][4];
+    uint8_t shared_invoke_id = 0;
+    unsigned i = 0;
+    unsigned j = 0;
+
+    tsm_peer_transactions_max_set(4);
+    for (i = 0; i < 60; i++) {
+        dest[i].mac_len = 6;
+        dest[i].mac[2] = (uint8_t) i;
+        /* each peer starts at other invoke IDs */
+        tsm_invokeID_set((uint8_t) (1 + (i * 4)));
+        for (j = 0; j < 4; j++) {
+            invoke_id[i][j] = tsm_next_free_invokeID_peer(&dest[i]);
+            ct_test(pTest, invoke_id[i][j] != 0);
+        }
+    }
+    ct_test(pTest, TSM_Invoke_Peers_Used == (255 - TSM_SHARED_INVOKE_IDS));
+    shared_invoke_id = tsm_next_free_invokeID();
+    ct_test(pTest, shared_invoke_id != 0);
+    ct_test(pTest, TSM_Invoke_Peers[shared_invoke_id] == 0);
+    tsm_free_invoke_id(shared_invoke_id);
+    for (i = 0; i < 60; i++) {
+        for (j = 0; j < 4; j++) {
+            tsm_free_invoke_id_peer(&dest[i], invoke_id[i][j]);
+        }
+    }
+    ct_test(pTest, TSM_Invoke_Peers_Used == 0);
+    ct_test(pTest, tsm_transaction_idle_count() == MAX_TSM_TRANSACTIONS);
+    tsm_peer_transactions_max_set(MAX_TSM_PEER_TRANSACTIONS);
+}
+#endif
+
+#if (MAX_SEGMENTED_RESPONSES)
+static void testSegmentedResponse(
+    Test * pTest)
+{
+    BACNET_ADDRESS dest = { 0 };
+    BACNET_NPDU_DATA npdu_data;
+    BACNET_CONFIRMED_SERVICE_DATA service_data = { 0 };
+    uint8_t *apdu = NULL;
+    unsigned apdu_max = 0;
+    unsigned i = 0;
+    uint8_t *segment = NULL;
+    bool status = false;
+
+    dest.mac_len = 1;
+    dest.mac[0] = 0x42;
+    npdu_encode_npdu_data(&npdu_data, false, MESSAGE_PRIORITY_NORMAL);
+    service_data.segmented_response_accepted = true;
+    service_data.invoke_id = 5;
+    service_data.max_resp = 128;
+    apdu = tsm_segmented_response_buffer(&apdu_max);
+    ct_test(pTest, apdu != NULL);
+    ct_test(pTest, apdu_max >= 603);
+    apdu[0] = PDU_TYPE_COMPLEX_ACK;
+    apdu[1] = 5;
+    apdu[2] = SERVICE_CONFIRMED_READ_PROP_MULTIPLE;
+    for (i = 3; i < 603; i++) {
+        apdu[i] = (uint8_t) i;
+    }
+    /* 600 octets in segments of 123 octets: 5 segments */
+    Test_PDU_Count = 0;
+    status =
+        tsm_set_segmented_response(&dest, &npdu_data, &service_data, apdu,
+        603);
+    ct_test(pTest, status == true);
+    /* only the first segment is sent, until the window is known */
+    ct_test(pTest, Test_PDU_Count == 1);
+    segment = testSegmentAPDU();
+    ct_test(pTest, segment[0] == (PDU_TYPE_COMPLEX_ACK | BIT(3) | BIT(2)));
+    ct_test(pTest, segment[1] == 5);
+    ct_test(pTest, segment[2] == 0);
+    ct_test(pTest, segment[3] == TSM_PROPOSED_WINDOW_SIZE);
+    ct_test(pTest, segment[4] == SERVICE_CONFIRMED_READ_PROP_MULTIPLE);
+    ct_test(pTest, segment[5] == 3);
+    ct_test(pTest, &Test_PDU[Test_PDU_Len] == &segment[128]);
+    /* an ACK from someone else, or for another invoke ID is ignored */
+    dest.mac[0] = 0x43;
+    tsm_segment_ack_handler(&dest, 5, 0, 2, false);
+    dest.mac[0] = 0x42;
+    tsm_segment_ack_handler(&dest, 6, 0, 2, false);
+    ct_test(pTest, Test_PDU_Count == 1);
+    /* window of 2 */
+    tsm_segment_ack_handler(&dest, 5, 0, 2, false);
+    ct_test(pTest, Test_PDU_Count == 3);
+    segment = testSegmentAPDU();
+    ct_test(pTest, segment[2] == 2);
+    ct_test(pTest, segment[5] == (uint8_t) (3 + 2 * 123));
+    /* duplicate ACK */
+    tsm_segment_ack_handler(&dest, 5, 0, 2, false);
+    ct_test(pTest, Test_PDU_Count == 3);
+    /* segment 2 lost: NAK asks for it again */
+    tsm_segment_ack_handler(&dest, 5, 1, 4, true);
+    ct_test(pTest, Test_PDU_Count == 6);
+    segment = testSegmentAPDU();
+    /* last segment has no more follows */
+    ct_test(pTest, segment[0] == (PDU_TYPE_COMPLEX_ACK | BIT(3)));
+    ct_test(pTest, segment[2] == 4);
+    ct_test(pTest, &Test_PDU[Test_PDU_Len] == &segment[5 + 600 - 4 * 123]);
+    /* the final ACK ends it */
+    tsm_segment_ack_handler(&dest, 5, 4, 4, false);
+    tsm_timer_milliseconds(apdu_timeout());
+    ct_test(pTest, Test_PDU_Count == 6);
+
+    /* the window is sent again on timeout, until the retries are done */
+    apdu = tsm_segmented_response_buffer(&apdu_max);
+    status =
+        tsm_set_segmented_response(&dest, &npdu_data, &service_data, apdu,
+        603);
+    ct_test(pTest, status == true);
+    Test_PDU_Count = 0;
+    for (i = 0; i < apdu_retries(); i++) {
+        tsm_timer_milliseconds(apdu_timeout());
+    }
+    ct_test(pTest, Test_PDU_Count == apdu_retries());
+    tsm_timer_milliseconds(apdu_timeout());
+    tsm_segment_ack_handler(&dest, 5, 0, 2, false);
+    ct_test(pTest, Test_PDU_Count == apdu_retries());
+
+    /* the client aborts */
+    status =
+        tsm_set_segmented_response(&dest, &npdu_data, &service_data, apdu,
+        603);
+    ct_test(pTest, status == true);
+    tsm_segmented_response_abort(&dest, 5);
+    Test_PDU_Count = 0;
+    tsm_segment_ack_handler(&dest, 5, 0, 2, false);
+    ct_test(pTest, Test_PDU_Count == 0);
+
+    /* the client, or we, accept too few segments */
+    service_data.max_segs = 4;
+    status =
+        tsm_set_segmented_response(&dest, &npdu_data, &service_data, apdu,
+        603);
+    ct_test(pTest, status == false);
+    service_data.max_segs = 0;
+    tsm_segmented_max_segments_set(4);
+    status =
+        tsm_set_segmented_response(&dest, &npdu_data, &service_data, apdu,
+        603);
+    ct_test(pTest, status == false);
+    tsm_segmented_max_segments_set(MAX_SEGMENTS_SENT);
+    service_data.segmented_response_accepted = false;
+    status =
+        tsm_set_segmented_response(&dest, &npdu_data, &service_data, apdu,
+        603);
+    ct_test(pTest, status == false);
+    ct_test(pTest, Test_PDU_Count == 0);
+}
+#endif
+
+#if (MAX_SEGMENTED_CONFIRMATIONS)
+static bool testSegment(
+    BACNET_ADDRESS * src,
+    uint8_t invoke_id,
+    uint8_t sequence_number,
+    bool more_follows,
+    uint8_t ** service_request,
+    uint16_t * service_request_len)
+{
+    BACNET_CONFIRMED_SERVICE_ACK_DATA service_ack_data = { 0 };
+    static uint8_t segment[10];
+    unsigned i = 0;
+
+    service_ack_data.segmented_message = true;
+    service_ack_data.more_follows = more_follows;
+    service_ack_data.invoke_id = invoke_id;
+    service_ack_data.sequence_number = sequence_number;
+    service_ack_data.proposed_window_number = 4;
+    for (i = 0; i < sizeof(segment); i++) {
+        segment[i] = (uint8_t) (sequence_number * sizeof(segment) + i);
+    }
+    *service_request = &segment[0];
+    *service_request_len = sizeof(segment);
+
+    return tsm_segmented_confirmation(src, &service_ack_data,
+        SERVICE_CONFIRMED_READ_PROP_MULTIPLE, service_request,
+        service_request_len);
+}
+
+static void testSegmentedConfirmation(
+    Test * pTest)
+{
+    BACNET_ADDRESS dest = { 0 };
+    BACNET_NPDU_DATA npdu_data;
+    uint8_t pdu[8] = { 0 };
+    uint8_t invoke_id = 0;
+    uint8_t *service_request = NULL;
+    uint16_t service_request_len = 0;
+    uint8_t *segment_ack = NULL;
+    unsigned i = 0;
+    bool status = false;
+
+    dest.mac_len = 1;
+    dest.mac[0] = 0x42;
+    npdu_encode_npdu_data(&npdu_data, true, MESSAGE_PRIORITY_NORMAL);
+    invoke_id = tsm_next_free_invokeID();
+    ct_test(pTest, invoke_id != 0);
+    tsm_set_confirmed_unsegmented_transaction(invoke_id, &dest, &npdu_data,
+        &pdu[0], sizeof(pdu));
+    Test_PDU_Count = 0;
+    /* the first segment gets the Segment-ACK with our window size */
+    status = testSegment(&dest, invoke_id, 0, true, &service_request,
+        &service_request_len);
+    ct_test(pTest, status == false);
+    ct_test(pTest, Test_PDU_Count == 1);
+    segment_ack = testSegmentAPDU();
+    ct_test(pTest, segment_ack[0] == PDU_TYPE_SEGMENT_ACK);
+    ct_test(pTest, segment_ack[1] == invoke_id);
+    ct_test(pTest, segment_ack[2] == 0);
+    ct_test(pTest, segment_ack[3] == 4);
+    /* a segment from someone else is not ours */
+    dest.mac[0] = 0x43;
+    status = testSegment(&dest, invoke_id, 1, true, &service_request,
+        &service_request_len);
+    ct_test(pTest, status == false);
+    dest.mac[0] = 0x42;
+    /* the window is acknowledged when it is full */
+    for (i = 1; i < 4; i++) {
+        status = testSegment(&dest, invoke_id, (uint8_t) i, true,
+            &service_request, &service_request_len);
+        ct_test(pTest, status == false);
+    }
+    ct_test(pTest, Test_PDU_Count == 1);
+    status = testSegment(&dest, invoke_id, 4, true, &service_request,
+        &service_request_len);
+    ct_test(pTest, Test_PDU_Count == 2);
+    segment_ack = testSegmentAPDU();
+    ct_test(pTest, segment_ack[2] == 4);
+    /* out of order: NAK for the last one in order */
+    status = testSegment(&dest, invoke_id, 6, false, &service_request,
+        &service_request_len);
+    ct_test(pTest, status == false);
+    ct_test(pTest, Test_PDU_Count == 3);
+    segment_ack = testSegmentAPDU();
+    ct_test(pTest, segment_ack[0] == (PDU_TYPE_SEGMENT_ACK | BIT(1)));
+    ct_test(pTest, segment_ack[2] == 4);
+    status = testSegment(&dest, invoke_id, 5, true, &service_request,
+        &service_request_len);
+    ct_test(pTest, status == false);
+    /* the last segment completes the ACK */
+    status = testSegment(&dest, invoke_id, 6, false, &service_request,
+        &service_request_len);
+    ct_test(pTest, status == true);
+    ct_test(pTest, Test_PDU_Count == 4);
+    segment_ack = testSegmentAPDU();
+    ct_test(pTest, segment_ack[0] == PDU_TYPE_SEGMENT_ACK);
+    ct_test(pTest, segment_ack[2] == 6);
+    ct_test(pTest, service_request_len == 70);
+    for (i = 0; i < 70; i++) {
+        if (service_request[i] != i) {
+            break;
+        }
+    }
+    ct_test(pTest, i == 70);
+    tsm_free_invoke_id(invoke_id);
+    ct_test(pTest, tsm_invoke_id_free(invoke_id));
+
+    /* the request fails when the segments stop */
+    invoke_id = tsm_next_free_invokeID();
+    tsm_set_confirmed_unsegmented_transaction(invoke_id, &dest, &npdu_data,
+        &pdu[0], sizeof(pdu));
+    status = testSegment(&dest, invoke_id, 0, true, &service_request,
+        &service_request_len);
+    ct_test(pTest, status == false);
+    for (i = 0; i < 4; i++) {
+        ct_test(pTest, tsm_invoke_id_failed(invoke_id) == false);
+        tsm_timer_milliseconds(apdu_timeout());
+    }
+    ct_test(pTest, tsm_invoke_id_failed(invoke_id) == true);
+    tsm_free_invoke_id(invoke_id);
+
+    /* the first segment must be the first one */
+    invoke_id = tsm_next_free_invokeID();
+    tsm_set_confirmed_unsegmented_transaction(invoke_id, &dest, &npdu_data,
+        &pdu[0], sizeof(pdu));
+    Test_PDU_Count = 0;
+    status = testSegment(&dest, invoke_id, 1, true, &service_request,
+        &service_request_len);
+    ct_test(pTest, status == false);
+    ct_test(pTest, Test_PDU_Count == 1);
+    segment_ack = testSegmentAPDU();
+    ct_test(pTest, (segment_ack[0] & 0xF0) == PDU_TYPE_ABORT);
+    ct_test(pTest, tsm_invoke_id_failed(invoke_id) == true);
+    tsm_free_invoke_id(invoke_id);
+}
+#endif
+
 void testTSM(
     Test * pTest)
 {
-    /* FIXME: add some unit testing... */
+    testTransaction(pTest);
+    testPeerTransaction(pTest);
+    testPeerLimits(pTest);
+#if (MAX_TSM_TRANSACTIONS >= 255)
+    testPeerInvokeIDs(pTest);
+#endif
+#if (MAX_SEGMENTED_RESPONSES)
+    testSegmentedResponse(pTest);
+#endif
+#if (MAX_SEGMENTED_CONFIRMATIONS)
+    testSegmentedConfirmation(pTest);
+#endif
     return;
 }
 
@@ -20,7 +20,11 @@
 #include <string.h>
 #include <stdlib.h>
 #include <time.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
 #include <sys/stat.h>
+#include <sys/inotify.h>
 
 #include <uci_config.h>
 #include <uci.h>
@@ -279,6 +283,135 @@ time_t check_uci_update(const char *config, time_t mtime)
 	return f_mtime;
 }
 
+/* Watch for config changes.
+ * /etc/config and /var/state are watched with inotify, so a changed
+ * config is known without a stat() of every file on every loop.
+ * uci replaces /etc/config files by a rename and rewrites the state
+ * deltas, so the directories are watched, not the files.
+ * Without inotify, the files are polled with check_uci_update() once
+ * a second instead. */
+#ifndef UCIX_WATCH_MAX_CONFIGS
+#define UCIX_WATCH_MAX_CONFIGS 16
+#endif
+
+struct ucix_watch_config {
+	char name[32];
+	bool changed;
+	time_t mtime;
+	time_t poll_time;
+};
+
+static struct ucix_watch_config ucix_watch_configs[UCIX_WATCH_MAX_CONFIGS];
+static int ucix_watch_fd = -1;
+
+/* returns the inotify descriptor to wait on, or -1 when polling */
+int ucix_watch_init(void)
+{
+	uint32_t mask = IN_CLOSE_WRITE | IN_MOVED_TO | IN_DELETE;
+
+	if (ucix_watch_fd >= 0)
+		return ucix_watch_fd;
+	ucix_watch_fd = inotify_init();
+	if (ucix_watch_fd < 0)
+		return -1;
+	fcntl(ucix_watch_fd, F_SETFL, fcntl(ucix_watch_fd, F_GETFL) | O_NONBLOCK);
+	fcntl(ucix_watch_fd, F_SETFD, FD_CLOEXEC);
+	/* uci creates it on the first save_state */
+	mkdir("/var/state", 0755);
+	if ((inotify_add_watch(ucix_watch_fd, "/etc/config", mask) < 0) ||
+	    (inotify_add_watch(ucix_watch_fd, "/var/state", mask) < 0)) {
+		close(ucix_watch_fd);
+		ucix_watch_fd = -1;
+	}
+	return ucix_watch_fd;
+}
+
+bool ucix_watch_add(const char *config)
+{
+	int i;
+	struct ucix_watch_config *watch;
+
+	if (strlen(config) >= sizeof(watch->name))
+		return false;
+	for (i = 0; i < UCIX_WATCH_MAX_CONFIGS; i++) {
+		watch = &ucix_watch_configs[i];
+		if (!strcmp(watch->name, config))
+			return true;
+		if (!watch->name[0]) {
+			strcpy(watch->name, config);
+			watch->changed = false;
+			watch->mtime = check_uci_update(config, 0);
+			watch->poll_time = time(NULL);
+			return true;
+		}
+	}
+	return false;
+}
+
+/* read the pending inotify events, e.g. when fd is readable */
+void ucix_watch_read(int fd)
+{
+	char buf[1024] __attribute__ ((aligned(__alignof__(struct inotify_event))));
+	const struct inotify_event *event;
+	ssize_t len;
+	char *ptr;
+	int i;
+
+	for (;;) {
+		len = read(fd, buf, sizeof(buf));
+		if (len <= 0)
+			break;
+		for (ptr = buf; ptr < buf + len;
+		     ptr += sizeof(struct inotify_event) + event->len) {
+			event = (const struct inotify_event *) ptr;
+			if (!event->len)
+				continue;
+			for (i = 0; i < UCIX_WATCH_MAX_CONFIGS; i++) {
+				if (!strcmp(ucix_watch_configs[i].name,
+					event->name)) {
+					ucix_watch_configs[i].changed = true;
+					break;
+				}
+			}
+		}
+	}
+}
+
+/* returns true once for every change of a watched config */
+bool ucix_watch_changed(const char *config)
+{
+	int i;
+	struct ucix_watch_config *watch = NULL;
+	time_t now, mtime;
+
+	for (i = 0; i < UCIX_WATCH_MAX_CONFIGS; i++) {
+		if (!strcmp(ucix_watch_configs[i].name, config)) {
+			watch = &ucix_watch_configs[i];
+			break;
+		}
+	}
+	if (!watch)
+		return false;
+	if ((ucix_watch_fd < 0) && !watch->changed) {
+		now = time(NULL);
+		if (now != watch->poll_time) {
+			watch->poll_time = now;
+			mtime = check_uci_update(config, 0);
+			if (mtime > watch->mtime) {
+				watch->changed = true;
+				/* the file may change again within this second */
+				if (mtime < now)
+					watch->mtime = mtime;
+			}
+		}
+	}
+	if (watch->changed) {
+		watch->changed = false;
+		return true;
+	}
+	return false;
+}
+
 /* Add tuple */
 void load_value(const char *sec_idx, struct uci_itr_ctx *itr)
 {
@@ -308,3 +441,266 @@ void load_value(const char *sec_idx, struct uci_itr_ctx *itr)
 }
 
 
+
+/* Write-behind persistence.
+ * WriteProperty used to open, parse and commit the whole config file on
+ * every write.  Instead, the written options are staged here and marked
+ * for a commit to /etc/config or a save to /var/state, then written from
+ * ucix_wb_task() through one long lived context per config:
+ * the state on the next call, and the commits in batches, at most
+ * ucix_wb_interval_set() seconds after the first one was marked. */
+#ifndef UCIX_WB_MAX_CONFIGS
+#define UCIX_WB_MAX_CONFIGS 16
+#endif
+#ifndef UCIX_WB_INTERVAL
+#define UCIX_WB_INTERVAL 5
+#endif
+
+struct ucix_wb_option {
+	char *section;
+	char *option;
+	char *value;		/* NULL for a list */
+	char (*list)[64];
+	int list_len;
+	struct ucix_wb_option *next;
+};
+
+struct ucix_wb_config {
+	char name[32];
+	struct uci_context *ctx;	/* for commits to /etc/config */
+	struct uci_context *state_ctx;	/* for saves to /var/state */
+	struct ucix_wb_option *staged;	/* not marked yet */
+	struct ucix_wb_option *commit;
+	struct ucix_wb_option *state;
+	time_t commit_time;	/* when the oldest commit was marked */
+};
+
+static struct ucix_wb_config ucix_wb_configs[UCIX_WB_MAX_CONFIGS];
+static unsigned ucix_wb_interval = UCIX_WB_INTERVAL;
+
+static struct ucix_wb_config *ucix_wb_config_get(const char *p)
+{
+	int i;
+	struct ucix_wb_config *free_config = NULL;
+
+	for (i = 0; i < UCIX_WB_MAX_CONFIGS; i++) {
+		if (!ucix_wb_configs[i].name[0]) {
+			if (!free_config)
+				free_config = &ucix_wb_configs[i];
+		} else if (!strcmp(ucix_wb_configs[i].name, p)) {
+			return &ucix_wb_configs[i];
+		}
+	}
+	if (free_config && (strlen(p) < sizeof(free_config->name)))
+		strcpy(free_config->name, p);
+	else
+		free_config = NULL;
+
+	return free_config;
+}
+
+static void ucix_wb_option_free(struct ucix_wb_option *opt)
+{
+	free(opt->section);
+	free(opt->option);
+	free(opt->value);
+	free(opt->list);
+	free(opt);
+}
+
+static void ucix_wb_list_free(struct ucix_wb_option **list)
+{
+	struct ucix_wb_option *opt;
+
+	while (*list) {
+		opt = *list;
+		*list = opt->next;
+		ucix_wb_option_free(opt);
+	}
+}
+
+/* add an option to a list, replacing an older value of the same option */
+static void ucix_wb_list_add(struct ucix_wb_option **list,
+	struct ucix_wb_option *opt)
+{
+	struct ucix_wb_option **prev;
+
+	for (prev = list; *prev; prev = &(*prev)->next) {
+		if (!strcmp((*prev)->section, opt->section) &&
+		    !strcmp((*prev)->option, opt->option)) {
+			opt->next = (*prev)->next;
+			ucix_wb_option_free(*prev);
+			*prev = opt;
+			return;
+		}
+	}
+	opt->next = NULL;
+	*prev = opt;
+}
+
+static void ucix_wb_list_merge(struct ucix_wb_option **list,
+	struct ucix_wb_option **from)
+{
+	struct ucix_wb_option *opt;
+
+	while (*from) {
+		opt = *from;
+		*from = opt->next;
+		ucix_wb_list_add(list, opt);
+	}
+}
+
+static struct ucix_wb_option *ucix_wb_option_new(const char *s, const char *o)
+{
+	struct ucix_wb_option *opt = calloc(1, sizeof(*opt));
+
+	if (opt) {
+		opt->section = strdup(s);
+		opt->option = strdup(o);
+		if (!opt->section || !opt->option) {
+			ucix_wb_option_free(opt);
+			opt = NULL;
+		}
+	}
+	return opt;
+}
+
+void ucix_wb_add_option(const char *p, const char *s, const char *o,
+	const char *t)
+{
+	struct ucix_wb_config *config = ucix_wb_config_get(p);
+	struct ucix_wb_option *opt;
+
+	if (!config || !s || !o)
+		return;
+	opt = ucix_wb_option_new(s, o);
+	if (!opt)
+		return;
+	opt->value = strdup((t)?(t):(""));
+	if (!opt->value) {
+		ucix_wb_option_free(opt);
+		return;
+	}
+	ucix_wb_list_add(&config->staged, opt);
+}
+
+void ucix_wb_add_option_int(const char *p, const char *s, const char *o,
+	int t)
+{
+	char tmp[64];
+	snprintf(tmp, 64, "%d", t);
+	ucix_wb_add_option(p, s, o, tmp);
+}
+
+void ucix_wb_set_list(const char *p, const char *s, const char *o,
+	char value[254][64], int l)
+{
+	struct ucix_wb_config *config = ucix_wb_config_get(p);
+	struct ucix_wb_option *opt;
+
+	if (!config || !s || !o || (l < 0) || (l > 254))
+		return;
+	opt = ucix_wb_option_new(s, o);
+	if (!opt)
+		return;
+	if (l) {
+		opt->list = malloc(l * sizeof(opt->list[0]));
+		if (!opt->list) {
+			ucix_wb_option_free(opt);
+			return;
+		}
+		memcpy(opt->list, value, l * sizeof(opt->list[0]));
+	}
+	opt->list_len = l;
+	ucix_wb_list_add(&config->staged, opt);
+}
+
+/* mark the staged options of a config to be committed to /etc/config */
+void ucix_wb_commit(const char *p)
+{
+	struct ucix_wb_config *config = ucix_wb_config_get(p);
+
+	if (!config || !config->staged)
+		return;
+	if (!config->commit)
+		config->commit_time = time(NULL);
+	ucix_wb_list_merge(&config->commit, &config->staged);
+}
+
+/* mark the staged options of a config to be saved to /var/state */
+void ucix_wb_save_state(const char *p)
+{
+	struct ucix_wb_config *config = ucix_wb_config_get(p);
+
+	if (!config)
+		return;
+	ucix_wb_list_merge(&config->state, &config->staged);
+}
+
+void ucix_wb_interval_set(unsigned seconds)
+{
+	ucix_wb_interval = seconds;
+}
+
+static void ucix_wb_apply(struct uci_context *ctx, const char *p,
+	struct ucix_wb_option *opt)
+{
+	for (; opt; opt = opt->next) {
+		if (opt->value)
+			ucix_add_option(ctx, p, opt->section, opt->option,
+				opt->value);
+		else
+			ucix_set_list(ctx, p, opt->section, opt->option,
+				opt->list, opt->list_len);
+	}
+}
+
+static void ucix_wb_config_flush(struct ucix_wb_config *config, bool commit)
+{
+	if (config->state) {
+		if (!config->state_ctx)
+			config->state_ctx = ucix_init(config->name);
+		if (config->state_ctx) {
+			ucix_wb_apply(config->state_ctx, config->name,
+				config->state);
+			ucix_save_state(config->state_ctx, config->name);
+		}
+		ucix_wb_list_free(&config->state);
+	}
+	if (commit && config->commit) {
+		if (!config->ctx)
+			config->ctx = ucix_init(config->name);
+		if (config->ctx) {
+			ucix_wb_apply(config->ctx, config->name,
+				config->commit);
+			ucix_commit(config->ctx, config->name);
+		}
+		ucix_wb_list_free(&config->commit);
+	}
+}
+
+/* write the marked options that are due */
+void ucix_wb_task(void)
+{
+	int i;
+	struct ucix_wb_config *config;
+	time_t now = time(NULL);
+
+	for (i = 0; i < UCIX_WB_MAX_CONFIGS; i++) {
+		config = &ucix_wb_configs[i];
+		if (!config->state && !config->commit)
+			continue;
+		ucix_wb_config_flush(config, config->commit &&
+			((now - config->commit_time) >= (time_t)ucix_wb_interval ||
+			 (now < config->commit_time)));
+	}
+}
+
+/* write all the marked options now, e.g. on shutdown */
+void ucix_wb_flush(void)
+{
+	int i;
+
+	for (i = 0; i < UCIX_WB_MAX_CONFIGS; i++)
+		ucix_wb_config_flush(&ucix_wb_configs[i], true);
+}
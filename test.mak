@@ -9,10 +9,10 @@
 
 LOGFILE = test.log
 
-all: abort address arf awf bvlc6 bacapp bacdcode bacerror bacint bacstr \
-	cov crc datetime dcc event filename fifo getevent iam ihave \
-	indtext keylist key memcopy npdu proplist ptransfer \
-	rd reject ringbuf rp rpm sbuf timesync vmac \
+all: abort address addressdyn arf awf binding bipworkers bvlc bvlc6 bacapp \
+	bacdcode bacerror bacint bacstr cov crc datetime dcc event filename \
+	fifo getevent iam ihave indtext keylist key memcopy npdu proplist ptransfer \
+	rd reject ringbuf rp rpm sbuf shmvalue timesync tsm vmac \
 	whohas whois wp objects lighting
 
 clean: logfile
@@ -31,6 +31,11 @@ address: logfile test/address.mak
 	( ./test/address >> ${LOGFILE} )
 	$(MAKE) -s -C test -f address.mak clean
 
+addressdyn: logfile test/addressdyn.mak
+	$(MAKE) -s -C test -f addressdyn.mak clean all
+	( ./test/addressdyn >> ${LOGFILE} )
+	$(MAKE) -s -C test -f addressdyn.mak clean
+
 arf: logfile test/arf.mak
 	$(MAKE) -s -C test -f arf.mak clean all
 	( ./test/arf >> ${LOGFILE} )
@@ -66,6 +71,21 @@ bacstr: logfile test/bacstr.mak
 	( ./test/bacstr >> ${LOGFILE} )
 	$(MAKE) -s -C test -f bacstr.mak clean
 
+binding: logfile test/binding.mak
+	$(MAKE) -s -C test -f binding.mak clean all
+	( ./test/binding >> ${LOGFILE} )
+	$(MAKE) -s -C test -f binding.mak clean
+
+bipworkers: logfile test/bipworkers.mak
+	$(MAKE) -s -C test -f bipworkers.mak clean all
+	( ./test/bipworkers >> ${LOGFILE} )
+	$(MAKE) -s -C test -f bipworkers.mak clean
+
+bvlc: logfile test/bvlc.mak
+	$(MAKE) -s -C test -f bvlc.mak clean all
+	( ./test/bvlc >> ${LOGFILE} )
+	$(MAKE) -s -C test -f bvlc.mak clean
+
 bvlc6: logfile test/bvlc6.mak
 	$(MAKE) -s -C test -f bvlc6.mak clean all
 	( ./test/bvlc6 >> ${LOGFILE} )
@@ -191,11 +211,21 @@ sbuf: logfile test/sbuf.mak
 	( ./test/sbuf >> ${LOGFILE} )
 	$(MAKE) -s -C test -f sbuf.mak clean
 
+shmvalue: logfile test/shmvalue.mak
+	$(MAKE) -s -C test -f shmvalue.mak clean all
+	( ./test/shmvalue >> ${LOGFILE} )
+	$(MAKE) -s -C test -f shmvalue.mak clean
+
 timesync: logfile test/timesync.mak
 	$(MAKE) -s -C test -f timesync.mak clean all
 	( ./test/timesync >> ${LOGFILE} )
 	$(MAKE) -s -C test -f timesync.mak clean
 
+tsm: logfile test/tsm.mak
+	$(MAKE) -s -C test -f tsm.mak clean all
+	( ./test/tsm >> ${LOGFILE} )
+	$(MAKE) -s -C test -f tsm.mak clean
+
 vmac: logfile test/vmac.mak
 	$(MAKE) -s -C test -f vmac.mak clean all
 	( ./test/vmac >> ${LOGFILE} )
@@ -2,7 +2,8 @@
 CC      = gcc
 SRC_DIR = ../src
 INCLUDES = -I../include -I.
-DEFINES = -DBIG_ENDIAN=0 -DTEST -DTEST_ADDRESS
+DEFINES = -DBIG_ENDIAN=0 -DTEST -DTEST_ADDRESS -DADDRESS_CACHE_DYNAMIC=0 \
+	-DMAX_ADDRESS_CACHE=255 -DBACNET_ADDRESS_CACHE_FILE
 
 CFLAGS  = -Wall $(INCLUDES) $(DEFINES) -g
 
@@ -0,0 +1,39 @@
+#Makefile to build test case
+CC      = gcc
+SRC_DIR = ../src
+PORT_DIR = ../ports/linux
+INCLUDES = -I../include -I. -I$(PORT_DIR)
+DEFINES = -DBACDL_BIP -DBIG_ENDIAN=0 -DTEST -DTEST_BIP_WORKERS
+
+CFLAGS  = -Wall $(INCLUDES) $(DEFINES) -g
+
+SRCS = $(SRC_DIR)/bacdcode.c \
+	$(SRC_DIR)/bacint.c \
+	$(SRC_DIR)/bacstr.c \
+	$(SRC_DIR)/bacreal.c \
+	$(SRC_DIR)/bip.c \
+	$(SRC_DIR)/bvlc.c \
+	$(SRC_DIR)/debug.c \
+	$(PORT_DIR)/bip-init.c \
+	ctest.c
+
+TARGET = bipworkers
+
+all: ${TARGET}
+ 
+OBJS = ${SRCS:.c=.o}
+
+${TARGET}: ${OBJS}
+	${CC} -o $@ ${OBJS} -lpthread
+
+.c.o:
+	${CC} -c ${CFLAGS} $*.c -o $@
+	
+depend:
+	rm -f .depend
+	${CC} -MM ${CFLAGS} *.c >> .depend
+	
+clean:
+	rm -rf core ${TARGET} $(OBJS) *.bak *.1 *.ini
+
+include: .depend